@@ -0,0 +1,456 @@
+/// @file Binary_log.cpp
+
+#include "Binary_log.h"
+#include "Log_clock.h"
+#include "Log_format.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+#pragma warning(disable:4996)
+
+const char Binary_log::magic[8] = { 'D', 'B', 'G', 'L', 'O', 'G', 'B', '\0' };
+
+namespace
+{
+   const int s_padding = 12;      // Column widths used by Debugfile
+   const int s_depth_width = 6;
+
+   template <typename T>
+   void Write_raw(std::ostream &os, const T& v)
+   {
+      os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+   }
+
+   void Write_str(std::ostream &os, const char *s)
+   {
+      std::uint32_t len = s ? static_cast<std::uint32_t>(std::strlen(s)) : 0;
+      Write_raw(os, len);
+      os.write(s, len);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Sequential reader over the binary stream; every read reports truncation through Ok().
+   // ---------------------------------------------------------------------------------------------
+   class Frame_reader
+   {
+   public:
+      explicit Frame_reader(std::istream &in) : m_in(in) {}
+
+      template <typename T>
+      T Get()
+      {
+         T v{};
+         m_in.read(reinterpret_cast<char*>(&v), sizeof(T));
+         return v;
+      }
+
+      std::string Get_string()
+      {
+         std::uint32_t len = Get<std::uint32_t>();
+         std::string s;
+         if (Ok())
+         {
+            s.resize(len);
+            m_in.read(&s[0], len);
+         }
+         return s;
+      }
+
+      template <typename T>
+      void Get_block(std::vector<T> &values, std::uint64_t count)
+      {
+         // A count larger than the bytes left fails the read instead of the allocation
+         const std::uint64_t chunk = 65536;
+         values.clear();
+         while (count != 0 && Ok())
+         {
+            std::size_t n = static_cast<std::size_t>(std::min(count, chunk));
+            std::size_t at = values.size();
+            values.resize(at + n);
+            m_in.read(reinterpret_cast<char*>(&values[at]), static_cast<std::streamsize>(n * sizeof(T)));
+            count -= n;
+         }
+      }
+
+      bool Ok() const { return !m_in.fail(); }
+      bool At_end() { return m_in.peek() == std::char_traits<char>::eof(); }
+
+   private:
+      std::istream &m_in;
+   };
+
+   struct Site_info
+   {
+      std::string m_description;
+      bool        m_has_description;
+   };
+
+   void Decode_scalar(Frame_reader &in, Binary_log::value_tag tag, std::ostream &os, bool in_vector)
+   {
+      typedef Binary_log::value_tag value_tag;
+
+      switch (tag)
+      {
+      case value_tag::e_bool:
+      {
+         bool b = in.Get<std::uint8_t>() != 0;
+         // operator<< prints a bool as 1/0; the bool overload of Write spells it out
+         if (in_vector)
+            os << b;
+         else
+            os << (b ? "true" : "false");
+         break;
+      }
+      case value_tag::e_char:    os << static_cast<char>(in.Get<std::uint8_t>()); break;
+      case value_tag::e_i16:     os << in.Get<std::int16_t>(); break;
+      case value_tag::e_i32:     os << in.Get<std::int32_t>(); break;
+      case value_tag::e_i64:     os << in.Get<std::int64_t>(); break;
+      case value_tag::e_u16:     os << in.Get<std::uint16_t>(); break;
+      case value_tag::e_u32:     os << in.Get<std::uint32_t>(); break;
+      case value_tag::e_u64:     os << in.Get<std::uint64_t>(); break;
+      case value_tag::e_f32:     os << in.Get<float>(); break;
+      case value_tag::e_f64:     os << in.Get<double>(); break;
+      case value_tag::e_pointer:
+         os << reinterpret_cast<const void*>(static_cast<std::uintptr_t>(in.Get<std::uint64_t>()));
+         break;
+      case value_tag::e_string:  os << in.Get_string(); break;
+      default:                   break;
+      }
+   }
+
+   void Decode_value(Frame_reader &in, std::ostream &os, bool in_vector)
+   {
+      typedef Binary_log::value_tag value_tag;
+
+      value_tag tag = static_cast<value_tag>(in.Get<std::uint8_t>());
+      if (tag != value_tag::e_vector)
+      {
+         Decode_scalar(in, tag, os, in_vector);
+         return;
+      }
+
+      std::uint32_t count = in.Get<std::uint32_t>();
+      value_tag element = static_cast<value_tag>(in.Get<std::uint8_t>());
+      for (std::uint32_t i = 0; i < count && in.Ok(); ++i)
+      {
+         if (element == value_tag::e_none)
+            Decode_value(in, os, true);
+         else
+            Decode_scalar(in, element, os, true);
+         if (i + 1 < count)
+            os << ", ";
+      }
+   }
+
+   // Renders an e_format value list into the record's format
+   void Decode_format(Frame_reader &in, const std::string &format, std::ostream &os)
+   {
+      std::uint8_t count = in.Get<std::uint8_t>();
+
+      std::vector<std::string> values(count);
+      for (std::string &value : values)
+      {
+         std::ostringstream text;
+         Decode_value(in, text, false);
+         value = text.str();
+      }
+
+      std::vector<Log_format::Argument> args;
+      for (const std::string &value : values)
+      {
+         args.push_back(Log_format::Argument{ &value, &Log_format::Append_erased<std::string> });
+      }
+
+      std::string line;
+      Log_format::Substitute(line, format, args.data(), args.size());
+      os << line;
+   }
+
+   // Appends decoded elements; bool ranges are read as bytes, as vector<bool> has no data()
+   template <typename T, typename S>
+   void Append_decoded(std::string &text, const std::vector<S> &values, Log_range::style style)
+   {
+      if constexpr (std::is_same<T, bool>::value)
+      {
+         std::unique_ptr<bool[]> flags(new bool[values.size() + 1]);
+         for (std::size_t i = 0; i < values.size(); ++i)
+            flags[i] = values[i] != 0;
+         Log_range::Append_elements(text, flags.get(), values.size(), style);
+      }
+      else
+      {
+         Log_range::Append_elements(text, values.data(), values.size(), style);
+      }
+   }
+
+   // Renders an e_range value of element type T
+   template <typename T>
+   void Decode_range_of(Frame_reader &in, Log_range::style style, std::uint64_t count, std::ostream &os)
+   {
+      std::string text;
+      if (style == Log_range::style::e_summary)
+      {
+         Log_range::summary<T> s{ static_cast<std::size_t>(count), T(), T(), 0.0 };
+         s.m_min = static_cast<T>(in.Get<typename std::conditional<sizeof(T) == 1, std::uint8_t, T>::type>());
+         s.m_max = static_cast<T>(in.Get<typename std::conditional<sizeof(T) == 1, std::uint8_t, T>::type>());
+         s.m_mean = in.Get<double>();
+         Log_range::Append_summary(text, s);
+      }
+      else
+      {
+         std::uint64_t head = in.Get<std::uint64_t>();
+         std::uint64_t tail = in.Get<std::uint64_t>();
+         if (!in.Ok() || head > count || tail > count - head)
+            return;
+
+         typedef typename std::conditional<std::is_same<T, bool>::value, std::uint8_t, T>::type S;
+         std::vector<S> values;
+         in.Get_block(values, head);
+         Append_decoded<T>(text, values, style);
+         if (head + tail < count)
+         {
+            Log_range::Append_skipped(text, static_cast<std::size_t>(count - head - tail), head != 0, tail != 0);
+         }
+         in.Get_block(values, tail);
+         Append_decoded<T>(text, values, style);
+      }
+      os << text;
+   }
+
+   void Decode_range(Frame_reader &in, std::ostream &os)
+   {
+      typedef Binary_log::value_tag value_tag;
+
+      Log_range::style style = static_cast<Log_range::style>(in.Get<std::uint8_t>());
+      std::uint64_t count = in.Get<std::uint64_t>();
+      switch (static_cast<value_tag>(in.Get<std::uint8_t>()))
+      {
+      case value_tag::e_bool:    Decode_range_of<bool>(in, style, count, os); break;
+      case value_tag::e_char:    Decode_range_of<char>(in, style, count, os); break;
+      case value_tag::e_i16:     Decode_range_of<std::int16_t>(in, style, count, os); break;
+      case value_tag::e_i32:     Decode_range_of<std::int32_t>(in, style, count, os); break;
+      case value_tag::e_i64:     Decode_range_of<std::int64_t>(in, style, count, os); break;
+      case value_tag::e_u16:     Decode_range_of<std::uint16_t>(in, style, count, os); break;
+      case value_tag::e_u32:     Decode_range_of<std::uint32_t>(in, style, count, os); break;
+      case value_tag::e_u64:     Decode_range_of<std::uint64_t>(in, style, count, os); break;
+      case value_tag::e_f32:     Decode_range_of<float>(in, style, count, os); break;
+      case value_tag::e_f64:     Decode_range_of<double>(in, style, count, os); break;
+      default:                   break;
+      }
+   }
+
+   void Write_asctime(std::ostream &out, std::time_t systime)
+   {
+      out << std::asctime(std::localtime(&systime)) << '\n';
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Binary_log::Write_file_header(std::ostream &os, bool is_milli, bool show_depth,
+                                   bool show_thread_names, Log_timestamp::mode timestamp_mode, 
+                                   std::time_t systime, std::uint64_t start_ticks)
+{
+   os.write(magic, sizeof(magic));
+   Write_raw(os, byte_order_mark);
+   Write_raw(os, version);
+   Write_raw(os, static_cast<std::uint8_t>(is_milli ? 1 : 0));
+   Write_raw(os, static_cast<std::uint8_t>(show_depth ? 1 : 0));
+   Write_raw(os, static_cast<std::uint8_t>(show_thread_names ? 1 : 0));
+   Write_raw(os, static_cast<std::uint8_t>(timestamp_mode));
+   Write_raw(os, static_cast<std::int64_t>(systime));
+   Write_raw(os, Log_clock::Ns_per_tick());
+   Write_raw(os, static_cast<std::int64_t>(start_ticks));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Binary_log::Write_site(std::ostream &os, std::uint32_t id, const Log_call_site &site)
+{
+   Write_raw(os, static_cast<std::uint8_t>(frame_type::e_site));
+   Write_raw(os, id);
+   Write_raw(os, static_cast<std::uint32_t>(site.m_line));
+   Write_str(os, site.m_file);
+   Write_str(os, site.m_function);
+   Write_raw(os, static_cast<std::uint8_t>(site.m_description ? 1 : 0));
+   Write_str(os, site.m_description);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Binary_log::Write_record(std::ostream &os, std::uint32_t site_id, const Log_record &rec)
+{
+   Write_raw(os, static_cast<std::uint8_t>(frame_type::e_record));
+   Write_raw(os, site_id);
+   Write_raw(os, static_cast<std::int64_t>(rec.m_ticks));
+   Write_raw(os, static_cast<std::uint64_t>(rec.m_thread));
+   Write_raw(os, static_cast<std::uint16_t>(std::max(rec.m_indent, 1)));
+   Write_raw(os, static_cast<std::uint16_t>(std::max(rec.m_depth, 0)));
+   Write_raw(os, static_cast<std::uint8_t>(rec.m_newline ? 1 : 0));
+   os.write(rec.m_text.data(), static_cast<std::streamsize>(rec.m_text.size()));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Binary_log::Write_thread_name(std::ostream &os, std::uint32_t thread, const char *name)
+{
+   Write_raw(os, static_cast<std::uint8_t>(frame_type::e_thread_name));
+   Write_raw(os, thread);
+   Write_str(os, name);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Binary_log::Write_systemtime(std::ostream &os, std::time_t systime)
+{
+   Write_raw(os, static_cast<std::uint8_t>(frame_type::e_systemtime));
+   Write_raw(os, static_cast<std::int64_t>(systime));
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Binary_log::Decode(std::istream &in, std::ostream &out, const Log_timestamp::mode *timestamp_mode)
+{
+   Frame_reader reader(in);
+
+   char file_magic[sizeof(magic)];
+   in.read(file_magic, sizeof(file_magic));
+   if (!reader.Ok() || !std::equal(file_magic, file_magic + sizeof(magic), magic) ||
+       reader.Get<std::uint32_t>() != byte_order_mark || reader.Get<std::uint8_t>() != version)
+   {
+      return false;
+   }
+
+   bool is_milli = reader.Get<std::uint8_t>() != 0;
+   bool show_depth = reader.Get<std::uint8_t>() != 0;
+   bool show_thread_names = reader.Get<std::uint8_t>() != 0;
+   Log_timestamp::mode written_mode = static_cast<Log_timestamp::mode>(reader.Get<std::uint8_t>());
+   std::time_t systime = static_cast<std::time_t>(reader.Get<std::int64_t>());
+   double ns_per_tick = reader.Get<double>();
+   std::int64_t start_ticks = reader.Get<std::int64_t>();
+   if (!reader.Ok() || !(ns_per_tick > 0.0))
+      return false;
+
+   Log_timestamp column;
+   column.Start(timestamp_mode ? *timestamp_mode : written_mode, static_cast<std::uint64_t>(start_ticks));
+
+   // Same arithmetic as Log_clock::To_us / To_ms, with the rate the writer was calibrated to
+   double divisor = is_milli ? 1e6 : 1e3;
+
+   // Debugfile::Open_file: system time, then the column header
+   Write_asctime(out, systime);
+   out << std::right << std::setw(s_padding) << Log_timestamp::Heading(column.Mode(), is_milli)
+       << std::setw(s_padding) << "Thread_ID";
+   if (show_depth)
+   {
+      out << std::setw(s_depth_width) << "Depth";
+   }
+   out << std::right << std::setw(1) << ' ' << std::left << "Log_message" << '\n';
+
+   std::unordered_map<std::uint32_t, Site_info> sites;
+   std::unordered_map<std::uint64_t, std::string> thread_names;
+   bool newline = true;
+   std::ostringstream text;
+
+   while (!reader.At_end())
+   {
+      frame_type type = static_cast<frame_type>(reader.Get<std::uint8_t>());
+
+      if (type == frame_type::e_site)
+      {
+         std::uint32_t id = reader.Get<std::uint32_t>();
+         reader.Get<std::uint32_t>();   // line
+         reader.Get_string();           // file
+         reader.Get_string();           // function
+         Site_info &info = sites[id];
+         info.m_has_description = reader.Get<std::uint8_t>() != 0;
+         info.m_description = reader.Get_string();
+      }
+      else if (type == frame_type::e_thread_name)
+      {
+         std::uint32_t thread = reader.Get<std::uint32_t>();
+         thread_names[thread] = reader.Get_string();
+      }
+      else if (type == frame_type::e_systemtime)
+      {
+         Write_asctime(out, static_cast<std::time_t>(reader.Get<std::int64_t>()));
+         newline = true;
+      }
+      else if (type == frame_type::e_record)
+      {
+         std::uint32_t site_id = reader.Get<std::uint32_t>();
+         std::int64_t ticks = reader.Get<std::int64_t>();
+         std::uint64_t thread = reader.Get<std::uint64_t>();
+         std::uint16_t indent = reader.Get<std::uint16_t>();
+         std::uint16_t depth = reader.Get<std::uint16_t>();
+         bool ends_line = reader.Get<std::uint8_t>() != 0;
+         layout_type layout = static_cast<layout_type>(reader.Get<std::uint8_t>());
+
+         std::string description;
+         if (site_id == 0)
+         {
+            if (layout != layout_type::e_message)
+               description = reader.Get_string();
+         }
+         else
+         {
+            description = sites[site_id].m_description;
+         }
+
+         text.str(std::string());
+         switch (layout)
+         {
+         case layout_type::e_message:      break;
+         case layout_type::e_value:        text << description << " "; break;
+         case layout_type::e_spaced_value: text << " " << description << " "; break;
+         case layout_type::e_vector:       text << description << " = "; break;
+         case layout_type::e_format:       break;
+         case layout_type::e_range:        text << description << " = "; break;
+         }
+         if (layout == layout_type::e_format)
+            Decode_format(reader, description, text);
+         else if (layout == layout_type::e_range)
+            Decode_range(reader, text);
+         else
+            Decode_value(reader, text, false);
+
+         if (!reader.Ok())
+            return false;
+
+         if (newline)
+         {
+            std::int64_t column_ticks = column.Column_ticks(thread, static_cast<std::uint64_t>(ticks));
+            double elapsed = static_cast<double>(column_ticks) * ns_per_tick / divisor;
+
+            out << std::fixed << std::setprecision(2) << std::right << std::setw(s_padding)
+                << elapsed;
+            out.unsetf(std::ios::floatfield);
+            out << std::setprecision(6) << std::setw(s_padding);
+            auto name = show_thread_names ? thread_names.find(thread) : thread_names.end();
+            if (name != thread_names.end())
+               out << name->second;
+            else
+               out << thread;
+            if (show_depth)
+            {
+               out << std::setw(s_depth_width) << depth;
+            }
+            out << std::setw(indent) << ' ';
+         }
+         out << text.str();
+         if (ends_line)
+            out << '\n';
+         newline = ends_line;
+      }
+      else
+      {
+         return false;
+      }
+
+      if (!reader.Ok())
+         return false;
+   }
+
+   return true;
+}
+
+#pragma warning(default:4996)
@@ -0,0 +1,350 @@
+/// @file Binary_log.h
+
+#ifndef BINARY_LOG_H_
+#define BINARY_LOG_H_
+
+#include "Log_call_site.h"
+#include "Log_range.h"
+#include "Log_record.h"
+#include "Log_timestamp.h"
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Binary log format written by Debugfile in output_format::e_binary. The calling
+///            thread only copies the raw argument bytes; the text columns that Write_header
+///            describes are produced offline by Decode() (see tools/Debuglog_decode.cpp).
+///
+///            File  := header frame*
+///            header:= magic[8] u32 byte_order_mark u8 version u8 is_milli u8 show_depth
+///                     u8 show_thread_names u8 timestamp_mode i64 systime f64 ns_per_tick i64 start_ticks
+///            frame := u8 frame_type, then
+///                     e_site:       u32 id u32 line str file str function
+///                                   u8 has_description str description
+///                     e_record:     u32 site_id i64 ticks u64 thread u16 indent u16 depth
+///                                   u8 newline payload
+///                     e_systemtime: i64 systime
+///                     e_thread_name: u32 thread str name
+///            payload:= u8 layout [str description, when site_id is 0] value
+///                       (e_format: u8 count value*, the description being the format;
+///                        e_range: u8 style u64 count u8 value_tag, then for e_summary
+///                        min max f64 mean, otherwise u64 head u64 tail and the head and tail
+///                        elements raw)
+///            value := u8 value_tag bytes      (str = u32 length + bytes; host byte order)
+// ================================================================================================
+class Binary_log
+{
+public:
+
+   enum class frame_type : std::uint8_t
+   {
+      e_site         = 1,
+      e_record       = 2,
+      e_systemtime   = 3,
+      e_thread_name  = 4
+   };
+
+   /// How description and value are combined, mirroring the Debugfile::Write overloads.
+   enum class layout_type : std::uint8_t
+   {
+      e_message,        ///< value only                      Write(str)
+      e_value,          ///< "description value"             Write(description, value)
+      e_spaced_value,   ///< " description value"            Write(description, bool / void*)
+      e_vector,         ///< "description = v0, v1, ..."     Write(description, vector)
+      e_format,         ///< description is a Log_format     Write_format(format, args...)
+      e_range           ///< "description = " Log_range      Write_range(description, range)
+   };
+
+   enum class value_tag : std::uint8_t
+   {
+      e_none,
+      e_bool,
+      e_char,
+      e_i16,
+      e_i32,
+      e_i64,
+      e_u16,
+      e_u32,
+      e_u64,
+      e_f32,
+      e_f64,
+      e_pointer,
+      e_string,
+      e_vector
+   };
+
+   static const char             magic[8];
+   static constexpr std::uint32_t byte_order_mark = 0x01020304u;
+   static constexpr std::uint8_t  version = 7;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends a record payload (layout, inline description, value) to out.
+   /// @param     description   Written inline only when not null; call sites carry their own.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Encode_payload(std::string &out, layout_type layout, const char *description,
+                              const T& value)
+   {
+      Put(out, static_cast<std::uint8_t>(layout));
+      if (description)
+      {
+         Put_string(out, description, std::strlen(description));
+      }
+      Encode_value(out, value);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends an e_format payload: the format (inline when not null), the argument
+   ///            count and the arguments, each encoded as by Encode_value().
+   // ---------------------------------------------------------------------------------------------
+   template <typename... Args>
+   static void Encode_format(std::string &out, const char *format, std::size_t format_length,
+                             const Args&... args)
+   {
+      static_assert(sizeof...(Args) <= 255, "too many arguments for one record");
+
+      Put(out, static_cast<std::uint8_t>(layout_type::e_format));
+      if (format)
+      {
+         Put_string(out, format, format_length);
+      }
+      Put(out, static_cast<std::uint8_t>(sizeof...(Args)));
+      (Encode_value(out, args), ...);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends an e_range payload: the summary, or the elements @p opt keeps copied in
+   ///            at most two blocks.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Encode_range(std::string &out, const char *description, const T *data,
+                            std::size_t count, Log_range::options opt)
+   {
+      Put(out, static_cast<std::uint8_t>(layout_type::e_range));
+      if (description)
+      {
+         Put_string(out, description, std::strlen(description));
+      }
+      Put(out, static_cast<std::uint8_t>(opt.m_style));
+      Put(out, static_cast<std::uint64_t>(count));
+      Put(out, static_cast<std::uint8_t>(Tag_of<T>()));
+
+      if (opt.m_style == Log_range::style::e_summary)
+      {
+         Log_range::summary<T> s = Log_range::Summarize(data, count);
+         Put_scalar(out, s.m_min);
+         Put_scalar(out, s.m_max);
+         Put(out, s.m_mean);
+         return;
+      }
+
+      std::size_t head = count;
+      std::size_t tail = 0;
+      if (Log_range::Is_cut(count, opt))
+      {
+         head = opt.m_head;
+         tail = opt.m_tail;
+      }
+      Put(out, static_cast<std::uint64_t>(head));
+      Put(out, static_cast<std::uint64_t>(tail));
+      Put_block(out, data, head);
+      Put_block(out, data + count - tail, tail);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends a tagged value. Arithmetic types, pointers and strings are stored raw;
+   ///            anything else is formatted with operator<< as a fallback.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Encode_value(std::string &out, const T& value)
+   {
+      typedef typename std::decay<T>::type D;
+
+      if constexpr (std::is_arithmetic<D>::value)
+      {
+         Put(out, static_cast<std::uint8_t>(Tag_of<D>()));
+         Put_scalar(out, value);
+      }
+      else if constexpr (std::is_enum<D>::value)
+      {
+         Encode_value(out, static_cast<typename std::underlying_type<D>::type>(value));
+      }
+      else if constexpr (std::is_array<T>::value && 
+                         Is_char<typename std::remove_cv<typename std::remove_extent<T>::type>::type>())
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_string));
+         Put_string(out, value, Bounded_length(value, std::extent<T>::value));
+      }
+      else if constexpr (std::is_pointer<D>::value && 
+                         Is_char<typename std::remove_cv<typename std::remove_pointer<D>::type>::type>())
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_string));
+         if (value)
+            Put_string(out, value, std::strlen(value));
+         else
+            Put_string(out, "(null)", 6);
+      }
+      else if constexpr (std::is_same<D, std::string>::value || std::is_same<D, std::string_view>::value)
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_string));
+         Put_string(out, value.data(), value.size());
+      }
+      else if constexpr (std::is_pointer<D>::value || std::is_null_pointer<D>::value)
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_pointer));
+         Put(out, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(
+            static_cast<const volatile void*>(value))));
+      }
+      else
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_string));
+         Put_formatted(out, value);
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Vectors of arithmetic elements are copied in one block; other element types are
+   ///            encoded one by one.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Encode_value(std::string &out, const std::vector<T>& vec)
+   {
+      Put(out, static_cast<std::uint8_t>(value_tag::e_vector));
+      Put(out, static_cast<std::uint32_t>(vec.size()));
+
+      if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value)
+      {
+         Put(out, static_cast<std::uint8_t>(Tag_of<T>()));
+         if constexpr (std::is_same<T, long double>::value)
+         {
+            for (const T &v : vec)
+               Put(out, static_cast<double>(v));
+         }
+         else if (!vec.empty())
+         {
+            out.append(reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(T));
+         }
+      }
+      else
+      {
+         Put(out, static_cast<std::uint8_t>(value_tag::e_none));
+         for (auto i = vec.begin(); i != vec.end(); ++i)
+         {
+            Encode_value(out, static_cast<const T&>(*i));
+         }
+      }
+   }
+
+   template <typename T>
+   static constexpr value_tag Tag_of()
+   {
+      if constexpr (std::is_same<T, bool>::value)
+         return value_tag::e_bool;
+      else if constexpr (Is_char<T>())
+         return value_tag::e_char;
+      else if constexpr (std::is_floating_point<T>::value)
+         return (sizeof(T) == 4) ? value_tag::e_f32 : value_tag::e_f64;
+      else if constexpr (std::is_signed<T>::value)
+         return (sizeof(T) <= 2) ? value_tag::e_i16 : (sizeof(T) <= 4) ? value_tag::e_i32 : value_tag::e_i64;
+      else
+         return (sizeof(T) <= 2) ? value_tag::e_u16 : (sizeof(T) <= 4) ? value_tag::e_u32 : value_tag::e_u64;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Frame writers used by Debugfile. All take an already-open binary stream.
+   // ---------------------------------------------------------------------------------------------
+   static void Write_file_header(std::ostream &os, bool is_milli, bool show_depth, 
+                                 bool show_thread_names, Log_timestamp::mode timestamp_mode, 
+                                 std::time_t systime, std::uint64_t start_ticks);
+   static void Write_site(std::ostream &os, std::uint32_t id, const Log_call_site &site);
+   static void Write_record(std::ostream &os, std::uint32_t site_id, const Log_record &rec);
+   static void Write_systemtime(std::ostream &os, std::time_t systime);
+   static void Write_thread_name(std::ostream &os, std::uint32_t thread, const char *name);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Renders a binary log as the text layout Debugfile writes in e_text mode.
+   /// @param     timestamp_mode   Time column to render; by default the one the writer chose
+   /// @return    @e false if the input is not a binary log or is truncated mid-frame.
+   // ---------------------------------------------------------------------------------------------
+   static bool Decode(std::istream &in, std::ostream &out, 
+                      const Log_timestamp::mode *timestamp_mode = nullptr);
+
+private:
+
+   template <typename T>
+   static constexpr bool Is_char()
+   {
+      return std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+             std::is_same<T, unsigned char>::value;
+   }
+
+   template <typename T>
+   static void Put(std::string &out, const T& v)
+   {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+   }
+
+   template <typename T>
+   static void Put_scalar(std::string &out, const T& v)
+   {
+      if constexpr (std::is_same<T, bool>::value || Is_char<T>())
+         Put(out, static_cast<std::uint8_t>(v));
+      else if constexpr (std::is_same<T, long double>::value)
+         Put(out, static_cast<double>(v));
+      else
+         Put(out, v);
+   }
+
+   template <typename T>
+   static void Put_block(std::string &out, const T *data, std::size_t count)
+   {
+      if constexpr (std::is_same<T, long double>::value)
+      {
+         for (std::size_t i = 0; i < count; ++i)
+            Put(out, static_cast<double>(data[i]));
+      }
+      else if (count != 0)
+      {
+         out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+      }
+   }
+
+   static void Put_string(std::string &out, const char *s, std::size_t len)
+   {
+      Put(out, static_cast<std::uint32_t>(len));
+      out.append(s, len);
+   }
+
+   template <typename C>
+   static std::size_t Bounded_length(const C *s, std::size_t max)
+   {
+      std::size_t len = 0;
+      while (len < max && s[len] != 0)
+         ++len;
+      return len;
+   }
+
+   // Fallback for types only printable through operator<<: format straight into the payload.
+   template <typename T>
+   static void Put_formatted(std::string &out, const T& value)
+   {
+      std::size_t at = out.size();
+      Put(out, std::uint32_t(0));
+
+      Log_record_streambuf buf(&out);
+      std::ostream os(&buf);
+      os << value;
+
+      std::uint32_t len = static_cast<std::uint32_t>(out.size() - at - sizeof(std::uint32_t));
+      std::memcpy(&out[at], &len, sizeof(len));
+   }
+};
+
+#endif // BINARY_LOG_H_
@@ -3,39 +3,303 @@
 #ifndef DEBUG_LOGGER_MACROS_H_
 #define DEBUG_LOGGER_MACROS_H_
 
+// Severities for G_LOG_COMPILE_LEVEL and G_LOG_MODULE_LEVEL; same order as log_level.
+#define  G_LOG_LEVEL_TRACE             0
+#define  G_LOG_LEVEL_DEBUG             1
+#define  G_LOG_LEVEL_INFO              2
+#define  G_LOG_LEVEL_WARN              3
+#define  G_LOG_LEVEL_ERROR             4
+#define  G_LOG_LEVEL_OFF               5
+
+// Statements below this level are removed at compile time, arguments and all. Define it on the
+// command line, e.g. -DG_LOG_COMPILE_LEVEL=G_LOG_LEVEL_INFO for release builds.
+#if !defined G_LOG_COMPILE_LEVEL
+#define  G_LOG_COMPILE_LEVEL           G_LOG_LEVEL_TRACE
+#endif
+
+// Logger_helper is declared with or without ENABLE_DEBUG_LOGGING
+#include "Log_profile.h"
+#include "Trace_recorder.h"
+
 #if defined ENABLE_DEBUG_LOGGING
 
 #include "Debugfile.h"
+#include "Log_latency.h"
+#include "Log_sampler.h"
+#include "Log_site_registry.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <sstream>
+
+static_assert(G_LOG_LEVEL_TRACE == static_cast<int>(log_level::e_trace) &&
+              G_LOG_LEVEL_OFF == static_cast<int>(log_level::e_off), "G_LOG_LEVEL_* out of step");
+
+// ------------------------------------------------------------------------------------------------
+/// @brief     FNV-1a of a module tag, so that a tag can select a template specialization.
+// ------------------------------------------------------------------------------------------------
+constexpr std::uint64_t Log_module_hash(const char *tag)
+{
+   std::uint64_t hash = 14695981039346656037ull;
+   for (; *tag; ++tag)
+   {
+      hash = (hash ^ static_cast<unsigned char>(*tag)) * 1099511628211ull;
+   }
+   return hash;
+}
+
+// ------------------------------------------------------------------------------------------------
+/// @brief     Compile-time threshold of one module: G_LOG_COMPILE_LEVEL unless the module was
+///            given its own with G_LOG_MODULE_LEVEL, which may be higher or lower.
+// ------------------------------------------------------------------------------------------------
+template <std::uint64_t Module>
+struct Log_module_threshold
+{
+   static constexpr int value = G_LOG_COMPILE_LEVEL;
+};
+
+// ------------------------------------------------------------------------------------------------
+/// @brief     Lets the G_LOG_FMT macros pass their whole argument list: the format is already the
+///            site's description, so it is dropped here.
+// ------------------------------------------------------------------------------------------------
+template <typename... Args>
+inline void Log_write_format(Debugfile &logger, const Log_call_site &site, const char *,
+                             const Args&... args)
+{
+   logger.Write_format(site, args...);
+}
+
+// First of a macro's variable arguments. The extra expansion is for MSVC's traditional
+// preprocessor, which otherwise passes __VA_ARGS__ on as a single argument.
+#define  G_LOG_EXPAND(x)               x
+#define  G_LOG_FIRST(...)              G_LOG_EXPAND(G_LOG_FIRST_(__VA_ARGS__, unused))
+#define  G_LOG_FIRST_(first, ...)      first
+
+// Newline argument of the site-less Write() overloads, before the site of a message macro.
+#define  G_LOG_NL                      Debugfile::newline_type::e_write_newline
+
+// Compile-time check of a G_LOG_FMT format (the first argument) against the rest.
+#define  G_LOG_FMT_CHECK(...)          static_assert(Log_format::Placeholders(G_LOG_FIRST(__VA_ARGS__)) >= 0, \
+                                                     "log format has an unescaped brace"); \
+                                       static_assert(static_cast<std::size_t>(Log_format::Placeholders( \
+                                                        G_LOG_FIRST(__VA_ARGS__))) + 2 == \
+                                                     sizeof(Log_format::Arity(__VA_ARGS__)), \
+                                                     "log format placeholders do not match the arguments");
+
+// Gives a module its own compile-time threshold. Use at namespace scope, before the module's first
+// statement, e.g. G_LOG_MODULE_LEVEL(net, WARN) in a header every file of the module includes.
+#define  G_LOG_MODULE_LEVEL(module, level) \
+                                       template <> struct Log_module_threshold<Log_module_hash(#module)> \
+                                       { static constexpr int value = G_LOG_LEVEL_##level; };
+
+// True at compile time if statements of @p level in @p module are compiled in.
+#define  G_LOG_COMPILED(level, module) (G_LOG_LEVEL_##level >= \
+                                        Log_module_threshold<Log_module_hash(#module)>::value)
 
 #define  G_LOG_DEFINE(path_to_file)    Debugfile g_log(#path_to_file);
+#define  G_LOG_DEFINE_BINARY(path_to_file) \
+                                       Debugfile g_log(#path_to_file, true, \
+                                                       Debugfile::timing_type::e_micro, \
+                                                       Debugfile::output_format::e_binary);
 #define  G_LOG_EXTERN                  extern Debugfile g_log;
 #define  G_LOG_ENABLE                  g_log.Turn_on_debug_file(true);
 #define  G_LOG_DISABLE                 g_log.Turn_on_debug_file(false);
-#define  G_LOG_VAR(var)                g_log.Write(#var, var);
-#define  G_LOG_MSG(msg)                g_log.Write(msg);
-#define  G_LOG_MSG_NONL(msg)           g_log.Write(msg, Debugfile::newline_type::e_no_newline);
-#define  G_LOG_MSG_VAR(msg, var)       g_log.Write(msg, var);
-#define  G_LOG_FUNCTION                std::stringstream ss; \
-                                       ss << "Entering  --> " << __FUNCTION__; \
-                                       G_LOG_MSG(ss.str().c_str()) \
-                                       Logger_helper lh(g_log, __FUNCTION__); 
+#define  G_LOG_SET_LEVEL(level)        g_log.Set_level(static_cast<log_level>(G_LOG_LEVEL_##level));
+#define  G_LOG_SITE(desc)              static Log_call_site g_log_site(__FILE__, __LINE__, \
+                                                                       __FUNCTION__, desc);
+#define  G_LOG_SITE_AT(level, module, desc) \
+                                       static Log_call_site g_log_site(__FILE__, __LINE__, \
+                                          __FUNCTION__, desc, \
+                                          static_cast<log_level>(G_LOG_LEVEL_##level), #module);
+
+// Runs @p statement only if @p level is compiled in for @p module and enabled at run time. The
+// statement (and so every argument in it) is a discarded if-constexpr branch when compiled out.
+#define  G_LOG_IF(level, module, statement) \
+                                       do { if constexpr (G_LOG_COMPILED(level, module)) { \
+                                          if (g_log.Is_enabled(static_cast<log_level>(G_LOG_LEVEL_##level))) \
+                                          { statement } } } while (0);
+
+// G_LOG_IF with the statement's call site (G_LOG_SITE or G_LOG_SITE_AT) declared first. The
+// statement runs only while the site is switched on (see Log_site_registry), which costs one load
+// and one branch when it is off.
+#define  G_LOG_IF_SITE(level, module, site, statement) \
+                                       G_LOG_IF(level, module, site if (g_log_site.Is_on()) { statement })
+
+// Untagged statements are debug level in module "general"; G_LOG_FUNCTION is trace level.
+#define  G_LOG_VAR(var)                G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(#var), g_log.Write(g_log_site, var);)
+#define  G_LOG_MSG(msg)                G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(nullptr), \
+                                          g_log.Write(msg, G_LOG_NL, &g_log_site);)
+#define  G_LOG_MSG_NONL(msg)           G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(nullptr), \
+                                          g_log.Write(msg, Debugfile::newline_type::e_no_newline, &g_log_site);)
+#define  G_LOG_MSG_VAR(msg, var)       G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(nullptr), \
+                                          g_log.Write(msg, var, G_LOG_NL, &g_log_site);)
+#if G_LOG_COMPILE_LEVEL <= G_LOG_LEVEL_TRACE
+#define  G_LOG_FUNCTION                static Log_call_site g_log_function_site(__FILE__, __LINE__, \
+                                          __FUNCTION__, nullptr, log_level::e_trace); \
+                                       Logger_helper lh(g_log, __FUNCTION__, \
+                                                        g_log.Is_enabled(log_level::e_trace) && \
+                                                        g_log_function_site.Is_on(), \
+                                                        &g_log_function_site);
+#else
+#define  G_LOG_FUNCTION
+#endif
+// Times the rest of the enclosing scope into the latency histogram called name, a string literal
+// (see Log_latency); debug level, at most one per scope. G_LOG_LATENCY_SUMMARY writes a line per
+// name with count, min, p50, p90, p99 and max since the previous summary.
+#if G_LOG_COMPILE_LEVEL <= G_LOG_LEVEL_DEBUG
+#define  G_LOG_TIMED_SCOPE(name)       static Log_call_site g_log_timed_site(__FILE__, __LINE__, __FUNCTION__, name); \
+                                       Log_latency::scope g_log_timed_scope(g_log_timed_site, \
+                                                                            g_log.Is_enabled(log_level::e_debug) && \
+                                                                            g_log_timed_site.Is_on());
+#else
+#define  G_LOG_TIMED_SCOPE(name)
+#endif
+#define  G_LOG_LATENCY_SUMMARY         g_log.Write_latency_summary();
+
+// Levelled, tagged statements: level is TRACE, DEBUG, INFO, WARN or ERROR; module is a bare word.
+// The line starts with "[LEVEL module]". G_LOG_MSG_VAR_AT needs a string literal description.
+#define  G_LOG_MSG_AT(level, module, msg) \
+                                       G_LOG_IF_SITE(level, module, \
+                                          G_LOG_SITE_AT(level, module, "[" #level " " #module "]"), \
+                                          g_log.Write(g_log_site, msg);)
+#define  G_LOG_VAR_AT(level, module, var) \
+                                       G_LOG_IF_SITE(level, module, \
+                                          G_LOG_SITE_AT(level, module, "[" #level " " #module "] " #var), \
+                                          g_log.Write(g_log_site, var);)
+#define  G_LOG_MSG_VAR_AT(level, module, msg, var) \
+                                       G_LOG_IF_SITE(level, module, \
+                                          G_LOG_SITE_AT(level, module, "[" #level " " #module "] " msg), \
+                                          g_log.Write(g_log_site, var);)
+
+// Contiguous ranges of numbers (vector, array, C array): the first head and last tail elements,
+// in decimal or hex, or only count, min, max and mean. See Debugfile::Write_range().
+#define  G_LOG_RANGE(var, head, tail)  G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(#var), \
+                                          g_log.Write_range(g_log_site, var, \
+                                             Log_range::options(Log_range::style::e_decimal, head, tail));)
+#define  G_LOG_RANGE_HEX(var, head, tail) \
+                                       G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(#var), \
+                                          g_log.Write_range(g_log_site, var, \
+                                             Log_range::options(Log_range::style::e_hex, head, tail));)
+#define  G_LOG_RANGE_SUMMARY(var)      G_LOG_IF_SITE(DEBUG, general, G_LOG_SITE(#var), \
+                                          g_log.Write_range(g_log_site, var, Log_range::style::e_summary);)
+
+// Formatted statements: G_LOG_FMT("x = {}, name = {}", x, name). The format must be a string
+// literal; a stray brace or a placeholder count that differs from the argument count fails to
+// compile. Arguments are formatted into the record without a stream (see Log_format).
+#define  G_LOG_FMT(...)                G_LOG_IF_SITE(DEBUG, general, G_LOG_FMT_CHECK(__VA_ARGS__) \
+                                          G_LOG_SITE(G_LOG_FIRST(__VA_ARGS__)), \
+                                          Log_write_format(g_log, g_log_site, __VA_ARGS__);)
+#define  G_LOG_FMT_AT(level, module, ...) \
+                                       G_LOG_IF_SITE(level, module, G_LOG_FMT_CHECK(__VA_ARGS__) \
+                                          G_LOG_SITE_AT(level, module, \
+                                                        "[" #level " " #module "] " G_LOG_FIRST(__VA_ARGS__)), \
+                                          Log_write_format(g_log, g_log_site, __VA_ARGS__);)
+
+// Sampled statements for hot loops. Each call site has its own lock-free Log_sampler (sampling
+// e_every_nth, e_per_second or e_first_then_every), which only sees hits that pass the level
+// check and the site's switch. The next line written reports how many were skipped:
+// "... [<count> suppressed]".
+#define  G_LOG_SAMPLED(level, module, sampling, n, m, statement) \
+                                       G_LOG_SAMPLED_SITE(level, module, G_LOG_SITE_AT(level, module, nullptr), \
+                                                          sampling, n, m, statement)
+#define  G_LOG_SAMPLED_SITE(level, module, site, sampling, n, m, statement) \
+                                       G_LOG_IF_SITE(level, module, site, \
+                                          static Log_sampler g_log_sampler(Log_sampler::kind::sampling, n, m); \
+                                          std::uint64_t g_log_suppressed = 0; \
+                                          if (g_log_sampler.Admit(g_log_suppressed)) { \
+                                             if (g_log_suppressed != 0) \
+                                                Debugfile::Note_suppressed(g_log_suppressed); \
+                                             statement })
+
+// Hits 1, n + 1, 2n + 1, ...
+#define  G_LOG_VAR_EVERY_N(var, n)     G_LOG_SAMPLED_SITE(DEBUG, general, G_LOG_SITE(#var), e_every_nth, n, 1, \
+                                                          g_log.Write(g_log_site, var);)
+#define  G_LOG_MSG_EVERY_N(msg, n)     G_LOG_SAMPLED(DEBUG, general, e_every_nth, n, 1, \
+                                                     g_log.Write(msg, G_LOG_NL, &g_log_site);)
+// At most k hits per second
+#define  G_LOG_VAR_PER_SECOND(var, k)  G_LOG_SAMPLED_SITE(DEBUG, general, G_LOG_SITE(#var), e_per_second, k, 1, \
+                                                          g_log.Write(g_log_site, var);)
+#define  G_LOG_MSG_PER_SECOND(msg, k)  G_LOG_SAMPLED(DEBUG, general, e_per_second, k, 1, \
+                                                     g_log.Write(msg, G_LOG_NL, &g_log_site);)
+// The first n hits, then every m-th
+#define  G_LOG_VAR_FIRST_N_EVERY_M(var, n, m) \
+                                       G_LOG_SAMPLED_SITE(DEBUG, general, G_LOG_SITE(#var), e_first_then_every, n, m, \
+                                                          g_log.Write(g_log_site, var);)
+#define  G_LOG_MSG_FIRST_N_EVERY_M(msg, n, m) \
+                                       G_LOG_SAMPLED(DEBUG, general, e_first_then_every, n, m, \
+                                                     g_log.Write(msg, G_LOG_NL, &g_log_site);)
+
+#define  G_LOG_THREAD_NAME(name)       g_log.Set_thread_name(name);
+
+// Run-time switches per call site, e.g. G_LOG_SITES_ON("module=net"), or a control file that is
+// reloaded when it changes or on SIGHUP. See Log_site_registry for the rule syntax.
+#define  G_LOG_SITES_ON(selector)      Log_site_registry::Enable(selector, true);
+#define  G_LOG_SITES_OFF(selector)     Log_site_registry::Enable(selector, false);
+#define  G_LOG_SITES_WATCH(path)       Log_site_registry::Watch(path);
+#define  G_LOG_TRACE_ENABLE            g_log.Trace_functions(true);
+#define  G_LOG_TRACE_DISABLE           g_log.Trace_functions(false);
+#define  G_LOG_TRACE_EXPORT(path)      g_log.Write_trace(path);
+// Call-tree profile of G_LOG_FUNCTION scopes, kept in memory instead of written as lines; the
+// export writes folded stacks to path and the top functions and paths to the log.
+#define  G_LOG_PROFILE_ENABLE          g_log.Profile_functions(true);
+#define  G_LOG_PROFILE_DISABLE         g_log.Profile_functions(false);
+#define  G_LOG_PROFILE_EXPORT(path)    g_log.Write_profile(path);
 #define  G_LOG_RESET                   g_log.Reset();
+#define  G_LOG_ASYNC                   g_log.Start_async();
+// Multi-process logging: records go to a shared-memory channel, a string such as "myapp", which
+// one process (or tools/Debuglog_collect) collects into one log. See Debugfile::Start_shared().
+#define  G_LOG_SHARED(channel)         g_log.Start_shared(channel);
+#define  G_LOG_COLLECT(channel)        g_log.Start_collector(channel);
+#define  G_LOG_FLUSH                   g_log.Flush();
 //#define  G_LOG_FUNCTION_RETURN(var)    Logger_helper lh(__FUNCTION__);        // This too
 
 #else
 
 #define  G_LOG_DEFINE
+#define  G_LOG_DEFINE_BINARY(path_to_file)
 #define  G_LOG_EXTERN
 #define  G_LOG_ENABLE 
 #define  G_LOG_DISABLE
+#define  G_LOG_SET_LEVEL(level)
+#define  G_LOG_MODULE_LEVEL(module, level)
 #define  G_LOG_VAR(var)
 #define  G_LOG_MSG(msg)
 #define  G_LOG_MSG_NONL(msg)
+#define  G_LOG_MSG_VAR(msg, var)
+#define  G_LOG_MSG_AT(level, module, msg)
+#define  G_LOG_VAR_AT(level, module, var)
+#define  G_LOG_MSG_VAR_AT(level, module, msg, var)
+#define  G_LOG_RANGE(var, head, tail)
+#define  G_LOG_RANGE_HEX(var, head, tail)
+#define  G_LOG_RANGE_SUMMARY(var)
+#define  G_LOG_FMT(...)
+#define  G_LOG_FMT_AT(level, module, ...)
+#define  G_LOG_SAMPLED(level, module, sampling, n, m, statement)
+#define  G_LOG_SAMPLED_SITE(level, module, site, sampling, n, m, statement)
+#define  G_LOG_VAR_EVERY_N(var, n)
+#define  G_LOG_MSG_EVERY_N(msg, n)
+#define  G_LOG_VAR_PER_SECOND(var, k)
+#define  G_LOG_MSG_PER_SECOND(msg, k)
+#define  G_LOG_VAR_FIRST_N_EVERY_M(var, n, m)
+#define  G_LOG_MSG_FIRST_N_EVERY_M(msg, n, m)
 #define  G_LOG_FUNCTION 
+#define  G_LOG_TIMED_SCOPE(name)
+#define  G_LOG_LATENCY_SUMMARY
+#define  G_LOG_THREAD_NAME(name)
+#define  G_LOG_SITES_ON(selector)
+#define  G_LOG_SITES_OFF(selector)
+#define  G_LOG_SITES_WATCH(path)
+#define  G_LOG_TRACE_ENABLE
+#define  G_LOG_TRACE_DISABLE
+#define  G_LOG_TRACE_EXPORT(path)
+#define  G_LOG_PROFILE_ENABLE
+#define  G_LOG_PROFILE_DISABLE
+#define  G_LOG_PROFILE_EXPORT(path)
 #define  G_LOG_FUNCTION_RETURN(var)
 #define  G_LOG_RESET 
+#define  G_LOG_ASYNC
+#define  G_LOG_SHARED(channel)
+#define  G_LOG_COLLECT(channel)
+#define  G_LOG_FLUSH
 
 #endif // ENABLE_DEBUG_LOGGING
 
@@ -44,14 +308,35 @@ class Logger_helper
 public:
 
    // ---------------------------------------------------------------------------------------------
-   /// @brief     Default constructor
+   /// @brief     Logs function entry and indents, or records a trace event in tracing mode or
+   ///            the call in profiling mode.
+   ///            @p fname must outlive the helper (__FUNCTION__ does); it is not copied.
+   ///            With @p enabled false (trace level filtered out) it does nothing at all.
+   ///            @p site, that of G_LOG_FUNCTION, puts the lines in the index.
    // ---------------------------------------------------------------------------------------------
-   Logger_helper(Debugfile &logger, const char* fname)
+   Logger_helper(Debugfile &logger, const char* fname, bool enabled = true,
+                 const Log_call_site *site = nullptr)
    : m_logger(logger)
    , m_function_name(fname)
+   , m_site(site)
    , m_return_variable_value("")
+   , m_enabled(enabled)
+   , m_traced(enabled && logger.Is_tracing_functions())
+   , m_profiled(enabled && !m_traced && logger.Is_profiling_functions())
    { 
-      m_logger.Modify_indentation(m_func_indent);
+      if (m_traced)
+      {
+         Trace_recorder::Begin(m_function_name);
+      }
+      else if (m_profiled)
+      {
+         Log_profile::Begin(m_function_name);
+      }
+      else if (m_enabled)
+      {
+         m_logger.Write("Entering  -->", m_function_name, Debugfile::newline_type::e_write_newline, m_site);
+         m_logger.Enter_scope(m_func_indent);
+      }
    }
 
    // ---------------------------------------------------------------------------------------------
@@ -59,18 +344,31 @@ public:
    // ---------------------------------------------------------------------------------------------
    ~Logger_helper()
    {
-      std::stringstream ss;
-      ss << "Returning <-- " << m_function_name;
-      m_logger.Modify_indentation(-m_func_indent);
-      m_logger.Write(ss.str().c_str());
+      if (m_traced)
+      {
+         Trace_recorder::End(m_function_name);
+      }
+      else if (m_profiled)
+      {
+         Log_profile::End(m_function_name);
+      }
+      else if (m_enabled)
+      {
+         m_logger.Leave_scope(m_func_indent);
+         m_logger.Write("Returning <--", m_function_name, Debugfile::newline_type::e_write_newline, m_site);
+      }
    }
 
    Logger_helper(const Logger_helper& c) = delete;
    Logger_helper& operator=(const Logger_helper& c) = delete;
 
    Debugfile&           m_logger;
-   std::string          m_function_name;
+   const char*          m_function_name;
+   const Log_call_site* m_site;
    std::string          m_return_variable_value;
+   const bool           m_enabled;
+   const bool           m_traced;
+   const bool           m_profiled;
    const int            m_func_indent{3};
 };
 
@@ -1,22 +1,83 @@
 /// @file Debugfile.cpp
 
 #include "Debugfile.h"
-#include "Simple_timer.h"
+#include "Flight_recorder.h"
+#include "Log_clock.h"
+#include "Log_latency.h"
+#include "Log_profile.h"
+#include "Log_shard.h"
+#include "Log_thread.h"
+#include "Trace_recorder.h"
 
+#include <algorithm>
 #include <ctime>
+#include <fstream>
+#include <sstream>
 #include <thread>
 
+namespace
+{
+   // Per-thread record that messages are formatted into before they are written or queued.
+   // Reusing it keeps the text buffer's capacity, so steady-state logging does not allocate.
+   struct Staging_area
+   {
+      Staging_area() : m_buf(&m_record.m_text), m_stream(&m_buf) {}
+
+      Log_record           m_record;
+      Log_record_streambuf m_buf;
+      std::ostream         m_stream;
+   };
+
+   Staging_area& Staging()
+   {
+      thread_local Staging_area area;
+      return area;
+   }
+
+   // Indentation and Logger_helper depth of the calling thread
+   struct Thread_scope
+   {
+      int m_indent{0};
+      int m_depth{0};
+   };
+
+   thread_local Thread_scope t_scope;
+
+   // Records skipped by a sampling macro, reported with the thread's next record
+   thread_local std::uint64_t t_suppressed = 0;
+
+   // Source of shard generations, unique across all Debugfile instances
+   std::atomic<std::uint64_t> s_shard_generation{0};
+
+   // Nanoseconds between two Log_clock readings, for the metrics
+   std::uint64_t Elapsed_ns(std::uint64_t start, std::uint64_t end)
+   {
+      return static_cast<std::uint64_t>(Log_clock::To_ns(static_cast<std::int64_t>(end - start)));
+   }
+
+   struct Shard_cache
+   {
+      const Debugfile   *m_owner{nullptr};
+      std::uint64_t     m_generation{0};
+      Log_shard         *m_shard{nullptr};
+   };
+}
+
 // ------------------------------------------------------------------------------------------------
-Debugfile::Debugfile(const char *filename, bool open_now, Debugfile::timing_type t_unit)
+Debugfile::Debugfile(const char *filename, bool open_now, Debugfile::timing_type t_unit,
+                     Debugfile::output_format format)
    : m_filename(filename)
+   , m_sink()
+   , m_bugfile(&m_sink)
    , m_debug_on(open_now)
+   , m_threshold(static_cast<int>(open_now ? log_level::e_trace : log_level::e_off))
    , m_is_open(false)
    , m_newline(false)
-   , m_timer(new Simple_timer)
-   , m_bugfile()
    , m_padding(12)
    , m_indent(1)
    , m_timing_unit(t_unit)
+   , m_format(format)
+   , m_line(m_padding)
 {
    if (m_debug_on)
    {
@@ -27,13 +88,20 @@ Debugfile::Debugfile(const char *filename, bool open_now, Debugfile::timing_type
 // ------------------------------------------------------------------------------------------------
 Debugfile::~Debugfile()
 {
-   Close_file();
+   Log_latency::Clear_reporter(this);
+   Stop_flight_recorder();
+   Stop_async();
+   Stop_sharded();
+   Stop_shared();
+   Stop_collector();
+   Stop_flusher();
 
-   if (m_timer)
    {
-      delete m_timer;
-      m_timer = 0;
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Close_file();
    }
+
+   Stop_compression();
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -42,6 +110,7 @@ void Debugfile::Turn_on_debug_file(bool turn_on)
    std::lock_guard<std::mutex> file_lock(m_logger_mutex);
 
    m_debug_on = turn_on;
+   Update_threshold();
 
    if (m_debug_on)
    {
@@ -49,18 +118,93 @@ void Debugfile::Turn_on_debug_file(bool turn_on)
    }
 }
 
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_level(log_level level)
+{
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   m_level = level;
+   Update_threshold();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Update_threshold()
+{
+   bool capturing = m_debug_on || m_flight;
+   m_threshold.store(static_cast<int>(capturing ? m_level : log_level::e_off), std::memory_order_relaxed);
+}
+
 // ------------------------------------------------------------------------------------------------
 void Debugfile::Open_file()
 {
    if (!m_is_open)
    {
-      m_bugfile.open(m_filename, std::ios::out);
-      if (m_bugfile.is_open())
+      bool binary = (m_format == output_format::e_binary);
+
+      // Cheap, and a reopen is a natural point to correct a TSC rate that has wandered
+      Log_clock::Check_drift();
+
+      m_show_depth = m_show_depth_requested;
+      m_show_thread_names = m_show_thread_names_requested;
+      m_index_epoch = Log_clock::Now();
+      m_timestamp.Start(m_timestamp_mode_requested, m_index_epoch);
+
+      bool mapped = false;
+      if (!binary && m_segment_bytes > 0)
+      {
+         m_mapped.Set_preamble(Heading() + '\n');
+         mapped = m_mapped.Open(m_filename, m_segment_bytes, m_keep_segments);
+      }
+      if (mapped)
+      {
+         m_bugfile.rdbuf(&m_mapped);
+      }
+      else
+      {
+         m_bugfile.rdbuf(&m_sink);
+         m_sink.Open(m_filename, binary);
+      }
+
+      if (mapped || m_sink.Is_open())
       {
+         m_bugfile.clear();
          m_is_open = true;
-         Write_systemtime();
-         Write_header();
-         Write_endline(Debugfile::newline_type::e_write_newline);
+         m_sites_written.clear();
+
+         if (binary)
+         {
+            Binary_log::Write_file_header(m_bugfile, m_timing_unit == timing_type::e_milli,
+                                          m_show_depth, m_show_thread_names, m_timestamp_mode_requested, 
+                                          std::time(nullptr), Log_clock::Now());
+            m_newline = true;
+         }
+         else
+         {
+            if (!mapped && m_index_bytes > 0)
+            {
+               Log_index::header index;
+               index.m_timestamp_mode = m_timestamp_mode_requested;
+               index.m_is_milli = (m_timing_unit == timing_type::e_milli);
+               index.m_show_depth = m_show_depth;
+               index.m_block_bytes = static_cast<std::uint32_t>(m_index_bytes);
+               index.m_systime = static_cast<std::int64_t>(std::time(nullptr));
+               m_index.Open(m_filename + ".idx", index);
+            }
+            Write_systemtime();
+            Write_header();
+            Write_endline(Debugfile::newline_type::e_write_newline);
+         }
+
+         for (const Log_thread::entry &thread : Log_thread::Threads())
+         {
+            if (thread.m_name)
+               Write_thread_name(thread.m_id, thread.m_name);
+         }
+
+         // Segments are renamed and compressed as they rotate, so an index of offsets could not
+         // follow them; say so rather than leave the .idx missing without a word
+         if (mapped && m_index_bytes > 0)
+            Write_note("Debugfile: no index is written while segments are in use");
       }
    }
 }
@@ -70,47 +214,369 @@ void Debugfile::Close_file()
 {
    if (m_is_open)
    {
-      Write("Debug file closed.\n");
+      if (m_debug_on)
+      {
+         Write_note("Debug file closed.\n");
+      }
       Write_systemtime();
-      m_bugfile.flush();
-      m_bugfile.close(); // No try/catch - std::streams don't throw by default
+      Flush_file();
+      m_index.Close(m_sink.Position());
+      m_sink.Close();
+      m_mapped.Close();
+      m_is_open = false;
    }
 }
 
 // ------------------------------------------------------------------------------------------------
-void Debugfile::Write(const char *str, Debugfile::newline_type nl)
+void Debugfile::Write(const char *str, Debugfile::newline_type nl, const Log_call_site *site)
 {
-   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   if (Is_capturing())
+   {
+      if (m_format == output_format::e_binary)
+         Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_message, nullptr, str);
+      else
+         Begin_message() << str;
+      Submit(nl, Indexed(site));
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write(const char *description, const void* value, 
+                      newline_type nl, const Log_call_site *site)
+{
+   if (Is_capturing())
+   {
+      if (m_format == output_format::e_binary)
+         Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_spaced_value, 
+                                    description, value);
+      else
+         Begin_message() << " " << description << " " << value;
+      Submit(nl, Indexed(site));
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write(const char *description, bool value, newline_type nl, const Log_call_site *site)
+{
+   if (Is_capturing())
+   {
+      if (m_format == output_format::e_binary)
+         Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_spaced_value, 
+                                    description, value);
+      else
+         Begin_message() << " " << description << " " << (value ? "true" : "false");
+      Submit(nl, Indexed(site));
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write(const Log_call_site &site, bool value, newline_type nl)
+{
+   if (Is_capturing())
+   {
+      if (m_format == output_format::e_binary)
+         Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_spaced_value, 
+                                    nullptr, value);
+      else
+         Begin_message() << " " << site.m_description << " " << (value ? "true" : "false");
+      Submit(nl, &site);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+std::ostream& Debugfile::Begin_message()
+{
+   Staging_area &area = Staging();
+   area.m_record.m_text.clear();
+   return area.m_stream;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string& Debugfile::Begin_binary()
+{
+   Log_record &rec = Staging().m_record;
+   rec.m_text.clear();
+   return rec.m_text;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string& Debugfile::Begin_text()
+{
+   Log_record &rec = Staging().m_record;
+   rec.m_text.clear();
+   return rec.m_text;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Submit(Debugfile::newline_type nl, const Log_call_site *site)
+{
+   Log_record &rec = Staging().m_record;
+   rec.m_site = site;
+   rec.m_thread = Log_thread::Id();
+   rec.m_thread_name = Log_thread::Name();
+   rec.m_indent = std::max(1, m_indent + t_scope.m_indent);
+   rec.m_depth = t_scope.m_depth;
+   rec.m_newline = (nl == newline_type::e_write_newline);
+
+   // Stamped before any lock is taken, so time spent waiting for the file is not in the record
+   rec.m_ticks = Log_clock::Now();
+
+   if (t_suppressed != 0)
+   {
+      Report_suppressed(rec);
+   }
+
+   bool measured = m_metrics_on.load(std::memory_order_relaxed);
+   std::size_t bytes = rec.m_text.size();
+   Dispatch(rec);
+   if (measured)
+   {
+      Measure_write(rec.m_ticks, bytes);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Dispatch(const Log_record &rec)
+{
+   if (m_flight.load(std::memory_order_relaxed))
+   {
+      Flight_recorder::Record(rec);
+      if (!m_debug_on.load(std::memory_order_relaxed))
+         return;
+   }
+
+   if (m_shared.load(std::memory_order_acquire))
+   {
+      Write_to_ring(rec);
+      return;
+   }
+
+   if (m_sharded.load(std::memory_order_acquire))
+   {
+      Write_to_shard(rec);
+      return;
+   }
+
+   if (m_async.load(std::memory_order_acquire))
+   {
+      Enqueue(rec);
+      return;
+   }
+
+   std::unique_lock<std::mutex> file_lock(m_logger_mutex, std::defer_lock);
+   Lock_file(file_lock);
 
    if (m_debug_on)
    {
-      if (m_newline)
+      Write_record(rec);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Note_suppressed(std::uint64_t count)
+{
+   t_suppressed += count;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Report_suppressed(Log_record &rec)
+{
+   std::string note = "[" + std::to_string(t_suppressed) + " suppressed]";
+   if (m_metrics_on.load(std::memory_order_relaxed))
+   {
+      m_metrics.Add(Log_metrics::counter::e_suppressed, t_suppressed);
+   }
+   t_suppressed = 0;
+
+   if (m_format == output_format::e_binary)
+   {
+      Log_record before;
+      before.m_ticks = rec.m_ticks;
+      before.m_thread = rec.m_thread;
+      before.m_thread_name = rec.m_thread_name;
+      before.m_indent = rec.m_indent;
+      before.m_depth = rec.m_depth;
+      Binary_log::Encode_payload(before.m_text, Binary_log::layout_type::e_message, nullptr, note.c_str());
+      Dispatch(before);
+   }
+   else
+   {
+      rec.m_text += ' ';
+      rec.m_text += note;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Measure_write(std::uint64_t start, std::size_t bytes)
+{
+   std::uint64_t now = Log_clock::Now();
+   m_metrics.Add(Log_metrics::counter::e_records);
+   m_metrics.Add(Log_metrics::counter::e_bytes, bytes);
+   m_metrics.Record(Log_metrics::timing::e_write, Elapsed_ns(start, now));
+
+   if (now >= m_next_summary.load(std::memory_order_relaxed))
+   {
+      Write_metrics_summary(now);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_metrics_summary(std::uint64_t now)
+{
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   // Another thread may have written it meanwhile; a partial line waits for its end
+   if (m_summary_ticks == 0 || now < m_next_summary.load(std::memory_order_relaxed) || !m_newline)
+      return;
+
+   Log_metrics::snapshot current = m_metrics.Snapshot();
+   Log_metrics::snapshot interval = current;
+   interval.Subtract(m_last_summary);
+   double seconds = Log_clock::To_ns(static_cast<std::int64_t>(current.m_ticks - m_last_summary.m_ticks)) / 1e9;
+   m_last_summary = current;
+   m_next_summary.store(now + static_cast<std::uint64_t>(m_summary_ticks), std::memory_order_relaxed);
+
+   if (m_is_open && m_debug_on)
+   {
+      Write_note(("Debugfile: " + Log_metrics::Summary(interval, seconds)).c_str());
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_latency_summary()
+{
+   std::vector<Log_latency::summary> summaries = Log_latency::Since_last();
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   if (m_is_open && m_debug_on)
+   {
+      for (const Log_latency::summary &s : summaries)
       {
-         Write_timestamp();
-         Write_thread_ID();
-         m_bugfile << std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ';
+         Write_note(("Debugfile: " + Log_latency::Format(s)).c_str());
       }
-      m_bugfile << str;
-      Write_endline(nl);
    }
 }
 
-void Debugfile::Write(const char *description, const void* value, 
-                      newline_type nl)
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Report_latency(void *self)
+{
+   static_cast<Debugfile*>(self)->Write_latency_summary();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_latency_summary(std::chrono::milliseconds interval)
+{
+   if (interval.count() > 0)
+      Log_latency::Set_reporter(&Report_latency, this, interval);
+   else
+      Log_latency::Clear_reporter(this);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_metrics_summary(std::chrono::milliseconds interval)
 {
    std::lock_guard<std::mutex> file_lock(m_logger_mutex);
 
-   if (m_debug_on)
+   m_summary_ticks = 0;
+   if (interval.count() > 0)
+   {
+      m_summary_ticks = std::max<std::int64_t>(1, Log_clock::From_ns(static_cast<double>(interval.count()) * 1e6));
+   }
+   m_last_summary = m_metrics.Snapshot();
+   m_next_summary.store(m_summary_ticks ? m_last_summary.m_ticks + static_cast<std::uint64_t>(m_summary_ticks)
+                                        : UINT64_MAX,
+                        std::memory_order_relaxed);
+   if (m_summary_ticks)
+   {
+      m_metrics_on.store(true, std::memory_order_relaxed);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Lock_file(std::unique_lock<std::mutex> &file_lock)
+{
+   if (file_lock.try_lock())
+      return;
+
+   if (!m_metrics_on.load(std::memory_order_relaxed))
+   {
+      file_lock.lock();
+      return;
+   }
+
+   std::uint64_t start = Log_clock::Now();
+   file_lock.lock();
+   m_metrics.Record(Log_metrics::timing::e_lock_wait,
+                    Elapsed_ns(start, Log_clock::Now()));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Flush_file()
+{
+   if (m_index.Is_open())
+   {
+      m_index.Flush();
+   }
+
+   if (!m_metrics_on.load(std::memory_order_relaxed))
+   {
+      m_bugfile.flush();
+      return;
+   }
+
+   std::uint64_t start = Log_clock::Now();
+   m_bugfile.flush();
+   m_metrics.Record(Log_metrics::timing::e_flush,
+                    Elapsed_ns(start, Log_clock::Now()));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_record(const Log_record &rec)
+{
+   if (m_format == output_format::e_binary)
+   {
+      std::uint32_t site_id = 0;
+      if (rec.m_site)
+      {
+         site_id = rec.m_site->Id();
+         if (site_id >= m_sites_written.size())
+         {
+            m_sites_written.resize(site_id + 1, false);
+         }
+         if (!m_sites_written[site_id])
+         {
+            Binary_log::Write_site(m_bugfile, site_id, *rec.m_site);
+            m_sites_written[site_id] = true;
+         }
+      }
+      Binary_log::Write_record(m_bugfile, site_id, rec);
+      m_newline = rec.m_newline;
+      return;
+   }
+
+   m_line.Clear();
+   if (m_newline)
    {
-      if (m_newline)
+      if (m_index.Is_open())
       {
-         Write_timestamp();
-         Write_thread_ID();
-         m_bugfile << std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ';
+         Index_record(rec);
       }
-      m_bugfile << " " << description << " " << value;
-      Write_endline(nl);
+      Write_timestamp(rec);
+      Write_thread_ID(rec);
+      if (m_show_depth)
+      {
+         m_line.Append_column(static_cast<std::uint64_t>(rec.m_depth), m_depth_width);
+      }
+      m_line.Append_indent(rec.m_indent);
+   }
+   m_line.Append(rec.m_text);
+   if (rec.m_newline)
+   {
+      // One write per line, so a segment rotation never splits a line
+      m_line.Append('\n');
    }
+   m_bugfile.write(m_line.Data(), static_cast<std::streamsize>(m_line.Size()));
+   End_line(rec.m_newline ? newline_type::e_write_newline : newline_type::e_no_newline);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -119,6 +585,12 @@ void Debugfile::Write_systemtime()
 #pragma warning(disable:4996)
 
    std::time_t systime = std::time(nullptr);
+   if (m_format == output_format::e_binary)
+   {
+      Binary_log::Write_systemtime(m_bugfile, systime);
+      m_newline = true;
+      return;
+   }
    m_bugfile << std::asctime(std::localtime(&systime));
    Write_endline(Debugfile::newline_type::e_write_newline);
 
@@ -131,8 +603,23 @@ void Debugfile::Write_endline(Debugfile::newline_type newline)
 {
    if (newline == Debugfile::newline_type::e_write_newline)
    {
-      m_bugfile << std::endl;
+      m_bugfile << '\n';
+   }
+   End_line(newline);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::End_line(Debugfile::newline_type newline)
+{
+   if (newline == Debugfile::newline_type::e_write_newline)
+   {
       m_newline = true;
+
+      if (m_flush_policy == flush_policy::e_every_line ||
+          (m_flush_policy == flush_policy::e_bytes && m_sink.Pending() >= m_flush_threshold))
+      {
+         Flush_file();
+      }
    }
    else
    {
@@ -140,62 +627,795 @@ void Debugfile::Write_endline(Debugfile::newline_type newline)
    }
 }
 
-#define USE_INCREMENTAL
-
 // ------------------------------------------------------------------------------------------------
-void Debugfile::Write_timestamp()
+void Debugfile::Write_note(const char *text)
 {
-   std::ios_base::fmtflags old_flags = m_bugfile.setf(std::ios::fixed, std::ios::floatfield);
-   std::streamsize old_p = m_bugfile.precision(2);
+   Log_record rec;
+   rec.m_ticks = Log_clock::Now();
+   rec.m_thread = Log_thread::Id();
+   rec.m_thread_name = Log_thread::Name();
+   rec.m_indent = m_indent;
+   rec.m_depth = t_scope.m_depth;
+
+   if (m_format == output_format::e_binary)
+      Binary_log::Encode_payload(rec.m_text, Binary_log::layout_type::e_message, nullptr, text);
+   else
+      rec.m_text = text;
 
-   m_bugfile << std::right << std::setw(m_padding) << 
-      ((m_timing_unit == timing_type::e_milli) ? m_timer->Elapsed_ms() : m_timer->Elapsed_us());
+   Write_record(rec);
+}
 
-   m_bugfile.setf(old_flags);
-   m_bugfile.precision(old_p); // "precision" doesn't appear to be sticky for all streams
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Emergency_output(void *self, const char *data, std::size_t length)
+{
+   Debugfile *file = static_cast<Debugfile*>(self);
 
-#if defined USE_INCREMENTAL
+   if (file->m_mapped.Is_open() && file->m_flight_dumping)
+      file->m_mapped.Write(data, length);
+   else if (file->m_mapped.Is_open())
+      file->m_mapped.Emergency_write(data, length);
+   else
+      file->m_sink.Emergency_write(data, length);
+}
 
-   m_timer->Reset_timer();
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_timestamp(const Log_record &rec)
+{
+   std::uint64_t thread = (static_cast<std::uint64_t>(rec.m_process) << 32) | rec.m_thread;
+   std::int64_t ticks = m_timestamp.Column_ticks(thread, rec.m_ticks);
 
-#endif
+   m_line.Append_timestamp((m_timing_unit == timing_type::e_milli) ? Log_clock::To_ms(ticks) : 
+                                                                     Log_clock::To_us(ticks));
 }
 
 // ------------------------------------------------------------------------------------------------
 void Debugfile::Write_header()
 {
-   m_bugfile << std::right << std::setw(m_padding) << 
-                              ((m_timing_unit == timing_type::e_milli) ? 
-                                 "Elapsed_ms" : "Elapsed_us") <<
-                              std::setw(m_padding) << "Thread_ID" <<
-                              std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ' <<
-                              std::left << "Log_message";
+   m_bugfile << Heading();
    m_newline = false;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string Debugfile::Heading() const
+{
+   std::ostringstream heading;
+
+   heading << std::right << std::setw(m_padding) << 
+                            Log_timestamp::Heading(m_timestamp.Mode(), 
+                                                   m_timing_unit == timing_type::e_milli) <<
+                            std::setw(m_padding) << "Thread_ID";
+   if (m_show_depth)
+   {
+      heading << std::setw(m_depth_width) << "Depth";
+   }
+   heading <<               std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ' <<
+                            std::left << "Log_message";
+   return heading.str();
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string Debugfile::Thread_label(const Log_record &rec) const
+{
+   std::string label = (m_show_thread_names && rec.m_thread_name) ? std::string(rec.m_thread_name) :
+                                                                    std::to_string(rec.m_thread);
+   return (rec.m_process != 0) ? std::to_string(rec.m_process) + "." + label : label;
+}
 
-#if defined USE_INCREMENTAL
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_thread_ID(const Log_record &rec)
+{
+   if (rec.m_process != 0)
+      m_line.Append_column(Thread_label(rec).c_str());
+   else if (m_show_thread_names && rec.m_thread_name)
+      m_line.Append_column(rec.m_thread_name);
+   else
+      m_line.Append_column(static_cast<std::uint64_t>(rec.m_thread));
+}
 
-   m_timer->Reset_timer();
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Index_record(const Log_record &rec)
+{
+   std::uint64_t thread = Log_index::Thread_key(rec.m_process, rec.m_thread);
+   if (m_index.Needs_label(thread, rec.m_thread_name))
+   {
+      m_index.Add_label(thread, rec.m_thread_name, Thread_label(rec));
+   }
 
-#endif
+   std::int64_t ns = static_cast<std::int64_t>(
+      Log_clock::To_ns(static_cast<std::int64_t>(rec.m_ticks - m_index_epoch)));
+   m_index.Add(m_sink.Position(), ns, thread, rec.m_site);
 }
 
 // ------------------------------------------------------------------------------------------------
-void Debugfile::Write_thread_ID()
+void Debugfile::Set_thread_name(const char *name)
 {
-   m_bugfile << std::right << std::setw(m_padding) << std::this_thread::get_id();
+   Log_thread::Set_name(name);
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   if (m_is_open && m_debug_on)
+   {
+      Write_thread_name(Log_thread::Id(), Log_thread::Name());
+   }
 }
 
 // ------------------------------------------------------------------------------------------------
-void Debugfile::Reset()
+void Debugfile::Write_thread_name(std::uint32_t id, const char *name)
 {
-   Close_file();
-   Open_file();
+   // Binary files also get the line, so that they decode to what a text file shows
+   if (m_format == output_format::e_binary)
+   {
+      Binary_log::Write_thread_name(m_bugfile, id, name);
+   }
+
+   std::string note = "Thread " + std::to_string(id) + " is " + name;
+   Write_note(note.c_str());
 }
 
 // ------------------------------------------------------------------------------------------------
-void Debugfile::Modify_indentation(const int spaces)
+void Debugfile::Reset()
 {
-   m_indent += spaces;
-   if (m_indent < 1) 
-      m_indent = 1;
-}
\ No newline at end of file
+   Drain();
+
+   For_each_shard([](Log_shard &shard)
+   {
+      if (shard.Is_open())
+      {
+         shard.Close();
+         shard.Open();
+      }
+   });
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   Close_file();
+   Open_file();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Modify_indentation(const int spaces)
+{
+   t_scope.m_indent += spaces;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Enter_scope(const int spaces)
+{
+   ++t_scope.m_depth;
+   t_scope.m_indent += spaces;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Leave_scope(const int spaces)
+{
+   if (t_scope.m_depth > 0)
+      --t_scope.m_depth;
+   t_scope.m_indent -= spaces;
+}
+
+// ------------------------------------------------------------------------------------------------
+int Debugfile::Call_depth()
+{
+   return t_scope.m_depth;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Start_async(std::size_t queue_capacity, Debugfile::overflow_policy policy)
+{
+   if (m_async.load(std::memory_order_acquire))
+      return;
+
+   if (!m_queue)
+   {
+      m_queue.reset(new Log_queue<Log_record>(queue_capacity));
+   }
+   m_overflow = policy;
+   m_stop_writer.store(false, std::memory_order_relaxed);
+   m_writer_thread = std::thread(&Debugfile::Writer_loop, this);
+   m_async.store(true, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_async()
+{
+   if (!m_async.exchange(false, std::memory_order_acq_rel))
+      return;
+
+   m_stop_writer.store(true, std::memory_order_release);
+   m_wake.notify_one();
+   if (m_writer_thread.joinable())
+   {
+      m_writer_thread.join();
+   }
+
+   // A producer that saw m_async just before it was cleared may still have pushed a record.
+   Write_pending();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Drain()
+{
+   while (m_written.load(std::memory_order_acquire) < m_submitted.load(std::memory_order_acquire))
+   {
+      if (!m_writer_thread.joinable())
+      {
+         Write_pending();
+         continue;
+      }
+      m_wake.notify_one();
+      std::this_thread::yield();
+   }
+
+   For_each_shard([](Log_shard &shard) { shard.Flush(); });
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   Flush_file();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Enqueue(const Log_record &rec)
+{
+   auto copy_into = [&rec](Log_record &slot)
+   {
+      slot.m_ticks = rec.m_ticks;
+      slot.m_thread = rec.m_thread;
+      slot.m_thread_name = rec.m_thread_name;
+      slot.m_indent = rec.m_indent;
+      slot.m_depth = rec.m_depth;
+      slot.m_newline = rec.m_newline;
+      slot.m_text.assign(rec.m_text);
+      slot.m_site = rec.m_site;
+   };
+
+   m_submitted.fetch_add(1, std::memory_order_acq_rel);
+
+   // While the overflow list is non-empty, keep appending to it so that a thread's records
+   // are not reordered between the list and the ring.
+   bool pushed = !m_spilling.load(std::memory_order_acquire) && m_queue->Try_push(copy_into);
+   bool measured = m_metrics_on.load(std::memory_order_relaxed);
+   std::uint64_t wait_start = 0;
+
+   while (!pushed)
+   {
+      if (m_overflow == overflow_policy::e_drop)
+      {
+         m_dropped.fetch_add(1, std::memory_order_relaxed);
+         m_submitted.fetch_sub(1, std::memory_order_acq_rel);
+         if (measured)
+            m_metrics.Add(Log_metrics::counter::e_dropped);
+         return;
+      }
+      if (m_overflow == overflow_policy::e_grow)
+      {
+         std::lock_guard<std::mutex> spill_lock(m_spill_mutex);
+         m_spill.push_back(rec);
+         m_spilling.store(true, std::memory_order_release);
+         if (measured)
+            m_metrics.Add(Log_metrics::counter::e_spilled);
+         pushed = true;
+         break;
+      }
+
+      if (measured && wait_start == 0)
+         wait_start = Log_clock::Now();
+      m_wake.notify_one();
+      std::this_thread::yield();
+      pushed = m_queue->Try_push(copy_into);
+   }
+
+   if (wait_start != 0)
+   {
+      m_metrics.Record(Log_metrics::timing::e_queue_wait, Elapsed_ns(wait_start, Log_clock::Now()));
+   }
+
+   if (m_writer_waiting.load(std::memory_order_acquire))
+   {
+      m_wake.notify_one();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Writer_loop()
+{
+   for (;;)
+   {
+      bool stopping = m_stop_writer.load(std::memory_order_acquire);
+
+      if (Write_pending() == 0)
+      {
+         if (stopping)
+            break;
+
+         std::unique_lock<std::mutex> wake_lock(m_wake_mutex);
+         m_writer_waiting.store(true, std::memory_order_release);
+         m_wake.wait_for(wake_lock, std::chrono::milliseconds(1));
+         m_writer_waiting.store(false, std::memory_order_release);
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+std::size_t Debugfile::Write_pending()
+{
+   std::size_t count = 0;
+   std::vector<Log_record> spilled;
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   if (m_queue)
+   {
+      while (m_queue->Try_pop([this](Log_record &rec) { Write_record(rec); }))
+      {
+         ++count;
+      }
+   }
+
+   // The ring is empty, so everything still in the overflow list is newer than what was written.
+   if (m_spilling.load(std::memory_order_acquire))
+   {
+      std::lock_guard<std::mutex> spill_lock(m_spill_mutex);
+      spilled.swap(m_spill);
+      m_spilling.store(false, std::memory_order_release);
+   }
+   for (const Log_record &rec : spilled)
+   {
+      Write_record(rec);
+      ++count;
+   }
+
+   std::uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+   if (dropped != m_dropped_reported && m_newline)
+   {
+      std::string note = "Debugfile: " + std::to_string(dropped - m_dropped_reported) + 
+                         " records dropped (queue full)";
+      Write_note(note.c_str());
+      m_dropped_reported = dropped;
+   }
+
+   m_written.fetch_add(count, std::memory_order_acq_rel);
+   return count;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_flush_policy(Debugfile::flush_policy policy, std::size_t threshold)
+{
+   Stop_flusher();
+
+   {
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      m_flush_policy = policy;
+      m_flush_threshold = threshold;
+      Flush_file();
+   }
+
+   For_each_shard([policy, threshold](Log_shard &shard)
+   {
+      shard.Set_flush_policy(policy, threshold);
+      shard.Flush();
+   });
+
+   if (policy == flush_policy::e_interval)
+   {
+      std::chrono::milliseconds interval(threshold > 0 ? threshold : 100);
+      m_stop_flusher.store(false, std::memory_order_relaxed);
+      m_flush_thread = std::thread(&Debugfile::Flusher_loop, this, interval);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_buffer_size(std::size_t bytes)
+{
+   For_each_shard([bytes](Log_shard &shard) { shard.Set_buffer_size(bytes); });
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   m_sink.Set_buffer_size(bytes);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Set_segments(std::size_t segment_bytes, int keep_segments)
+{
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   m_segment_bytes = segment_bytes;
+   m_keep_segments = keep_segments;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Set_index(std::size_t block_bytes, std::string *error)
+{
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   if (block_bytes > 0 && m_segment_bytes > 0)
+   {
+      if (error)
+         *error = "an index cannot be written with segments";
+      return false;
+   }
+   m_index_bytes = block_bytes;
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Start_compression(Debugfile::compression_format format, int cpu_percent)
+{
+   if (m_format != output_format::e_text)
+      return false;
+
+   m_compressor.Start(format, cpu_percent);
+   m_mapped.Set_compressor(&m_compressor);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_compression()
+{
+   m_mapped.Set_compressor(nullptr);
+   m_compressor.Stop();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Flush()
+{
+   Drain();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Flusher_loop(std::chrono::milliseconds interval)
+{
+   std::unique_lock<std::mutex> flusher_lock(m_flusher_mutex);
+
+   while (!m_stop_flusher.load(std::memory_order_acquire))
+   {
+      m_flusher_wake.wait_for(flusher_lock, interval);
+
+      For_each_shard([](Log_shard &shard) { shard.Flush(); });
+
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Flush_file();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_flusher()
+{
+   if (m_flush_thread.joinable())
+   {
+      {
+         std::lock_guard<std::mutex> flusher_lock(m_flusher_mutex);
+         m_stop_flusher.store(true, std::memory_order_release);
+      }
+      m_flusher_wake.notify_one();
+      m_flush_thread.join();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Write_trace(const char *path) const
+{
+   return Trace_recorder::Write_chrome_trace(path);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Write_profile(const char *folded_path, std::size_t top)
+{
+   Log_profile profile = Log_profile::Collect();
+
+   bool ok = true;
+   if (folded_path)
+   {
+      std::ofstream folded(folded_path);
+      profile.Write_folded(folded);
+      ok = static_cast<bool>(folded.flush());
+   }
+
+   std::ostringstream table;
+   profile.Write_top(table, top);
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   if (m_is_open && m_debug_on)
+   {
+      std::string line;
+      std::istringstream lines(table.str());
+      while (std::getline(lines, line))
+      {
+         Write_note(("Debugfile: " + line).c_str());
+      }
+   }
+   return ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Start_sharded()
+{
+   if (m_format != output_format::e_text)
+      return false;
+
+   if (m_sharded.load(std::memory_order_acquire))
+      return true;
+
+   Stop_async();
+
+   {
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Flush_file();
+      m_shard_epoch = Log_clock::Now();
+      Write_note(("Debugfile: per-thread shards in " + m_filename + ".<thread id>").c_str());
+   }
+
+   m_shard_generation.store(s_shard_generation.fetch_add(1) + 1, std::memory_order_release);
+   m_sharded.store(true, std::memory_order_release);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_sharded()
+{
+   if (!m_sharded.exchange(false, std::memory_order_acq_rel))
+      return;
+
+   // Shard objects stay allocated: a thread may still hold its cached pointer.
+   For_each_shard([](Log_shard &shard) { shard.Close(); });
+   m_shard_generation.store(0, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_shard& Debugfile::Thread_shard()
+{
+   thread_local Shard_cache cache;
+
+   std::uint64_t generation = m_shard_generation.load(std::memory_order_acquire);
+   if (cache.m_owner == this && cache.m_generation == generation)
+      return *cache.m_shard;
+
+   std::uint64_t thread = Log_thread::Id();
+   Log_shard *shard = nullptr;
+
+   std::lock_guard<std::mutex> shards_lock(m_shards_mutex);
+
+   for (const std::unique_ptr<Log_shard> &s : m_shards)
+   {
+      if (s->Thread() == thread)
+      {
+         shard = s.get();
+         break;
+      }
+   }
+   if (!shard)
+   {
+      m_shards.emplace_back(new Log_shard(m_filename + "." + std::to_string(thread), thread,
+                                          m_padding, m_timing_unit == timing_type::e_milli));
+      shard = m_shards.back().get();
+   }
+
+   {
+      std::lock_guard<std::mutex> shard_lock(shard->Mutex());
+      if (!shard->Is_open())
+      {
+         std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+         shard->Set_flush_policy(m_flush_policy, m_flush_threshold);
+         shard->Set_buffer_size(m_sink.Buffer_size());
+         shard->Show_depth(m_show_depth);
+         shard->Show_thread_names(m_show_thread_names);
+         shard->Open();
+      }
+   }
+
+   cache.m_owner = this;
+   cache.m_generation = generation;
+   cache.m_shard = shard;
+   return *shard;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_to_shard(const Log_record &rec)
+{
+   Log_shard &shard = Thread_shard();
+
+   std::int64_t ticks = static_cast<std::int64_t>(rec.m_ticks - m_shard_epoch);
+   double absolute = (m_timing_unit == timing_type::e_milli) ? Log_clock::To_ms(ticks) : Log_clock::To_us(ticks);
+
+   std::lock_guard<std::mutex> shard_lock(shard.Mutex());
+   if (shard.Is_open())
+   {
+      shard.Write(std::max(0.0, absolute), rec);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Start_shared(const char *channel, std::size_t ring_bytes, std::string *error)
+{
+   if (m_format != output_format::e_text)
+   {
+      if (error)
+         *error = "shared-memory mode needs the text format";
+      return false;
+   }
+
+   if (m_shared.load(std::memory_order_acquire))
+      return true;
+
+   std::unique_ptr<Log_shm_ring> ring(new Log_shm_ring);
+   if (!ring->Create(channel, ring_bytes, error))
+      return false;
+
+   Stop_async();
+   Stop_sharded();
+
+   {
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Flush_file();
+      Write_note(("Debugfile: records go to shared-memory channel " + std::string(channel) + 
+                  " (" + ring->Name() + ")").c_str());
+   }
+
+   m_rings.push_back(std::move(ring));
+   m_ring.store(m_rings.back().get(), std::memory_order_release);
+   m_shared.store(true, std::memory_order_release);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_shared()
+{
+   if (!m_shared.exchange(false, std::memory_order_acq_rel))
+      return;
+
+   // Only marked closed: threads that saw m_shared may still be writing to it
+   m_ring.load(std::memory_order_acquire)->Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_to_ring(const Log_record &rec)
+{
+   if (!m_ring.load(std::memory_order_acquire)->Try_write(rec))
+   {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      if (m_metrics_on.load(std::memory_order_relaxed))
+         m_metrics.Add(Log_metrics::counter::e_dropped);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Start_collector(const char *channel, std::chrono::milliseconds hold, std::string *error)
+{
+   if (m_format != output_format::e_text)
+   {
+      if (error)
+         *error = "collecting needs the text format";
+      return false;
+   }
+
+   if (m_collector_thread.joinable())
+      return true;
+
+   std::unique_ptr<Log_collector> collector(new Log_collector);
+   if (!collector->Open(channel, error))
+      return false;
+
+   {
+      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Write_note(("Debugfile: collecting shared-memory channel " + std::string(channel)).c_str());
+   }
+
+   m_collector = std::move(collector);
+   m_stop_collector.store(false, std::memory_order_relaxed);
+   m_collector_thread = std::thread(&Debugfile::Collector_loop, this, hold);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_collector()
+{
+   if (m_collector_thread.joinable())
+   {
+      {
+         std::lock_guard<std::mutex> collector_lock(m_collector_mutex);
+         m_stop_collector.store(true, std::memory_order_release);
+      }
+      m_collector_wake.notify_one();
+      m_collector_thread.join();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Collector_loop(std::chrono::milliseconds hold)
+{
+   std::chrono::milliseconds poll = std::min(std::max(hold / 4, std::chrono::milliseconds(1)),
+                                             std::chrono::milliseconds(10));
+   std::vector<Log_shm_ring::record> ready;
+
+   std::unique_lock<std::mutex> collector_lock(m_collector_mutex);
+
+   for (;;)
+   {
+      // The last pass hands out everything, held or not
+      bool stopping = m_stop_collector.load(std::memory_order_acquire);
+      m_collector->Poll(ready, stopping ? std::chrono::nanoseconds::zero() : 
+                                          std::chrono::nanoseconds(hold));
+      Write_collected(ready);
+      ready.clear();
+
+      if (stopping)
+         break;
+      m_collector_wake.wait_for(collector_lock, poll);
+   }
+
+   m_collector->Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Write_collected(std::vector<Log_shm_ring::record> &records)
+{
+   if (records.empty())
+      return;
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   if (!m_is_open || !m_debug_on)
+      return;
+
+   Log_record rec;
+   for (Log_shm_ring::record &r : records)
+   {
+      rec.m_ticks = Log_clock::From_steady_ns(r.m_steady_ns);
+      rec.m_process = r.m_pid;
+      rec.m_thread = r.m_thread;
+      rec.m_thread_name = r.m_thread_name.empty() ? nullptr : r.m_thread_name.c_str();
+      rec.m_indent = r.m_indent;
+      rec.m_depth = r.m_depth;
+      rec.m_text.swap(r.m_text);
+      Write_record(rec);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Debugfile::Start_flight_recorder(std::size_t records_per_thread)
+{
+   if (m_format != output_format::e_text)
+      return false;
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   Open_file();
+   Flight_recorder::Start(&Debugfile::Emergency_output, this, records_per_thread, 
+                          m_timing_unit == timing_type::e_milli);
+   m_flight.store(true, std::memory_order_release);
+   Update_threshold();
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Stop_flight_recorder()
+{
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+
+   if (m_flight.exchange(false, std::memory_order_acq_rel))
+   {
+      Flight_recorder::Stop();
+      Update_threshold();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Debugfile::Dump_flight_recorder()
+{
+   if (!m_flight.load(std::memory_order_acquire))
+      return;
+
+   Drain();
+
+   std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+   Flush_file();
+   m_flight_dumping = true;
+   Flight_recorder::Dump();
+   m_flight_dumping = false;
+}
+
+// ------------------------------------------------------------------------------------------------
+template <typename Fn>
+void Debugfile::For_each_shard(Fn&& fn)
+{
+   std::lock_guard<std::mutex> shards_lock(m_shards_mutex);
+
+   for (const std::unique_ptr<Log_shard> &shard : m_shards)
+   {
+      std::lock_guard<std::mutex> shard_lock(shard->Mutex());
+      fn(*shard);
+   }
+}
@@ -4,13 +4,36 @@
 
 #define DEBUGFILE_H_
 
-#include <fstream>
+#include "Binary_log.h"
+#include "File_sink.h"
+#include "Line_formatter.h"
+#include "Log_collector.h"
+#include "Log_call_site.h"
+#include "Log_compressor.h"
+#include "Log_index.h"
+#include "Log_format.h"
+#include "Log_metrics.h"
+#include "Log_range.h"
+#include "Log_record.h"
+#include "Log_queue.h"
+#include "Log_timestamp.h"
+#include "Mmap_sink.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <iomanip>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-class Simple_timer;
+class Log_shard;
 
 class Debugfile
 {
@@ -28,9 +51,37 @@ public:
       e_micro
    };
 
+   /// What the first column measures (see Log_timestamp::mode)
+   typedef Log_timestamp::mode timestamp_mode;
+
+   /// How rotated segments are compressed (see Log_compression)
+   typedef Log_compression::format compression_format;
+
+   enum class output_format : int
+   {
+      e_text,        ///< Formatted columns, as described by Write_header
+      e_binary       ///< Raw arguments (see Binary_log), rendered offline by Debuglog_decode
+   };
+
+   enum class flush_policy : int
+   {
+      e_every_line,  ///< Flush after each complete line (the historical std::endl behaviour)
+      e_bytes,       ///< Flush once at least N bytes are buffered
+      e_interval,    ///< Flush every N milliseconds from a background timer thread
+      e_explicit     ///< Flush only on Flush(), Reset(), close, or when the buffer fills
+   };
+
+   enum class overflow_policy : int
+   {
+      e_block,       ///< Producer yields until the writer thread frees a slot
+      e_drop,        ///< Record is discarded and counted; the count is logged by the writer
+      e_grow         ///< Record goes to an unbounded overflow list drained after the ring
+   };
+
    explicit Debugfile(const char *filename, 
                       bool open_now = true, 
-                      Debugfile::timing_type t_unit = Debugfile::timing_type::e_micro);
+                      Debugfile::timing_type t_unit = Debugfile::timing_type::e_micro,
+                      Debugfile::output_format format = Debugfile::output_format::e_text);
 
    ~Debugfile();
 
@@ -44,86 +95,221 @@ public:
 
    // ---------------------------------------------------------------------------------------------
    /// @brief     Write a description and value to file, with timestamp and optional newline.
+   ///            @p site is the call site of a G_LOG_* macro whose text is not the site's
+   ///            description; it only puts the line in the index (text format).
    /// @author    Tanaya Mankad 11/06/02, 11/30/03
    // ---------------------------------------------------------------------------------------------
    template <typename T>
    void Write(const char *description, const T& value, 
-              newline_type nl = newline_type::e_write_newline)
+              newline_type nl = newline_type::e_write_newline, const Log_call_site *site = nullptr)
    {
-      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      if (Is_capturing())
+      {
+         if (m_format == output_format::e_binary)
+         {
+            Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_value,
+                                       description, value);
+         }
+         else
+         {
+            Begin_message() << description << " " << value;
+         }
+         Submit(nl, Indexed(site));
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Write a description and boolean value to file as "true"/"false".
+   // ---------------------------------------------------------------------------------------------
+   void Write(const char *description, bool value, 
+              newline_type nl = newline_type::e_write_newline, const Log_call_site *site = nullptr);
 
-      if (m_debug_on)
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Template overload to write a description and vector to file.
+   /// @author    Tanaya Mankad 10/28/2015
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   void Write(const char *description, const std::vector<T>& vec, 
+              newline_type nl = newline_type::e_write_newline, const Log_call_site *site = nullptr)
+   {
+      if (Is_capturing())
       {
-         if (m_newline)
+         if (m_format == output_format::e_binary)
+         {
+            Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_vector,
+                                       description, vec);
+         }
+         else
          {
-            Write_timestamp();
-            Write_thread_ID();
-            m_bugfile << std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ';
+            Format_vector(description, vec);
          }
-         m_bugfile << description << " " << value;
-         Write_endline(nl);
+         Submit(nl, Indexed(site));
       }
    }
 
-   template <>
-   void Write<bool>(const char *description, const bool& value, 
-                    newline_type nl)
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Call-site overloads used by the G_LOG_* macros. In binary mode only the site id
+   ///            and the raw value are recorded; in text mode they write what the overloads above
+   ///            write with the site's description, and the site goes to the index, if any.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   void Write(const Log_call_site &site, const T& value, 
+              newline_type nl = newline_type::e_write_newline)
    {
-      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      if (Is_capturing())
+      {
+         if (m_format == output_format::e_binary)
+         {
+            Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_value, 
+                                       nullptr, value);
+         }
+         else
+         {
+            Begin_message() << site.m_description << " " << value;
+         }
+         Submit(nl, &site);
+      }
+   }
 
-      if (m_debug_on)
+   template <typename T>
+   void Write(const Log_call_site &site, const std::vector<T>& vec, 
+              newline_type nl = newline_type::e_write_newline)
+   {
+      if (Is_capturing())
       {
-         if (m_newline)
+         if (m_format == output_format::e_binary)
          {
-            Write_timestamp();
-            Write_thread_ID();
-            m_bugfile << std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ';
+            Binary_log::Encode_payload(Begin_binary(), Binary_log::layout_type::e_vector,
+                                       nullptr, vec);
          }
-         m_bugfile << " " << description << " " << (value ? "true" : "false");
-         Write_endline(nl);
+         else
+         {
+            Format_vector(site.m_description, vec);
+         }
+         Submit(nl, &site);
       }
    }
 
+   void Write(const Log_call_site &site, bool value, 
+              newline_type nl = newline_type::e_write_newline);
+
    // ---------------------------------------------------------------------------------------------
-   /// @brief     Template overload to write a description and vector to file.
-   /// @author    Tanaya Mankad 10/28/2015
+   /// @brief     Writes "description = " and a contiguous range of arithmetic values (a pointer and
+   ///            count, or anything std::data() and std::size() accept: vector, array, C array).
+   ///            Large ranges are formatted in bulk before the file lock is taken; @p opt can cut
+   ///            them to their first and last elements, switch to hex, or write only count, min,
+   ///            max and mean (see Log_range). In binary format the kept elements are copied in
+   ///            one block and formatted by Debuglog_decode. Ends the line.
    // ---------------------------------------------------------------------------------------------
    template <typename T>
-   void Write(const char *description, const std::vector<T>& vec, 
-              newline_type nl = newline_type::e_write_newline)
+   void Write_range(const char *description, const T *data, std::size_t count,
+                    Log_range::options opt = Log_range::options())
+   {
+      if (Is_capturing())
+      {
+         if (m_format == output_format::e_binary)
+         {
+            Binary_log::Encode_range(Begin_binary(), description, data, count, opt);
+         }
+         else
+         {
+            Format_range(description, data, count, opt);
+         }
+         Submit(newline_type::e_write_newline);
+      }
+   }
+
+   template <typename Range>
+   void Write_range(const char *description, const Range &range, 
+                    Log_range::options opt = Log_range::options())
    {
-      std::lock_guard<std::mutex> file_lock(m_logger_mutex);
+      Write_range(description, std::data(range), std::size(range), opt);
+   }
 
-      if (m_debug_on)
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Call-site overloads of Write_range() used by the G_LOG_RANGE macros.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   void Write_range(const Log_call_site &site, const T *data, std::size_t count,
+                    Log_range::options opt = Log_range::options())
+   {
+      if (Is_capturing())
       {
-         if (m_newline)
+         if (m_format == output_format::e_binary)
          {
-            Write_timestamp();
-            Write_thread_ID();
-            m_bugfile << std::right << std::setw(static_cast<std::streamsize>(m_indent)) << ' ';
+            Binary_log::Encode_range(Begin_binary(), nullptr, data, count, opt);
          }
-         m_bugfile << description << " = ";
-         for (auto i = vec.begin(); i != vec.end(); ++i)
+         else
          {
-            m_bugfile << *i;
-            if (i < vec.end() - 1)
-               m_bugfile << ", ";
+            Format_range(site.m_description, data, count, opt);
          }
-         Write_endline(nl);
+         Submit(newline_type::e_write_newline, &site);
       }
    }
 
+   template <typename Range>
+   void Write_range(const Log_call_site &site, const Range &range, 
+                    Log_range::options opt = Log_range::options())
+   {
+      Write_range(site, std::data(range), std::size(range), opt);
+   }
+
    // ---------------------------------------------------------------------------------------------
    /// @brief     Write a pointer to file
    /// @author    Tanaya Mankad
    // ---------------------------------------------------------------------------------------------
-   void Write(const char *description, const void* value, newline_type nl);
+   void Write(const char *description, const void* value, newline_type nl,
+              const Log_call_site *site = nullptr);
 
    // ---------------------------------------------------------------------------------------------
    /// @brief     Write a user-supplied string to file, with timestamp and optional newline.
    /// @author    Tanaya Mankad 11/06/02, 11/30/03
    // ---------------------------------------------------------------------------------------------
-   void Write(const char *str, newline_type nl = newline_type::e_write_newline);
+   void Write(const char *str, newline_type nl = newline_type::e_write_newline,
+              const Log_call_site *site = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes @p format with each "{}" replaced by the next argument (see Log_format),
+   ///            formatted straight into the record: no stream and, in steady state, no heap
+   ///            allocation. In binary format the format and the raw arguments are recorded and
+   ///            substituted by Debuglog_decode. Ends the line.
+   // ---------------------------------------------------------------------------------------------
+   template <typename... Args>
+   void Write_format(std::string_view format, const Args&... args)
+   {
+      if (Is_capturing())
+      {
+         if (m_format == output_format::e_binary)
+            Binary_log::Encode_format(Begin_binary(), format.data(), format.size(), args...);
+         else
+            Log_format::Format(Begin_text(), format, args...);
+         Submit(newline_type::e_write_newline);
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Call-site overload used by the G_LOG_FMT macros: the site's description is the
+   ///            format, so the binary record holds only the site id and the arguments.
+   // ---------------------------------------------------------------------------------------------
+   template <typename... Args>
+   void Write_format(const Log_call_site &site, const Args&... args)
+   {
+      if (Is_capturing())
+      {
+         if (m_format == output_format::e_binary)
+            Binary_log::Encode_format(Begin_binary(), nullptr, 0, args...);
+         else
+            Log_format::Format(Begin_text(), site.m_description, args...);
+         Submit(newline_type::e_write_newline, &site);
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Used by the sampling macros: @p count records were skipped at the statement the
+   ///            calling thread writes next. That record carries " [<count> suppressed]" (in
+   ///            binary format, a separate message just before it).
+   // ---------------------------------------------------------------------------------------------
+   static void Note_suppressed(std::uint64_t count);
 
    // ---------------------------------------------------------------------------------------------
    /// @return    @e true if debugging is turned on, @e false otherwise
@@ -131,6 +317,23 @@ public:
    // ---------------------------------------------------------------------------------------------
    bool Is_activated() const { return m_debug_on; }
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Lowest severity written by the levelled G_LOG_*_AT macros. Calls below it are
+   ///            rejected by Is_enabled() before their arguments are evaluated. Default e_trace.
+   // ---------------------------------------------------------------------------------------------
+   void Set_level(log_level level);
+
+   log_level Level() const { return m_level; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if a statement of @p level would be written: logging is on and the level
+   ///            is at or above Set_level(). One relaxed atomic load, no lock.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_enabled(log_level level) const
+   {
+      return static_cast<int>(level) >= m_threshold.load(std::memory_order_relaxed);
+   }
+
    // ---------------------------------------------------------------------------------------------
    /// @brief     Close the existing stream and re-open for writing (not appending)
    /// @author    Tanaya Mankad 01/07/16
@@ -138,15 +341,309 @@ public:
    void Reset();
 
    // ---------------------------------------------------------------------------------------------
-   /// @brief     Indent or de-indent the log message
+   /// @brief     Indent or de-indent the calling thread's log messages. Indentation is kept per
+   ///            thread, so threads do not disturb each other's nesting.
    /// @author    Tanaya Mankad 04/07/22
    // ---------------------------------------------------------------------------------------------
    void Modify_indentation(const int spaces);
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Function scope entry/exit for Logger_helper: one level of call depth plus
+   ///            @p spaces of indentation on the calling thread.
+   // ---------------------------------------------------------------------------------------------
+   void Enter_scope(const int spaces);
+   void Leave_scope(const int spaces);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of Logger_helper scopes open on the calling thread.
+   // ---------------------------------------------------------------------------------------------
+   static int Call_depth();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds a "Depth" column (the writer's call depth) after Thread_ID, so tools can
+   ///            rebuild per-thread call trees. Takes effect when the file is next opened, i.e.
+   ///            call it before opening or follow it with Reset().
+   // ---------------------------------------------------------------------------------------------
+   void Show_depth(bool turn_on) { m_show_depth_requested = turn_on; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Names the calling thread (see Log_thread), e.g. "io-worker-3". The Thread_ID
+   ///            column shows small sequential numbers; the file records which number has which
+   ///            name once, here and in the header of every file opened later.
+   // ---------------------------------------------------------------------------------------------
+   void Set_thread_name(const char *name);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Shows a named thread's name instead of its number in the Thread_ID column (names
+   ///            longer than the column push the line out). Takes effect when the file is next
+   ///            opened, like Show_depth().
+   // ---------------------------------------------------------------------------------------------
+   void Show_thread_names(bool turn_on) { m_show_thread_names_requested = turn_on; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Chooses the first column: time since the previous line of any thread (the
+   ///            default), since the previous line of the same thread, or since the file was
+   ///            opened. Records always carry their absolute time; this only changes how it is
+   ///            rendered. Takes effect when the file is next opened, like Show_depth().
+   // ---------------------------------------------------------------------------------------------
+   void Set_timestamp_mode(timestamp_mode mode) { m_timestamp_mode_requested = mode; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Chooses when buffered output reaches the OS. Independently of the policy, data
+   ///            is flushed by Flush(), Reset(), the destructor, a full buffer, and (through
+   ///            File_sink) SIGSEGV/SIGBUS/SIGILL/SIGFPE/SIGABRT.
+   /// @param     threshold   Bytes for e_bytes, milliseconds for e_interval; ignored otherwise
+   // ---------------------------------------------------------------------------------------------
+   void Set_flush_policy(flush_policy policy, std::size_t threshold = 0);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Size of the user-space output buffer (64 KiB by default).
+   // ---------------------------------------------------------------------------------------------
+   void Set_buffer_size(std::size_t bytes);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes through memory-mapped, preallocated segments of @p segment_bytes (see
+   ///            Mmap_sink) instead of the buffered file. When a segment fills, the file is
+   ///            renamed to "<filename>.1" and so on, and at most @p keep_segments files are kept,
+   ///            which bounds the disk space a long run can use. Every segment starts with the
+   ///            column heading. Opening, and so Reset(), also rotates instead of truncating.
+   ///            Text format only; takes effect when the file is next opened, like Show_depth().
+   ///            0 bytes returns to the buffered file. Falls back to it if mapping fails. A flight
+   ///            recorder dump on a crash only gets the space left in the current segment, and
+   ///            no index is written (see Set_index()).
+   // ---------------------------------------------------------------------------------------------
+   void Set_segments(std::size_t segment_bytes, int keep_segments = 4);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes a sparse index of the file to "<filename>.idx" (see Log_index): every
+   ///            @p block_bytes of log, the block's offset, time range, and Bloom filters of the
+   ///            threads and call sites in it. tools/Debuglog_query uses it to read only the
+   ///            blocks that can match a time range, thread or call site. Text format only;
+   ///            takes effect when the file is next opened, like Show_depth(). 0 stops indexing.
+   ///            Segments are renamed as they rotate, so no index is written with Set_segments():
+   ///            this fails if segments are already set, and if they are set afterwards, opening
+   ///            the file writes a note line instead of the index.
+   /// @return    @e false, with the reason in @p error, if segments are set.
+   // ---------------------------------------------------------------------------------------------
+   bool Set_index(std::size_t block_bytes = 64 * 1024, std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Compresses rotated segments, and the file left by closing or Reset(), on a
+   ///            low-priority background thread that uses at most @p cpu_percent of one core (see
+   ///            Log_compressor). "<filename>.N" is replaced by "<filename>.N.zst" (or .lz4, .dlz).
+   ///            Only applies to Set_segments() output; Log_compression::Reader reads the files.
+   /// @return    @e false in binary format.
+   // ---------------------------------------------------------------------------------------------
+   bool Start_compression(compression_format format = Log_compression::Best_available(), 
+                          int cpu_percent = 25);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Finishes the files already handed over and stops the compression thread.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_compression();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of segment rotations since construction.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Rotations() const { return m_mapped.Rotations(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes everything logged so far (including queued async records) to the file.
+   // ---------------------------------------------------------------------------------------------
+   void Flush();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of write system calls made on the log file so far.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Write_calls() const { return m_sink.Write_calls(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Switches to asynchronous writing. Write() then only formats the message and
+   ///            pushes it onto a bounded lock-free queue; a dedicated writer thread renders the
+   ///            timestamp/thread/indent columns and writes to the file.
+   /// @param     queue_capacity  Number of queued records (rounded up to a power of two)
+   /// @param     policy          What a producer does when the queue is full
+   // ---------------------------------------------------------------------------------------------
+   void Start_async(std::size_t queue_capacity = 8192, 
+                    overflow_policy policy = overflow_policy::e_block);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Drains the queue, joins the writer thread and returns to synchronous writing.
+   ///            Call when no other thread is still writing.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_async();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Blocks until every record queued so far has been written to the file.
+   // ---------------------------------------------------------------------------------------------
+   void Drain();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     When on, G_LOG_FUNCTION records fixed-size entry/exit events in per-thread rings
+   ///            (see Trace_recorder) instead of writing "Entering"/"Returning" lines.
+   // ---------------------------------------------------------------------------------------------
+   void Trace_functions(bool turn_on) { m_trace_functions.store(turn_on, std::memory_order_relaxed); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if logging is on and function scopes are recorded as trace events.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_tracing_functions() const
+   {
+      return m_trace_functions.load(std::memory_order_relaxed) && m_debug_on.load(std::memory_order_relaxed);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Exports recorded function events as Chrome Trace Event JSON (chrome://tracing,
+   ///            Perfetto).
+   // ---------------------------------------------------------------------------------------------
+   bool Write_trace(const char *path) const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     When on, G_LOG_FUNCTION adds its call to an in-process call-tree profile (see
+   ///            Log_profile) instead of writing "Entering"/"Returning" lines. Function tracing
+   ///            takes precedence.
+   // ---------------------------------------------------------------------------------------------
+   void Profile_functions(bool turn_on) { m_profile_functions.store(turn_on, std::memory_order_relaxed); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if logging is on and function scopes are profiled.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_profiling_functions() const
+   {
+      return m_profile_functions.load(std::memory_order_relaxed) && m_debug_on.load(std::memory_order_relaxed);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes the calls profiled so far on all threads: folded stacks for flame graphs
+   ///            to @p folded_path (unless nullptr), and the @p top functions and call paths to
+   ///            this file as "Debugfile: " lines.
+   /// @return    @e false if @p folded_path cannot be written.
+   // ---------------------------------------------------------------------------------------------
+   bool Write_profile(const char *folded_path, std::size_t top = 20);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Gives every writing thread its own buffer and file, "<filename>.<thread id>", so
+   ///            that writers share no lock and no cache line. Shards carry absolute times and
+   ///            are combined into the usual single-file layout by tools/Debuglog_merge.
+   ///            Text format only; stops async mode if it is running.
+   /// @return    @e false in binary format.
+   // ---------------------------------------------------------------------------------------------
+   bool Start_sharded();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Flushes and closes all shards and returns to writing the main file.
+   ///            Call when no other thread is still writing.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_sharded();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Sends this process's records to a ring of @p ring_bytes in shared memory
+   ///            instead of the file (see Log_shm_ring), for the collector of @p channel to merge
+   ///            with those of other processes into one log: tools/Debuglog_collect, or a Debugfile
+   ///            in another process that called Start_collector(). Writers never wait for the
+   ///            collector; a record that finds the ring full is dropped and counted. Each record
+   ///            becomes a line of its own. Text format only; stops async and sharded mode.
+   /// @return    @e false in binary format or if the ring cannot be created (see @p error).
+   // ---------------------------------------------------------------------------------------------
+   bool Start_shared(const char *channel, std::size_t ring_bytes = 4 << 20, std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Closes the ring, which the collector removes once it has read it, and returns
+   ///            to writing the file. Records that other threads are still sending to the ring
+   ///            are dropped and counted; the ring stays mapped until destruction.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_shared();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Makes this logger the collector of @p channel: a thread reads every process's
+   ///            ring and writes the records into this file, merged by time. A record is written
+   ///            once it is @p hold old, so that records of other processes stamped earlier can
+   ///            still go before it. The thread column shows "<pid>.<thread>". To merge this
+   ///            process's own records too, also call Start_shared(). Text format only.
+   /// @return    @e false in binary format or if the channel cannot be opened (see @p error).
+   // ---------------------------------------------------------------------------------------------
+   bool Start_collector(const char *channel, std::chrono::milliseconds hold = std::chrono::milliseconds(50),
+                        std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes out everything read so far and stops the collector thread.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_collector();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Keeps the last @p records_per_thread records of every thread in memory (see
+   ///            Flight_recorder), also while writing is turned off. The rings are dumped into
+   ///            this file on a fatal signal, on std::terminate, or by Dump_flight_recorder().
+   ///            Opens the file if it is not open yet. Text format only.
+   /// @return    @e false in binary format.
+   // ---------------------------------------------------------------------------------------------
+   bool Start_flight_recorder(std::size_t records_per_thread = 1024);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Stops recording; a crash no longer dumps anything.
+   // ---------------------------------------------------------------------------------------------
+   void Stop_flight_recorder();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends the flight recorder's rings to the file, merged by time.
+   // ---------------------------------------------------------------------------------------------
+   void Dump_flight_recorder();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of records discarded under overflow_policy::e_drop, or because the
+   ///            shared-memory ring was full, since construction.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Dropped_records() const { return m_dropped.load(std::memory_order_relaxed); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Keeps counters and duration histograms about the logger itself (see
+   ///            Log_metrics): records and bytes, write latency, waits for the file lock and the
+   ///            async queue, flushes, and dropped, spilled and suppressed records. Costs one
+   ///            more clock read and a few uncontended atomic adds per record. Off by default.
+   // ---------------------------------------------------------------------------------------------
+   void Collect_metrics(bool turn_on) { m_metrics_on.store(turn_on, std::memory_order_relaxed); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Totals collected so far.
+   // ---------------------------------------------------------------------------------------------
+   Log_metrics::snapshot Metrics() const { return m_metrics.Snapshot(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes a "Debugfile: metrics ..." line covering each @p interval, and turns on
+   ///            Collect_metrics(). The line is written by the first record after the interval
+   ///            ends, so an idle logger writes none. 0 stops the lines.
+   // ---------------------------------------------------------------------------------------------
+   void Set_metrics_summary(std::chrono::milliseconds interval);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes one "Debugfile: latency <name>: ..." line per G_LOG_TIMED_SCOPE name
+   ///            (see Log_latency), covering what was timed since the previous summary.
+   // ---------------------------------------------------------------------------------------------
+   void Write_latency_summary();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Calls Write_latency_summary() every @p interval, from the first timed scope that
+   ///            ends after it; 0 stops. One logger at a time can do this.
+   // ---------------------------------------------------------------------------------------------
+   void Set_latency_summary(std::chrono::milliseconds interval);
+
 private:
 
    // Internal utility functions
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Whether Write() should format at all: the file or the flight recorder wants it.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_capturing() const
+   {
+      return m_debug_on.load(std::memory_order_relaxed) || m_flight.load(std::memory_order_relaxed);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Recomputes m_threshold from m_level, m_debug_on and m_flight (file lock held).
+   // ---------------------------------------------------------------------------------------------
+   void Update_threshold();
+
    // ---------------------------------------------------------------------------------------------
    /// @brief     Checks if file is already open, or opens for writing. fstream::open() will
    ///            only fail if the path does not exist (file not found), or if the object
@@ -168,17 +665,22 @@ private:
    void Write_systemtime();
 
    // ---------------------------------------------------------------------------------------------
-   /// @brief     Writes a new line character and flushes the character buffer using std::endl) If 
-   ///            there is no end of line, the next item written will not have a time stamp.
+   /// @brief     Writes a new line character and applies the flush policy. If there is no end
+   ///            of line, the next item written will not have a time stamp.
    /// @author    Tanaya Mankad 11/13/02
    // ---------------------------------------------------------------------------------------------
    void Write_endline(newline_type newline);
 
    // ---------------------------------------------------------------------------------------------
-   /// @brief     Writes the time in milliseconds to the file.
+   /// @brief     Write_endline() for a line whose newline character is already written.
+   // ---------------------------------------------------------------------------------------------
+   void End_line(newline_type newline);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Renders the elapsed time column into the current line.
    /// @author    Tanaya Mankad 11/06/02
    // ---------------------------------------------------------------------------------------------
-   void Write_timestamp();
+   void Write_timestamp(const Log_record &rec);
 
    // ---------------------------------------------------------------------------------------------
    /// @brief     Writes the time in milliseconds to the file.
@@ -186,20 +688,269 @@ private:
    // ---------------------------------------------------------------------------------------------
    void Write_header();
 
-   void Write_thread_ID();
+   // ---------------------------------------------------------------------------------------------
+   /// @return    The column heading line written by Write_header(), without a newline.
+   // ---------------------------------------------------------------------------------------------
+   std::string Heading() const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Renders the thread id column into the current line: the writer's compact id, or
+   ///            its name with Show_thread_names(), after "<pid>." for collected records.
+   // ---------------------------------------------------------------------------------------------
+   void Write_thread_ID(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    The text of @p rec's thread id column, unpadded.
+   // ---------------------------------------------------------------------------------------------
+   std::string Thread_label(const Log_record &rec) const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Enters a record that starts at the current end of the file in the index.
+   ///            Caller holds m_logger_mutex.
+   // ---------------------------------------------------------------------------------------------
+   void Index_record(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Records that thread @p id is called @p name (a line, or a binary frame). Caller
+   ///            holds m_logger_mutex.
+   // ---------------------------------------------------------------------------------------------
+   void Write_thread_name(std::uint32_t id, const char *name);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Clears and returns the calling thread's message stream. The text ends up in the
+   ///            thread's staged record, which Submit() then hands to the writer.
+   // ---------------------------------------------------------------------------------------------
+   static std::ostream& Begin_message();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Binary-mode counterpart of Begin_message(): clears and returns the staged
+   ///            record's payload buffer.
+   // ---------------------------------------------------------------------------------------------
+   static std::string& Begin_binary();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Clears and returns the staged record's text, for formatting without the stream.
+   // ---------------------------------------------------------------------------------------------
+   static std::string& Begin_text();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Text format of Write(description, vector) and Write_range() into the staged
+   ///            record, shared by their call-site overloads.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Format_vector(const char *description, const std::vector<T>& vec)
+   {
+      if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                    !std::is_same<T, long double>::value)
+      {
+         // Same text as operator<<, formatted in bulk
+         std::string &text = Begin_text();
+         text.append(description).append(" = ");
+         Log_range::Append(text, vec.data(), vec.size());
+      }
+      else
+      {
+         std::ostream &os = Begin_message();
+         os << description << " = ";
+         for (auto i = vec.begin(); i != vec.end(); ++i)
+         {
+            if (i != vec.begin())
+               os << ", ";
+            os << *i;
+         }
+      }
+   }
+
+   template <typename T>
+   static void Format_range(const char *description, const T *data, std::size_t count,
+                            Log_range::options opt)
+   {
+      std::string &text = Begin_text();
+      text.append(description).append(" = ");
+      Log_range::Append(text, data, count, opt);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Stamps the staged record and either writes it (synchronous mode, under the
+   ///            logger mutex) or queues it for the writer thread.
+   // ---------------------------------------------------------------------------------------------
+   void Submit(newline_type nl, const Log_call_site *site = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     @p site for a record whose text is given inline: kept for the text index, but
+   ///            dropped in binary format, where a record with a site takes its description from
+   ///            the site.
+   // ---------------------------------------------------------------------------------------------
+   const Log_call_site* Indexed(const Log_call_site *site) const
+   {
+      return (m_format == output_format::e_binary) ? nullptr : site;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Hands a stamped record to the flight recorder and to the active writing mode.
+   // ---------------------------------------------------------------------------------------------
+   void Dispatch(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds the count from Note_suppressed() to @p rec, or dispatches it as its own
+   ///            message in binary format.
+   // ---------------------------------------------------------------------------------------------
+   void Report_suppressed(Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Metrics of one submitted record that was stamped at @p start, and the periodic
+   ///            summary when it is due.
+   // ---------------------------------------------------------------------------------------------
+   void Measure_write(std::uint64_t start, std::size_t bytes);
+   void Write_metrics_summary(std::uint64_t now);
+
+   static void Report_latency(void *self);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Takes the file lock, timing the wait if it is contended and metrics are on.
+   // ---------------------------------------------------------------------------------------------
+   void Lock_file(std::unique_lock<std::mutex> &file_lock);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Flushes the output buffer, timed if metrics are on. Caller holds m_logger_mutex.
+   // ---------------------------------------------------------------------------------------------
+   void Flush_file();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Renders one record to the file. Caller holds m_logger_mutex.
+   // ---------------------------------------------------------------------------------------------
+   void Write_record(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes a message generated by the logger itself. Caller holds m_logger_mutex.
+   // ---------------------------------------------------------------------------------------------
+   void Write_note(const char *text);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Flight_recorder's dump writer: the open sink's Emergency_write(), or a rotating
+   ///            Mmap_sink::Write() during Dump_flight_recorder().
+   // ---------------------------------------------------------------------------------------------
+   static void Emergency_output(void *self, const char *data, std::size_t length);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Pushes a record according to m_overflow.
+   // ---------------------------------------------------------------------------------------------
+   void Enqueue(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer thread body, and one pass over the ring and the overflow list.
+   /// @return    Number of records written by the pass.
+   // ---------------------------------------------------------------------------------------------
+   void Writer_loop();
+   std::size_t Write_pending();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Timer thread body for flush_policy::e_interval, and its shutdown.
+   // ---------------------------------------------------------------------------------------------
+   void Flusher_loop(std::chrono::milliseconds interval);
+   void Stop_flusher();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Sharded mode: the calling thread's shard (created on first use), and running a
+   ///            function on every shard under its lock.
+   // ---------------------------------------------------------------------------------------------
+   Log_shard& Thread_shard();
+   void Write_to_shard(const Log_record &rec);
+   template <typename Fn> void For_each_shard(Fn&& fn);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Shared-memory mode: sending a record to the ring, and the collector thread's body
+   ///            and its writing of one batch of merged records.
+   // ---------------------------------------------------------------------------------------------
+   void Write_to_ring(const Log_record &rec);
+   void Collector_loop(std::chrono::milliseconds hold);
+   void Write_collected(std::vector<Log_shm_ring::record> &records);
 
 private:
 
    std::string       m_filename;
-   std::ofstream     m_bugfile;
-   bool              m_debug_on;
+   File_sink         m_sink;
+   Mmap_sink         m_mapped;            ///< Used instead of m_sink when segments are set
+   Log_compressor    m_compressor;        ///< Stopped before m_mapped is destroyed
+   std::ostream      m_bugfile;
+   std::atomic<bool> m_debug_on;
+   log_level         m_level{log_level::e_trace};
+   std::atomic<int>  m_threshold;         ///< m_level while capturing, e_off otherwise
+   std::atomic<bool> m_flight{false};     ///< Flight recorder running
+   bool              m_flight_dumping{false};   ///< In Dump_flight_recorder(), not a crash
    bool              m_is_open;
    bool              m_newline;
-   Simple_timer      *m_timer;
    std::mutex        m_logger_mutex;
    const int         m_padding;
-   int               m_indent;
+   int               m_indent;            ///< Base indentation; per-thread nesting is added to it
+   bool              m_show_depth_requested{false};
+   bool              m_show_depth{false};
+   const int         m_depth_width{6};
+   bool              m_show_thread_names_requested{false};
+   bool              m_show_thread_names{false};
    timing_type       m_timing_unit;
+   timestamp_mode    m_timestamp_mode_requested{timestamp_mode::e_global_delta};
+   Log_timestamp     m_timestamp;         ///< Render-side state of the time column
+   const output_format m_format;
+   Line_formatter    m_line;              ///< Text mode: line being rendered by Write_record
+   flush_policy      m_flush_policy{flush_policy::e_every_line};
+   std::size_t       m_flush_threshold{0};
+   std::size_t       m_segment_bytes{0};  ///< 0: no segments
+   int               m_keep_segments{4};
+   std::size_t       m_index_bytes{0};    ///< Block size of the index; 0: no index
+   Log_index         m_index;
+   std::uint64_t     m_index_epoch{0};    ///< Log_clock ticks when the file was opened
+
+   // Interval flushing
+   std::thread                m_flush_thread;
+   std::atomic<bool>          m_stop_flusher{false};
+   std::mutex                 m_flusher_mutex;
+   std::condition_variable    m_flusher_wake;
+
+   std::atomic<bool>          m_trace_functions{false};
+   std::atomic<bool>          m_profile_functions{false};
+
+   // Sharded mode
+   std::atomic<bool>          m_sharded{false};
+   std::atomic<std::uint64_t> m_shard_generation{0};   ///< Invalidates threads' cached shard
+   std::uint64_t     m_shard_epoch{0};   ///< Log_clock ticks
+   std::mutex                 m_shards_mutex;
+   std::vector<std::unique_ptr<Log_shard>> m_shards;   ///< Closed shards are kept, not freed
+   std::vector<bool> m_sites_written;     ///< Binary mode: sites already defined in this file
+
+   // Shared-memory mode, as producer and as collector
+   std::atomic<bool>          m_shared{false};
+   std::atomic<Log_shm_ring*> m_ring{nullptr};
+   std::vector<std::unique_ptr<Log_shm_ring>> m_rings;   ///< Closed rings are kept, not freed
+   std::unique_ptr<Log_collector> m_collector;
+   std::thread                m_collector_thread;
+   std::atomic<bool>          m_stop_collector{false};
+   std::mutex                 m_collector_mutex;
+   std::condition_variable    m_collector_wake;
+
+   // Asynchronous mode
+   std::unique_ptr<Log_queue<Log_record>> m_queue;
+   std::thread                m_writer_thread;
+   std::atomic<bool>          m_async{false};
+   std::atomic<bool>          m_stop_writer{false};
+   std::atomic<bool>          m_writer_waiting{false};
+   overflow_policy            m_overflow{overflow_policy::e_block};
+   std::atomic<std::uint64_t> m_submitted{0};
+   std::atomic<std::uint64_t> m_written{0};
+   std::atomic<std::uint64_t> m_dropped{0};
+   std::uint64_t              m_dropped_reported{0};
+   std::atomic<bool>          m_spilling{false};
+   std::mutex                 m_spill_mutex;
+   std::vector<Log_record>    m_spill;
+   std::mutex                 m_wake_mutex;
+   std::condition_variable    m_wake;
+
+   // Self-metrics
+   Log_metrics                m_metrics;
+   std::atomic<bool>          m_metrics_on{false};
+   std::atomic<std::uint64_t> m_next_summary{UINT64_MAX};   ///< Log_clock ticks
+   std::int64_t               m_summary_ticks{0};           ///< Interval; 0: no summary lines
+   Log_metrics::snapshot      m_last_summary;
 };
 
 // ================================================================================================
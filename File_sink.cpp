@@ -0,0 +1,300 @@
+/// @file File_sink.cpp
+
+#include "File_sink.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+
+#if defined _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   const std::size_t s_default_buffer_size = 64 * 1024;
+
+   // Open sinks, scanned by the fatal-signal handler. Plain atomics only: no locks in a handler.
+   const int                  s_max_sinks = 64;
+   std::atomic<File_sink*>    s_sinks[s_max_sinks];
+
+#if defined _WIN32
+   const int                  s_fatal_signals[] = { SIGSEGV, SIGILL, SIGFPE, SIGABRT };
+   typedef void (*Handler)(int);
+   Handler                    s_previous[sizeof(s_fatal_signals) / sizeof(s_fatal_signals[0])];
+#else
+   const int                  s_fatal_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+   struct sigaction           s_previous[sizeof(s_fatal_signals) / sizeof(s_fatal_signals[0])];
+#endif
+   const int                  s_fatal_signal_count = sizeof(s_fatal_signals) / sizeof(s_fatal_signals[0]);
+   std::once_flag             s_handlers_installed;
+   std::atomic<void (*)()>    s_fatal_signal_hook{nullptr};
+
+   extern "C" void Fatal_signal_handler(int sig)
+   {
+      File_sink::Emergency_flush_all();
+
+      void (*hook)() = s_fatal_signal_hook.load(std::memory_order_acquire);
+      if (hook)
+      {
+         hook();
+      }
+
+      // Restore whatever was there before and re-raise. The signal is blocked while this
+      // handler runs, so it is delivered again, with the old disposition, once we return.
+      for (int i = 0; i < s_fatal_signal_count; ++i)
+      {
+         if (s_fatal_signals[i] == sig)
+         {
+#if defined _WIN32
+            std::signal(sig, s_previous[i]);
+#else
+            sigaction(sig, &s_previous[i], nullptr);
+#endif
+            break;
+         }
+      }
+      std::raise(sig);
+   }
+
+   void Install_signal_handlers()
+   {
+      for (int i = 0; i < s_fatal_signal_count; ++i)
+      {
+#if defined _WIN32
+         s_previous[i] = std::signal(s_fatal_signals[i], Fatal_signal_handler);
+#else
+         struct sigaction action;
+         std::memset(&action, 0, sizeof(action));
+         action.sa_handler = Fatal_signal_handler;
+         sigemptyset(&action.sa_mask);
+         action.sa_flags = SA_ONSTACK;
+         sigaction(s_fatal_signals[i], &action, &s_previous[i]);
+#endif
+      }
+   }
+
+   void Register(File_sink *sink)
+   {
+      std::call_once(s_handlers_installed, Install_signal_handlers);
+
+      for (int i = 0; i < s_max_sinks; ++i)
+      {
+         File_sink *expected = nullptr;
+         if (s_sinks[i].compare_exchange_strong(expected, sink))
+            return;
+      }
+      // Table full: the sink still works, it is just not flushed on a crash.
+   }
+
+   void Unregister(File_sink *sink)
+   {
+      for (int i = 0; i < s_max_sinks; ++i)
+      {
+         File_sink *expected = sink;
+         if (s_sinks[i].compare_exchange_strong(expected, nullptr))
+            return;
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+File_sink::File_sink()
+   : m_fd(-1)
+   , m_buffer(new char[s_default_buffer_size])
+   , m_capacity(s_default_buffer_size)
+   , m_write_calls(0)
+   , m_flushed(0)
+{
+   setp(m_buffer.get(), m_buffer.get() + m_capacity);
+}
+
+// ------------------------------------------------------------------------------------------------
+File_sink::~File_sink()
+{
+   Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+bool File_sink::Open(const std::string &path, bool binary)
+{
+   Close();
+
+#if defined _WIN32
+   m_fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | (binary ? _O_BINARY : _O_TEXT),
+                _S_IREAD | _S_IWRITE);
+#else
+   (void)binary;
+   m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+
+   setp(m_buffer.get(), m_buffer.get() + m_capacity);
+   m_flushed = 0;
+
+   if (m_fd >= 0)
+   {
+      Register(this);
+   }
+   return m_fd >= 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Close()
+{
+   if (m_fd >= 0)
+   {
+      Flush();
+      Unregister(this);
+#if defined _WIN32
+      _close(m_fd);
+#else
+      ::close(m_fd);
+#endif
+      m_fd = -1;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Set_buffer_size(std::size_t bytes)
+{
+   if (bytes < 1 || bytes == m_capacity)
+      return;
+
+   Flush();
+   m_buffer.reset(new char[bytes]);
+   m_capacity = bytes;
+   setp(m_buffer.get(), m_buffer.get() + m_capacity);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool File_sink::Flush()
+{
+   std::size_t pending = Pending();
+   if (pending == 0)
+      return true;
+
+   bool ok = Write_all(pbase(), pending);
+   setp(m_buffer.get(), m_buffer.get() + m_capacity);
+   return ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Emergency_flush()
+{
+   if (m_fd >= 0)
+   {
+      char *begin = pbase();
+      char *end = pptr();
+      if (begin && end > begin)
+      {
+         Write_all(begin, static_cast<std::size_t>(end - begin));
+         setp(begin, epptr());
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Emergency_write(const char *data, std::size_t length)
+{
+   Emergency_flush();
+   if (m_fd >= 0)
+   {
+      Write_all(data, length);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Set_fatal_signal_hook(void (*hook)())
+{
+   // The hook may be all there is to do on a crash (output through Mmap_sink needs no flush)
+   if (hook)
+   {
+      std::call_once(s_handlers_installed, Install_signal_handlers);
+   }
+   s_fatal_signal_hook.store(hook, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+void File_sink::Emergency_flush_all()
+{
+   for (int i = 0; i < s_max_sinks; ++i)
+   {
+      File_sink *sink = s_sinks[i].load(std::memory_order_acquire);
+      if (sink)
+      {
+         sink->Emergency_flush();
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+File_sink::int_type File_sink::overflow(int_type c)
+{
+   if (!Flush())
+      return traits_type::eof();
+
+   if (!traits_type::eq_int_type(c, traits_type::eof()))
+   {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+   }
+   return traits_type::not_eof(c);
+}
+
+// ------------------------------------------------------------------------------------------------
+std::streamsize File_sink::xsputn(const char_type *s, std::streamsize n)
+{
+   std::size_t length = static_cast<std::size_t>(n);
+
+   if (length > static_cast<std::size_t>(epptr() - pptr()))
+   {
+      if (!Flush())
+         return 0;
+
+      // Larger than the whole buffer: skip the copy
+      if (length >= m_capacity)
+         return Write_all(s, length) ? n : 0;
+   }
+
+   std::memcpy(pptr(), s, length);
+   pbump(static_cast<int>(length));
+   return n;
+}
+
+// ------------------------------------------------------------------------------------------------
+int File_sink::sync()
+{
+   return Flush() ? 0 : -1;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool File_sink::Write_all(const char *data, std::size_t length)
+{
+   if (m_fd < 0)
+      return false;
+
+   while (length > 0)
+   {
+      m_write_calls.fetch_add(1, std::memory_order_relaxed);
+#if defined _WIN32
+      int written = _write(m_fd, data, static_cast<unsigned int>(length));
+#else
+      ssize_t written = ::write(m_fd, data, length);
+      if (written < 0 && errno == EINTR)
+         continue;
+#endif
+      if (written <= 0)
+         return false;
+
+      data += written;
+      length -= static_cast<std::size_t>(written);
+      m_flushed += static_cast<std::uint64_t>(written);
+   }
+   return true;
+}
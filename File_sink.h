@@ -0,0 +1,115 @@
+/// @file File_sink.h
+
+#ifndef FILE_SINK_H_
+#define FILE_SINK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+// ================================================================================================
+/// @brief     Stream buffer over a raw file descriptor with a user-sized buffer. Unlike
+///            std::filebuf, the buffer and descriptor are ours. The owner therefore decides when
+///            data reaches the OS (see Debugfile::flush_policy), and a fatal-signal handler can
+///            write out what is still buffered with nothing but write(2).
+///
+///            Every open sink is registered with a process-wide table. The first Open() installs
+///            handlers for SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT. The handlers flush every
+///            open sink and then re-raise the signal with the previous disposition.
+// ================================================================================================
+class File_sink : public std::streambuf
+{
+public:
+
+   File_sink();
+   ~File_sink() override;
+
+   File_sink(const File_sink&) = delete;
+   File_sink& operator=(const File_sink&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Creates or truncates @p path for writing.
+   /// @param     binary   On Windows, disables newline translation. No effect elsewhere.
+   // ---------------------------------------------------------------------------------------------
+   bool Open(const std::string &path, bool binary = false);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Flushes and closes the descriptor.
+   // ---------------------------------------------------------------------------------------------
+   void Close();
+
+   bool Is_open() const { return m_fd >= 0; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Resizes the user-space buffer (pending data is flushed first).
+   // ---------------------------------------------------------------------------------------------
+   void Set_buffer_size(std::size_t bytes);
+
+   std::size_t Buffer_size() const { return m_capacity; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes all buffered bytes to the descriptor.
+   /// @return    @e false on a write error.
+   // ---------------------------------------------------------------------------------------------
+   bool Flush();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Bytes buffered and not yet written.
+   // ---------------------------------------------------------------------------------------------
+   std::size_t Pending() const { return static_cast<std::size_t>(pptr() - pbase()); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Offset in the file of the next byte written, i.e. bytes written since Open().
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Position() const { return m_flushed + Pending(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of write system calls made since construction.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Write_calls() const { return m_write_calls.load(std::memory_order_relaxed); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Async-signal-safe best-effort flush, for signal handlers only. It takes no lock,
+   ///            so a line being written by an interrupted thread may be cut short.
+   // ---------------------------------------------------------------------------------------------
+   void Emergency_flush();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Emergency_flush(), then writes @p data straight to the descriptor.
+   ///            Async-signal-safe, with the same caveat.
+   // ---------------------------------------------------------------------------------------------
+   void Emergency_write(const char *data, std::size_t length);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Emergency_flush() on every open sink. Async-signal-safe.
+   // ---------------------------------------------------------------------------------------------
+   static void Emergency_flush_all();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Async-signal-safe function the fatal-signal handler calls after flushing the
+   ///            sinks and before re-raising (e.g. Flight_recorder's dump). nullptr removes it.
+   ///            Installs the handlers if no sink has done so yet.
+   // ---------------------------------------------------------------------------------------------
+   static void Set_fatal_signal_hook(void (*hook)());
+
+protected:
+
+   int_type overflow(int_type c) override;
+   std::streamsize xsputn(const char_type *s, std::streamsize n) override;
+   int sync() override;
+
+private:
+
+   bool Write_all(const char *data, std::size_t length);
+
+   int                        m_fd;
+   std::unique_ptr<char[]>    m_buffer;
+   std::size_t                m_capacity;
+   std::atomic<std::uint64_t> m_write_calls;
+   std::uint64_t              m_flushed;      ///< Bytes written to the descriptor since Open()
+};
+
+#endif // FILE_SINK_H_
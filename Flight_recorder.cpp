@@ -0,0 +1,361 @@
+/// @file Flight_recorder.cpp
+
+#include "Flight_recorder.h"
+#include "File_sink.h"
+#include "Log_clock.h"
+#include "Log_record.h"
+#include "Log_timestamp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+   // ---------------------------------------------------------------------------------------------
+   // One recorded line. m_seq is the slot's record index + 1 once the slot is filled, and 0 while
+   // the owner is rewriting it, so a dump can tell a torn slot from a good one.
+   // ---------------------------------------------------------------------------------------------
+   struct alignas(64) Flight_slot
+   {
+      std::atomic<std::uint64_t> m_seq{0};
+      std::uint64_t              m_ticks{0};
+      std::uint64_t              m_thread{0};
+      std::int32_t               m_indent{1};
+      std::uint32_t              m_length{0};     ///< Length of the original text, before truncation
+      char                       m_text[Flight_recorder::s_text_bytes];
+   };
+
+   struct Slot_copy
+   {
+      std::uint64_t              m_ticks;
+      std::uint64_t              m_thread;
+      std::int32_t               m_indent;
+      std::uint32_t              m_length;
+      char                       m_text[Flight_recorder::s_text_bytes];
+   };
+
+   struct Flight_ring
+   {
+      explicit Flight_ring(std::size_t capacity)
+         : m_slots(new Flight_slot[capacity])
+         , m_mask(capacity - 1)
+         , m_head(0)
+         , m_in_use(true)
+      {
+      }
+
+      std::unique_ptr<Flight_slot[]>   m_slots;
+      const std::size_t                m_mask;
+      std::atomic<std::uint64_t>       m_head;
+      std::atomic<bool>                m_in_use;      ///< Claimed by a live thread
+   };
+
+   const std::size_t                s_max_rings = Flight_recorder::s_max_threads;
+
+   std::atomic<Flight_ring*>        s_rings[s_max_rings];       // Never freed: a dump may be reading
+   std::atomic<std::size_t>         s_capacity{1024};
+   std::atomic<void*>               s_target{nullptr};
+   std::atomic<Flight_recorder::writer_type> s_writer{nullptr};
+   std::atomic<bool>                s_is_milli{false};
+   std::atomic<bool>                s_dumping{false};
+   std::atomic<bool>                s_crash_dumped{false};
+   std::once_flag                   s_terminate_installed;
+   std::terminate_handler           s_previous_terminate = nullptr;
+
+   // Dump state. Static rather than on the stack: a crashing thread may be short of stack.
+   std::uint64_t                    s_cursor[s_max_rings];
+   std::uint64_t                    s_end[s_max_rings];
+   bool                             s_has_current[s_max_rings];
+   Slot_copy                        s_current[s_max_rings];
+   char                             s_out[32768];
+   std::size_t                      s_out_length = 0;
+
+   // ---------------------------------------------------------------------------------------------
+   // Adds a ring for the calling thread. Once the table is full, takes over the ring of a thread
+   // that has exited (losing that thread's history). nullptr if every ring is in use.
+   // ---------------------------------------------------------------------------------------------
+   Flight_ring* Claim_ring()
+   {
+      std::size_t capacity = 2;
+      while (capacity < s_capacity.load(std::memory_order_relaxed))
+         capacity <<= 1;
+
+      std::unique_ptr<Flight_ring> ring(new Flight_ring(capacity));
+      for (std::size_t i = 0; i < s_max_rings; ++i)
+      {
+         Flight_ring *expected = nullptr;
+         if (s_rings[i].compare_exchange_strong(expected, ring.get(), std::memory_order_acq_rel))
+            return ring.release();
+      }
+
+      for (std::size_t i = 0; i < s_max_rings; ++i)
+      {
+         Flight_ring *exited = s_rings[i].load(std::memory_order_acquire);
+         bool expected = false;
+         if (exited->m_in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+            return exited;
+      }
+      return nullptr;
+   }
+
+   // Hands the ring back for reuse when its thread exits.
+   struct Ring_owner
+   {
+      ~Ring_owner()
+      {
+         if (m_ring)
+         {
+            m_ring->m_in_use.store(false, std::memory_order_release);
+         }
+      }
+
+      Flight_ring    *m_ring{nullptr};
+      bool           m_claimed{false};
+   };
+
+   Flight_ring* Local_ring()
+   {
+      thread_local Ring_owner owner;
+
+      if (!owner.m_claimed)
+      {
+         owner.m_ring = Claim_ring();
+         owner.m_claimed = true;
+      }
+      return owner.m_ring;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Copies record @p index of @p ring, if it is still there and was not being rewritten.
+   // ---------------------------------------------------------------------------------------------
+   bool Read_slot(const Flight_ring &ring, std::uint64_t index, Slot_copy &copy)
+   {
+      const Flight_slot &slot = ring.m_slots[index & ring.m_mask];
+
+      if (slot.m_seq.load(std::memory_order_acquire) != index + 1)
+         return false;
+
+      copy.m_ticks = slot.m_ticks;
+      copy.m_thread = slot.m_thread;
+      copy.m_indent = slot.m_indent;
+      copy.m_length = slot.m_length;
+      std::memcpy(copy.m_text, slot.m_text, std::min<std::size_t>(copy.m_length, sizeof(copy.m_text)));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return slot.m_seq.load(std::memory_order_relaxed) == index + 1;
+   }
+
+   // Moves ring @p r's cursor to its next readable record.
+   void Advance(std::size_t r, const Flight_ring &ring)
+   {
+      s_has_current[r] = false;
+      while (s_cursor[r] < s_end[r] && !s_has_current[r])
+      {
+         s_has_current[r] = Read_slot(ring, s_cursor[r], s_current[r]);
+         ++s_cursor[r];
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Output through s_out, handed to the target's writer when nearly full.
+   // ---------------------------------------------------------------------------------------------
+   struct Dump_target
+   {
+      Flight_recorder::writer_type  m_writer;
+      void                          *m_target;
+   };
+
+   void Out_flush(const Dump_target &sink)
+   {
+      if (s_out_length > 0)
+      {
+         sink.m_writer(sink.m_target, s_out, s_out_length);
+         s_out_length = 0;
+      }
+   }
+
+   void Out(const Dump_target &sink, const char *data, std::size_t length)
+   {
+      if (s_out_length + length > sizeof(s_out))
+      {
+         Out_flush(sink);
+      }
+      length = std::min(length, sizeof(s_out));
+      std::memcpy(s_out + s_out_length, data, length);
+      s_out_length += length;
+   }
+
+   void Out(const Dump_target &sink, const char *text)
+   {
+      Out(sink, text, std::strlen(text));
+   }
+
+   void Out_padded(const Dump_target &sink, const char *begin, const char *end, std::size_t width)
+   {
+      static const char spaces[] = "                                                                ";
+      std::size_t length = static_cast<std::size_t>(end - begin);
+      if (length < width)
+      {
+         Out(sink, spaces, std::min(width - length, sizeof(spaces) - 1));
+      }
+      Out(sink, begin, length);
+   }
+
+   const std::size_t s_padding = 12;    // As Debugfile
+
+   void Out_line(const Dump_target &sink, const Slot_copy &rec, double time)
+   {
+      char digits[64];
+      std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), time,
+                                             std::chars_format::fixed, 2);
+      Out_padded(sink, digits, r.ptr, s_padding);
+
+      r = std::to_chars(digits, digits + sizeof(digits), rec.m_thread);
+      Out_padded(sink, digits, r.ptr, s_padding);
+
+      Out_padded(sink, " ", " " + 1, static_cast<std::size_t>(std::max(1, std::min(rec.m_indent, 64))));
+
+      std::size_t length = std::min<std::size_t>(rec.m_length, Flight_recorder::s_text_bytes);
+      Out(sink, rec.m_text, length);
+      if (rec.m_length > Flight_recorder::s_text_bytes)
+      {
+         Out(sink, "...");
+      }
+      Out(sink, "\n", 1);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Start(writer_type writer, void *target, std::size_t records_per_thread, 
+                            bool is_milli)
+{
+   s_capacity.store(std::max<std::size_t>(records_per_thread, 2), std::memory_order_relaxed);
+   s_is_milli.store(is_milli, std::memory_order_relaxed);
+   s_writer.store(writer, std::memory_order_relaxed);
+   s_target.store(target, std::memory_order_release);
+
+   File_sink::Set_fatal_signal_hook(&Flight_recorder::Dump_on_crash);
+   std::call_once(s_terminate_installed, []
+   {
+      s_previous_terminate = std::set_terminate(&Flight_recorder::Terminate_handler);
+   });
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Stop()
+{
+   File_sink::Set_fatal_signal_hook(nullptr);
+   s_target.store(nullptr, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Record(const Log_record &rec)
+{
+   Flight_ring *ring = Local_ring();
+   if (!ring)
+      return;
+
+   std::uint64_t head = ring->m_head.load(std::memory_order_relaxed);
+   Flight_slot &slot = ring->m_slots[head & ring->m_mask];
+
+   slot.m_seq.store(0, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   std::size_t length = rec.m_text.size();
+   slot.m_ticks = rec.m_ticks;
+   slot.m_thread = rec.m_thread;
+   slot.m_indent = rec.m_indent;
+   slot.m_length = static_cast<std::uint32_t>(std::min<std::size_t>(length, UINT32_MAX));
+   std::memcpy(slot.m_text, rec.m_text.data(), std::min(length, s_text_bytes));
+
+   slot.m_seq.store(head + 1, std::memory_order_release);
+   ring->m_head.store(head + 1, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Dump()
+{
+   Dump_target target = { nullptr, s_target.load(std::memory_order_acquire) };
+   target.m_writer = s_writer.load(std::memory_order_relaxed);
+   if (!target.m_target || !target.m_writer || s_dumping.exchange(true, std::memory_order_acquire))
+      return;
+
+   bool is_milli = s_is_milli.load(std::memory_order_relaxed);
+   Flight_ring *rings[s_max_rings];
+
+   for (std::size_t r = 0; r < s_max_rings; ++r)
+   {
+      rings[r] = s_rings[r].load(std::memory_order_acquire);
+      s_has_current[r] = false;
+      if (rings[r])
+      {
+         std::uint64_t head = rings[r]->m_head.load(std::memory_order_acquire);
+         std::uint64_t capacity = rings[r]->m_mask + 1;
+         s_cursor[r] = (head > capacity) ? head - capacity : 0;
+         s_end[r] = head;
+         Advance(r, *rings[r]);
+      }
+   }
+
+   s_out_length = 0;
+   Out(target, "\n---- Flight recorder: last records of each thread, oldest first ----\n");
+   const char *heading = Log_timestamp::Heading(Log_timestamp::mode::e_absolute, is_milli);
+   Out_padded(target, heading, heading + std::strlen(heading), s_padding);
+   Out_padded(target, "Thread_ID", "Thread_ID" + 9, s_padding);
+   Out(target, " Log_message\n");
+
+   bool first = true;
+   std::uint64_t origin = 0;
+   for (;;)
+   {
+      std::size_t next = s_max_rings;
+      for (std::size_t r = 0; r < s_max_rings; ++r)
+      {
+         if (s_has_current[r] && (next == s_max_rings || s_current[r].m_ticks < s_current[next].m_ticks))
+            next = r;
+      }
+      if (next == s_max_rings)
+         break;
+
+      if (first)
+      {
+         origin = s_current[next].m_ticks;
+         first = false;
+      }
+      std::int64_t ticks = static_cast<std::int64_t>(s_current[next].m_ticks - origin);
+      Out_line(target, s_current[next], is_milli ? Log_clock::To_ms(ticks) : Log_clock::To_us(ticks));
+      Advance(next, *rings[next]);
+   }
+
+   Out(target, "---- End of flight recorder ----\n");
+   Out_flush(target);
+
+   s_dumping.store(false, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Dump_on_crash()
+{
+   if (!s_crash_dumped.exchange(true, std::memory_order_acq_rel))
+   {
+      Dump();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Flight_recorder::Terminate_handler()
+{
+   Dump_on_crash();
+
+   if (s_previous_terminate)
+   {
+      s_previous_terminate();
+   }
+   std::abort();
+}
@@ -0,0 +1,65 @@
+/// @file Flight_recorder.h
+
+#ifndef FLIGHT_RECORDER_H_
+#define FLIGHT_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+struct Log_record;
+
+// ================================================================================================
+/// @brief     Keeps the last N log records of every thread in memory, whether or not they are
+///            written to the file, so that the context before a crash is not lost.
+///
+///            Each thread owns a preallocated ring of fixed-size slots (timestamp, thread, indent
+///            and the first s_text_bytes of the text). Recording copies into the next slot. It
+///            takes no lock and does not allocate after the thread's first record. Rings are kept
+///            in a fixed table; once it is full, new threads take over rings of exited threads.
+///
+///            Dump() merges the rings by timestamp into static buffers and hands them to the
+///            target's writer (File_sink or Mmap_sink Emergency_write), so it is async-signal-safe. Once started,
+///            it runs automatically on SIGSEGV/SIGBUS/SIGILL/SIGFPE/SIGABRT (through File_sink's
+///            handler) and from std::terminate, at most once per process.
+///            Debugfile::Start_flight_recorder() drives it.
+// ================================================================================================
+class Flight_recorder
+{
+public:
+
+   static constexpr std::size_t s_text_bytes = 216;    ///< Longer messages are cut off
+   static constexpr std::size_t s_max_threads = 256;   ///< Threads recording at the same time
+
+   /// Async-signal-safe output function of a dump target
+   typedef void (*writer_type)(void *target, const char *data, std::size_t length);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Starts recording into rings of @p records_per_thread slots (rounded up to a power
+   ///            of two; rings that already exist keep their size). Dumps go to @p writer,
+   ///            called with @p target.
+   // ---------------------------------------------------------------------------------------------
+   static void Start(writer_type writer, void *target, std::size_t records_per_thread, bool is_milli);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Stops dumping to the target. Recorded records stay until the next Start().
+   // ---------------------------------------------------------------------------------------------
+   static void Stop();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Copies one record into the calling thread's ring.
+   // ---------------------------------------------------------------------------------------------
+   static void Record(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes every ring, oldest record first, to the target. Async-signal-safe. The
+   ///            caller must keep other writers off the target (Debugfile holds its file lock).
+   // ---------------------------------------------------------------------------------------------
+   static void Dump();
+
+private:
+
+   static void Dump_on_crash();
+   static void Terminate_handler();
+};
+
+#endif // FLIGHT_RECORDER_H_
@@ -0,0 +1,65 @@
+/// @file Line_formatter.cpp
+
+#include "Line_formatter.h"
+
+#include <charconv>
+
+namespace
+{
+   const char        s_spaces[] = "                                                                ";
+   const std::size_t s_spaces_length = sizeof(s_spaces) - 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+Line_formatter::Line_formatter(int padding)
+   : m_padding(padding < 0 ? 0 : static_cast<std::size_t>(padding))
+{
+   m_buffer.reserve(256);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Line_formatter::Append_timestamp(double value)
+{
+   char digits[320];   // Enough for DBL_MAX in fixed notation
+
+   std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value, 
+                                          std::chars_format::fixed, 2);
+   Append_padded(digits, static_cast<std::size_t>(r.ptr - digits), m_padding);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Line_formatter::Append_column(std::uint64_t value, std::size_t width)
+{
+   char digits[24];
+
+   std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+   Append_padded(digits, static_cast<std::size_t>(r.ptr - digits), width);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Line_formatter::Append_column(const char *text, std::size_t width)
+{
+   Append_padded(text, std::char_traits<char>::length(text), width);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Line_formatter::Append_padded(const char *digits, std::size_t length, std::size_t width)
+{
+   // std::setw pads short fields and never truncates long ones
+   if (length < width)
+   {
+      Append_spaces(width - length);
+   }
+   m_buffer.append(digits, length);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Line_formatter::Append_spaces(std::size_t count)
+{
+   while (count > s_spaces_length)
+   {
+      m_buffer.append(s_spaces, s_spaces_length);
+      count -= s_spaces_length;
+   }
+   m_buffer.append(s_spaces, count);
+}
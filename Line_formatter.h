@@ -0,0 +1,66 @@
+/// @file Line_formatter.h
+
+#ifndef LINE_FORMATTER_H_
+#define LINE_FORMATTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ================================================================================================
+/// @brief     Renders the fixed columns of a log line (Elapsed, Thread_ID, indentation) and the
+///            message into a reusable character buffer with std::to_chars, so that a whole line
+///            is handed to the file in one write. The output is byte-identical to the previous
+///            std::setw / std::fixed / precision(2) stream formatting, but touches no stream
+///            state and no locale.
+// ================================================================================================
+class Line_formatter
+{
+public:
+
+   explicit Line_formatter(int padding = 12);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Discards the current contents; capacity is kept.
+   // ---------------------------------------------------------------------------------------------
+   void Clear() { m_buffer.clear(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Fixed-point value with two decimals, right-aligned in the column width.
+   // ---------------------------------------------------------------------------------------------
+   void Append_timestamp(double value);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Unsigned integer right-aligned in the column width (thread id column).
+   // ---------------------------------------------------------------------------------------------
+   void Append_column(std::uint64_t value) { Append_column(value, m_padding); }
+   void Append_column(std::uint64_t value, std::size_t width);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Text right-aligned in the column width (column headings).
+   // ---------------------------------------------------------------------------------------------
+   void Append_column(const char *text) { Append_column(text, m_padding); }
+   void Append_column(const char *text, std::size_t width);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Indentation: @p indent characters in total, at least one.
+   // ---------------------------------------------------------------------------------------------
+   void Append_indent(int indent) { Append_spaces(indent < 1 ? 1 : static_cast<std::size_t>(indent)); }
+
+   void Append(const char *text, std::size_t length) { m_buffer.append(text, length); }
+   void Append(const std::string &text) { m_buffer.append(text); }
+   void Append(char c) { m_buffer.push_back(c); }
+
+   const char* Data() const { return m_buffer.data(); }
+   std::size_t Size() const { return m_buffer.size(); }
+
+private:
+
+   void Append_padded(const char *digits, std::size_t length, std::size_t width);
+   void Append_spaces(std::size_t count);
+
+   std::string          m_buffer;
+   const std::size_t    m_padding;
+};
+
+#endif // LINE_FORMATTER_H_
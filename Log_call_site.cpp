@@ -0,0 +1,28 @@
+/// @file Log_call_site.cpp
+
+#include "Log_call_site.h"
+#include "Log_site_registry.h"
+
+namespace
+{
+   std::atomic<std::uint32_t> s_last_site_id{0};
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint32_t Log_call_site::Assign_id() const
+{
+   std::uint32_t expected = 0;
+   std::uint32_t fresh = s_last_site_id.fetch_add(1, std::memory_order_relaxed) + 1;
+
+   // Two threads can race on the first call; the loser adopts the winner's id.
+   if (m_id.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+      return fresh;
+
+   return expected;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_call_site::Register() const
+{
+   return Log_site_registry::Add(*this);
+}
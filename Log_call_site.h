@@ -0,0 +1,95 @@
+/// @file Log_call_site.h
+
+#ifndef LOG_CALL_SITE_H_
+#define LOG_CALL_SITE_H_
+
+#include <atomic>
+#include <cstdint>
+
+// ------------------------------------------------------------------------------------------------
+/// @brief     Severity of a logging statement. The values match G_LOG_LEVEL_* in
+///            Debug_logger_macros.h, which the preprocessor needs as plain numbers.
+// ------------------------------------------------------------------------------------------------
+enum class log_level : std::uint8_t
+{
+   e_trace,
+   e_debug,
+   e_info,
+   e_warn,
+   e_error,
+   e_off          ///< Threshold only: nothing passes
+};
+
+// ================================================================================================
+/// @brief     Static description of one logging statement. The G_LOG_* macros declare one of these
+///            as a function-local static; its constructor is constexpr, so it is constant-
+///            initialized and costs no guard check. The binary log refers to a site by a small
+///            id and writes the strings only once per file.
+///
+///            Each site also has a run-time switch, set through Log_site_registry. The site
+///            registers itself the first time Is_on() is asked.
+// ================================================================================================
+struct Log_call_site
+{
+   constexpr Log_call_site(const char *file, int line, const char *function, 
+                           const char *description, log_level level = log_level::e_debug,
+                           const char *module = nullptr)
+   : m_file(file)
+   , m_line(line)
+   , m_function(function)
+   , m_description(description)
+   , m_level(level)
+   , m_module(module)
+   , m_id(0)
+   , m_state(e_unknown)
+   {
+   }
+
+   Log_call_site(const Log_call_site&) = delete;
+   Log_call_site& operator=(const Log_call_site&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Process-wide id of the site (1, 2, ...), assigned on first use.
+   // ---------------------------------------------------------------------------------------------
+   std::uint32_t Id() const
+   {
+      std::uint32_t id = m_id.load(std::memory_order_acquire);
+      return (id != 0) ? id : Assign_id();
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true unless the site has been switched off. A site that is off costs one
+   ///            load and one branch; the first call registers the site.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_on() const
+   {
+      std::uint8_t state = m_state.load(std::memory_order_relaxed);
+      return state != e_off && (state == e_on || Register());
+   }
+
+   const char                          *m_file;
+   int                                 m_line;
+   const char                          *m_function;
+   const char                          *m_description;
+   log_level                           m_level;
+   const char                          *m_module;     ///< Module tag, or nullptr
+
+private:
+
+   friend class Log_site_registry;
+
+   enum : std::uint8_t
+   {
+      e_unknown,     ///< Not registered yet
+      e_on,
+      e_off
+   };
+
+   std::uint32_t Assign_id() const;
+   bool Register() const;
+
+   mutable std::atomic<std::uint32_t>  m_id;
+   mutable std::atomic<std::uint8_t>   m_state;
+};
+
+#endif // LOG_CALL_SITE_H_
@@ -0,0 +1,195 @@
+/// @file Log_clock.cpp
+
+#include "Log_clock.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+
+#if defined DEBUGLOG_HAS_TSC && !defined _MSC_VER
+#include <cpuid.h>
+#endif
+
+std::atomic<bool>   Log_clock::s_ready(false);
+bool                Log_clock::s_use_tsc = false;
+
+namespace
+{
+   // One (tsc, steady_clock) reading plus the rate derived from it. Two slots so Check_drift()
+   // can publish a new rate while other threads convert with the old one.
+   struct Calibration
+   {
+      std::uint64_t  m_tsc{0};
+      std::uint64_t  m_steady_ns{0};
+      double         m_ns_per_tick{1.0};
+   };
+
+   Calibration             s_calibration[2];
+   std::atomic<int>        s_current(0);
+   std::once_flag          s_initialized;
+   std::mutex              s_drift_mutex;
+
+   const auto              s_calibration_time = std::chrono::milliseconds(10);
+
+#if defined DEBUGLOG_HAS_TSC
+   // ---------------------------------------------------------------------------------------------
+   // CPUID.80000007H:EDX[8]: the TSC runs at a constant rate in all P-, C- and T-states, and is
+   // synchronized across cores.
+   // ---------------------------------------------------------------------------------------------
+   bool Has_invariant_tsc()
+   {
+#if defined _MSC_VER
+      int regs[4] = { 0 };
+      __cpuid(regs, 0x80000000);
+      if (static_cast<unsigned>(regs[0]) < 0x80000007u)
+         return false;
+      __cpuid(regs, 0x80000007);
+      return (regs[3] & (1 << 8)) != 0;
+#else
+      unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+      if (__get_cpuid_max(0x80000000u, nullptr) < 0x80000007u)
+         return false;
+      __get_cpuid(0x80000007u, &eax, &ebx, &ecx, &edx);
+      return (edx & (1u << 8)) != 0;
+#endif
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // A (tsc, steady) pair with the tsc read as close to the steady_clock read as we can manage:
+   // the tightest of a few bracketing attempts.
+   // ---------------------------------------------------------------------------------------------
+   void Read_pair(std::uint64_t &tsc, std::uint64_t &steady_ns)
+   {
+      std::uint64_t best = ~std::uint64_t(0);
+      for (int i = 0; i < 5; ++i)
+      {
+         std::uint64_t before = __rdtsc();
+         std::uint64_t ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now().time_since_epoch()).count());
+         std::uint64_t after = __rdtsc();
+         if (after - before < best)
+         {
+            best = after - before;
+            tsc = before + (after - before) / 2;
+            steady_ns = ns;
+         }
+      }
+   }
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Log_clock::Steady_ns()
+{
+   return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_clock::Initialize()
+{
+   std::call_once(s_initialized, []
+   {
+#if defined DEBUGLOG_HAS_TSC
+      if (Has_invariant_tsc())
+      {
+         Calibration &c = s_calibration[0];
+         Read_pair(c.m_tsc, c.m_steady_ns);
+
+         std::uint64_t tsc = 0, ns = 0;
+         do
+         {
+            Read_pair(tsc, ns);
+         } while (ns - c.m_steady_ns < static_cast<std::uint64_t>(
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(s_calibration_time).count()));
+
+         if (tsc > c.m_tsc)
+         {
+            c.m_ns_per_tick = static_cast<double>(ns - c.m_steady_ns) / static_cast<double>(tsc - c.m_tsc);
+            s_use_tsc = true;
+         }
+      }
+#endif
+      s_ready.store(true, std::memory_order_release);
+   });
+}
+
+// ------------------------------------------------------------------------------------------------
+double Log_clock::Ns_per_tick()
+{
+   if (!s_ready.load(std::memory_order_acquire))
+   {
+      Initialize();
+   }
+   return s_calibration[s_current.load(std::memory_order_acquire)].m_ns_per_tick;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Log_clock::To_steady_ns(std::uint64_t ticks)
+{
+   if (Source() != source::e_tsc)
+      return ticks;
+
+   const Calibration &c = s_calibration[s_current.load(std::memory_order_acquire)];
+   double ns = static_cast<double>(static_cast<std::int64_t>(ticks - c.m_tsc)) * c.m_ns_per_tick;
+   return c.m_steady_ns + static_cast<std::uint64_t>(std::llround(ns));
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Log_clock::From_steady_ns(std::uint64_t ns)
+{
+   if (Source() != source::e_tsc)
+      return ns;
+
+   const Calibration &c = s_calibration[s_current.load(std::memory_order_acquire)];
+   double ticks = static_cast<double>(static_cast<std::int64_t>(ns - c.m_steady_ns)) / c.m_ns_per_tick;
+   return c.m_tsc + static_cast<std::uint64_t>(std::llround(ticks));
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_clock::source Log_clock::Source()
+{
+   if (!s_ready.load(std::memory_order_acquire))
+   {
+      Initialize();
+   }
+   return s_use_tsc ? source::e_tsc : source::e_steady;
+}
+
+// ------------------------------------------------------------------------------------------------
+double Log_clock::Check_drift(double tolerance_ppm)
+{
+   if (Source() != source::e_tsc)
+      return 0.0;
+
+#if defined DEBUGLOG_HAS_TSC
+   std::lock_guard<std::mutex> lock(s_drift_mutex);
+
+   int current = s_current.load(std::memory_order_relaxed);
+   const Calibration &c = s_calibration[current];
+
+   std::uint64_t tsc = 0, ns = 0;
+   Read_pair(tsc, ns);
+   if (tsc <= c.m_tsc || ns <= c.m_steady_ns)
+      return 0.0;
+
+   double predicted_ns = static_cast<double>(tsc - c.m_tsc) * c.m_ns_per_tick;
+   double actual_ns = static_cast<double>(ns - c.m_steady_ns);
+   double drift_ppm = (predicted_ns - actual_ns) / actual_ns * 1e6;
+
+   if (std::abs(drift_ppm) > tolerance_ppm)
+   {
+      // Keep the original reading as the base: the longer the baseline, the better the rate
+      Calibration &next = s_calibration[1 - current];
+      next.m_tsc = c.m_tsc;
+      next.m_steady_ns = c.m_steady_ns;
+      next.m_ns_per_tick = actual_ns / static_cast<double>(tsc - c.m_tsc);
+      s_current.store(1 - current, std::memory_order_release);
+   }
+   return drift_ppm;
+#else
+   (void)tolerance_ppm;
+   return 0.0;
+#endif
+}
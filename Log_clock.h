@@ -0,0 +1,95 @@
+/// @file Log_clock.h
+
+#ifndef LOG_CLOCK_H_
+#define LOG_CLOCK_H_
+
+#include <atomic>
+#include <cstdint>
+
+#if !defined DEBUGLOG_NO_TSC && (defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86)
+#define DEBUGLOG_HAS_TSC
+#if defined _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// ================================================================================================
+/// @brief     Timestamp source for Debugfile and Simple_timer. Timestamps are raw integer ticks,
+///            and are converted to ns/us/ms only when they are formatted.
+///
+///            On x86 with an invariant TSC (CPUID 0x80000007 EDX bit 8) a tick is one rdtsc
+///            count. The rate is calibrated against std::chrono::steady_clock on first use, and
+///            Check_drift() re-measures it against steady_clock later. Everywhere else, or when
+///            built with DEBUGLOG_NO_TSC, a tick is one steady_clock nanosecond.
+///            The source is fixed on first use, so ticks from any two calls are comparable.
+// ================================================================================================
+class Log_clock
+{
+public:
+
+   enum class source : int
+   {
+      e_steady,      ///< std::chrono::steady_clock nanoseconds
+      e_tsc          ///< Calibrated invariant time-stamp counter
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Current time in ticks.
+   // ---------------------------------------------------------------------------------------------
+   static std::uint64_t Now()
+   {
+      if (!s_ready.load(std::memory_order_acquire))
+      {
+         Initialize();
+      }
+#if defined DEBUGLOG_HAS_TSC
+      if (s_use_tsc)
+         return __rdtsc();
+#endif
+      return Steady_ns();
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Conversions of a tick difference.
+   // ---------------------------------------------------------------------------------------------
+   static double To_ns(std::int64_t ticks) { return static_cast<double>(ticks) * Ns_per_tick(); }
+   static double To_us(std::int64_t ticks) { return static_cast<double>(ticks) * Ns_per_tick() / 1e3; }
+   static double To_ms(std::int64_t ticks) { return static_cast<double>(ticks) * Ns_per_tick() / 1e6; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Tick count covering a duration, for deadlines.
+   // ---------------------------------------------------------------------------------------------
+   static std::int64_t From_ns(double ns) { return static_cast<std::int64_t>(ns / Ns_per_tick()); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Converts a Now() reading to steady_clock nanoseconds and back. steady_clock is
+   ///            CLOCK_MONOTONIC on Linux, which all processes on a host share, so converted
+   ///            readings of different processes can be compared.
+   // ---------------------------------------------------------------------------------------------
+   static std::uint64_t To_steady_ns(std::uint64_t ticks);
+   static std::uint64_t From_steady_ns(std::uint64_t ns);
+
+   static double Ns_per_tick();
+   static source Source();
+   static const char* Source_name() { return (Source() == source::e_tsc) ? "tsc" : "steady_clock"; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Compares the TSC against steady_clock over the whole time since calibration.
+   ///            If they disagree by more than @p tolerance_ppm, the rate is re-derived from
+   ///            that longer baseline. Always 0 for the steady_clock source.
+   /// @return    Measured drift in parts per million before any correction.
+   // ---------------------------------------------------------------------------------------------
+   static double Check_drift(double tolerance_ppm = 50.0);
+
+private:
+
+   static void Initialize();
+   static std::uint64_t Steady_ns();
+
+   static std::atomic<bool>   s_ready;
+   static bool                s_use_tsc;
+};
+
+#endif // LOG_CLOCK_H_
@@ -0,0 +1,135 @@
+/// @file Log_collector.cpp
+
+#include "Log_collector.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+#if !defined _WIN32
+#include <signal.h>
+#endif
+
+namespace
+{
+   std::uint64_t Steady_now_ns()
+   {
+      return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+   }
+
+   bool Is_running(std::uint32_t pid)
+   {
+#if defined _WIN32
+      (void)pid;
+      return true;
+#else
+      return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_collector::Open(const std::string &channel, std::string *error)
+{
+   Close();
+   return m_directory.Open(channel, error);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_collector::Close()
+{
+   m_sources.clear();
+   m_pending.clear();
+   m_directory.Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_collector::Note(std::uint64_t now, std::uint32_t pid, const std::string &text)
+{
+   Log_shm_ring::record note;
+   note.m_steady_ns = now;
+   note.m_pid = pid;
+   note.m_text = "Debugfile: process " + std::to_string(pid) + " " + text;
+   m_pending.push_back(std::move(note));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_collector::Attach_new(std::uint64_t now)
+{
+   for (const Log_shm_directory::entry &e : m_directory.Entries())
+   {
+      bool known = std::any_of(m_sources.begin(), m_sources.end(),
+                               [&e](const Source &s) { return s.m_entry == e.m_index; });
+      if (known)
+         continue;
+
+      std::unique_ptr<Log_shm_ring> ring(new Log_shm_ring);
+      if (!ring->Attach(e.m_ring))
+      {
+         // The producer died before creating its ring, or a collector removed it already
+         if (e.m_state == Log_shm_directory::state::e_closed || !Is_running(e.m_pid))
+            m_directory.Set_state(e.m_index, Log_shm_directory::state::e_free);
+         continue;
+      }
+
+      Note(now, e.m_pid, "joined (" + e.m_ring + ")");
+      m_sources.push_back(Source{ std::move(ring), e.m_index, 0 });
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_collector::Poll(std::vector<Log_shm_ring::record> &out, std::chrono::nanoseconds hold)
+{
+   std::uint64_t now = Steady_now_ns();
+   Attach_new(now);
+
+   for (std::size_t i = 0; i < m_sources.size(); )
+   {
+      Source &source = m_sources[i];
+      Log_shm_ring &ring = *source.m_ring;
+
+      // A process that is gone writes nothing more, so asked before reading it is drained by
+      // the read. A closed ring takes no new records, but writers that reserved room before
+      // the close may still be copying theirs in: it stays until they have been read.
+      bool gone = !Is_running(ring.Pid());
+
+      ring.Read(m_pending);
+      bool closed = ring.Is_closed();
+      bool drained = closed && ring.Is_drained();
+
+      std::uint64_t dropped = ring.Dropped();
+      if (dropped != source.m_dropped_reported)
+      {
+         Note(now, ring.Pid(), "dropped " + std::to_string(dropped - source.m_dropped_reported) +
+                               " records (ring full)");
+         source.m_dropped_reported = dropped;
+      }
+
+      if (drained || gone)
+      {
+         Note(now, ring.Pid(), closed ? "left" : "exited without closing its log");
+         ring.Unlink();
+         ring.Close();
+         m_directory.Set_state(source.m_entry, Log_shm_directory::state::e_free);
+         m_sources.erase(m_sources.begin() + static_cast<std::ptrdiff_t>(i));
+         continue;
+      }
+      ++i;
+   }
+
+   std::stable_sort(m_pending.begin(), m_pending.end(),
+                    [](const Log_shm_ring::record &a, const Log_shm_ring::record &b)
+                    {
+                       return a.m_steady_ns < b.m_steady_ns;
+                    });
+
+   std::uint64_t hold_ns = static_cast<std::uint64_t>(std::max<std::int64_t>(0, hold.count()));
+   std::uint64_t cutoff = (now > hold_ns) ? now - hold_ns : 0;
+   auto ready_end = (hold_ns == 0) ? m_pending.end() :
+                    std::upper_bound(m_pending.begin(), m_pending.end(), cutoff,
+                                     [](std::uint64_t t, const Log_shm_ring::record &r) { return t < r.m_steady_ns; });
+
+   std::move(m_pending.begin(), ready_end, std::back_inserter(out));
+   m_pending.erase(m_pending.begin(), ready_end);
+}
@@ -0,0 +1,71 @@
+/// @file Log_collector.h
+
+#ifndef LOG_COLLECTOR_H_
+#define LOG_COLLECTOR_H_
+
+#include "Log_shm.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Reader side of a shared-memory log channel (see Log_shm_ring): finds the rings of
+///            all producer processes in the channel's table, drains them, and hands their records
+///            out merged by time.
+///
+///            Records from different rings arrive in no particular order, so each Poll() keeps
+///            the records of the last @e hold and hands out only older ones, sorted. A record
+///            that reaches its ring later than that (its writer was descheduled between stamping
+///            and copying it) comes out late rather than not at all.
+///
+///            Poll() also reports, as records of their own ("Debugfile: process <pid> ..."),
+///            processes that join or leave and records a full ring dropped. A ring is removed
+///            once its process has closed it and every record reserved before the close has been
+///            read, or once the process no longer exists, which is checked by pid: the collector
+///            must see the producers' process ids.
+// ================================================================================================
+class Log_collector
+{
+public:
+
+   Log_collector() = default;
+   ~Log_collector() { Close(); }
+
+   Log_collector(const Log_collector&) = delete;
+   Log_collector& operator=(const Log_collector&) = delete;
+
+   bool Open(const std::string &channel, std::string *error = nullptr);
+   void Close();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Reads all rings and appends to @p out, in time order, the records stamped at
+   ///            least @p hold ago. A hold of 0 hands out everything read so far.
+   // ---------------------------------------------------------------------------------------------
+   void Poll(std::vector<Log_shm_ring::record> &out, std::chrono::nanoseconds hold);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of rings being read.
+   // ---------------------------------------------------------------------------------------------
+   std::size_t Rings() const { return m_sources.size(); }
+
+private:
+
+   struct Source
+   {
+      std::unique_ptr<Log_shm_ring> m_ring;
+      int                           m_entry;
+      std::uint64_t                 m_dropped_reported;
+   };
+
+   void Attach_new(std::uint64_t now);
+   void Note(std::uint64_t now, std::uint32_t pid, const std::string &text);
+
+   Log_shm_directory                   m_directory;
+   std::vector<Source>                 m_sources;
+   std::vector<Log_shm_ring::record>   m_pending;     ///< Read, not yet handed out
+};
+
+#endif // LOG_COLLECTOR_H_
@@ -0,0 +1,868 @@
+/// @file Log_compression.cpp
+
+#include "Log_compression.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined DEBUGLOG_WITH_ZSTD
+#define DEBUGLOG_HAS_ZSTD
+#include <zstd.h>
+#endif
+#if defined DEBUGLOG_WITH_LZ4
+#define DEBUGLOG_HAS_LZ4
+#include <lz4frame.h>
+#endif
+
+struct Log_compression::Writer::Encoder
+{
+   virtual ~Encoder() = default;
+   virtual bool Write(std::ostream &out, const char *data, std::size_t length) = 0;
+   virtual bool Finish(std::ostream &out) = 0;
+};
+
+struct Log_compression::Reader::Decoder
+{
+   virtual ~Decoder() = default;
+
+   // Next decompressed bytes, 0 at the end of the data. Sets @p failed on corrupt or cut input.
+   virtual std::size_t Read(std::istream &in, char *out, std::size_t capacity, bool &failed) = 0;
+};
+
+namespace
+{
+   const unsigned char  s_builtin_magic[4] = { 'D', 'L', 'Z', '1' };
+   const unsigned char  s_zstd_magic[4] = { 0x28, 0xB5, 0x2F, 0xFD };
+   const unsigned char  s_lz4_magic[4] = { 0x04, 0x22, 0x4D, 0x18 };
+
+   const std::size_t    s_block_bytes = Log_compression::s_block_bytes;
+   const std::size_t    s_min_match = 4;
+   const std::size_t    s_max_offset = 65535;
+   const int            s_hash_bits = 14;
+
+   void Put_u32(unsigned char *p, std::uint32_t value)
+   {
+      p[0] = static_cast<unsigned char>(value);
+      p[1] = static_cast<unsigned char>(value >> 8);
+      p[2] = static_cast<unsigned char>(value >> 16);
+      p[3] = static_cast<unsigned char>(value >> 24);
+   }
+
+   std::uint32_t Get_u32(const unsigned char *p)
+   {
+      return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+             (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+   }
+
+   std::uint32_t Fnv1a(const unsigned char *data, std::size_t length)
+   {
+      std::uint32_t hash = 2166136261u;
+      for (std::size_t i = 0; i < length; ++i)
+      {
+         hash = (hash ^ data[i]) * 16777619u;
+      }
+      return hash;
+   }
+
+   std::uint32_t Load_u32(const unsigned char *p)
+   {
+      std::uint32_t value;
+      std::memcpy(&value, p, sizeof(value));
+      return value;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Built-in LZ77 with LZ4-style sequences: a token (literal length << 4 | match length - 4), the
+   // literals, a 16-bit little-endian offset, and for lengths of 15 and up, extra length bytes
+   // (255 means more follow). The last sequence of a block has literals only.
+   // ---------------------------------------------------------------------------------------------
+   std::size_t Lz_bound(std::size_t length)
+   {
+      return length + length / 255 + 16;
+   }
+
+   unsigned char* Put_length(unsigned char *op, std::size_t length)
+   {
+      for (; length >= 255; length -= 255)
+      {
+         *op++ = 255;
+      }
+      *op++ = static_cast<unsigned char>(length);
+      return op;
+   }
+
+   bool Get_length(const unsigned char *&ip, const unsigned char *end, std::size_t &length)
+   {
+      unsigned char byte;
+      do
+      {
+         if (ip == end)
+            return false;
+         byte = *ip++;
+         length += byte;
+      } while (byte == 255);
+      return true;
+   }
+
+   // A match length of 0 makes the block's closing, literals-only sequence
+   unsigned char* Put_sequence(unsigned char *op, const unsigned char *literals, std::size_t literal_length,
+                               std::size_t offset, std::size_t match_length)
+   {
+      unsigned char *token = op++;
+      unsigned int code = static_cast<unsigned int>(std::min<std::size_t>(literal_length, 15)) << 4;
+
+      if (literal_length >= 15)
+      {
+         op = Put_length(op, literal_length - 15);
+      }
+      std::memcpy(op, literals, literal_length);
+      op += literal_length;
+
+      if (match_length > 0)
+      {
+         std::size_t extra = match_length - s_min_match;
+         code |= static_cast<unsigned int>(std::min<std::size_t>(extra, 15));
+         *op++ = static_cast<unsigned char>(offset);
+         *op++ = static_cast<unsigned char>(offset >> 8);
+         if (extra >= 15)
+         {
+            op = Put_length(op, extra - 15);
+         }
+      }
+      *token = static_cast<unsigned char>(code);
+      return op;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Greedy single-probe hash matching. @p dst holds Lz_bound(length) bytes; @p table
+   // 1 << s_hash_bits entries.
+   // ---------------------------------------------------------------------------------------------
+   std::size_t Lz_compress(const unsigned char *src, std::size_t length, unsigned char *dst,
+                           std::uint32_t *table)
+   {
+      std::fill(table, table + (std::size_t(1) << s_hash_bits), 0u);
+
+      unsigned char *op = dst;
+      std::size_t anchor = 0;
+      std::size_t i = 0;
+
+      while (i + s_min_match <= length)
+      {
+         std::uint32_t sequence = Load_u32(src + i);
+         std::uint32_t hash = (sequence * 2654435761u) >> (32 - s_hash_bits);
+         std::size_t candidate = table[hash];           // Position + 1, 0 when empty
+         table[hash] = static_cast<std::uint32_t>(i + 1);
+
+         if (candidate > 0 && i - (candidate - 1) <= s_max_offset && Load_u32(src + candidate - 1) == sequence)
+         {
+            std::size_t match = candidate - 1;
+            std::size_t match_length = s_min_match;
+            while (i + match_length < length && src[match + match_length] == src[i + match_length])
+            {
+               ++match_length;
+            }
+            op = Put_sequence(op, src + anchor, i - anchor, i - match, match_length);
+            i += match_length;
+            anchor = i;
+         }
+         else
+         {
+            ++i;
+         }
+      }
+      op = Put_sequence(op, src + anchor, length - anchor, 0, 0);
+      return static_cast<std::size_t>(op - dst);
+   }
+
+   bool Lz_decompress(const unsigned char *ip, std::size_t length, unsigned char *out, std::size_t raw_length)
+   {
+      const unsigned char *end = ip + length;
+      unsigned char *op = out;
+      unsigned char *out_end = out + raw_length;
+
+      while (ip < end)
+      {
+         unsigned int token = *ip++;
+
+         std::size_t literal_length = token >> 4;
+         if (literal_length == 15 && !Get_length(ip, end, literal_length))
+            return false;
+         if (static_cast<std::size_t>(end - ip) < literal_length ||
+             static_cast<std::size_t>(out_end - op) < literal_length)
+            return false;
+         std::memcpy(op, ip, literal_length);
+         op += literal_length;
+         ip += literal_length;
+
+         if (ip == end)
+            break;
+
+         if (end - ip < 2)
+            return false;
+         std::size_t offset = static_cast<std::size_t>(ip[0]) | (static_cast<std::size_t>(ip[1]) << 8);
+         ip += 2;
+         if (offset == 0 || offset > static_cast<std::size_t>(op - out))
+            return false;
+
+         std::size_t match_length = token & 15;
+         if (match_length == 15 && !Get_length(ip, end, match_length))
+            return false;
+         match_length += s_min_match;
+         if (static_cast<std::size_t>(out_end - op) < match_length)
+            return false;
+
+         // Byte by byte: the match may overlap the bytes it produces
+         const unsigned char *match = op - offset;
+         for (std::size_t k = 0; k < match_length; ++k)
+         {
+            op[k] = match[k];
+         }
+         op += match_length;
+      }
+      return op == out_end;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Built-in format
+   // ---------------------------------------------------------------------------------------------
+   class Builtin_encoder : public Log_compression::Writer::Encoder
+   {
+   public:
+
+      Builtin_encoder()
+         : m_packed(Lz_bound(s_block_bytes))
+         , m_table(std::size_t(1) << s_hash_bits)
+         , m_started(false)
+      {
+         m_block.reserve(s_block_bytes);
+      }
+
+      bool Write(std::ostream &out, const char *data, std::size_t length) override
+      {
+         Begin(out);
+         while (length > 0)
+         {
+            std::size_t part = std::min(length, s_block_bytes - m_block.size());
+            m_block.append(data, part);
+            data += part;
+            length -= part;
+
+            if (m_block.size() == s_block_bytes && !Put_block(out))
+               return false;
+         }
+         return static_cast<bool>(out);
+      }
+
+      bool Finish(std::ostream &out) override
+      {
+         Begin(out);
+         if (!m_block.empty() && !Put_block(out))
+            return false;
+
+         const char end[8] = { 0 };
+         out.write(end, sizeof(end));
+         return static_cast<bool>(out);
+      }
+
+   private:
+
+      void Begin(std::ostream &out)
+      {
+         if (!m_started)
+         {
+            out.write(reinterpret_cast<const char*>(s_builtin_magic), sizeof(s_builtin_magic));
+            m_started = true;
+         }
+      }
+
+      bool Put_block(std::ostream &out)
+      {
+         const unsigned char *raw = reinterpret_cast<const unsigned char*>(m_block.data());
+         std::size_t packed = Lz_compress(raw, m_block.size(), m_packed.data(), m_table.data());
+
+         // Incompressible blocks are stored as they are
+         bool store = (packed >= m_block.size());
+         std::size_t stored = store ? m_block.size() : packed;
+
+         unsigned char header[12];
+         Put_u32(header, static_cast<std::uint32_t>(m_block.size()));
+         Put_u32(header + 4, static_cast<std::uint32_t>(stored));
+         Put_u32(header + 8, Fnv1a(raw, m_block.size()));
+         out.write(reinterpret_cast<const char*>(header), sizeof(header));
+         out.write(reinterpret_cast<const char*>(store ? raw : m_packed.data()),
+                   static_cast<std::streamsize>(stored));
+
+         m_block.clear();
+         return static_cast<bool>(out);
+      }
+
+      std::string                   m_block;
+      std::vector<unsigned char>    m_packed;
+      std::vector<std::uint32_t>    m_table;
+      bool                          m_started;
+   };
+
+   class Builtin_decoder : public Log_compression::Reader::Decoder
+   {
+   public:
+
+      Builtin_decoder()
+         : m_position(0)
+         , m_started(false)
+         , m_ended(false)
+      {
+      }
+
+      std::size_t Read(std::istream &in, char *out, std::size_t capacity, bool &failed) override
+      {
+         if (m_position == m_raw.size() && !Next_block(in, failed))
+            return 0;
+
+         std::size_t length = std::min(capacity, m_raw.size() - m_position);
+         std::memcpy(out, m_raw.data() + m_position, length);
+         m_position += length;
+         return length;
+      }
+
+   private:
+
+      bool Next_block(std::istream &in, bool &failed)
+      {
+         if (m_ended)
+            return false;
+
+         if (!m_started)
+         {
+            char magic[sizeof(s_builtin_magic)];
+            in.read(magic, sizeof(magic));
+            m_started = true;
+         }
+
+         // The end marker is only the two sizes
+         unsigned char header[12];
+         in.read(reinterpret_cast<char*>(header), 8);
+         if (in.gcount() != 8)
+         {
+            failed = true;
+            return false;
+         }
+
+         std::uint32_t raw_length = Get_u32(header);
+         std::uint32_t stored_length = Get_u32(header + 4);
+         if (raw_length == 0 && stored_length == 0)
+         {
+            m_ended = true;
+            return false;
+         }
+
+         in.read(reinterpret_cast<char*>(header + 8), 4);
+         if (in.gcount() != 4)
+         {
+            failed = true;
+            return false;
+         }
+         if (raw_length == 0 || raw_length > s_block_bytes || stored_length > raw_length)
+         {
+            failed = true;
+            return false;
+         }
+
+         m_stored.resize(stored_length);
+         in.read(reinterpret_cast<char*>(m_stored.data()), stored_length);
+         if (in.gcount() != static_cast<std::streamsize>(stored_length))
+         {
+            failed = true;
+            return false;
+         }
+
+         m_raw.resize(raw_length);
+         m_position = 0;
+         if (stored_length == raw_length)
+         {
+            std::memcpy(&m_raw[0], m_stored.data(), raw_length);
+         }
+         else if (!Lz_decompress(m_stored.data(), stored_length, reinterpret_cast<unsigned char*>(&m_raw[0]), raw_length))
+         {
+            m_raw.clear();
+            failed = true;
+            return false;
+         }
+
+         if (Fnv1a(reinterpret_cast<const unsigned char*>(m_raw.data()), raw_length) != Get_u32(header + 8))
+         {
+            m_raw.clear();
+            failed = true;
+            return false;
+         }
+         return true;
+      }
+
+      std::vector<unsigned char>    m_stored;
+      std::string                   m_raw;
+      std::size_t                   m_position;
+      bool                          m_started;
+      bool                          m_ended;
+   };
+
+#if defined DEBUGLOG_HAS_ZSTD
+   // ---------------------------------------------------------------------------------------------
+   // Zstandard
+   // ---------------------------------------------------------------------------------------------
+   class Zstd_encoder : public Log_compression::Writer::Encoder
+   {
+   public:
+
+      Zstd_encoder()
+         : m_context(ZSTD_createCCtx())
+         , m_buffer(ZSTD_CStreamOutSize())
+      {
+         if (m_context)
+         {
+            ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, 3);
+         }
+      }
+
+      ~Zstd_encoder() override
+      {
+         ZSTD_freeCCtx(m_context);
+      }
+
+      bool Write(std::ostream &out, const char *data, std::size_t length) override
+      {
+         return Compress(out, data, length, ZSTD_e_continue);
+      }
+
+      bool Finish(std::ostream &out) override
+      {
+         return Compress(out, nullptr, 0, ZSTD_e_end);
+      }
+
+   private:
+
+      bool Compress(std::ostream &out, const char *data, std::size_t length, ZSTD_EndDirective mode)
+      {
+         if (!m_context)
+            return false;
+
+         ZSTD_inBuffer input = { data, length, 0 };
+         for (;;)
+         {
+            ZSTD_outBuffer output = { m_buffer.data(), m_buffer.size(), 0 };
+            std::size_t remaining = ZSTD_compressStream2(m_context, &output, &input, mode);
+            if (ZSTD_isError(remaining))
+               return false;
+
+            out.write(m_buffer.data(), static_cast<std::streamsize>(output.pos));
+            if (mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size)
+               break;
+         }
+         return static_cast<bool>(out);
+      }
+
+      ZSTD_CCtx            *m_context;
+      std::vector<char>    m_buffer;
+   };
+
+   class Zstd_decoder : public Log_compression::Reader::Decoder
+   {
+   public:
+
+      Zstd_decoder()
+         : m_context(ZSTD_createDCtx())
+         , m_buffer(ZSTD_DStreamInSize())
+         , m_input{ m_buffer.data(), 0, 0 }
+         , m_hint(0)
+         , m_end_of_file(false)
+      {
+      }
+
+      ~Zstd_decoder() override
+      {
+         ZSTD_freeDCtx(m_context);
+      }
+
+      std::size_t Read(std::istream &in, char *out, std::size_t capacity, bool &failed) override
+      {
+         if (!m_context)
+         {
+            failed = true;
+            return 0;
+         }
+
+         ZSTD_outBuffer output = { out, capacity, 0 };
+         for (;;)
+         {
+            if (m_input.pos == m_input.size && !m_end_of_file)
+            {
+               in.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+               m_input.size = static_cast<std::size_t>(in.gcount());
+               m_input.pos = 0;
+               m_end_of_file = (m_input.size == 0);
+            }
+
+            // A hint of 0 means the last frame ended and was flushed; asking again without input
+            // would return the hint for the next frame's header
+            bool drained = m_end_of_file && m_input.pos == m_input.size;
+            if (drained && m_hint == 0)
+               return 0;
+
+            m_hint = ZSTD_decompressStream(m_context, &output, &m_input);
+            if (ZSTD_isError(m_hint))
+            {
+               failed = true;
+               return 0;
+            }
+            if (output.pos > 0)
+               return output.pos;
+
+            if (drained)
+            {
+               failed = true;             // Ended inside a frame
+               return 0;
+            }
+         }
+      }
+
+   private:
+
+      ZSTD_DCtx            *m_context;
+      std::vector<char>    m_buffer;
+      ZSTD_inBuffer        m_input;
+      std::size_t          m_hint;
+      bool                 m_end_of_file;
+   };
+#endif
+
+#if defined DEBUGLOG_HAS_LZ4
+   // ---------------------------------------------------------------------------------------------
+   // LZ4 frame format
+   // ---------------------------------------------------------------------------------------------
+   const std::size_t s_lz4_chunk = 64 * 1024;
+
+   class Lz4_encoder : public Log_compression::Writer::Encoder
+   {
+   public:
+
+      Lz4_encoder()
+         : m_context(nullptr)
+         , m_started(false)
+      {
+         if (LZ4F_isError(LZ4F_createCompressionContext(&m_context, LZ4F_VERSION)))
+         {
+            m_context = nullptr;
+         }
+         std::memset(&m_preferences, 0, sizeof(m_preferences));
+         m_buffer.resize(LZ4F_compressBound(s_lz4_chunk, &m_preferences) + LZ4F_HEADER_SIZE_MAX);
+      }
+
+      ~Lz4_encoder() override
+      {
+         if (m_context)
+         {
+            LZ4F_freeCompressionContext(m_context);
+         }
+      }
+
+      bool Write(std::ostream &out, const char *data, std::size_t length) override
+      {
+         if (!Begin(out))
+            return false;
+
+         while (length > 0)
+         {
+            std::size_t part = std::min(length, s_lz4_chunk);
+            std::size_t written = LZ4F_compressUpdate(m_context, m_buffer.data(), m_buffer.size(),
+                                                      data, part, nullptr);
+            if (LZ4F_isError(written))
+               return false;
+
+            out.write(m_buffer.data(), static_cast<std::streamsize>(written));
+            data += part;
+            length -= part;
+         }
+         return static_cast<bool>(out);
+      }
+
+      bool Finish(std::ostream &out) override
+      {
+         if (!Begin(out))
+            return false;
+
+         std::size_t written = LZ4F_compressEnd(m_context, m_buffer.data(), m_buffer.size(), nullptr);
+         if (LZ4F_isError(written))
+            return false;
+
+         out.write(m_buffer.data(), static_cast<std::streamsize>(written));
+         return static_cast<bool>(out);
+      }
+
+   private:
+
+      bool Begin(std::ostream &out)
+      {
+         if (!m_context)
+            return false;
+         if (m_started)
+            return true;
+
+         std::size_t written = LZ4F_compressBegin(m_context, m_buffer.data(), m_buffer.size(), &m_preferences);
+         if (LZ4F_isError(written))
+            return false;
+
+         out.write(m_buffer.data(), static_cast<std::streamsize>(written));
+         m_started = true;
+         return true;
+      }
+
+      LZ4F_cctx            *m_context;
+      LZ4F_preferences_t   m_preferences;
+      std::vector<char>    m_buffer;
+      bool                 m_started;
+   };
+
+   class Lz4_decoder : public Log_compression::Reader::Decoder
+   {
+   public:
+
+      Lz4_decoder()
+         : m_context(nullptr)
+         , m_buffer(s_lz4_chunk)
+         , m_position(0)
+         , m_size(0)
+         , m_hint(0)
+         , m_end_of_file(false)
+      {
+         if (LZ4F_isError(LZ4F_createDecompressionContext(&m_context, LZ4F_VERSION)))
+         {
+            m_context = nullptr;
+         }
+      }
+
+      ~Lz4_decoder() override
+      {
+         if (m_context)
+         {
+            LZ4F_freeDecompressionContext(m_context);
+         }
+      }
+
+      std::size_t Read(std::istream &in, char *out, std::size_t capacity, bool &failed) override
+      {
+         if (!m_context)
+         {
+            failed = true;
+            return 0;
+         }
+
+         for (;;)
+         {
+            if (m_position == m_size && !m_end_of_file)
+            {
+               in.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+               m_size = static_cast<std::size_t>(in.gcount());
+               m_position = 0;
+               m_end_of_file = (m_size == 0);
+            }
+
+            bool drained = m_end_of_file && m_position == m_size;
+            if (drained && m_hint == 0)
+               return 0;
+
+            std::size_t produced = capacity;
+            std::size_t consumed = m_size - m_position;
+            m_hint = LZ4F_decompress(m_context, out, &produced, m_buffer.data() + m_position, &consumed, nullptr);
+            if (LZ4F_isError(m_hint))
+            {
+               failed = true;
+               return 0;
+            }
+            m_position += consumed;
+            if (produced > 0)
+               return produced;
+
+            if (drained)
+            {
+               failed = true;             // Ended inside a frame
+               return 0;
+            }
+         }
+      }
+
+   private:
+
+      LZ4F_dctx            *m_context;
+      std::vector<char>    m_buffer;
+      std::size_t          m_position;
+      std::size_t          m_size;
+      std::size_t          m_hint;
+      bool                 m_end_of_file;
+   };
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compression::Is_available(format f)
+{
+   switch (f)
+   {
+#if defined DEBUGLOG_HAS_ZSTD
+   case format::e_zstd:
+      return true;
+#endif
+#if defined DEBUGLOG_HAS_LZ4
+   case format::e_lz4:
+      return true;
+#endif
+   case format::e_builtin:
+      return true;
+   default:
+      return false;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::format Log_compression::Best_available()
+{
+   if (Is_available(format::e_zstd))
+      return format::e_zstd;
+   if (Is_available(format::e_lz4))
+      return format::e_lz4;
+   return format::e_builtin;
+}
+
+// ------------------------------------------------------------------------------------------------
+const char* Log_compression::Extension(format f)
+{
+   switch (f)
+   {
+   case format::e_zstd:
+      return ".zst";
+   case format::e_lz4:
+      return ".lz4";
+   default:
+      return ".dlz";
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::Writer::Writer(format f, std::ostream &out)
+   : m_out(out)
+{
+   switch (f)
+   {
+   case format::e_builtin:
+      m_encoder.reset(new Builtin_encoder);
+      break;
+   case format::e_zstd:
+#if defined DEBUGLOG_HAS_ZSTD
+      m_encoder.reset(new Zstd_encoder);
+#endif
+      break;
+   case format::e_lz4:
+#if defined DEBUGLOG_HAS_LZ4
+      m_encoder.reset(new Lz4_encoder);
+#endif
+      break;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::Writer::~Writer()
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compression::Writer::Write(const char *data, std::size_t length)
+{
+   return m_encoder && m_encoder->Write(m_out, data, length);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compression::Writer::Finish()
+{
+   return m_encoder && m_encoder->Finish(m_out) && m_out.flush();
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::Reader::Reader()
+   : m_failed(false)
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::Reader::~Reader()
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compression::Reader::Open(const std::string &path)
+{
+   m_in.close();
+   m_in.clear();
+   m_decoder.reset();
+   m_failed = false;
+   setg(nullptr, nullptr, nullptr);
+
+   m_in.open(path, std::ios::in | std::ios::binary);
+   if (!m_in.is_open())
+      return false;
+
+   unsigned char magic[4] = { 0 };
+   m_in.read(reinterpret_cast<char*>(magic), sizeof(magic));
+   bool complete = (m_in.gcount() == static_cast<std::streamsize>(sizeof(magic)));
+   m_in.clear();
+   m_in.seekg(0);
+
+   if (complete && std::memcmp(magic, s_builtin_magic, sizeof(magic)) == 0)
+   {
+      m_decoder.reset(new Builtin_decoder);
+   }
+   else if (complete && std::memcmp(magic, s_zstd_magic, sizeof(magic)) == 0)
+   {
+#if defined DEBUGLOG_HAS_ZSTD
+      m_decoder.reset(new Zstd_decoder);
+#else
+      m_failed = true;
+      return false;
+#endif
+   }
+   else if (complete && std::memcmp(magic, s_lz4_magic, sizeof(magic)) == 0)
+   {
+#if defined DEBUGLOG_HAS_LZ4
+      m_decoder.reset(new Lz4_decoder);
+#else
+      m_failed = true;
+      return false;
+#endif
+   }
+
+   m_buffer.resize(s_block_bytes);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compression::Reader::int_type Log_compression::Reader::underflow()
+{
+   if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+   if (m_failed || !m_in.is_open())
+      return traits_type::eof();
+
+   std::size_t length = 0;
+   if (m_decoder)
+   {
+      length = m_decoder->Read(m_in, m_buffer.data(), m_buffer.size(), m_failed);
+   }
+   else
+   {
+      m_in.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+      length = static_cast<std::size_t>(m_in.gcount());
+   }
+
+   if (length == 0)
+      return traits_type::eof();
+
+   setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + length);
+   return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,134 @@
+/// @file Log_compression.h
+
+#ifndef LOG_COMPRESSION_H_
+#define LOG_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Streaming compression of log files. zstd and lz4 (frame format) are compiled in
+///            only on request: define DEBUGLOG_WITH_ZSTD and link libzstd, or DEBUGLOG_WITH_LZ4
+///            and link liblz4, e.g. "-DDEBUGLOG_WITH_ZSTD ... -lzstd".
+///
+///            The built-in format needs no library. It is a sequence of independent blocks of at
+///            most s_block_bytes, each LZ77-compressed with a 64 KiB window (or stored as-is if
+///            that does not make it smaller). Every block is preceded by its raw and stored sizes
+///            and an FNV-1a hash of its raw bytes. This does well enough on log text, where the
+///            time/thread columns and function entry/exit lines repeat.
+///
+///               "DLZ1" { u32 raw_size, u32 stored_size, u32 fnv1a, stored bytes }... u32 0, u32 0
+///
+///            Reader detects the format of a file from its first bytes.
+// ================================================================================================
+class Log_compression
+{
+public:
+
+   enum class format : std::uint8_t
+   {
+      e_builtin,     ///< Built-in block LZ, ".dlz"
+      e_lz4,         ///< LZ4 frame, ".lz4"
+      e_zstd         ///< Zstandard, ".zst"
+   };
+
+   static constexpr std::size_t s_block_bytes = 256 * 1024;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if @p f was compiled in.
+   // ---------------------------------------------------------------------------------------------
+   static bool Is_available(format f);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    zstd if compiled in, otherwise lz4, otherwise the built-in format.
+   // ---------------------------------------------------------------------------------------------
+   static format Best_available();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    File name suffix for @p f, including the dot.
+   // ---------------------------------------------------------------------------------------------
+   static const char* Extension(format f);
+
+   // =============================================================================================
+   /// @brief     Compresses a stream of bytes into @p out. Nothing is complete until Finish().
+   // =============================================================================================
+   class Writer
+   {
+   public:
+
+      Writer(format f, std::ostream &out);
+      ~Writer();
+
+      Writer(const Writer&) = delete;
+      Writer& operator=(const Writer&) = delete;
+
+      // ------------------------------------------------------------------------------------------
+      /// @return    @e false if compression or writing failed (or @p f is not compiled in).
+      // ------------------------------------------------------------------------------------------
+      bool Write(const char *data, std::size_t length);
+
+      // ------------------------------------------------------------------------------------------
+      /// @brief     Compresses what is still pending and ends the stream.
+      // ------------------------------------------------------------------------------------------
+      bool Finish();
+
+      struct Encoder;
+
+   private:
+
+      std::unique_ptr<Encoder>   m_encoder;
+      std::ostream               &m_out;
+   };
+
+   // =============================================================================================
+   /// @brief     Stream buffer that decompresses a file while it is read, e.g.
+   ///               Log_compression::Reader reader;
+   ///               reader.Open(path);
+   ///               std::istream in(&reader);
+   ///            Files in none of the formats are read as they are.
+   // =============================================================================================
+   class Reader : public std::streambuf
+   {
+   public:
+
+      Reader();
+      ~Reader() override;
+
+      // ------------------------------------------------------------------------------------------
+      /// @return    @e false if @p path cannot be opened, or is in a format that was not compiled
+      ///            in (Failed() is then @e true).
+      // ------------------------------------------------------------------------------------------
+      bool Open(const std::string &path);
+
+      // ------------------------------------------------------------------------------------------
+      /// @return    @e true if the file is compressed.
+      // ------------------------------------------------------------------------------------------
+      bool Is_compressed() const { return static_cast<bool>(m_decoder); }
+
+      // ------------------------------------------------------------------------------------------
+      /// @return    @e true if the data was found to be corrupt or cut short. Reading stops there.
+      // ------------------------------------------------------------------------------------------
+      bool Failed() const { return m_failed; }
+
+      struct Decoder;
+
+   protected:
+
+      int_type underflow() override;
+
+   private:
+
+      std::ifstream              m_in;
+      std::unique_ptr<Decoder>   m_decoder;
+      std::vector<char>          m_buffer;
+      bool                       m_failed;
+   };
+};
+
+#endif // LOG_COMPRESSION_H_
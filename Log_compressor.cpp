@@ -0,0 +1,186 @@
+/// @file Log_compressor.cpp
+
+#include "Log_compressor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#if defined _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#if defined __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+// ------------------------------------------------------------------------------------------------
+Log_compressor::Log_compressor()
+   : m_format(Log_compression::format::e_builtin)
+   , m_cpu_percent(25)
+   , m_running(false)
+   , m_stopping(false)
+   , m_files(0)
+   , m_bytes_in(0)
+   , m_bytes_out(0)
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_compressor::~Log_compressor()
+{
+   Stop();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Start(Log_compression::format f, int cpu_percent)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   if (m_running)
+      return;
+
+   m_format = f;
+   m_cpu_percent = std::min(std::max(cpu_percent, 1), 100);
+   m_stopping.store(false, std::memory_order_relaxed);
+   m_thread = std::thread(&Log_compressor::Worker_loop, this);
+   m_running = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Stop()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_running)
+         return;
+      m_running = false;
+      m_stopping.store(true, std::memory_order_relaxed);
+   }
+   m_wake.notify_one();
+   m_thread.join();
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compressor::Enqueue(int fd, std::size_t length, const std::string &target,
+                             std::function<void(bool)> done)
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_running)
+         return false;
+      m_jobs.push_back(Job{ fd, length, target, std::move(done) });
+   }
+   m_wake.notify_one();
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Worker_loop()
+{
+   Lower_priority();
+
+   for (;;)
+   {
+      Job job;
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         m_wake.wait(lock, [this] { return !m_jobs.empty() || m_stopping.load(std::memory_order_relaxed); });
+         if (m_jobs.empty())
+            break;
+         job = std::move(m_jobs.front());
+         m_jobs.pop_front();
+      }
+
+      bool ok = Compress(job);
+      Close_descriptor(job.m_fd);
+      if (ok)
+      {
+         m_files.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (job.m_done)
+      {
+         job.m_done(ok);
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_compressor::Compress(const Job &job)
+{
+   std::ofstream out(job.m_target, std::ios::out | std::ios::binary | std::ios::trunc);
+   if (!out.is_open())
+      return false;
+
+   Log_compression::Writer writer(m_format, out);
+   std::vector<char> buffer(Log_compression::s_block_bytes);
+   std::size_t offset = 0;
+
+   while (offset < job.m_length)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      std::size_t wanted = std::min(buffer.size(), job.m_length - offset);
+#if defined _WIN32
+      long got = (_lseeki64(job.m_fd, static_cast<long long>(offset), SEEK_SET) < 0) ? -1 :
+                    _read(job.m_fd, buffer.data(), static_cast<unsigned int>(wanted));
+#else
+      ssize_t got = ::pread(job.m_fd, buffer.data(), wanted, static_cast<off_t>(offset));
+#endif
+      if (got <= 0 || !writer.Write(buffer.data(), static_cast<std::size_t>(got)))
+         return false;
+      offset += static_cast<std::size_t>(got);
+
+      if (!m_stopping.load(std::memory_order_relaxed))
+      {
+         Throttle(std::chrono::steady_clock::now() - start);
+      }
+   }
+
+   if (!writer.Finish())
+      return false;
+
+   m_bytes_in.fetch_add(offset, std::memory_order_relaxed);
+   m_bytes_out.fetch_add(static_cast<std::uint64_t>(out.tellp()), std::memory_order_relaxed);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Throttle(std::chrono::steady_clock::duration busy)
+{
+   if (m_cpu_percent < 100)
+   {
+      // busy / (busy + idle) = cpu_percent / 100
+      std::this_thread::sleep_for(busy * (100 - m_cpu_percent) / m_cpu_percent);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Lower_priority()
+{
+#if defined _WIN32
+   SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined __linux__
+   // On Linux the nice value and the I/O priority are per thread
+   pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+   ::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+#if defined SYS_ioprio_set
+   const int ioprio_who_process = 1;
+   const int ioprio_class_idle = 3;
+   ::syscall(SYS_ioprio_set, ioprio_who_process, tid, ioprio_class_idle << 13);
+#endif
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_compressor::Close_descriptor(int fd)
+{
+#if defined _WIN32
+   _close(fd);
+#else
+   ::close(fd);
+#endif
+}
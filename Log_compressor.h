@@ -0,0 +1,96 @@
+/// @file Log_compressor.h
+
+#ifndef LOG_COMPRESSOR_H_
+#define LOG_COMPRESSOR_H_
+
+#include "Log_compression.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// ================================================================================================
+/// @brief     Compresses finished log files on a background thread, so that no logging thread
+///            ever waits for it. The thread runs at the lowest scheduling priority (and idle I/O
+///            priority on Linux). After every block it sleeps long enough to keep its share of one
+///            core under the configured percentage.
+///
+///            Files are passed as open descriptors, so a file may be renamed (rotated) while it
+///            is being compressed. The owner decides the final name in the job's completion
+///            callback.
+// ================================================================================================
+class Log_compressor
+{
+public:
+
+   Log_compressor();
+   ~Log_compressor();
+
+   Log_compressor(const Log_compressor&) = delete;
+   Log_compressor& operator=(const Log_compressor&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Starts the thread. @p cpu_percent (1 to 100) caps the time it spends working.
+   // ---------------------------------------------------------------------------------------------
+   void Start(Log_compression::format f, int cpu_percent = 25);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Finishes the queued files without throttling, then joins the thread.
+   // ---------------------------------------------------------------------------------------------
+   void Stop();
+
+   Log_compression::format Format() const { return m_format; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Queues the first @p length bytes of @p fd to be compressed into @p target. The
+   ///            descriptor is closed when done, then @p done is called with the result (on the
+   ///            compressor's thread).
+   /// @return    @e false if the compressor is not running; @p fd then stays the caller's.
+   // ---------------------------------------------------------------------------------------------
+   bool Enqueue(int fd, std::size_t length, const std::string &target, std::function<void(bool)> done);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Files compressed, and bytes read and written, since construction.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Files() const { return m_files.load(std::memory_order_relaxed); }
+   std::uint64_t Bytes_in() const { return m_bytes_in.load(std::memory_order_relaxed); }
+   std::uint64_t Bytes_out() const { return m_bytes_out.load(std::memory_order_relaxed); }
+
+private:
+
+   struct Job
+   {
+      int                        m_fd;
+      std::size_t                m_length;
+      std::string                m_target;
+      std::function<void(bool)>  m_done;
+   };
+
+   void Worker_loop();
+   bool Compress(const Job &job);
+   void Throttle(std::chrono::steady_clock::duration busy);
+
+   static void Lower_priority();
+   static void Close_descriptor(int fd);
+
+   Log_compression::format    m_format;
+   int                        m_cpu_percent;
+   std::thread                m_thread;
+   std::mutex                 m_mutex;
+   std::condition_variable    m_wake;
+   std::deque<Job>            m_jobs;
+   bool                       m_running;
+   std::atomic<bool>          m_stopping;
+   std::atomic<std::uint64_t> m_files;
+   std::atomic<std::uint64_t> m_bytes_in;
+   std::atomic<std::uint64_t> m_bytes_out;
+};
+
+#endif // LOG_COMPRESSOR_H_
@@ -0,0 +1,58 @@
+/// @file Log_format.cpp
+
+#include "Log_format.h"
+
+// ------------------------------------------------------------------------------------------------
+void Log_format::Substitute(std::string &out, std::string_view format, const Argument *args,
+                            std::size_t count)
+{
+   std::size_t next = 0;
+   std::size_t literal = 0;    // Start of the text not yet copied
+
+   for (std::size_t i = 0; i < format.size(); ++i)
+   {
+      char c = format[i];
+      if ((c != '{' && c != '}') || i + 1 == format.size())
+         continue;
+
+      if (c == '{' && format[i + 1] == '}' && next < count)
+      {
+         out.append(format.data() + literal, i - literal);
+         args[next].m_append(out, args[next].m_value);
+         ++next;
+      }
+      else if (format[i + 1] == c)
+      {
+         // "{{" or "}}": copy up to and including the first brace
+         out.append(format.data() + literal, i + 1 - literal);
+      }
+      else
+      {
+         continue;
+      }
+      ++i;
+      literal = i + 1;
+   }
+   out.append(format.data() + literal, format.size() - literal);
+
+   for (; next < count; ++next)
+   {
+      out.push_back(' ');
+      args[next].m_append(out, args[next].m_value);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_format::Append_pointer(std::string &out, std::uintptr_t value)
+{
+   // operator<<(const void*) prints "0x" and lowercase hex digits, or just "0" for null
+   if (value == 0)
+   {
+      out.push_back('0');
+      return;
+   }
+
+   char digits[2 + 2 * sizeof(std::uintptr_t)] = { '0', 'x' };
+   std::to_chars_result r = std::to_chars(digits + 2, digits + sizeof(digits), value, 16);
+   out.append(digits, static_cast<std::size_t>(r.ptr - digits));
+}
@@ -0,0 +1,191 @@
+/// @file Log_format.h
+
+#ifndef LOG_FORMAT_H_
+#define LOG_FORMAT_H_
+
+#include "Log_record.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Placeholder formatting for Debugfile::Write_format() and the G_LOG_FMT macros.
+///            Every "{}" in the format is replaced by the next argument; "{{" and "}}" are
+///            literal braces. Arguments are rendered straight into the record's string with
+///            std::to_chars, so a call allocates nothing once the string has grown to its
+///            working size. Values print as operator<< with default stream settings would,
+///            except bool ("true"/"false", like Write(description, bool)).
+///
+///            Placeholders() is constexpr, so the macros check a literal format against the
+///            number of arguments at compile time. A call that gets past the check with the
+///            wrong count still writes everything: extra "{}" are left as they are and extra
+///            arguments are appended, separated by spaces.
+// ================================================================================================
+class Log_format
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of "{}" in @p format, or -1 if it has a brace that is neither part of
+   ///            "{}" nor escaped.
+   // ---------------------------------------------------------------------------------------------
+   static constexpr int Placeholders(const char *format)
+   {
+      int count = 0;
+      for (const char *c = format; *c; ++c)
+      {
+         if (*c == '{')
+         {
+            if (c[1] == '{')
+               ++c;
+            else if (c[1] == '}')
+               ++c, ++count;
+            else
+               return -1;
+         }
+         else if (*c == '}')
+         {
+            if (c[1] != '}')
+               return -1;
+            ++c;
+         }
+      }
+      return count;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Only for sizeof() in the macros: an array of one more char than there are
+   ///            arguments, so that the count is a constant even for run-time values.
+   // ---------------------------------------------------------------------------------------------
+   template <typename... Args>
+   static char (&Arity(const Args&...))[sizeof...(Args) + 1];
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends @p format to @p out with its placeholders replaced by @p args.
+   // ---------------------------------------------------------------------------------------------
+   template <typename... Args>
+   static void Format(std::string &out, std::string_view format, const Args&... args)
+   {
+      const Argument arguments[sizeof...(Args) + 1] = { { &args, &Append_erased<Args> }...,
+                                                        { nullptr, nullptr } };
+      Substitute(out, format, arguments, sizeof...(Args));
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends one value as text.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Append(std::string &out, const T& value)
+   {
+      typedef typename std::decay<T>::type D;
+
+      if constexpr (std::is_same<D, bool>::value)
+      {
+         out.append(value ? "true" : "false");
+      }
+      else if constexpr (std::is_same<D, char>::value || std::is_same<D, signed char>::value ||
+                         std::is_same<D, unsigned char>::value)
+      {
+         out.push_back(static_cast<char>(value));
+      }
+      else if constexpr (std::is_integral<D>::value)
+      {
+         char digits[24];
+         std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+         out.append(digits, static_cast<std::size_t>(r.ptr - digits));
+      }
+      else if constexpr (std::is_floating_point<D>::value)
+      {
+         // Binary_log keeps long double as double; so does the text, to read the same
+         char digits[32];
+         std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits),
+                                                static_cast<double>(value),
+                                                std::chars_format::general, 6);
+         out.append(digits, static_cast<std::size_t>(r.ptr - digits));
+      }
+      else if constexpr (std::is_enum<D>::value)
+      {
+         Append(out, static_cast<typename std::underlying_type<D>::type>(value));
+      }
+      else if constexpr (std::is_array<T>::value &&
+                         std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type,
+                                      char>::value)
+      {
+         std::size_t length = 0;
+         while (length < std::extent<T>::value && value[length] != 0)
+            ++length;
+         out.append(value, length);
+      }
+      else if constexpr (std::is_same<D, const char*>::value || std::is_same<D, char*>::value)
+      {
+         out.append(value ? value : "(null)");
+      }
+      else if constexpr (std::is_same<D, std::string>::value || std::is_same<D, std::string_view>::value)
+      {
+         out.append(value.data(), value.size());
+      }
+      else if constexpr (std::is_pointer<D>::value || std::is_null_pointer<D>::value)
+      {
+         Append_pointer(out, reinterpret_cast<std::uintptr_t>(static_cast<const volatile void*>(value)));
+      }
+      else
+      {
+         Log_record_streambuf buf(&out);
+         std::ostream os(&buf);
+         os << value;
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Vectors print as "v0, v1, ...", like Write(description, vector).
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Append(std::string &out, const std::vector<T>& vec)
+   {
+      for (auto i = vec.begin(); i != vec.end(); ++i)
+      {
+         if (i != vec.begin())
+            out.append(", ");
+         if constexpr (std::is_same<T, bool>::value)
+            out.push_back(*i ? '1' : '0');   // As operator<< prints them
+         else
+            Append(out, static_cast<const T&>(*i));
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     One argument with its type erased, so that the format is parsed by one function
+   ///            for any argument list.
+   // ---------------------------------------------------------------------------------------------
+   struct Argument
+   {
+      const void  *m_value;
+      void        (*m_append)(std::string &out, const void *value);
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Format() after type erasure; also used by Binary_log::Decode with the decoded
+   ///            arguments as strings.
+   // ---------------------------------------------------------------------------------------------
+   static void Substitute(std::string &out, std::string_view format, const Argument *args,
+                          std::size_t count);
+
+   template <typename T>
+   static void Append_erased(std::string &out, const void *value)
+   {
+      Append(out, *static_cast<const T*>(value));
+   }
+
+private:
+
+   static void Append_pointer(std::string &out, std::uintptr_t value);
+};
+
+#endif // LOG_FORMAT_H_
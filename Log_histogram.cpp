@@ -0,0 +1,87 @@
+/// @file Log_histogram.cpp
+
+#include "Log_histogram.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Log_histogram::snapshot::Percentile_ns(double fraction) const
+{
+   if (m_count == 0)
+      return 0;
+
+   double target = fraction * static_cast<double>(m_count);
+   std::uint64_t seen = 0;
+   for (int b = 0; b < s_buckets; ++b)
+   {
+      seen += m_buckets[b];
+      if (seen != 0 && static_cast<double>(seen) >= target)
+      {
+         if (b == 0)
+            return 0;
+         return (b == s_buckets - 1) ? m_max_ns : std::min(Bucket_end_ns(b) - 1, m_max_ns);
+      }
+   }
+   return m_max_ns;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_histogram::snapshot::Subtract(const snapshot &earlier)
+{
+   m_count -= earlier.m_count;
+   m_total_ns -= earlier.m_total_ns;
+   int last = -1;
+   for (int b = 0; b < s_buckets; ++b)
+   {
+      m_buckets[b] -= earlier.m_buckets[b];
+      if (m_buckets[b] != 0)
+         last = b;
+   }
+
+   // The interval's maximum is only known to its highest bucket; the last one is open-ended,
+   // so for it the all-time maximum is the best bound there is
+   if (last <= 0)
+      m_max_ns = 0;
+   else if (last < s_buckets - 1)
+      m_max_ns = std::min(Bucket_end_ns(last) - 1, m_max_ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_histogram::Add_to(snapshot &s) const
+{
+   s.m_count += m_count.load(std::memory_order_relaxed);
+   s.m_total_ns += m_total_ns.load(std::memory_order_relaxed);
+   s.m_max_ns = std::max(s.m_max_ns, m_max_ns.load(std::memory_order_relaxed));
+   for (int b = 0; b < s_buckets; ++b)
+   {
+      s.m_buckets[b] += m_buckets[b].load(std::memory_order_relaxed);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_histogram::Clear()
+{
+   m_count.store(0, std::memory_order_relaxed);
+   m_total_ns.store(0, std::memory_order_relaxed);
+   m_max_ns.store(0, std::memory_order_relaxed);
+   for (int b = 0; b < s_buckets; ++b)
+   {
+      m_buckets[b].store(0, std::memory_order_relaxed);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_histogram::Append_duration(std::string &out, std::uint64_t ns)
+{
+   char text[32];
+   if (ns < 1000)
+      std::snprintf(text, sizeof(text), "%lluns", static_cast<unsigned long long>(ns));
+   else if (ns < 1000000)
+      std::snprintf(text, sizeof(text), "%.1fus", static_cast<double>(ns) / 1e3);
+   else if (ns < 1000000000)
+      std::snprintf(text, sizeof(text), "%.2fms", static_cast<double>(ns) / 1e6);
+   else
+      std::snprintf(text, sizeof(text), "%.2fs", static_cast<double>(ns) / 1e9);
+   out += text;
+}
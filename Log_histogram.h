@@ -0,0 +1,115 @@
+/// @file Log_histogram.h
+
+#ifndef LOG_HISTOGRAM_H_
+#define LOG_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// ================================================================================================
+/// @brief     Distribution of durations in power-of-two buckets: bucket 0 holds 0 ns, bucket b
+///            holds [2^(b-1), 2^b) ns, and the last bucket everything from about 4.6 minutes up.
+///            Record() is a handful of relaxed atomic adds, so several threads may record into
+///            one histogram; to keep them off each other's cache lines, give each thread (or a
+///            stripe of threads) its own and add them up with Add_to().
+// ================================================================================================
+class Log_histogram
+{
+public:
+
+   static const int s_buckets = 40;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Plain copy of one or more histograms at some moment.
+   // ---------------------------------------------------------------------------------------------
+   struct snapshot
+   {
+      std::uint64_t  m_count{0};
+      std::uint64_t  m_total_ns{0};
+      std::uint64_t  m_max_ns{0};
+      std::uint64_t  m_buckets[s_buckets]{};
+
+      double Mean_ns() const { return m_count ? static_cast<double>(m_total_ns) / m_count : 0.0; }
+
+      // ------------------------------------------------------------------------------------------
+      /// @return    Upper edge of the bucket that holds the @p fraction quantile (0.5 for the
+      ///            median), at most m_max_ns; within a factor of two of the true value.
+      // ------------------------------------------------------------------------------------------
+      std::uint64_t Percentile_ns(double fraction) const;
+
+      // ------------------------------------------------------------------------------------------
+      /// @brief     Removes an earlier snapshot of the same histogram, leaving what was recorded
+      ///            in between. m_max_ns becomes the upper edge of the highest bucket left, at
+      ///            most the maximum over the whole time.
+      // ------------------------------------------------------------------------------------------
+      void Subtract(const snapshot &earlier);
+   };
+
+   Log_histogram() = default;
+   Log_histogram(const Log_histogram&) = delete;
+   Log_histogram& operator=(const Log_histogram&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Counts one duration.
+   // ---------------------------------------------------------------------------------------------
+   void Record(std::uint64_t ns)
+   {
+      m_buckets[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+      std::uint64_t max = m_max_ns.load(std::memory_order_relaxed);
+      while (ns > max && !m_max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+      {
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds this histogram's contents to @p s.
+   // ---------------------------------------------------------------------------------------------
+   void Add_to(snapshot &s) const;
+
+   void Clear();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Bucket of a duration, and the first duration past a bucket.
+   // ---------------------------------------------------------------------------------------------
+   static int Bucket(std::uint64_t ns)
+   {
+      int width = Bit_width(ns);
+      return (width < s_buckets) ? width : s_buckets - 1;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of bits needed for @p value: 0 for 0, else one more than the index of its
+   ///            highest set bit.
+   // ---------------------------------------------------------------------------------------------
+   static int Bit_width(std::uint64_t value)
+   {
+#if defined __GNUC__
+      return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+#else
+      int width = 0;
+      for (; value != 0; value >>= 1)
+         ++width;
+      return width;
+#endif
+   }
+
+   static std::uint64_t Bucket_end_ns(int bucket) { return std::uint64_t(1) << bucket; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends a duration in a unit that suits it: "850ns", "12.5us", "3.20ms", "1.50s".
+   // ---------------------------------------------------------------------------------------------
+   static void Append_duration(std::string &out, std::uint64_t ns);
+
+private:
+
+   std::atomic<std::uint64_t>    m_count{0};
+   std::atomic<std::uint64_t>    m_total_ns{0};
+   std::atomic<std::uint64_t>    m_max_ns{0};
+   std::atomic<std::uint64_t>    m_buckets[s_buckets]{};
+};
+
+#endif // LOG_HISTOGRAM_H_
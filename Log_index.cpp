@@ -0,0 +1,285 @@
+/// @file Log_index.cpp
+
+#include "Log_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+const char Log_index::magic[8] = { 'D', 'B', 'G', 'L', 'O', 'G', 'I', '\0' };
+
+namespace
+{
+   template <typename T>
+   void Write_raw(std::ostream &os, const T& v)
+   {
+      os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+   }
+
+   void Write_str(std::ostream &os, const char *s)
+   {
+      std::uint32_t len = s ? static_cast<std::uint32_t>(std::strlen(s)) : 0;
+      Write_raw(os, len);
+      os.write(s, len);
+   }
+
+   template <typename T>
+   bool Read_raw(std::istream &in, T &v)
+   {
+      return static_cast<bool>(in.read(reinterpret_cast<char*>(&v), sizeof(T)));
+   }
+
+   bool Read_str(std::istream &in, std::string &s)
+   {
+      std::uint32_t len = 0;
+      if (!Read_raw(in, len) || len > (1u << 24))
+         return false;
+      s.resize(len);
+      return len == 0 || static_cast<bool>(in.read(&s[0], len));
+   }
+
+   bool Fail(std::string *error, const std::string &text)
+   {
+      if (error)
+         *error = text;
+      return false;
+   }
+
+   // Two bit positions from one 64-bit mix (splitmix64's finalizer)
+   std::uint64_t Mix(std::uint64_t key)
+   {
+      key ^= key >> 30;
+      key *= 0xbf58476d1ce4e5b9ull;
+      key ^= key >> 27;
+      key *= 0x94d049bb133111ebull;
+      key ^= key >> 31;
+      return key;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_index::Open(const std::string &path, const header &h)
+{
+   Close(0);
+
+   m_out.open(path, std::ios::binary | std::ios::trunc);
+   if (!m_out.is_open())
+      return false;
+
+   m_block_bytes = h.m_block_bytes;
+   m_block = block();
+   m_sites_written.clear();
+   m_labels.clear();
+
+   m_out.write(magic, sizeof(magic));
+   Write_raw(m_out, byte_order_mark);
+   Write_raw(m_out, version);
+   Write_raw(m_out, static_cast<std::uint8_t>(h.m_timestamp_mode));
+   Write_raw(m_out, static_cast<std::uint8_t>(h.m_is_milli));
+   Write_raw(m_out, static_cast<std::uint8_t>(h.m_show_depth));
+   Write_raw(m_out, h.m_block_bytes);
+   Write_raw(m_out, h.m_systime);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Close(std::uint64_t end)
+{
+   if (m_out.is_open())
+   {
+      if (m_block.m_lines != 0)
+         Write_block(end);
+      m_out.close();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Add(std::uint64_t offset, std::int64_t ns, std::uint64_t thread_key, 
+                    const Log_call_site *site)
+{
+   if (m_block.m_lines != 0 && offset - m_block.m_offset >= m_block_bytes)
+      Write_block(offset);
+
+   if (m_block.m_lines == 0)
+   {
+      m_block.m_offset = offset;
+      m_block.m_first_ns = ns;
+      m_block.m_min_ns = ns;
+      m_block.m_max_ns = ns;
+   }
+   m_block.m_last_ns = ns;
+   m_block.m_min_ns = std::min(m_block.m_min_ns, ns);
+   m_block.m_max_ns = std::max(m_block.m_max_ns, ns);
+   ++m_block.m_lines;
+   Insert(m_block.m_threads, thread_key);
+
+   if (site)
+   {
+      std::uint32_t id = site->Id();
+      Insert(m_block.m_sites, id);
+      m_block.m_sited.push_back(sited_record{ static_cast<std::uint32_t>(offset - m_block.m_offset), id });
+
+      if (id >= m_sites_written.size())
+         m_sites_written.resize(id + 1, false);
+      if (!m_sites_written[id])
+      {
+         Write_raw(m_out, static_cast<std::uint8_t>(frame_type::e_site));
+         Write_raw(m_out, id);
+         Write_raw(m_out, static_cast<std::uint32_t>(site->m_line));
+         Write_str(m_out, site->m_file);
+         Write_str(m_out, site->m_function);
+         Write_str(m_out, site->m_description);
+         m_sites_written[id] = true;
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_index::Needs_label(std::uint64_t thread_key, const char *name)
+{
+   auto found = m_labels.find(thread_key);
+   return found == m_labels.end() || found->second != (name ? name : "");
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Add_label(std::uint64_t thread_key, const char *name, const std::string &label)
+{
+   m_labels[thread_key] = name ? name : "";
+
+   Write_raw(m_out, static_cast<std::uint8_t>(frame_type::e_thread));
+   Write_raw(m_out, thread_key);
+   Write_str(m_out, label.c_str());
+   Write_str(m_out, name);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Flush()
+{
+   m_out.flush();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Write_block(std::uint64_t end)
+{
+   m_block.m_end = end;
+
+   Write_raw(m_out, static_cast<std::uint8_t>(frame_type::e_block));
+   Write_raw(m_out, m_block.m_offset);
+   Write_raw(m_out, m_block.m_end);
+   Write_raw(m_out, m_block.m_first_ns);
+   Write_raw(m_out, m_block.m_last_ns);
+   Write_raw(m_out, m_block.m_min_ns);
+   Write_raw(m_out, m_block.m_max_ns);
+   Write_raw(m_out, m_block.m_lines);
+   for (std::uint64_t word : m_block.m_threads)
+      Write_raw(m_out, word);
+   for (std::uint64_t word : m_block.m_sites)
+      Write_raw(m_out, word);
+   Write_raw(m_out, static_cast<std::uint32_t>(m_block.m_sited.size()));
+   for (const sited_record &r : m_block.m_sited)
+   {
+      Write_raw(m_out, r.m_offset);
+      Write_raw(m_out, r.m_site);
+   }
+
+   m_block = block();
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_index::Load(const std::string &path, contents &out, std::string *error)
+{
+   std::ifstream in(path, std::ios::binary);
+   if (!in)
+      return Fail(error, "cannot open " + path);
+
+   char file_magic[sizeof(magic)];
+   std::uint32_t bom = 0;
+   std::uint8_t file_version = 0, mode = 0, is_milli = 0, show_depth = 0;
+   if (!in.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0)
+      return Fail(error, path + " is not a Debugfile index");
+   if (!Read_raw(in, bom) || bom != byte_order_mark)
+      return Fail(error, path + " was written with another byte order");
+   if (!Read_raw(in, file_version) || file_version != version)
+      return Fail(error, path + " has index version " + std::to_string(file_version) + 
+                         ", expected " + std::to_string(version));
+
+   out = contents();
+   header &h = out.m_header;
+   if (!Read_raw(in, mode) || !Read_raw(in, is_milli) || !Read_raw(in, show_depth) ||
+       !Read_raw(in, h.m_block_bytes) || !Read_raw(in, h.m_systime))
+      return Fail(error, path + " has a truncated header");
+   h.m_timestamp_mode = static_cast<Log_timestamp::mode>(mode);
+   h.m_is_milli = is_milli != 0;
+   h.m_show_depth = show_depth != 0;
+
+   // A writer that died leaves a partial frame at the end: keep what is complete
+   std::uint8_t type = 0;
+   while (Read_raw(in, type))
+   {
+      if (type == static_cast<std::uint8_t>(frame_type::e_block))
+      {
+         block b;
+         bool ok = Read_raw(in, b.m_offset) && Read_raw(in, b.m_end) && Read_raw(in, b.m_first_ns) &&
+                   Read_raw(in, b.m_last_ns) && Read_raw(in, b.m_min_ns) && Read_raw(in, b.m_max_ns) &&
+                   Read_raw(in, b.m_lines);
+         for (std::uint64_t &word : b.m_threads)
+            ok = ok && Read_raw(in, word);
+         for (std::uint64_t &word : b.m_sites)
+            ok = ok && Read_raw(in, word);
+         std::uint32_t sited = 0;
+         ok = ok && Read_raw(in, sited) && sited <= b.m_lines;
+         for (std::uint32_t i = 0; ok && i < sited; ++i)
+         {
+            sited_record r;
+            ok = Read_raw(in, r.m_offset) && Read_raw(in, r.m_site);
+            b.m_sited.push_back(r);
+         }
+         if (!ok)
+            break;
+         out.m_blocks.push_back(std::move(b));
+      }
+      else if (type == static_cast<std::uint8_t>(frame_type::e_site))
+      {
+         site s;
+         if (!Read_raw(in, s.m_id) || !Read_raw(in, s.m_line) || !Read_str(in, s.m_file) ||
+             !Read_str(in, s.m_function) || !Read_str(in, s.m_description))
+            break;
+         out.m_sites.push_back(std::move(s));
+      }
+      else if (type == static_cast<std::uint8_t>(frame_type::e_thread))
+      {
+         thread t;
+         if (!Read_raw(in, t.m_key) || !Read_str(in, t.m_label) || !Read_str(in, t.m_name))
+            break;
+         out.m_threads.push_back(std::move(t));
+      }
+      else
+      {
+         return Fail(error, path + " has an unknown frame type " + std::to_string(type));
+      }
+   }
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_index::Insert(std::uint64_t (&bloom)[s_bloom_words], std::uint64_t key)
+{
+   std::uint64_t h = Mix(key);
+   for (int i = 0; i < 2; ++i, h >>= 8)
+   {
+      unsigned bit = static_cast<unsigned>(h & 255);
+      bloom[bit / 64] |= std::uint64_t(1) << (bit % 64);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_index::May_contain(const std::uint64_t (&bloom)[s_bloom_words], std::uint64_t key)
+{
+   std::uint64_t h = Mix(key);
+   for (int i = 0; i < 2; ++i, h >>= 8)
+   {
+      unsigned bit = static_cast<unsigned>(h & 255);
+      if ((bloom[bit / 64] & (std::uint64_t(1) << (bit % 64))) == 0)
+         return false;
+   }
+   return true;
+}
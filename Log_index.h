@@ -0,0 +1,185 @@
+/// @file Log_index.h
+
+#ifndef LOG_INDEX_H_
+#define LOG_INDEX_H_
+
+#include "Log_call_site.h"
+#include "Log_timestamp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Sparse index of a text log, written by Debugfile::Set_index() to "<log>.idx" as the
+///            log grows. The log is cut into blocks of about block_bytes, each starting at a line;
+///            for every block the index holds its byte range, the times of its first and last
+///            record and the lowest and highest time in it (records are stamped before they queue
+///            for the file, so times within a block are not in order), and two 256-bit Bloom
+///            filters: of the threads and of the call sites that
+///            wrote to it, and the call site of each record that has one, by its offset in the
+///            block. It also names each thread and call site once. A reader can so skip blocks
+///            that cannot hold what it looks for and pick out a site's records exactly (see
+///            tools/Debuglog_query.cpp).
+///
+///            File  := header frame*
+///            header:= magic[8] u32 byte_order_mark u8 version u8 timestamp_mode u8 is_milli
+///                     u8 show_depth u32 block_bytes i64 systime
+///            frame := u8 frame_type, then
+///                     e_block:  u64 offset u64 end i64 first_ns i64 last_ns i64 min_ns
+///                               i64 max_ns u32 lines
+///                               u64 threads[4] u64 sites[4]
+///                               u32 count (u32 record_offset u32 site)[count]
+///                     e_site:   u32 id u32 line str file str function str description
+///                     e_thread: u64 key str label str name
+///                                                     (str = u32 length + bytes; host byte order)
+///
+///            Times are nanoseconds since the log was opened, which is @e systime. A block frame
+///            is written when the next block starts, so after a crash the end of the log is not
+///            indexed; readers scan it instead.
+// ================================================================================================
+class Log_index
+{
+public:
+
+   static const char             magic[8];
+   static constexpr std::uint32_t byte_order_mark = 0x01020304u;
+   static constexpr std::uint8_t  version = 3;
+   static const int              s_bloom_words = 4;
+
+   enum class frame_type : std::uint8_t
+   {
+      e_block  = 1,
+      e_site   = 2,
+      e_thread = 3
+   };
+
+   struct header
+   {
+      Log_timestamp::mode  m_timestamp_mode{Log_timestamp::mode::e_global_delta};
+      bool                 m_is_milli{false};
+      bool                 m_show_depth{false};
+      std::uint32_t        m_block_bytes{0};
+      std::int64_t         m_systime{0};
+   };
+
+   struct sited_record
+   {
+      std::uint32_t  m_offset;         ///< From the start of the block
+      std::uint32_t  m_site;           ///< Log_call_site::Id()
+   };
+
+   struct block
+   {
+      std::uint64_t  m_offset{0};
+      std::uint64_t  m_end{0};
+      std::int64_t   m_first_ns{0};
+      std::int64_t   m_last_ns{0};
+      std::int64_t   m_min_ns{0};
+      std::int64_t   m_max_ns{0};
+      std::uint32_t  m_lines{0};
+      std::uint64_t  m_threads[s_bloom_words]{};
+      std::uint64_t  m_sites[s_bloom_words]{};
+      std::vector<sited_record> m_sited;  ///< Records with a call site, in file order
+   };
+
+   struct site
+   {
+      std::uint32_t  m_id{0};
+      std::uint32_t  m_line{0};
+      std::string    m_file;
+      std::string    m_function;
+      std::string    m_description;
+   };
+
+   struct thread
+   {
+      std::uint64_t  m_key{0};         ///< Thread_key()
+      std::string    m_label;          ///< As shown in the Thread_ID column
+      std::string    m_name;           ///< Log_thread name, or empty
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Everything a reader gets from Load().
+   // ---------------------------------------------------------------------------------------------
+   struct contents
+   {
+      header               m_header;
+      std::vector<block>   m_blocks;
+      std::vector<site>    m_sites;
+      std::vector<thread>  m_threads;
+   };
+
+   Log_index() = default;
+   ~Log_index() { Close(0); }
+
+   Log_index(const Log_index&) = delete;
+   Log_index& operator=(const Log_index&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer: creates or truncates @p path and writes the header.
+   // ---------------------------------------------------------------------------------------------
+   bool Open(const std::string &path, const header &h);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer: writes the last block, which ends at @p end, and closes the file.
+   // ---------------------------------------------------------------------------------------------
+   void Close(std::uint64_t end);
+
+   bool Is_open() const { return m_out.is_open(); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer: a record starts at byte @p offset of the log, stamped @p ns after the
+   ///            log was opened, from thread @p thread_key and @p site (nullptr if it has none).
+   ///            Starts a new block if the current one has reached block_bytes.
+   // ---------------------------------------------------------------------------------------------
+   void Add(std::uint64_t offset, std::int64_t ns, std::uint64_t thread_key, const Log_call_site *site);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer: whether the Thread_ID label of @p thread_key must be (re)written, i.e. the
+   ///            thread is new or now has the name @p name; and writing it.
+   // ---------------------------------------------------------------------------------------------
+   bool Needs_label(std::uint64_t thread_key, const char *name);
+   void Add_label(std::uint64_t thread_key, const char *name, const std::string &label);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writer: hands the written frames to the OS, with the log's own flush.
+   // ---------------------------------------------------------------------------------------------
+   void Flush();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Reader: reads the index at @p path. A truncated last frame is ignored.
+   // ---------------------------------------------------------------------------------------------
+   static bool Load(const std::string &path, contents &out, std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    The key a thread is indexed under: its process (0 unless collected) and its
+   ///            Log_thread id.
+   // ---------------------------------------------------------------------------------------------
+   static std::uint64_t Thread_key(std::uint32_t process, std::uint32_t thread)
+   {
+      return (static_cast<std::uint64_t>(process) << 32) | thread;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Bloom filter operations on one of a block's filters. May_contain() has false
+   ///            positives but no false negatives.
+   // ---------------------------------------------------------------------------------------------
+   static void Insert(std::uint64_t (&bloom)[s_bloom_words], std::uint64_t key);
+   static bool May_contain(const std::uint64_t (&bloom)[s_bloom_words], std::uint64_t key);
+
+private:
+
+   void Write_block(std::uint64_t end);
+
+   std::ofstream        m_out;
+   std::uint32_t        m_block_bytes{0};
+   block                m_block;             ///< Being filled; m_lines == 0 when empty
+   std::vector<bool>    m_sites_written;
+   std::unordered_map<std::uint64_t, std::string> m_labels;   ///< Thread key -> name when written
+};
+
+#endif // LOG_INDEX_H_
@@ -0,0 +1,400 @@
+/// @file Log_latency.cpp
+
+#include "Log_latency.h"
+#include "Log_histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+   // Exact below 16 ticks, then 8 buckets per power of two up to 2^45 ticks; longer durations
+   // share the last bucket
+   const int s_linear = 16;
+   const int s_per_octave = 8;
+   const int s_max_exponent = 44;
+   const int s_buckets = s_linear + (s_max_exponent - 3) * s_per_octave;
+
+   int Bucket(std::uint64_t ticks)
+   {
+      if (ticks < static_cast<std::uint64_t>(s_linear))
+         return static_cast<int>(ticks);
+
+      int exponent = Log_histogram::Bit_width(ticks) - 1;      // 4 or more
+      if (exponent > s_max_exponent)
+         return s_buckets - 1;
+      return s_linear + (exponent - 4) * s_per_octave + static_cast<int>((ticks >> (exponent - 3)) & 7);
+   }
+
+   // First tick count of a bucket, and the first one past it
+   std::uint64_t Bucket_begin(int bucket)
+   {
+      if (bucket < s_linear)
+         return static_cast<std::uint64_t>(bucket);
+      int exponent = 4 + (bucket - s_linear) / s_per_octave;
+      return static_cast<std::uint64_t>(8 + (bucket - s_linear) % s_per_octave) << (exponent - 3);
+   }
+
+   std::uint64_t Bucket_end(int bucket)
+   {
+      return (bucket + 1 < s_buckets) ? Bucket_begin(bucket + 1) : UINT64_MAX;
+   }
+
+   // Single writer: the owning thread. A load and a store, no locked instruction; readers see
+   // each value whole because it is atomic.
+   void Bump(std::atomic<std::uint64_t> &value, std::uint64_t n)
+   {
+      value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+   }
+
+   struct Thread_histogram
+   {
+      explicit Thread_histogram(std::uint32_t name) : m_name(name) {}
+
+      void Add(std::uint64_t ticks)
+      {
+         Bump(m_buckets[Bucket(ticks)], 1);
+         Bump(m_count, 1);
+         Bump(m_sum, ticks);
+         if (ticks < m_min.load(std::memory_order_relaxed))
+            m_min.store(ticks, std::memory_order_relaxed);
+         if (ticks > m_max.load(std::memory_order_relaxed))
+            m_max.store(ticks, std::memory_order_relaxed);
+      }
+
+      const std::uint32_t           m_name;     ///< Index into Registry::m_names
+      std::atomic<std::uint64_t>    m_count{0};
+      std::atomic<std::uint64_t>    m_sum{0};
+      std::atomic<std::uint64_t>    m_min{UINT64_MAX};
+      std::atomic<std::uint64_t>    m_max{0};
+      std::atomic<std::uint64_t>    m_buckets[s_buckets]{};
+   };
+
+   // All threads' histograms of one name added up
+   struct Merged
+   {
+      void Add(const Thread_histogram &h)
+      {
+         m_count += h.m_count.load(std::memory_order_relaxed);
+         m_sum += h.m_sum.load(std::memory_order_relaxed);
+         m_min = std::min(m_min, h.m_min.load(std::memory_order_relaxed));
+         m_max = std::max(m_max, h.m_max.load(std::memory_order_relaxed));
+         for (int b = 0; b < s_buckets; ++b)
+         {
+            m_buckets[b] += h.m_buckets[b].load(std::memory_order_relaxed);
+         }
+      }
+
+      void Add(const Merged &m)
+      {
+         m_count += m.m_count;
+         m_sum += m.m_sum;
+         m_min = std::min(m_min, m.m_min);
+         m_max = std::max(m_max, m.m_max);
+         for (int b = 0; b < s_buckets; ++b)
+         {
+            m_buckets[b] += m.m_buckets[b];
+         }
+      }
+
+      std::uint64_t  m_count{0};
+      std::uint64_t  m_sum{0};
+      std::uint64_t  m_min{UINT64_MAX};
+      std::uint64_t  m_max{0};
+      std::uint64_t  m_buckets[s_buckets]{};
+   };
+
+   struct Thread_slots;
+
+   struct Registry
+   {
+      std::mutex                                         m_mutex;
+      std::vector<std::string>                           m_names;
+      std::unordered_map<std::string, std::uint32_t>     m_index;
+      std::vector<Thread_slots*>                         m_threads;    ///< Live threads that recorded
+      std::vector<Merged>                                m_retired;    ///< By name: exited threads
+      std::vector<Merged>                                m_reported;   ///< By name: at the last Since_last()
+   };
+
+   // Never destroyed, so that threads exiting during static destruction can still fold in
+   Registry& The_registry()
+   {
+      static Registry *registry = new Registry;
+      return *registry;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // The calling thread's histograms: one per name, and a lookup by call site id. Only the owner
+   // touches m_by_site; m_histograms grows under the registry lock, as merging reads it.
+   // ---------------------------------------------------------------------------------------------
+   struct Thread_slots
+   {
+      ~Thread_slots()
+      {
+         if (m_histograms.empty())
+            return;
+
+         Registry &registry = The_registry();
+         std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+         for (const std::unique_ptr<Thread_histogram> &h : m_histograms)
+         {
+            registry.m_retired[h->m_name].Add(*h);
+         }
+         registry.m_threads.erase(std::find(registry.m_threads.begin(), registry.m_threads.end(), this));
+      }
+
+      Thread_histogram& Slot(const Log_call_site &site)
+      {
+         std::uint32_t id = site.Id();
+         if (id < m_by_site.size() && m_by_site[id])
+            return *m_by_site[id];
+         return Add_slot(site, id);
+      }
+
+      Thread_histogram& Add_slot(const Log_call_site &site, std::uint32_t id)
+      {
+         Registry &registry = The_registry();
+         std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+         std::string name = site.m_description ? site.m_description : "(unnamed)";
+         auto found = registry.m_index.find(name);
+         std::uint32_t index = 0;
+         if (found != registry.m_index.end())
+         {
+            index = found->second;
+         }
+         else
+         {
+            index = static_cast<std::uint32_t>(registry.m_names.size());
+            registry.m_names.push_back(name);
+            registry.m_index.emplace(name, index);
+            registry.m_retired.emplace_back();
+            registry.m_reported.emplace_back();
+         }
+
+         Thread_histogram *histogram = nullptr;
+         for (const std::unique_ptr<Thread_histogram> &h : m_histograms)
+         {
+            if (h->m_name == index)
+               histogram = h.get();
+         }
+         if (!histogram)
+         {
+            if (m_histograms.empty())
+               registry.m_threads.push_back(this);
+            m_histograms.emplace_back(new Thread_histogram(index));
+            histogram = m_histograms.back().get();
+         }
+
+         if (id >= m_by_site.size())
+            m_by_site.resize(id + 1, nullptr);
+         m_by_site[id] = histogram;
+         return *histogram;
+      }
+
+      std::vector<Thread_histogram*>                     m_by_site;
+      std::vector<std::unique_ptr<Thread_histogram>>     m_histograms;
+   };
+
+   thread_local Thread_slots t_slots;
+
+   // Everything recorded so far, by name (registry lock held)
+   std::vector<Merged> Merge_all(const Registry &registry)
+   {
+      std::vector<Merged> merged(registry.m_retired);
+      for (const Thread_slots *thread : registry.m_threads)
+      {
+         for (const std::unique_ptr<Thread_histogram> &h : thread->m_histograms)
+         {
+            merged[h->m_name].Add(*h);
+         }
+      }
+      return merged;
+   }
+
+   std::uint64_t To_ns(std::uint64_t ticks)
+   {
+      return static_cast<std::uint64_t>(std::llround(static_cast<double>(ticks) * Log_clock::Ns_per_tick()));
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Summary of @p m. A percentile is the middle of its bucket, kept within [min, max].
+   // ---------------------------------------------------------------------------------------------
+   Log_latency::summary Summarize(const std::string &name, const Merged &m)
+   {
+      auto percentile = [&m](double fraction)
+      {
+         std::uint64_t target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * m.m_count)));
+         std::uint64_t seen = 0;
+         for (int b = 0; b < s_buckets; ++b)
+         {
+            seen += m.m_buckets[b];
+            if (seen >= target)
+            {
+               std::uint64_t middle = Bucket_begin(b) + (std::min(Bucket_end(b), m.m_max + 1) - Bucket_begin(b)) / 2;
+               return std::min(std::max(middle, m.m_min), m.m_max);
+            }
+         }
+         return m.m_max;
+      };
+
+      return Log_latency::summary{ name, m.m_count, To_ns(m.m_min), To_ns(percentile(0.5)), To_ns(percentile(0.9)),
+                                   To_ns(percentile(0.99)), To_ns(m.m_max),
+                                   m.m_count ? static_cast<double>(m.m_sum) * Log_clock::Ns_per_tick() / m.m_count : 0.0 };
+   }
+
+   // Periodic report
+   struct Reporter
+   {
+      std::mutex     m_mutex;
+      void           (*m_report)(void *context){nullptr};
+      void           *m_context{nullptr};
+      std::uint64_t  m_interval_ticks{0};
+   };
+
+   Reporter& The_reporter()
+   {
+      static Reporter *reporter = new Reporter;
+      return *reporter;
+   }
+
+   std::atomic<std::uint64_t> s_next_report{UINT64_MAX};    ///< Log_clock ticks
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_latency::Record(const Log_call_site &site, std::uint64_t ticks)
+{
+   t_slots.Slot(site).Add(ticks);
+
+   if (s_next_report.load(std::memory_order_relaxed) != UINT64_MAX)
+   {
+      std::uint64_t now = Log_clock::Now();
+      if (now >= s_next_report.load(std::memory_order_relaxed))
+         Report_due(now);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_latency::Report_due(std::uint64_t now)
+{
+   Reporter &reporter = The_reporter();
+
+   // Whoever gets the lock reports; the others go on
+   std::unique_lock<std::mutex> reporter_lock(reporter.m_mutex, std::try_to_lock);
+   if (!reporter_lock.owns_lock() || !reporter.m_report || now < s_next_report.load(std::memory_order_relaxed))
+      return;
+
+   s_next_report.store(now + reporter.m_interval_ticks, std::memory_order_relaxed);
+   reporter.m_report(reporter.m_context);
+}
+
+// ------------------------------------------------------------------------------------------------
+std::vector<Log_latency::summary> Log_latency::Totals()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   std::vector<Merged> merged = Merge_all(registry);
+   std::vector<summary> summaries;
+   for (std::size_t i = 0; i < merged.size(); ++i)
+   {
+      if (merged[i].m_count != 0)
+         summaries.push_back(Summarize(registry.m_names[i], merged[i]));
+   }
+   return summaries;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::vector<Log_latency::summary> Log_latency::Since_last()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   std::vector<Merged> merged = Merge_all(registry);
+   std::vector<summary> summaries;
+   for (std::size_t i = 0; i < merged.size(); ++i)
+   {
+      const Merged &now = merged[i];
+      const Merged &before = registry.m_reported[i];
+      if (now.m_count == before.m_count)
+         continue;
+
+      // min and max of the interval are only known to their buckets
+      Merged interval;
+      interval.m_count = now.m_count - before.m_count;
+      interval.m_sum = now.m_sum - before.m_sum;
+      int first = -1, last = -1;
+      for (int b = 0; b < s_buckets; ++b)
+      {
+         interval.m_buckets[b] = now.m_buckets[b] - before.m_buckets[b];
+         if (interval.m_buckets[b] != 0)
+         {
+            first = (first < 0) ? b : first;
+            last = b;
+         }
+      }
+      if (first < 0)
+         continue;    // Counts raced ahead of the buckets; report next time
+      interval.m_min = std::max(Bucket_begin(first), now.m_min);
+      interval.m_max = std::min(Bucket_end(last) - 1, now.m_max);
+
+      summaries.push_back(Summarize(registry.m_names[i], interval));
+      registry.m_reported[i] = now;
+   }
+   return summaries;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string Log_latency::Format(const summary &s)
+{
+   std::string line = "latency " + s.m_name + ": n=" + std::to_string(s.m_count);
+   const struct { const char *m_label; std::uint64_t m_ns; } columns[] =
+   {
+      { " min=", s.m_min_ns }, { " p50=", s.m_p50_ns }, { " p90=", s.m_p90_ns },
+      { " p99=", s.m_p99_ns }, { " max=", s.m_max_ns },
+   };
+   for (const auto &c : columns)
+   {
+      line += c.m_label;
+      Log_histogram::Append_duration(line, c.m_ns);
+   }
+   return line;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_latency::Set_reporter(void (*report)(void *context), void *context, std::chrono::milliseconds interval)
+{
+   Reporter &reporter = The_reporter();
+   std::lock_guard<std::mutex> reporter_lock(reporter.m_mutex);
+
+   if (interval.count() <= 0)
+   {
+      reporter.m_report = nullptr;
+      s_next_report.store(UINT64_MAX, std::memory_order_relaxed);
+      return;
+   }
+
+   reporter.m_report = report;
+   reporter.m_context = context;
+   reporter.m_interval_ticks = static_cast<std::uint64_t>(
+                                  std::max<std::int64_t>(1, Log_clock::From_ns(static_cast<double>(interval.count()) * 1e6)));
+   s_next_report.store(Log_clock::Now() + reporter.m_interval_ticks, std::memory_order_relaxed);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_latency::Clear_reporter(void *context)
+{
+   Reporter &reporter = The_reporter();
+   std::lock_guard<std::mutex> reporter_lock(reporter.m_mutex);
+
+   if (reporter.m_context == context)
+   {
+      reporter.m_report = nullptr;
+      reporter.m_context = nullptr;
+      s_next_report.store(UINT64_MAX, std::memory_order_relaxed);
+   }
+}
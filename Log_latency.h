@@ -0,0 +1,110 @@
+/// @file Log_latency.h
+
+#ifndef LOG_LATENCY_H_
+#define LOG_LATENCY_H_
+
+#include "Log_call_site.h"
+#include "Log_clock.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Latency histograms of timed scopes (G_LOG_TIMED_SCOPE), keyed by name. Durations
+///            are kept in Log_clock ticks in log-linear buckets, like an HDR histogram with
+///            three significant bits: exact up to 16 ticks, then 8 buckets per power of two, so a
+///            reported percentile is within 6.25% of the true value.
+///
+///            Every thread records into histograms of its own. Only that thread writes them and
+///            it does so with plain loads and stores, so recording takes no lock and no atomic
+///            read-modify-write. Summaries merge all threads' histograms on demand; histograms
+///            of threads that have exited are folded into a per-name total. Memory is bounded
+///            by the number of names times the number of live threads, about 3 KiB each.
+// ================================================================================================
+class Log_latency
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Times from construction to destruction into the histogram named by the site's
+   ///            description. With @p enabled false it does nothing, not even read the clock.
+   // ---------------------------------------------------------------------------------------------
+   class scope
+   {
+   public:
+      scope(const Log_call_site &site, bool enabled)
+      : m_site(site)
+      , m_start(enabled ? Log_clock::Now() : 0)
+      {
+      }
+
+      ~scope()
+      {
+         if (m_start != 0)
+         {
+            Record(m_site, Log_clock::Now() - m_start);
+         }
+      }
+
+      scope(const scope&) = delete;
+      scope& operator=(const scope&) = delete;
+
+   private:
+      const Log_call_site  &m_site;
+      const std::uint64_t  m_start;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds one duration of @p ticks to the histogram named by @p site's description.
+   ///            Sites with the same name share it.
+   // ---------------------------------------------------------------------------------------------
+   static void Record(const Log_call_site &site, std::uint64_t ticks);
+
+   struct summary
+   {
+      std::string    m_name;
+      std::uint64_t  m_count;
+      std::uint64_t  m_min_ns;
+      std::uint64_t  m_p50_ns;
+      std::uint64_t  m_p90_ns;
+      std::uint64_t  m_p99_ns;
+      std::uint64_t  m_max_ns;
+      double         m_mean_ns;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    One summary per name, over everything recorded since the start.
+   // ---------------------------------------------------------------------------------------------
+   static std::vector<summary> Totals();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    One summary per name that recorded anything since the previous call. min and
+   ///            max then come from the buckets, so they are as precise as the percentiles.
+   // ---------------------------------------------------------------------------------------------
+   static std::vector<summary> Since_last();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    "latency <name>: n=<count> min=.. p50=.. p90=.. p99=.. max=.."
+   // ---------------------------------------------------------------------------------------------
+   static std::string Format(const summary &s);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Calls @p report(@p context) from the first Record() after each @p interval (0
+   ///            stops it). Only one reporter is kept; setting one replaces the previous.
+   // ---------------------------------------------------------------------------------------------
+   static void Set_reporter(void (*report)(void *context), void *context, std::chrono::milliseconds interval);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Removes the reporter if its context is @p context, waiting for a call in
+   ///            progress to finish.
+   // ---------------------------------------------------------------------------------------------
+   static void Clear_reporter(void *context);
+
+private:
+
+   static void Report_due(std::uint64_t now);
+};
+
+#endif // LOG_LATENCY_H_
@@ -0,0 +1,101 @@
+/// @file Log_metrics.cpp
+
+#include "Log_metrics.h"
+#include "Log_clock.h"
+#include "Log_thread.h"
+
+#include <cstdio>
+
+namespace
+{
+   void Append_timing(std::string &out, const char *name, const Log_histogram::snapshot &h)
+   {
+      out += "; ";
+      out += name;
+      out += ' ';
+      out += std::to_string(h.m_count);
+      if (h.m_count != 0)
+      {
+         out += " p50 ";
+         Log_histogram::Append_duration(out, h.Percentile_ns(0.5));
+         out += " p99 ";
+         Log_histogram::Append_duration(out, h.Percentile_ns(0.99));
+         out += " max ";
+         Log_histogram::Append_duration(out, h.m_max_ns);
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_metrics::Stripe& Log_metrics::Mine()
+{
+   return m_stripes[Log_thread::Id() % s_stripes];
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_metrics::snapshot Log_metrics::Snapshot() const
+{
+   snapshot s;
+   s.m_ticks = Log_clock::Now();
+   for (const Stripe &stripe : m_stripes)
+   {
+      for (int c = 0; c < static_cast<int>(counter::e_count); ++c)
+      {
+         s.m_counters[c] += stripe.m_counters[c].load(std::memory_order_relaxed);
+      }
+      for (int t = 0; t < static_cast<int>(timing::e_count); ++t)
+      {
+         stripe.m_timings[t].Add_to(s.m_timings[t]);
+      }
+   }
+   return s;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_metrics::Clear()
+{
+   for (Stripe &stripe : m_stripes)
+   {
+      for (std::atomic<std::uint64_t> &c : stripe.m_counters)
+      {
+         c.store(0, std::memory_order_relaxed);
+      }
+      for (Log_histogram &h : stripe.m_timings)
+      {
+         h.Clear();
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_metrics::snapshot::Subtract(const snapshot &earlier)
+{
+   for (int c = 0; c < static_cast<int>(counter::e_count); ++c)
+   {
+      m_counters[c] -= earlier.m_counters[c];
+   }
+   for (int t = 0; t < static_cast<int>(timing::e_count); ++t)
+   {
+      m_timings[t].Subtract(earlier.m_timings[t]);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string Log_metrics::Summary(const snapshot &s, double seconds)
+{
+   char text[96];
+   std::uint64_t records = s.Get(counter::e_records);
+   std::snprintf(text, sizeof(text), "metrics %.2f s: %llu records (%.0f/s), %.2f MB",
+                 seconds, static_cast<unsigned long long>(records),
+                 (seconds > 0.0) ? records / seconds : 0.0, s.Get(counter::e_bytes) / 1e6);
+
+   std::string line = text;
+   Append_timing(line, "write", s.Get(timing::e_write));
+   Append_timing(line, "lock waits", s.Get(timing::e_lock_wait));
+   Append_timing(line, "queue waits", s.Get(timing::e_queue_wait));
+   Append_timing(line, "flushes", s.Get(timing::e_flush));
+   line += "; dropped " + std::to_string(s.Get(counter::e_dropped)) +
+           ", spilled " + std::to_string(s.Get(counter::e_spilled)) +
+           ", suppressed " + std::to_string(s.Get(counter::e_suppressed));
+   return line;
+}
@@ -0,0 +1,102 @@
+/// @file Log_metrics.h
+
+#ifndef LOG_METRICS_H_
+#define LOG_METRICS_H_
+
+#include "Log_histogram.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ================================================================================================
+/// @brief     What a Debugfile costs: counters and duration histograms it keeps about itself
+///            while Debugfile::Collect_metrics() is on. Updates go to one of a few cache-line
+///            aligned stripes chosen by the thread's compact id (see Log_thread), so threads
+///            that log at the same time rarely touch the same line. Snapshot() adds the stripes
+///            up; it reads without locking, so a snapshot taken while threads log can be off by
+///            the updates in flight.
+// ================================================================================================
+class Log_metrics
+{
+public:
+
+   enum class counter : std::uint8_t
+   {
+      e_records,     ///< Records submitted, one per Write call
+      e_bytes,       ///< Their formatted size: text, or binary payload
+      e_dropped,     ///< Discarded by overflow_policy::e_drop
+      e_spilled,     ///< Sent to the overflow list by overflow_policy::e_grow
+      e_suppressed,  ///< Skipped by the sampling macros
+      e_count
+   };
+
+   enum class timing : std::uint8_t
+   {
+      e_write,       ///< Submit to return: lock, queue or shard, and I/O; not the formatting
+      e_lock_wait,   ///< Waiting for the file lock, counted only when it was taken
+      e_queue_wait,  ///< Waiting for a slot in the async queue (overflow_policy::e_block)
+      e_flush,       ///< Flushing the output buffer to the OS
+      e_count
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Totals since construction (or Clear()) at Log_clock time m_ticks.
+   // ---------------------------------------------------------------------------------------------
+   struct snapshot
+   {
+      std::uint64_t              m_ticks{0};
+      std::uint64_t              m_counters[static_cast<int>(counter::e_count)]{};
+      Log_histogram::snapshot    m_timings[static_cast<int>(timing::e_count)];
+
+      std::uint64_t Get(counter c) const { return m_counters[static_cast<int>(c)]; }
+      const Log_histogram::snapshot& Get(timing t) const { return m_timings[static_cast<int>(t)]; }
+
+      // ------------------------------------------------------------------------------------------
+      /// @brief     Leaves what happened between @p earlier and this snapshot.
+      // ------------------------------------------------------------------------------------------
+      void Subtract(const snapshot &earlier);
+   };
+
+   Log_metrics() = default;
+   Log_metrics(const Log_metrics&) = delete;
+   Log_metrics& operator=(const Log_metrics&) = delete;
+
+   void Add(counter c, std::uint64_t n = 1)
+   {
+      Mine().m_counters[static_cast<int>(c)].fetch_add(n, std::memory_order_relaxed);
+   }
+
+   void Record(timing t, std::uint64_t ns)
+   {
+      Mine().m_timings[static_cast<int>(t)].Record(ns);
+   }
+
+   snapshot Snapshot() const;
+
+   void Clear();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    One line describing @p s, e.g. the difference of two snapshots @p seconds apart:
+   ///            "metrics 10.00 s: 120000 records (12000/s), 4.1 MB; write p50 180ns p99 1.0us
+   ///            max 52us; lock waits 31 p99 8.2us; ..."
+   // ---------------------------------------------------------------------------------------------
+   static std::string Summary(const snapshot &s, double seconds);
+
+private:
+
+   static const std::size_t s_stripes = 16;
+
+   struct alignas(64) Stripe
+   {
+      std::atomic<std::uint64_t> m_counters[static_cast<int>(counter::e_count)]{};
+      Log_histogram              m_timings[static_cast<int>(timing::e_count)];
+   };
+
+   Stripe& Mine();
+
+   Stripe   m_stripes[s_stripes];
+};
+
+#endif // LOG_METRICS_H_
@@ -0,0 +1,462 @@
+/// @file Log_profile.cpp
+
+#include "Log_profile.h"
+#include "Log_clock.h"
+#include "Log_thread.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+   // Deeper calls are not tracked (their returns are matched by count), so a log that never
+   // returns cannot grow a stack without bound
+   const std::size_t s_max_depth = 4096;
+
+   // One thread's in-process profile. The owning thread records under m_mutex; Collect() takes
+   // it too, so the lock is uncontended except while collecting.
+   struct Thread_profile
+   {
+      std::mutex     m_mutex;
+      Log_profile    m_profile;
+   };
+
+   struct Registry
+   {
+      std::mutex                       m_mutex;
+      std::vector<Thread_profile*>     m_threads;
+      Log_profile                      m_retired;     ///< Completed calls of exited threads
+   };
+
+   // Never destroyed, so that threads exiting during static destruction can still fold in
+   Registry& The_registry()
+   {
+      static Registry *registry = new Registry;
+      return *registry;
+   }
+
+   const std::uint64_t s_epoch = Log_clock::Now();
+
+   // Folds the thread's profile into the registry's total and frees it when the thread exits, so
+   // memory is bounded by the call paths rather than by the number of threads ever started.
+   struct Profile_owner
+   {
+      ~Profile_owner()
+      {
+         if (!m_profile)
+            return;
+
+         Registry &registry = The_registry();
+         std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+         registry.m_retired.Merge(m_profile->m_profile);
+         registry.m_threads.erase(std::find(registry.m_threads.begin(), registry.m_threads.end(), m_profile));
+         delete m_profile;
+         m_profile = nullptr;
+      }
+
+      Thread_profile    *m_profile{nullptr};
+   };
+
+   Thread_profile& Local_profile()
+   {
+      thread_local Profile_owner owner;
+
+      if (!owner.m_profile)
+      {
+         Registry &registry = The_registry();
+         std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+         owner.m_profile = new Thread_profile;
+         registry.m_threads.push_back(owner.m_profile);
+      }
+      return *owner.m_profile;
+   }
+
+   std::int64_t Now_ns()
+   {
+      return static_cast<std::int64_t>(Log_clock::To_ns(static_cast<std::int64_t>(Log_clock::Now() - s_epoch)));
+   }
+
+   double To_ms(std::int64_t ns)
+   {
+      return static_cast<double>(ns) / 1e6;
+   }
+
+   double Percent(std::int64_t part, std::int64_t total)
+   {
+      return (total > 0) ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_profile::Log_profile(std::size_t max_nodes)
+   : m_max_nodes(std::max<std::size_t>(max_nodes, 2))
+{
+   m_nodes.push_back(Node{ 0, 0, 0, 0, 0 });
+   m_truncated = Function_id("[truncated]");
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Enter(std::uint64_t thread, std::string_view function, std::int64_t ns)
+{
+   Enter_id(thread, Function_id(function), ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Leave(std::uint64_t thread, std::string_view function, std::int64_t ns)
+{
+   Leave_id(thread, Function_id(function), ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Enter(std::uint64_t thread, const char *function, std::int64_t ns)
+{
+   auto found = m_pointer_ids.find(function);
+   std::uint32_t id = (found != m_pointer_ids.end()) ? found->second :
+                                                       (m_pointer_ids[function] = Function_id(function));
+   Enter_id(thread, id, ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Leave(std::uint64_t thread, const char *function, std::int64_t ns)
+{
+   auto found = m_pointer_ids.find(function);
+   std::uint32_t id = (found != m_pointer_ids.end()) ? found->second :
+                                                       (m_pointer_ids[function] = Function_id(function));
+   Leave_id(thread, id, ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint32_t Log_profile::Function_id(std::string_view name)
+{
+   auto inserted = m_function_ids.emplace(std::string(name), static_cast<std::uint32_t>(m_functions.size()));
+   if (inserted.second)
+   {
+      m_functions.push_back(Function{ inserted.first->first, 0, 0, 0 });
+   }
+   return inserted.first->second;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint32_t Log_profile::Child(std::uint32_t parent, std::uint32_t function)
+{
+   std::uint64_t key = (static_cast<std::uint64_t>(parent) << 32) | function;
+   auto found = m_children.find(key);
+   if (found != m_children.end())
+      return found->second;
+
+   // Full: one "[truncated]" node per caller takes all new paths below it
+   if (m_nodes.size() >= m_max_nodes)
+   {
+      function = m_truncated;
+      key = (static_cast<std::uint64_t>(parent) << 32) | function;
+      found = m_children.find(key);
+      if (found != m_children.end())
+         return found->second;
+   }
+
+   std::uint32_t node = static_cast<std::uint32_t>(m_nodes.size());
+   m_nodes.push_back(Node{ parent, function, 0, 0, 0 });
+   m_children.emplace(key, node);
+   return node;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Enter_id(std::uint64_t thread, std::uint32_t function, std::int64_t ns)
+{
+   Thread &t = m_threads[thread];
+   t.m_last_ns = ns;
+
+   if (t.m_stack.size() >= s_max_depth || t.m_ignored != 0)
+   {
+      ++t.m_ignored;
+      return;
+   }
+
+   Frame f{ 0, function, ns, 0, frame_kind::e_own };
+   if (!t.m_stack.empty() && t.m_stack.back().m_kind != frame_kind::e_own)
+   {
+      f.m_node = t.m_stack.back().m_node;
+      f.m_kind = frame_kind::e_inside;
+   }
+   else
+   {
+      f.m_node = Child(t.m_stack.empty() ? 0 : t.m_stack.back().m_node, function);
+      if (m_nodes[f.m_node].m_function != function)
+         f.m_kind = frame_kind::e_collapsed;
+   }
+
+   if (function >= t.m_active.size())
+      t.m_active.resize(function + 1, 0);
+   ++t.m_active[function];
+
+   t.m_stack.push_back(f);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Leave_id(std::uint64_t thread, std::uint32_t function, std::int64_t ns)
+{
+   auto found = m_threads.find(thread);
+   if (found == m_threads.end())
+   {
+      ++m_unmatched;
+      return;
+   }
+
+   Thread &t = found->second;
+   t.m_last_ns = ns;
+
+   if (t.m_ignored != 0)
+   {
+      --t.m_ignored;
+      return;
+   }
+
+   std::size_t depth = t.m_stack.size();
+   while (depth != 0 && t.m_stack[depth - 1].m_function != function)
+      --depth;
+
+   if (depth == 0)
+   {
+      ++m_unmatched;
+      return;
+   }
+
+   // Calls above the match never returned (e.g. their return lines were filtered out)
+   while (t.m_stack.size() > depth)
+   {
+      Pop(t, ns);
+      ++m_unmatched;
+   }
+   Pop(t, ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Pop(Thread &t, std::int64_t ns)
+{
+   Frame f = t.m_stack.back();
+   t.m_stack.pop_back();
+
+   std::int64_t inclusive = std::max<std::int64_t>(0, ns - f.m_start_ns);
+   std::int64_t exclusive = std::max<std::int64_t>(0, inclusive - f.m_callees_ns);
+
+   if (f.m_kind != frame_kind::e_inside)
+   {
+      Node &n = m_nodes[f.m_node];
+      ++n.m_calls;
+      n.m_inclusive_ns += inclusive;
+      n.m_exclusive_ns += (f.m_kind == frame_kind::e_collapsed) ? inclusive : exclusive;
+   }
+
+   Function &fn = m_functions[f.m_function];
+   ++fn.m_calls;
+   fn.m_exclusive_ns += exclusive;
+   if (--t.m_active[f.m_function] == 0)
+      fn.m_inclusive_ns += inclusive;
+
+   if (!t.m_stack.empty())
+      t.m_stack.back().m_callees_ns += inclusive;
+
+   ++m_calls;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Finish()
+{
+   for (auto &entry : m_threads)
+   {
+      Thread &t = entry.second;
+      while (!t.m_stack.empty())
+      {
+         Pop(t, t.m_last_ns);
+         ++m_open_calls;
+      }
+      t.m_ignored = 0;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Merge(const Log_profile &other)
+{
+   std::vector<std::uint32_t> functions(other.m_functions.size());
+   for (std::size_t i = 0; i < other.m_functions.size(); ++i)
+   {
+      const Function &from = other.m_functions[i];
+      functions[i] = Function_id(from.m_name);
+
+      Function &to = m_functions[functions[i]];
+      to.m_calls += from.m_calls;
+      to.m_inclusive_ns += from.m_inclusive_ns;
+      to.m_exclusive_ns += from.m_exclusive_ns;
+   }
+
+   // Parents come before their children, so each node's parent is mapped when it is reached.
+   // Below a node that lands in "[truncated]", only exclusive time is added, as for calls.
+   std::vector<std::uint32_t> nodes(other.m_nodes.size(), 0);
+   std::vector<bool> collapsed(other.m_nodes.size(), false);
+   for (std::size_t i = 1; i < other.m_nodes.size(); ++i)
+   {
+      const Node &from = other.m_nodes[i];
+      std::uint32_t parent = nodes[from.m_parent];
+
+      if (collapsed[from.m_parent])
+      {
+         nodes[i] = parent;
+         collapsed[i] = true;
+         m_nodes[parent].m_exclusive_ns += from.m_exclusive_ns;
+         continue;
+      }
+
+      std::uint32_t function = functions[from.m_function];
+      std::uint32_t node = Child(parent, function);
+      nodes[i] = node;
+      collapsed[i] = (m_nodes[node].m_function != function);
+
+      Node &to = m_nodes[node];
+      to.m_calls += from.m_calls;
+      to.m_inclusive_ns += from.m_inclusive_ns;
+      to.m_exclusive_ns += from.m_exclusive_ns;
+   }
+
+   m_calls += other.m_calls;
+   m_unmatched += other.m_unmatched;
+   m_open_calls += other.m_open_calls;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string Log_profile::Path(std::uint32_t node) const
+{
+   std::vector<std::uint32_t> chain;
+   for (; node != 0; node = m_nodes[node].m_parent)
+      chain.push_back(node);
+
+   std::string path;
+   for (auto i = chain.rbegin(); i != chain.rend(); ++i)
+   {
+      if (!path.empty())
+         path += ';';
+      path += m_functions[m_nodes[*i].m_function].m_name;
+   }
+   return path;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Write_folded(std::ostream &os) const
+{
+   for (std::uint32_t i = 1; i < m_nodes.size(); ++i)
+   {
+      std::int64_t us = (m_nodes[i].m_exclusive_ns + 500) / 1000;
+      if (us > 0)
+         os << Path(i) << ' ' << us << '\n';
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Write_top(std::ostream &os, std::size_t top) const
+{
+   std::int64_t total = 0;
+   for (const Node &n : m_nodes)
+      total += n.m_exclusive_ns;
+
+   os << std::fixed << std::setprecision(3);
+   os << "Profile: " << m_calls << " calls, " << To_ms(total) << " ms; " <<
+         m_unmatched << " unmatched, " << m_open_calls << " still open\n";
+
+   std::vector<std::uint32_t> order;
+   for (std::uint32_t i = 0; i < m_functions.size(); ++i)
+   {
+      if (m_functions[i].m_calls != 0)
+         order.push_back(i);
+   }
+   std::sort(order.begin(), order.end(), [this](std::uint32_t a, std::uint32_t b)
+             {
+                return m_functions[a].m_exclusive_ns > m_functions[b].m_exclusive_ns;
+             });
+   if (order.size() > top)
+      order.resize(top);
+
+   os << std::right << std::setw(14) << "Exclusive_ms" << std::setw(8) << "Excl_%" <<
+         std::setw(14) << "Inclusive_ms" << std::setw(12) << "Calls" << std::setw(14) << "Avg_incl_us" <<
+         "  Function\n";
+   for (std::uint32_t i : order)
+   {
+      const Function &f = m_functions[i];
+      os << std::setw(14) << To_ms(f.m_exclusive_ns) << std::setw(8) << std::setprecision(1) <<
+            Percent(f.m_exclusive_ns, total) << std::setprecision(3) <<
+            std::setw(14) << To_ms(f.m_inclusive_ns) << std::setw(12) << f.m_calls <<
+            std::setw(14) << static_cast<double>(f.m_inclusive_ns) / 1e3 / static_cast<double>(f.m_calls) <<
+            "  " << f.m_name << '\n';
+   }
+
+   order.clear();
+   for (std::uint32_t i = 1; i < m_nodes.size(); ++i)
+   {
+      if (m_nodes[i].m_calls != 0)
+         order.push_back(i);
+   }
+   std::sort(order.begin(), order.end(), [this](std::uint32_t a, std::uint32_t b)
+             {
+                return m_nodes[a].m_inclusive_ns > m_nodes[b].m_inclusive_ns;
+             });
+   if (order.size() > top)
+      order.resize(top);
+
+   os << std::setw(14) << "Inclusive_ms" << std::setw(8) << "Incl_%" << std::setw(12) << "Calls" <<
+         "  Path\n";
+   for (std::uint32_t i : order)
+   {
+      const Node &n = m_nodes[i];
+      os << std::setw(14) << To_ms(n.m_inclusive_ns) << std::setw(8) << std::setprecision(1) <<
+            Percent(n.m_inclusive_ns, total) << std::setprecision(3) << std::setw(12) << n.m_calls <<
+            "  " << Path(i) << '\n';
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Begin(const char *function)
+{
+   Thread_profile &p = Local_profile();
+   std::int64_t ns = Now_ns();
+
+   std::lock_guard<std::mutex> profile_lock(p.m_mutex);
+   p.m_profile.Enter(Log_thread::Id(), function, ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::End(const char *function)
+{
+   Thread_profile &p = Local_profile();
+   std::int64_t ns = Now_ns();
+
+   std::lock_guard<std::mutex> profile_lock(p.m_mutex);
+   p.m_profile.Leave(Log_thread::Id(), function, ns);
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_profile Log_profile::Collect()
+{
+   Log_profile merged;
+
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   merged.Merge(registry.m_retired);
+   for (Thread_profile *p : registry.m_threads)
+   {
+      std::lock_guard<std::mutex> profile_lock(p->m_mutex);
+      merged.Merge(p->m_profile);
+   }
+   return merged;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_profile::Clear()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   registry.m_retired = Log_profile();
+   for (Thread_profile *p : registry.m_threads)
+   {
+      std::lock_guard<std::mutex> profile_lock(p->m_mutex);
+      p->m_profile = Log_profile();
+   }
+}
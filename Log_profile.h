@@ -0,0 +1,156 @@
+/// @file Log_profile.h
+
+#ifndef LOG_PROFILE_H_
+#define LOG_PROFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Call-tree profile built from function entry and exit events: those of G_LOG_FUNCTION
+///            in-process (Begin() and End(), see Debugfile::Profile_functions()), or the
+///            "Entering  -->" and "Returning <--" lines of a log (tools/Debuglog_profile.cpp).
+///
+///            Each thread has a stack of open calls. When a call returns, its inclusive time
+///            (entry to exit) and exclusive time (inclusive minus its callees) are added to its
+///            node in the call tree, one node per distinct path from the outermost call, and to
+///            its function's totals. A recursive function's inclusive time counts only its
+///            outermost call. A return that does not match the top of the stack closes the calls
+///            above the matching one; a return with no matching call is ignored. Both are counted
+///            as unmatched.
+///
+///            Memory is bounded by the number of distinct call paths, never by the number of
+///            events: past @e max_nodes, new paths are folded into a "[truncated]" frame under
+///            the deepest known caller.
+// ================================================================================================
+class Log_profile
+{
+public:
+
+   explicit Log_profile(std::size_t max_nodes = 1 << 20);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Thread @p thread entered or left @p function at @p ns (any origin, but one clock
+   ///            per thread). The const char* overloads remember the pointer, which must stay
+   ///            valid (__FUNCTION__ does), and skip hashing the name on later calls.
+   // ---------------------------------------------------------------------------------------------
+   void Enter(std::uint64_t thread, std::string_view function, std::int64_t ns);
+   void Leave(std::uint64_t thread, std::string_view function, std::int64_t ns);
+   void Enter(std::uint64_t thread, const char *function, std::int64_t ns);
+   void Leave(std::uint64_t thread, const char *function, std::int64_t ns);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Closes the calls still open at each thread's last event, e.g. at the end of a
+   ///            log. They are counted in Open_calls().
+   // ---------------------------------------------------------------------------------------------
+   void Finish();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds the completed calls of @p other to this profile, matching paths by name.
+   // ---------------------------------------------------------------------------------------------
+   void Merge(const Log_profile &other);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes one "outer;...;inner <microseconds>" line per call path with exclusive
+   ///            time, the folded format of flamegraph.pl and speedscope.
+   // ---------------------------------------------------------------------------------------------
+   void Write_folded(std::ostream &os) const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes the @p top functions by exclusive time and the @p top call paths by
+   ///            inclusive time, as tables.
+   // ---------------------------------------------------------------------------------------------
+   void Write_top(std::ostream &os, std::size_t top) const;
+
+   std::uint64_t Calls() const { return m_calls; }
+   std::uint64_t Unmatched() const { return m_unmatched; }
+   std::uint64_t Open_calls() const { return m_open_calls; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     In-process recording, used by Logger_helper: the calling thread enters or leaves
+   ///            @p function now. Each thread records into a profile of its own under a lock that
+   ///            only Collect() contends for; when the thread exits, its completed calls are merged
+   ///            into a shared total and the profile is freed.
+   // ---------------------------------------------------------------------------------------------
+   static void Begin(const char *function);
+   static void End(const char *function);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    The calls completed so far on all threads, merged.
+   // ---------------------------------------------------------------------------------------------
+   static Log_profile Collect();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Discards what Begin() and End() recorded. Call when no thread is profiling.
+   // ---------------------------------------------------------------------------------------------
+   static void Clear();
+
+private:
+
+   struct Node
+   {
+      std::uint32_t  m_parent;
+      std::uint32_t  m_function;
+      std::uint64_t  m_calls;
+      std::int64_t   m_inclusive_ns;
+      std::int64_t   m_exclusive_ns;
+   };
+
+   struct Function
+   {
+      std::string    m_name;
+      std::uint64_t  m_calls;
+      std::int64_t   m_inclusive_ns;
+      std::int64_t   m_exclusive_ns;
+   };
+
+   enum class frame_kind : std::uint8_t
+   {
+      e_own,         ///< Has its own node
+      e_collapsed,   ///< Outermost call in a "[truncated]" node, which gets all its time
+      e_inside       ///< Below a collapsed call
+   };
+
+   struct Frame
+   {
+      std::uint32_t  m_node;
+      std::uint32_t  m_function;
+      std::int64_t   m_start_ns;
+      std::int64_t   m_callees_ns;
+      frame_kind     m_kind;
+   };
+
+   struct Thread
+   {
+      std::vector<Frame>         m_stack;
+      std::vector<std::uint32_t> m_active;      ///< Open calls per function, for recursion
+      std::uint64_t              m_ignored{0};  ///< Entries past the depth limit
+      std::int64_t               m_last_ns{0};
+   };
+
+   std::uint32_t Function_id(std::string_view name);
+   std::uint32_t Child(std::uint32_t parent, std::uint32_t function);
+   void Enter_id(std::uint64_t thread, std::uint32_t function, std::int64_t ns);
+   void Leave_id(std::uint64_t thread, std::uint32_t function, std::int64_t ns);
+   void Pop(Thread &t, std::int64_t ns);
+   std::string Path(std::uint32_t node) const;
+
+   std::size_t                                        m_max_nodes;
+   std::vector<Node>                                  m_nodes;          ///< [0] is the root
+   std::unordered_map<std::uint64_t, std::uint32_t>   m_children;       ///< (parent, function) -> node
+   std::vector<Function>                              m_functions;
+   std::unordered_map<std::string, std::uint32_t>     m_function_ids;
+   std::unordered_map<const char*, std::uint32_t>     m_pointer_ids;
+   std::uint32_t                                      m_truncated;      ///< Function id of "[truncated]"
+   std::unordered_map<std::uint64_t, Thread>          m_threads;
+   std::uint64_t                                      m_calls{0};
+   std::uint64_t                                      m_unmatched{0};
+   std::uint64_t                                      m_open_calls{0};
+};
+
+#endif // LOG_PROFILE_H_
@@ -0,0 +1,137 @@
+/// @file Log_queue.h
+
+#ifndef LOG_QUEUE_H_
+#define LOG_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// ================================================================================================
+/// @brief     Bounded lock-free queue for many producers and one consumer (D. Vyukov's bounded
+///            MPMC ring). Each cell carries a sequence number that tells a producer whether the
+///            cell is free and the consumer whether it is filled, so neither side takes a lock.
+///            Cells are constructed once and reused in place; a T holding a std::string keeps its
+///            capacity, so steady-state pushes do not allocate.
+// ================================================================================================
+template <typename T>
+class Log_queue
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Capacity is rounded up to the next power of two (minimum 2).
+   // ---------------------------------------------------------------------------------------------
+   explicit Log_queue(std::size_t capacity)
+   {
+      std::size_t size = 2;
+      while (size < capacity)
+      {
+         size <<= 1;
+      }
+
+      m_cells.reset(new Cell[size]);
+      m_mask = size - 1;
+
+      for (std::size_t i = 0; i < size; ++i)
+      {
+         m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+      }
+      m_enqueue_pos.store(0, std::memory_order_relaxed);
+      m_dequeue_pos.store(0, std::memory_order_relaxed);
+   }
+
+   Log_queue(const Log_queue&) = delete;
+   Log_queue& operator=(const Log_queue&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Claims a free cell and calls fill(T&) on it.
+   /// @return    @e false if the queue is full; fill is not called in that case.
+   // ---------------------------------------------------------------------------------------------
+   template <typename Fill>
+   bool Try_push(Fill&& fill)
+   {
+      Cell *cell;
+      std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+      for (;;)
+      {
+         cell = &m_cells[pos & m_mask];
+         std::size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+         std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+         if (diff == 0)
+         {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               break;
+         }
+         else if (diff < 0)
+         {
+            return false;
+         }
+         else
+         {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+         }
+      }
+
+      fill(cell->m_data);
+      cell->m_sequence.store(pos + 1, std::memory_order_release);
+      return true;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Takes the oldest filled cell and calls consume(T&) on it.
+   /// @return    @e false if the queue is empty.
+   // ---------------------------------------------------------------------------------------------
+   template <typename Consume>
+   bool Try_pop(Consume&& consume)
+   {
+      Cell *cell;
+      std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+      for (;;)
+      {
+         cell = &m_cells[pos & m_mask];
+         std::size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+         std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+         if (diff == 0)
+         {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               break;
+         }
+         else if (diff < 0)
+         {
+            return false;
+         }
+         else
+         {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+         }
+      }
+
+      consume(cell->m_data);
+      cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+      return true;
+   }
+
+   std::size_t Capacity() const { return m_mask + 1; }
+
+private:
+
+   struct Cell
+   {
+      std::atomic<std::size_t>   m_sequence;
+      T                          m_data;
+   };
+
+   std::unique_ptr<Cell[]>                m_cells;
+   std::size_t                            m_mask{0};
+
+   // Producers and the consumer each hammer their own index; keep them on separate cache lines.
+   alignas(64) std::atomic<std::size_t>   m_enqueue_pos;
+   alignas(64) std::atomic<std::size_t>   m_dequeue_pos;
+};
+
+#endif // LOG_QUEUE_H_
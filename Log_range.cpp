@@ -0,0 +1,15 @@
+/// @file Log_range.cpp
+
+#include "Log_range.h"
+
+// ------------------------------------------------------------------------------------------------
+void Log_range::Append_skipped(std::string &out, std::size_t skipped, bool after_head, bool before_tail)
+{
+   if (after_head)
+      out.append(", ");
+   out.append("... (");
+   Append_value(out, static_cast<std::uint64_t>(skipped));
+   out.append(" more) ...");
+   if (before_tail)
+      out.append(", ");
+}
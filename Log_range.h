@@ -0,0 +1,253 @@
+/// @file Log_range.h
+
+#ifndef LOG_RANGE_H_
+#define LOG_RANGE_H_
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+// ================================================================================================
+/// @brief     Renders a contiguous range of arithmetic values for Debugfile::Write_range() and
+///            the vector overload of Write(). Elements are formatted with std::to_chars into a
+///            block on the stack that is appended to the record a few kilobytes at a time. That
+///            happens on the calling thread before the record is submitted, so a large range
+///            never holds the file lock while it is formatted.
+///
+///            Long ranges can be cut to their first and last elements, or reduced to a summary
+///            (count, min, max, mean). The summary's reductions keep several independent
+///            accumulators so that the compiler can vectorize them.
+// ================================================================================================
+class Log_range
+{
+public:
+
+   enum class style : std::uint8_t
+   {
+      e_decimal,     ///< As operator<< prints the elements ("1, 2, 3"); bool as 0 / 1
+      e_hex,         ///< Integers in hexadecimal (two's complement), floats as hexfloat
+      e_summary      ///< "n=<count> min=<min> max=<max> mean=<mean>"
+   };
+
+   static constexpr std::size_t s_all = std::numeric_limits<std::size_t>::max();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     What to write. A range longer than @p head + @p tail elements is written as its
+   ///            first @p head and last @p tail elements around "... (<skipped> more) ...".
+   // ---------------------------------------------------------------------------------------------
+   struct options
+   {
+      constexpr options(style s = style::e_decimal, std::size_t head = s_all, std::size_t tail = 0)
+      : m_style(s)
+      , m_head(head)
+      , m_tail(tail)
+      {
+      }
+
+      style          m_style;
+      std::size_t    m_head;
+      std::size_t    m_tail;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Result of Summarize(). min and max keep the element type; mean is 0 for n = 0.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   struct summary
+   {
+      std::size_t    m_count;
+      T              m_min;
+      T              m_max;
+      double         m_mean;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Count, min, max and mean of @p count elements. NaNs are not treated specially.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static summary<T> Summarize(const T *data, std::size_t count)
+   {
+      static_assert(std::is_arithmetic<T>::value, "Log_range takes arithmetic elements");
+
+      if (count == 0)
+         return summary<T>{ 0, T(), T(), 0.0 };
+
+      // Independent lanes, so each loop iteration is one vector operation per accumulator
+      const std::size_t lanes = 8;
+      T lo[lanes], hi[lanes];
+      double sum[lanes];
+      for (std::size_t l = 0; l < lanes; ++l)
+      {
+         lo[l] = hi[l] = data[0];
+         sum[l] = 0.0;
+      }
+
+      std::size_t i = 0;
+      for (; i + lanes <= count; i += lanes)
+      {
+         for (std::size_t l = 0; l < lanes; ++l)
+         {
+            T v = data[i + l];
+            lo[l] = (v < lo[l]) ? v : lo[l];
+            hi[l] = (hi[l] < v) ? v : hi[l];
+            sum[l] += static_cast<double>(v);
+         }
+      }
+      for (; i < count; ++i)
+      {
+         T v = data[i];
+         lo[0] = (v < lo[0]) ? v : lo[0];
+         hi[0] = (hi[0] < v) ? v : hi[0];
+         sum[0] += static_cast<double>(v);
+      }
+
+      summary<T> s{ count, lo[0], hi[0], sum[0] };
+      for (std::size_t l = 1; l < lanes; ++l)
+      {
+         s.m_min = (lo[l] < s.m_min) ? lo[l] : s.m_min;
+         s.m_max = (s.m_max < hi[l]) ? hi[l] : s.m_max;
+         s.m_mean += sum[l];
+      }
+      s.m_mean /= static_cast<double>(count);
+      return s;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends the elements (or their summary) to @p out as @p opt says.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Append(std::string &out, const T *data, std::size_t count, options opt = options())
+   {
+      static_assert(std::is_arithmetic<T>::value, "Log_range takes arithmetic elements");
+
+      if (opt.m_style == style::e_summary)
+      {
+         Append_summary(out, Summarize(data, count));
+         return;
+      }
+
+      if (!Is_cut(count, opt))
+      {
+         Append_elements(out, data, count, opt.m_style);
+         return;
+      }
+
+      Append_elements(out, data, opt.m_head, opt.m_style);
+      Append_skipped(out, count - opt.m_head - opt.m_tail, opt.m_head != 0, opt.m_tail != 0);
+      Append_elements(out, data + count - opt.m_tail, opt.m_tail, opt.m_style);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends "n=<count> min=<min> max=<max> mean=<mean>" (also used by the decoder).
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Append_summary(std::string &out, const summary<T> &s)
+   {
+      out.append("n=");
+      Append_value(out, static_cast<std::uint64_t>(s.m_count));
+      if (s.m_count != 0)
+      {
+         out.append(" min=");
+         Append_value(out, s.m_min);
+         out.append(" max=");
+         Append_value(out, s.m_max);
+         out.append(" mean=");
+         Append_value(out, s.m_mean);
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if @p opt leaves out part of a range of @p count elements.
+   // ---------------------------------------------------------------------------------------------
+   static bool Is_cut(std::size_t count, const options &opt)
+   {
+      return opt.m_head < count && opt.m_tail < count - opt.m_head;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends the elements separated by ", ", formatted a block at a time.
+   // ---------------------------------------------------------------------------------------------
+   template <typename T>
+   static void Append_elements(std::string &out, const T *data, std::size_t count, style st)
+   {
+      // Widest element: a double in general or hex notation, plus the separator
+      const std::size_t widest = 40;
+      char block[4096];
+      char *p = block;
+
+      for (std::size_t i = 0; i < count; ++i)
+      {
+         if (static_cast<std::size_t>(block + sizeof(block) - p) < widest)
+         {
+            out.append(block, static_cast<std::size_t>(p - block));
+            p = block;
+         }
+         if (i != 0)
+         {
+            *p++ = ',';
+            *p++ = ' ';
+         }
+         p = Put_element(p, block + sizeof(block), data[i], st);
+      }
+      out.append(block, static_cast<std::size_t>(p - block));
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends the marker for @p skipped elements left out between head and tail.
+   // ---------------------------------------------------------------------------------------------
+   static void Append_skipped(std::string &out, std::size_t skipped, bool after_head, bool before_tail);
+
+private:
+
+   // Where the text after a std::to_chars() continues; unchanged if it did not fit
+   static char* Advance(char *p, std::to_chars_result r)
+   {
+      return (r.ec == std::errc()) ? r.ptr : p;
+   }
+
+   template <typename T>
+   static void Append_value(std::string &out, T value, style st = style::e_decimal)
+   {
+      char digits[48];
+      out.append(digits, static_cast<std::size_t>(Put_element(digits, digits + sizeof(digits), value, st) - digits));
+   }
+
+   template <typename T>
+   static char* Put_element(char *p, char *end, T value, style st)
+   {
+      if constexpr (std::is_same<T, bool>::value)
+      {
+         *p++ = value ? '1' : '0';
+         return p;
+      }
+      else if constexpr (std::is_floating_point<T>::value)
+      {
+         // long double is written as double, as Binary_log stores it
+         if (st == style::e_hex)
+            return Advance(p, std::to_chars(p, end, static_cast<double>(value), std::chars_format::hex));
+         return Advance(p, std::to_chars(p, end, static_cast<double>(value), std::chars_format::general, 6));
+      }
+      else
+      {
+         if (st == style::e_hex)
+            return Advance(p, std::to_chars(p, end, static_cast<typename std::make_unsigned<T>::type>(value), 16));
+         if constexpr (std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+                       std::is_same<T, unsigned char>::value)
+         {
+            *p++ = static_cast<char>(value);   // operator<< prints characters
+            return p;
+         }
+         else
+         {
+            return Advance(p, std::to_chars(p, end, value));
+         }
+      }
+   }
+};
+
+#endif // LOG_RANGE_H_
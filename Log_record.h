@@ -0,0 +1,77 @@
+/// @file Log_record.h
+
+#ifndef LOG_RECORD_H_
+#define LOG_RECORD_H_
+
+#include <cstdint>
+#include <cstring>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+struct Log_call_site;
+
+// ================================================================================================
+/// @brief     One log line as captured on the calling thread: the formatted message plus everything
+///            the writer needs to render the timestamp, thread and indentation columns later.
+// ================================================================================================
+struct Log_record
+{
+   std::uint64_t     m_ticks{0};      ///< Log_clock::Now() when the record was submitted
+   std::uint32_t     m_thread{0};     ///< Log_thread::Id() of the writing thread
+   std::uint32_t     m_process{0};    ///< Collected from another process: its pid; else 0
+   const char        *m_thread_name{nullptr};   ///< Log_thread::Name() when it was submitted
+   int               m_indent{1};
+   int               m_depth{0};      ///< Logger_helper nesting on the writing thread
+   bool              m_newline{true};
+   std::string       m_text;
+   const Log_call_site *m_site{nullptr};  ///< Static site, if the caller had one
+};
+
+// ------------------------------------------------------------------------------------------------
+/// @brief     The integer that operator<<(std::thread::id) prints (pthread_t on POSIX, the
+///            thread id on Windows), for formats that store or render it without a stream.
+// ------------------------------------------------------------------------------------------------
+inline std::uint64_t Thread_id_value(std::thread::id id)
+{
+   static_assert(sizeof(std::thread::id) <= sizeof(std::uint64_t), "thread::id wider than 64 bits");
+
+   std::uint64_t value = 0;
+   std::memcpy(&value, &id, sizeof(id));
+   return value;
+}
+
+// ================================================================================================
+/// @brief     Stream buffer that appends to a std::string. Used to format a message into a record
+///            that is reused, so that the string keeps its capacity between calls.
+// ================================================================================================
+class Log_record_streambuf : public std::streambuf
+{
+public:
+   explicit Log_record_streambuf(std::string *target = nullptr) : m_target(target)
+   {
+   }
+
+   void Set_target(std::string *target) { m_target = target; }
+
+protected:
+   int_type overflow(int_type c) override
+   {
+      if (!traits_type::eq_int_type(c, traits_type::eof()))
+      {
+         m_target->push_back(traits_type::to_char_type(c));
+      }
+      return traits_type::not_eof(c);
+   }
+
+   std::streamsize xsputn(const char_type *s, std::streamsize n) override
+   {
+      m_target->append(s, static_cast<std::size_t>(n));
+      return n;
+   }
+
+private:
+   std::string *m_target;
+};
+
+#endif // LOG_RECORD_H_
@@ -0,0 +1,28 @@
+/// @file Log_sampler.cpp
+
+#include "Log_sampler.h"
+#include "Log_clock.h"
+
+// ------------------------------------------------------------------------------------------------
+bool Log_sampler::Admit_per_second(std::uint64_t &suppressed)
+{
+   const std::uint64_t count_mask = 0xFFFFFFFFu;
+   std::uint64_t second = static_cast<std::uint64_t>(
+                             Log_clock::To_ns(static_cast<std::int64_t>(Log_clock::Now())) / 1e9) & count_mask;
+
+   std::uint64_t window = m_window.load(std::memory_order_relaxed);
+   while ((window >> 32) < second)
+   {
+      // The first hit of a new second starts its window and reports the last one's excess
+      if (m_window.compare_exchange_weak(window, (second << 32) | 1, std::memory_order_relaxed))
+      {
+         std::uint64_t hits = window & count_mask;
+         suppressed = (hits > m_n) ? hits - m_n : 0;
+         return true;
+      }
+   }
+
+   // Counts in whichever window is current by now; a thread that read the clock a little later
+   // may already have started the next one
+   return (m_window.fetch_add(1, std::memory_order_relaxed) & count_mask) < m_n;
+}
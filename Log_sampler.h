@@ -0,0 +1,83 @@
+/// @file Log_sampler.h
+
+#ifndef LOG_SAMPLER_H_
+#define LOG_SAMPLER_H_
+
+#include <atomic>
+#include <cstdint>
+
+// ================================================================================================
+/// @brief     Decides which hits of one logging statement are written, so that a statement in a
+///            hot loop does not flood the file or contend on its lock. The G_LOG_*_EVERY_N,
+///            _PER_SECOND and _FIRST_N_EVERY_M macros declare one as a function-local static.
+///            The constructor is constexpr, so with constant arguments there is no guard check.
+///
+///            Admit() is lock-free: one relaxed fetch-add for the counting kinds. The per-second
+///            kind adds a clock read, and a compare-exchange once per second to start a new
+///            window. Admit() also says how many hits were suppressed since the previous admitted
+///            one (for the per-second kind, the excess of the last window that had any), so that
+///            the next written line can report them.
+// ================================================================================================
+class Log_sampler
+{
+public:
+
+   enum class kind : std::uint8_t
+   {
+      e_every_nth,         ///< Hits 1, n + 1, 2n + 1, ...
+      e_per_second,        ///< The first n hits of every second of Log_clock time
+      e_first_then_every   ///< The first n hits, then every m-th
+   };
+
+   constexpr Log_sampler(kind k, std::uint32_t n, std::uint32_t m = 1)
+   : m_kind(k)
+   , m_n(n > 0 ? n : 1)
+   , m_m(m > 0 ? m : 1)
+   , m_hits(0)
+   , m_window(0)
+   {
+   }
+
+   Log_sampler(const Log_sampler&) = delete;
+   Log_sampler& operator=(const Log_sampler&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Counts one hit.
+   /// @return    @e true if it is to be written; @p suppressed is then the number of hits skipped
+   ///            before it.
+   // ---------------------------------------------------------------------------------------------
+   bool Admit(std::uint64_t &suppressed)
+   {
+      suppressed = 0;
+      if (m_kind == kind::e_per_second)
+         return Admit_per_second(suppressed);
+
+      std::uint64_t hit = m_hits.fetch_add(1, std::memory_order_relaxed);
+      if (m_kind == kind::e_every_nth)
+      {
+         if (hit % m_n != 0)
+            return false;
+         suppressed = (hit == 0) ? 0 : m_n - 1;
+         return true;
+      }
+
+      if (hit < m_n)
+         return true;
+      if ((hit - m_n + 1) % m_m != 0)
+         return false;
+      suppressed = m_m - 1;
+      return true;
+   }
+
+private:
+
+   bool Admit_per_second(std::uint64_t &suppressed);
+
+   const kind                    m_kind;
+   const std::uint32_t           m_n;
+   const std::uint32_t           m_m;
+   std::atomic<std::uint64_t>    m_hits;
+   std::atomic<std::uint64_t>    m_window;   ///< Per second: second << 32 | hits in that second
+};
+
+#endif // LOG_SAMPLER_H_
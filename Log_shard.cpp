@@ -0,0 +1,97 @@
+/// @file Log_shard.cpp
+
+#include "Log_shard.h"
+
+#pragma warning(disable:4996)
+
+namespace
+{
+   const std::size_t s_depth_width = 6;   // As Debugfile
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_shard::Log_shard(const std::string &path, std::uint64_t thread, int padding, bool is_milli)
+   : m_path(path)
+   , m_thread(thread)
+   , m_is_milli(is_milli)
+   , m_line(padding)
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shard::Open()
+{
+   if (!m_sink.Open(m_path))
+      return false;
+
+   // Same preamble as Debugfile::Open_file, with the absolute time heading
+   std::time_t systime = std::time(nullptr);
+   m_line.Clear();
+   m_line.Append(std::asctime(std::localtime(&systime)));
+   m_line.Append('\n');
+   m_line.Append_column(Log_timestamp::Heading(Log_timestamp::mode::e_absolute, m_is_milli));
+   m_line.Append_column("Thread_ID");
+   if (m_show_depth)
+   {
+      m_line.Append_column("Depth", s_depth_width);
+   }
+   m_line.Append(" Log_message\n");
+   Write_line();
+
+   m_newline = true;
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shard::Close()
+{
+   m_sink.Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shard::Write(double absolute, const Log_record &rec)
+{
+   m_line.Clear();
+   if (m_newline)
+   {
+      m_line.Append_timestamp(absolute);
+      if (m_show_thread_names && rec.m_thread_name)
+         m_line.Append_column(rec.m_thread_name);
+      else
+         m_line.Append_column(m_thread);
+      if (m_show_depth)
+      {
+         m_line.Append_column(static_cast<std::uint64_t>(rec.m_depth), s_depth_width);
+      }
+      m_line.Append_indent(rec.m_indent);
+   }
+   m_line.Append(rec.m_text);
+   if (rec.m_newline)
+   {
+      m_line.Append('\n');
+   }
+   m_newline = rec.m_newline;
+   Write_line();
+
+   if (m_newline &&
+       (m_flush_policy == Debugfile::flush_policy::e_every_line ||
+        (m_flush_policy == Debugfile::flush_policy::e_bytes && m_sink.Pending() >= m_flush_threshold)))
+   {
+      m_sink.Flush();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shard::Set_flush_policy(Debugfile::flush_policy policy, std::size_t threshold)
+{
+   m_flush_policy = policy;
+   m_flush_threshold = threshold;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shard::Write_line()
+{
+   m_sink.sputn(m_line.Data(), static_cast<std::streamsize>(m_line.Size()));
+}
+
+#pragma warning(default:4996)
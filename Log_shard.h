@@ -0,0 +1,79 @@
+/// @file Log_shard.h
+
+#ifndef LOG_SHARD_H_
+#define LOG_SHARD_H_
+
+#include "Debugfile.h"
+#include "File_sink.h"
+#include "Line_formatter.h"
+#include "Log_record.h"
+#include "Log_timestamp.h"
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+
+// ================================================================================================
+/// @brief     One thread's private log file in Debugfile's sharded mode. The owning thread is the
+///            only writer, so the mutex is uncontended; it exists so that Flush(), Reset() and
+///            the interval flusher can reach the shard from other threads.
+///
+///            A shard has the same columns as the main log except the first, which holds the time
+///            since the Debugfile's shard epoch ("Absolute_us"/"Absolute_ms") instead of the
+///            Debugfile's timestamp mode. Debuglog_merge uses it to interleave shards.
+// ================================================================================================
+class Log_shard
+{
+public:
+
+   Log_shard(const std::string &path, std::uint64_t thread, int padding, bool is_milli);
+
+   Log_shard(const Log_shard&) = delete;
+   Log_shard& operator=(const Log_shard&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Creates or truncates the file and writes the system time and column header.
+   ///            Caller holds Mutex().
+   // ---------------------------------------------------------------------------------------------
+   bool Open();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Flushes and closes. Caller holds Mutex().
+   // ---------------------------------------------------------------------------------------------
+   void Close();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Renders one record. Caller holds Mutex().
+   /// @param     absolute   Time since the shard epoch in the configured unit
+   // ---------------------------------------------------------------------------------------------
+   void Write(double absolute, const Log_record &rec);
+
+   void Flush() { m_sink.Flush(); }
+   void Set_flush_policy(Debugfile::flush_policy policy, std::size_t threshold);
+   void Set_buffer_size(std::size_t bytes) { m_sink.Set_buffer_size(bytes); }
+   void Show_depth(bool turn_on) { m_show_depth = turn_on; }
+   void Show_thread_names(bool turn_on) { m_show_thread_names = turn_on; }
+
+   bool Is_open() const { return m_sink.Is_open(); }
+   std::uint64_t Thread() const { return m_thread; }
+   std::mutex& Mutex() { return m_mutex; }
+
+private:
+
+   void Write_line();
+
+   std::mutex                 m_mutex;
+   std::string                m_path;
+   std::uint64_t              m_thread;
+   bool                       m_is_milli;
+   File_sink                  m_sink;
+   Line_formatter             m_line;
+   bool                       m_newline{true};
+   bool                       m_show_depth{false};
+   bool                       m_show_thread_names{false};
+   Debugfile::flush_policy    m_flush_policy{Debugfile::flush_policy::e_every_line};
+   std::size_t                m_flush_threshold{0};
+};
+
+#endif // LOG_SHARD_H_
@@ -0,0 +1,542 @@
+/// @file Log_shm.cpp
+
+#include "Log_shm.h"
+#include "Log_clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#if !defined _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   const std::uint32_t  s_magic = 0x4d485344;   // "DSHM"
+   const std::uint32_t  s_version = 1;
+   const std::size_t    s_ring_name_length = 56;
+   const std::size_t    s_data_offset = 256;    ///< Ring header, rounded up
+   const std::size_t    s_min_ring_bytes = 64 * 1024;
+
+   // Set in the head by the producer's Close(): a writer's reservation then fails, so the head
+   // no longer moves and the reader knows where the last record ends
+   const std::uint64_t  s_closed_bit = std::uint64_t(1) << 63;
+
+   // Every record and padding run starts with a frame; both are multiples of 16 bytes, so a
+   // padding run always has room for its frame
+   struct Frame
+   {
+      std::atomic<std::uint64_t> m_commit;   ///< Ring position + 1 once the record is complete
+      std::uint32_t              m_length;   ///< Bytes after the frame
+      std::uint32_t              m_kind;
+   };
+
+   enum frame_kind : std::uint32_t
+   {
+      e_padding = 1,
+      e_record = 2
+   };
+
+   // Record layout after the frame: steady ns (8), thread (4), indent (2), depth (2), thread
+   // name length (1), thread name, text
+   const std::size_t    s_fixed_length = 17;
+
+   static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory needs lock-free 64-bit atomics");
+   static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "shared memory needs lock-free 32-bit atomics");
+   static_assert(sizeof(Frame) == 16, "frame layout");
+
+   std::uint64_t Align(std::uint64_t bytes)
+   {
+      return (bytes + 15) & ~std::uint64_t(15);
+   }
+
+   void Set_error(std::string *error, const std::string &text)
+   {
+      if (error)
+         *error = text;
+   }
+
+#if !defined _WIN32
+   // Maps @p bytes of an open shared memory object; closes the descriptor
+   unsigned char* Map(int fd, std::size_t bytes)
+   {
+      void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      return (base == MAP_FAILED) ? nullptr : static_cast<unsigned char*>(base);
+   }
+#endif
+}
+
+// ================================================================================================
+// Shared layouts
+// ================================================================================================
+struct Log_shm_directory::Table
+{
+   struct Slot
+   {
+      std::atomic<std::uint32_t> m_state;
+      std::uint32_t              m_pid;
+      char                       m_ring[s_ring_name_length];
+   };
+
+   std::atomic<std::uint32_t>    m_version;    ///< 0 until the first opener sets it
+   Slot                          m_slots[s_entries];
+};
+
+struct Log_shm_ring::Header
+{
+   std::uint32_t                 m_magic;
+   std::uint32_t                 m_version;
+   std::uint64_t                 m_size;       ///< Data bytes, a power of two
+   std::uint32_t                 m_pid;
+   std::atomic<std::uint32_t>    m_closed;     ///< Set after s_closed_bit
+
+   alignas(64) std::atomic<std::uint64_t> m_head;   ///< Plus s_closed_bit once closed
+   alignas(64) std::atomic<std::uint64_t> m_tail;
+   alignas(64) std::atomic<std::uint64_t> m_dropped;
+};
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_directory::Is_valid_channel(const std::string &channel)
+{
+   if (channel.empty() || channel.size() > 24)
+      return false;
+
+   return std::all_of(channel.begin(), channel.end(), [](char c)
+   {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+   });
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_directory::Open(const std::string &channel, std::string *error)
+{
+   Close();
+
+   if (!Is_valid_channel(channel))
+   {
+      Set_error(error, "invalid channel name \"" + channel + "\"");
+      return false;
+   }
+
+#if defined _WIN32
+   Set_error(error, "shared-memory logging needs POSIX shared memory");
+   return false;
+#else
+   // Every opener sizes the object; resizing to the same size keeps the contents, and a new
+   // object reads as all zeroes, i.e. all entries free
+   std::string name = "/" + channel;
+   int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+   if (fd < 0 || ftruncate(fd, sizeof(Table)) != 0)
+   {
+      Set_error(error, name + ": " + std::strerror(errno));
+      if (fd >= 0)
+         close(fd);
+      return false;
+   }
+
+   unsigned char *base = Map(fd, sizeof(Table));
+   if (!base)
+   {
+      Set_error(error, name + ": " + std::strerror(errno));
+      return false;
+   }
+
+   Table *table = reinterpret_cast<Table*>(base);
+   std::uint32_t version = 0;
+   if (!table->m_version.compare_exchange_strong(version, s_version) && version != s_version)
+   {
+      Set_error(error, name + ": written by an incompatible version");
+      munmap(base, sizeof(Table));
+      return false;
+   }
+
+   m_table = table;
+   return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shm_directory::Close()
+{
+#if !defined _WIN32
+   if (m_table)
+   {
+      munmap(m_table, sizeof(Table));
+      m_table = nullptr;
+   }
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+int Log_shm_directory::Claim(std::uint32_t pid, const std::string &ring)
+{
+   if (!m_table || ring.size() >= s_ring_name_length)
+      return -1;
+
+   for (int i = 0; i < s_entries; ++i)
+   {
+      Table::Slot &slot = m_table->m_slots[i];
+      std::uint32_t expected = static_cast<std::uint32_t>(state::e_free);
+      if (slot.m_state.compare_exchange_strong(expected, static_cast<std::uint32_t>(state::e_claimed)))
+      {
+         slot.m_pid = pid;
+         std::memset(slot.m_ring, 0, sizeof(slot.m_ring));
+         std::memcpy(slot.m_ring, ring.data(), ring.size());
+         slot.m_state.store(static_cast<std::uint32_t>(state::e_open), std::memory_order_release);
+         return i;
+      }
+   }
+   return -1;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shm_directory::Set_state(int index, state s)
+{
+   if (m_table && index >= 0 && index < s_entries)
+   {
+      m_table->m_slots[index].m_state.store(static_cast<std::uint32_t>(s), std::memory_order_release);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+std::vector<Log_shm_directory::entry> Log_shm_directory::Entries() const
+{
+   std::vector<entry> entries;
+   if (!m_table)
+      return entries;
+
+   for (int i = 0; i < s_entries; ++i)
+   {
+      const Table::Slot &slot = m_table->m_slots[i];
+      state s = static_cast<state>(slot.m_state.load(std::memory_order_acquire));
+      if (s == state::e_open || s == state::e_closed)
+      {
+         entries.push_back(entry{ i, s, slot.m_pid, std::string(slot.m_ring, strnlen(slot.m_ring, sizeof(slot.m_ring))) });
+      }
+   }
+   return entries;
+}
+
+// ------------------------------------------------------------------------------------------------
+unsigned char* Log_shm_ring::Data() const
+{
+   return m_base + s_data_offset;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_ring::Create(const std::string &channel, std::size_t bytes, std::string *error)
+{
+   Close();
+   Unmap();
+
+#if defined _WIN32
+   (void)channel;
+   (void)bytes;
+   Set_error(error, "shared-memory logging needs POSIX shared memory");
+   return false;
+#else
+   if (!m_directory.Open(channel, error))
+      return false;
+
+   static std::atomic<unsigned> s_rings{0};
+   std::uint32_t pid = static_cast<std::uint32_t>(getpid());
+   m_name = "/" + channel + "." + std::to_string(pid) + "." + std::to_string(s_rings.fetch_add(1));
+
+   std::size_t size = s_min_ring_bytes;
+   while (size < bytes)
+   {
+      size <<= 1;
+   }
+
+   // A leftover of an earlier process with the same pid is replaced
+   int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+   if (fd < 0 && errno == EEXIST)
+   {
+      shm_unlink(m_name.c_str());
+      fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+   }
+   if (fd < 0 || ftruncate(fd, static_cast<off_t>(s_data_offset + size)) != 0)
+   {
+      Set_error(error, m_name + ": " + std::strerror(errno));
+      if (fd >= 0)
+      {
+         close(fd);
+         shm_unlink(m_name.c_str());
+      }
+      m_directory.Close();
+      return false;
+   }
+
+   m_base = Map(fd, s_data_offset + size);
+   if (!m_base)
+   {
+      Set_error(error, m_name + ": " + std::strerror(errno));
+      shm_unlink(m_name.c_str());
+      m_directory.Close();
+      return false;
+   }
+   m_mapped_bytes = s_data_offset + size;
+   m_mask = size - 1;
+
+   // The object is zero-filled, so the atomics already hold 0
+   static_assert(sizeof(Header) <= s_data_offset, "ring header too large");
+   Header *head = Head();
+   head->m_magic = s_magic;
+   head->m_version = s_version;
+   head->m_size = size;
+   head->m_pid = pid;
+
+   m_entry = m_directory.Claim(pid, m_name);
+   if (m_entry < 0)
+   {
+      Set_error(error, "channel \"" + channel + "\" has no free entry; is its collector running?");
+      Unlink();
+      munmap(m_base, m_mapped_bytes);
+      m_base = nullptr;
+      m_directory.Close();
+      return false;
+   }
+
+   m_is_producer = true;
+   return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_ring::Try_write(const Log_record &rec)
+{
+   Header &head = *Head();
+   std::size_t name_length = rec.m_thread_name ? std::min<std::size_t>(std::strlen(rec.m_thread_name), 255) : 0;
+   std::uint64_t length = s_fixed_length + name_length + rec.m_text.size();
+   std::uint64_t need = Align(sizeof(Frame) + length);
+   std::uint64_t size = m_mask + 1;
+
+   // Reserve the record, and the rest of the array before it if it would not fit there
+   std::uint64_t pos = head.m_head.load(std::memory_order_relaxed);
+   std::uint64_t padding = 0;
+   for (;;)
+   {
+      std::uint64_t offset = pos & m_mask;
+      padding = (offset + need > size) ? size - offset : 0;
+      if ((pos & s_closed_bit) != 0 || need > size ||
+          pos + padding + need - head.m_tail.load(std::memory_order_acquire) > size)
+      {
+         head.m_dropped.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+      if (head.m_head.compare_exchange_weak(pos, pos + padding + need, std::memory_order_relaxed))
+         break;
+   }
+
+   if (padding != 0)
+   {
+      Frame *frame = reinterpret_cast<Frame*>(Data() + (pos & m_mask));
+      frame->m_length = static_cast<std::uint32_t>(padding - sizeof(Frame));
+      frame->m_kind = e_padding;
+      frame->m_commit.store(pos + 1, std::memory_order_release);
+      pos += padding;
+   }
+
+   Frame *frame = reinterpret_cast<Frame*>(Data() + (pos & m_mask));
+   unsigned char *out = reinterpret_cast<unsigned char*>(frame + 1);
+
+   std::uint64_t steady_ns = Log_clock::To_steady_ns(rec.m_ticks);
+   std::uint16_t indent = static_cast<std::uint16_t>(std::min(rec.m_indent, 0xffff));
+   std::uint16_t depth = static_cast<std::uint16_t>(std::min(rec.m_depth, 0xffff));
+   std::uint8_t name_byte = static_cast<std::uint8_t>(name_length);
+   std::memcpy(out, &steady_ns, 8);
+   std::memcpy(out + 8, &rec.m_thread, 4);
+   std::memcpy(out + 12, &indent, 2);
+   std::memcpy(out + 14, &depth, 2);
+   std::memcpy(out + 16, &name_byte, 1);
+   std::memcpy(out + s_fixed_length, rec.m_thread_name, name_length);
+   std::memcpy(out + s_fixed_length + name_length, rec.m_text.data(), rec.m_text.size());
+
+   frame->m_length = static_cast<std::uint32_t>(length);
+   frame->m_kind = e_record;
+   frame->m_commit.store(pos + 1, std::memory_order_release);
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_ring::Attach(const std::string &name)
+{
+   Close();
+   Unmap();
+
+#if defined _WIN32
+   (void)name;
+   return false;
+#else
+   int fd = shm_open(name.c_str(), O_RDWR, 0600);
+   struct stat info;
+   if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) <= s_data_offset)
+   {
+      if (fd >= 0)
+         close(fd);
+      return false;
+   }
+
+   std::size_t bytes = static_cast<std::size_t>(info.st_size);
+   m_base = Map(fd, bytes);
+   if (!m_base)
+      return false;
+
+   const Header &head = *Head();
+   std::uint64_t size = head.m_size;
+   if (head.m_magic != s_magic || head.m_version != s_version || size == 0 || (size & (size - 1)) != 0 ||
+       s_data_offset + size > bytes)
+   {
+      munmap(m_base, bytes);
+      m_base = nullptr;
+      return false;
+   }
+
+   m_mapped_bytes = bytes;
+   m_mask = size - 1;
+   m_name = name;
+   m_is_producer = false;
+   return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+std::size_t Log_shm_ring::Read(std::vector<record> &out)
+{
+   if (!m_base)
+      return 0;
+
+   Header &head = *Head();
+   std::uint64_t size = m_mask + 1;
+   std::uint64_t tail = head.m_tail.load(std::memory_order_relaxed);
+   std::size_t count = 0;
+
+   for (;;)
+   {
+      std::uint64_t offset = tail & m_mask;
+      Frame *frame = reinterpret_cast<Frame*>(Data() + offset);
+      if (frame->m_commit.load(std::memory_order_acquire) != tail + 1)
+         break;
+
+      std::uint64_t span = (frame->m_kind == e_padding) ? size - offset : Align(sizeof(Frame) + frame->m_length);
+      if (span > size - offset || (frame->m_kind == e_record && frame->m_length < s_fixed_length))
+         break;    // Not something a writer produces; leave the ring as it is
+
+      if (frame->m_kind == e_record)
+      {
+         const unsigned char *in = reinterpret_cast<const unsigned char*>(frame + 1);
+         std::uint16_t indent = 0, depth = 0;
+         std::uint8_t name_length = 0;
+
+         record r;
+         std::memcpy(&r.m_steady_ns, in, 8);
+         std::memcpy(&r.m_thread, in + 8, 4);
+         std::memcpy(&indent, in + 12, 2);
+         std::memcpy(&depth, in + 14, 2);
+         std::memcpy(&name_length, in + 16, 1);
+         name_length = static_cast<std::uint8_t>(std::min<std::uint32_t>(name_length, frame->m_length - s_fixed_length));
+         r.m_pid = head.m_pid;
+         r.m_indent = indent;
+         r.m_depth = depth;
+         r.m_thread_name.assign(reinterpret_cast<const char*>(in + s_fixed_length), name_length);
+         r.m_text.assign(reinterpret_cast<const char*>(in + s_fixed_length + name_length),
+                         frame->m_length - s_fixed_length - name_length);
+         out.push_back(std::move(r));
+         ++count;
+      }
+
+      // Zeroed, so that a later lap never mistakes old bytes for a frame
+      frame->m_commit.store(0, std::memory_order_relaxed);
+      std::memset(Data() + offset + sizeof(std::uint64_t), 0, span - sizeof(std::uint64_t));
+      tail += span;
+      head.m_tail.store(tail, std::memory_order_release);
+   }
+   return count;
+}
+
+// ------------------------------------------------------------------------------------------------
+Log_shm_ring::~Log_shm_ring()
+{
+   Close();
+   Unmap();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shm_ring::Close()
+{
+   if (!m_base)
+      return;
+
+   if (!m_is_producer)
+   {
+      Unmap();
+      return;
+   }
+
+   if (Head()->m_closed.load(std::memory_order_relaxed) == 0)
+   {
+      Head()->m_head.fetch_or(s_closed_bit, std::memory_order_acq_rel);
+      Head()->m_closed.store(1, std::memory_order_release);
+      m_directory.Set_state(m_entry, Log_shm_directory::state::e_closed);
+      m_directory.Close();
+      m_entry = -1;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shm_ring::Unmap()
+{
+#if !defined _WIN32
+   if (m_base)
+   {
+      munmap(m_base, m_mapped_bytes);
+      m_base = nullptr;
+      m_mapped_bytes = 0;
+      m_is_producer = false;
+   }
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_shm_ring::Unlink()
+{
+#if !defined _WIN32
+   if (!m_name.empty())
+      shm_unlink(m_name.c_str());
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_ring::Is_closed() const
+{
+   return m_base && Head()->m_closed.load(std::memory_order_acquire) != 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_shm_ring::Is_drained() const
+{
+   if (!Is_closed())
+      return false;
+
+   const Header &head = *Head();
+   std::uint64_t end = head.m_head.load(std::memory_order_acquire) & ~s_closed_bit;
+   return head.m_tail.load(std::memory_order_relaxed) == end;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Log_shm_ring::Dropped() const
+{
+   return m_base ? Head()->m_dropped.load(std::memory_order_relaxed) : 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint32_t Log_shm_ring::Pid() const
+{
+   return m_base ? Head()->m_pid : 0;
+}
@@ -0,0 +1,203 @@
+/// @file Log_shm.h
+
+#ifndef LOG_SHM_H_
+#define LOG_SHM_H_
+
+#include "Log_record.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ================================================================================================
+/// @brief     The table of a shared-memory log channel: one POSIX shared memory object,
+///            "/<channel>", with a fixed number of entries, each naming the ring of one producer.
+///            Whoever opens it first creates it; it is never removed, so that producers and the
+///            collector may come and go in any order. Entries move from free to claimed (being
+///            filled) to open and, when the producer closes its ring, to closed; the collector
+///            frees them once it has drained the ring.
+///
+///            POSIX only; Open() fails elsewhere.
+// ================================================================================================
+class Log_shm_directory
+{
+public:
+
+   static const int s_entries = 256;
+
+   enum class state : std::uint32_t
+   {
+      e_free,
+      e_claimed,
+      e_open,
+      e_closed
+   };
+
+   struct entry
+   {
+      int            m_index;
+      state          m_state;
+      std::uint32_t  m_pid;
+      std::string    m_ring;
+   };
+
+   Log_shm_directory() = default;
+   ~Log_shm_directory() { Close(); }
+
+   Log_shm_directory(const Log_shm_directory&) = delete;
+   Log_shm_directory& operator=(const Log_shm_directory&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Maps the table of @p channel, creating it if needed. A channel name is 1 to 24
+   ///            letters, digits, '-' or '_'.
+   // ---------------------------------------------------------------------------------------------
+   bool Open(const std::string &channel, std::string *error = nullptr);
+   void Close();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Takes a free entry for the ring @p ring of process @p pid and marks it open.
+   /// @return    Index of the entry, or -1 if the table is full.
+   // ---------------------------------------------------------------------------------------------
+   int Claim(std::uint32_t pid, const std::string &ring);
+
+   void Set_state(int index, state s);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    All entries that are open or closed.
+   // ---------------------------------------------------------------------------------------------
+   std::vector<entry> Entries() const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Whether @p channel is a valid channel name.
+   // ---------------------------------------------------------------------------------------------
+   static bool Is_valid_channel(const std::string &channel);
+
+private:
+
+   struct Table;
+
+   Table       *m_table{nullptr};
+};
+
+// ================================================================================================
+/// @brief     One process's log ring in a POSIX shared memory object, "/<channel>.<pid>.<n>".
+///            The producer's threads write records into it and a collector in another process
+///            reads them out.
+///
+///            The ring is a byte array with a 64-bit head (next byte to reserve) and tail (next
+///            byte to read). A writer reserves the whole record with one compare-and-swap on the
+///            head, copies the record into it, and publishes it by storing the record's position
+///            in its header. The reader accepts a header only if it holds that position, so it
+///            never reads a record that is still being written. After reading, it zeroes the
+///            bytes and moves the tail on. A record that does not fit before the end of the
+///            array is preceded by a padding record and starts again at offset 0. A writer that
+///            finds too little room counts the record as dropped and returns: writers never wait
+///            for the reader. Closing sets a bit in the head, so that no reservation succeeds
+///            afterwards; records reserved before it still arrive, and Is_drained() tells when
+///            the reader has them all.
+///
+///            Times are stored as steady_clock nanoseconds (Log_clock::To_steady_ns()), which
+///            processes on one host share.
+///
+///            POSIX only; Create() and Attach() fail elsewhere.
+// ================================================================================================
+class Log_shm_ring
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     A record as the reader sees it.
+   // ---------------------------------------------------------------------------------------------
+   struct record
+   {
+      std::uint64_t  m_steady_ns{0};
+      std::uint32_t  m_pid{0};
+      std::uint32_t  m_thread{0};      ///< Log_thread::Id() in the writing process
+      int            m_indent{1};
+      int            m_depth{0};
+      std::string    m_thread_name;
+      std::string    m_text;
+   };
+
+   Log_shm_ring() = default;
+   ~Log_shm_ring();
+
+   Log_shm_ring(const Log_shm_ring&) = delete;
+   Log_shm_ring& operator=(const Log_shm_ring&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Producer: creates this process's ring of @p bytes (rounded up to a power of two,
+   ///            at least 64 KiB) and enters it in the channel's table.
+   // ---------------------------------------------------------------------------------------------
+   bool Create(const std::string &channel, std::size_t bytes, std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Producer: copies @p rec into the ring. Lock-free; any thread may call it.
+   /// @return    @e false if the ring had no room or is closed (the record is counted as
+   ///            dropped).
+   // ---------------------------------------------------------------------------------------------
+   bool Try_write(const Log_record &rec);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Reader: maps the ring named @p name. Only one reader per ring.
+   // ---------------------------------------------------------------------------------------------
+   bool Attach(const std::string &name);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Reader: appends the records written so far, oldest first.
+   /// @return    Number of records appended.
+   // ---------------------------------------------------------------------------------------------
+   std::size_t Read(std::vector<record> &out);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Producer: marks the ring closed, so that the collector removes it once it is
+   ///            drained; later writes are dropped. The ring stays mapped until destruction, so
+   ///            threads may still be writing. Reader: unmaps it.
+   // ---------------------------------------------------------------------------------------------
+   void Close();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Reader: removes the shared memory object; the mapping stays valid until Close().
+   // ---------------------------------------------------------------------------------------------
+   void Unlink();
+
+   bool Is_open() const { return m_base != nullptr; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Whether the producer has closed the ring.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_closed() const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Reader: whether the ring is closed and every record reserved in it before that
+   ///            has been read. Writers may still be copying records in until then.
+   // ---------------------------------------------------------------------------------------------
+   bool Is_drained() const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Records dropped because the ring was full, since it was created.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Dropped() const;
+
+   std::uint32_t Pid() const;
+   const std::string& Name() const { return m_name; }
+
+private:
+
+   struct Header;
+
+   Header* Head() const { return reinterpret_cast<Header*>(m_base); }
+   unsigned char* Data() const;
+   void Unmap();
+
+   unsigned char     *m_base{nullptr};
+   std::size_t       m_mapped_bytes{0};
+   std::uint64_t     m_mask{0};
+   std::string       m_name;
+   bool              m_is_producer{false};
+   Log_shm_directory m_directory;            ///< Producer: where the ring is entered
+   int               m_entry{-1};
+};
+
+#endif // LOG_SHM_H_
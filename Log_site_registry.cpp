@@ -0,0 +1,451 @@
+/// @file Log_site_registry.cpp
+
+#include "Log_site_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+   const char *s_level_names[] = { "trace", "debug", "info", "warn", "error" };
+
+   struct Term
+   {
+      enum kind
+      {
+         e_all,
+         e_file,
+         e_line,
+         e_function,
+         e_module,
+         e_level
+      };
+
+      kind           m_kind;
+      std::string    m_pattern;
+      int            m_line;
+
+      bool operator==(const Term &other) const
+      {
+         return m_kind == other.m_kind && m_pattern == other.m_pattern && m_line == other.m_line;
+      }
+   };
+
+   struct Rule
+   {
+      bool                 m_on;
+      std::vector<Term>    m_terms;
+   };
+
+   struct Registry
+   {
+      std::mutex                          m_mutex;
+      std::vector<const Log_call_site*>   m_sites;    ///< Function-local statics: never freed
+      std::vector<Rule>                   m_rules;
+   };
+
+   // Never destroyed, so that sites reached during static destruction can still register
+   Registry& The_registry()
+   {
+      static Registry *registry = new Registry;
+      return *registry;
+   }
+
+   struct Watcher
+   {
+      std::mutex                       m_control_mutex;  ///< Serializes Watch() and Stop_watching()
+      std::mutex                       m_mutex;
+      std::condition_variable          m_wake;
+      std::thread                      m_thread;
+      std::string                      m_path;
+      std::chrono::milliseconds        m_poll{1000};
+      bool                             m_stopping{false};
+   };
+
+   Watcher& The_watcher()
+   {
+      static Watcher *watcher = new Watcher;
+      return *watcher;
+   }
+
+   // Set by the SIGHUP handler, picked up by the watcher thread at its next poll
+   std::atomic<bool> s_reload_requested{false};
+
+#if !defined _WIN32
+   struct sigaction s_previous_sighup;
+
+   extern "C" void Sighup_handler(int)
+   {
+      s_reload_requested.store(true, std::memory_order_relaxed);
+   }
+
+   void Install_sighup_handler()
+   {
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_handler = Sighup_handler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      sigaction(SIGHUP, &action, &s_previous_sighup);
+   }
+
+   void Restore_sighup_handler()
+   {
+      sigaction(SIGHUP, &s_previous_sighup, nullptr);
+   }
+#else
+   void Install_sighup_handler() {}
+   void Restore_sighup_handler() {}
+#endif
+
+   std::string_view Trim(std::string_view text)
+   {
+      const char *space = " \t\r\n";
+      std::size_t first = text.find_first_not_of(space);
+      if (first == std::string_view::npos)
+         return std::string_view();
+      return text.substr(first, text.find_last_not_of(space) + 1 - first);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Splits a selector into its terms; false (with the reason in @p error) if one is not valid.
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_selector(std::string_view selector, std::vector<Term> &terms, std::string &error)
+   {
+      terms.clear();
+      selector = Trim(selector);
+      while (!selector.empty())
+      {
+         std::size_t end = selector.find_first_of(" \t");
+         std::string_view word = selector.substr(0, end);
+         selector = (end == std::string_view::npos) ? std::string_view() : Trim(selector.substr(end));
+
+         if (word == "*")
+         {
+            terms.push_back(Term{ Term::e_all, std::string(), 0 });
+            continue;
+         }
+
+         std::size_t equals = word.find('=');
+         if (equals == std::string_view::npos || equals + 1 == word.size())
+         {
+            error = "expected key=value, got \"" + std::string(word) + "\"";
+            return false;
+         }
+         std::string_view key = word.substr(0, equals);
+         std::string value(word.substr(equals + 1));
+
+         if (key == "file")
+            terms.push_back(Term{ Term::e_file, value, 0 });
+         else if (key == "function")
+            terms.push_back(Term{ Term::e_function, value, 0 });
+         else if (key == "module")
+            terms.push_back(Term{ Term::e_module, value, 0 });
+         else if (key == "level")
+            terms.push_back(Term{ Term::e_level, value, 0 });
+         else if (key == "line" && value.find_first_not_of("0123456789") == std::string::npos &&
+                  value.size() < 10)
+            terms.push_back(Term{ Term::e_line, std::string(), std::stoi(value) });
+         else
+         {
+            error = "unknown term \"" + std::string(word) + "\"";
+            return false;
+         }
+      }
+
+      if (terms.empty())
+      {
+         error = "empty selector";
+         return false;
+      }
+      return true;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Parses "on <selector>" or "off <selector>".
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_rule(std::string_view line, Rule &rule, std::string &error)
+   {
+      line = Trim(line);
+      std::size_t end = line.find_first_of(" \t");
+      std::string_view action = line.substr(0, end);
+
+      if (action == "on")
+         rule.m_on = true;
+      else if (action == "off")
+         rule.m_on = false;
+      else
+      {
+         error = "expected \"on\" or \"off\", got \"" + std::string(action) + "\"";
+         return false;
+      }
+      return Parse_selector((end == std::string_view::npos) ? std::string_view() : line.substr(end),
+                            rule.m_terms, error);
+   }
+
+   bool Matches(const Term &term, const Log_call_site &site)
+   {
+      switch (term.m_kind)
+      {
+      case Term::e_all:
+         return true;
+      case Term::e_file:
+         return Log_site_registry::Glob_match(term.m_pattern, site.m_file ? site.m_file : "");
+      case Term::e_line:
+         return site.m_line == term.m_line;
+      case Term::e_function:
+         return Log_site_registry::Glob_match(term.m_pattern, site.m_function ? site.m_function : "");
+      case Term::e_module:
+         return Log_site_registry::Glob_match(term.m_pattern, site.m_module ? site.m_module : "general");
+      case Term::e_level:
+      {
+         std::size_t level = static_cast<std::size_t>(site.m_level);
+         return level < sizeof(s_level_names) / sizeof(s_level_names[0]) &&
+                Log_site_registry::Glob_match(term.m_pattern, s_level_names[level]);
+      }
+      }
+      return false;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // State of @p site under the current rules (registry lock held): the last matching rule wins.
+   // ---------------------------------------------------------------------------------------------
+   bool Decide(const Registry &registry, const Log_call_site &site)
+   {
+      for (auto rule = registry.m_rules.rbegin(); rule != registry.m_rules.rend(); ++rule)
+      {
+         bool all = true;
+         for (const Term &term : rule->m_terms)
+         {
+            if (!Matches(term, site))
+            {
+               all = false;
+               break;
+            }
+         }
+         if (all)
+            return rule->m_on;
+      }
+      return true;
+   }
+
+   // Last modification of a file, and its size, to notice edits; zero if it cannot be read
+   std::pair<std::filesystem::file_time_type, std::uintmax_t> Stamp(const std::string &path)
+   {
+      std::error_code ec;
+      std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, ec);
+      if (ec)
+         return { std::filesystem::file_time_type(), 0 };
+      std::uintmax_t size = std::filesystem::file_size(path, ec);
+      return { modified, ec ? 0 : size };
+   }
+
+   void Watch_loop()
+   {
+      Watcher &watcher = The_watcher();
+      std::unique_lock<std::mutex> lock(watcher.m_mutex);
+      auto stamp = Stamp(watcher.m_path);
+
+      while (!watcher.m_wake.wait_for(lock, watcher.m_poll, [&] { return watcher.m_stopping; }))
+      {
+         auto current = Stamp(watcher.m_path);
+         bool requested = s_reload_requested.exchange(false, std::memory_order_relaxed);
+         if (current != stamp || requested)
+         {
+            stamp = current;
+            Log_site_registry::Load(watcher.m_path.c_str());
+         }
+      }
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_site_registry::Add(const Log_call_site &site)
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   // Another thread may have registered it meanwhile
+   std::uint8_t state = site.m_state.load(std::memory_order_relaxed);
+   if (state == Log_call_site::e_unknown)
+   {
+      registry.m_sites.push_back(&site);
+      state = Decide(registry, site) ? Log_call_site::e_on : Log_call_site::e_off;
+      site.m_state.store(state, std::memory_order_relaxed);
+   }
+   return state == Log_call_site::e_on;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_site_registry::Apply_rules()
+{
+   const Registry &registry = The_registry();
+   for (const Log_call_site *site : registry.m_sites)
+   {
+      site->m_state.store(Decide(registry, *site) ? Log_call_site::e_on : Log_call_site::e_off,
+                          std::memory_order_relaxed);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_site_registry::Enable(std::string_view selector, bool on)
+{
+   Rule rule{ on, {} };
+   std::string error;
+   if (!Parse_selector(selector, rule.m_terms, error))
+      return false;
+
+   // The new rule is last, so it overrides any earlier rule with the same terms, or all of them
+   // if it matches every site; dropping those keeps the list from growing with repeated calls
+   bool every_site = std::all_of(rule.m_terms.begin(), rule.m_terms.end(),
+                                 [](const Term &term) { return term.m_kind == Term::e_all; });
+
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   auto overridden = [&](const Rule &earlier) { return every_site || earlier.m_terms == rule.m_terms; };
+   registry.m_rules.erase(std::remove_if(registry.m_rules.begin(), registry.m_rules.end(), overridden),
+                          registry.m_rules.end());
+   registry.m_rules.push_back(std::move(rule));
+   Apply_rules();
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_site_registry::Load(const char *path, std::string *error)
+{
+   std::ifstream in(path);
+   if (!in)
+   {
+      if (error)
+         *error = std::string(path) + ": cannot open";
+      return false;
+   }
+
+   std::vector<Rule> rules;
+   std::string line;
+   for (int number = 1; std::getline(in, line); ++number)
+   {
+      std::string_view text = Trim(std::string_view(line).substr(0, line.find('#')));
+      if (text.empty())
+         continue;
+
+      Rule rule{ true, {} };
+      std::string reason;
+      if (!Parse_rule(text, rule, reason))
+      {
+         if (error)
+            *error = std::string(path) + ":" + std::to_string(number) + ": " + reason;
+         return false;
+      }
+      rules.push_back(std::move(rule));
+   }
+
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   registry.m_rules.swap(rules);
+   Apply_rules();
+   return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_site_registry::Clear()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   registry.m_rules.clear();
+   Apply_rules();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_site_registry::Watch(const char *path, std::chrono::milliseconds poll)
+{
+   Stop_watching();
+
+   Watcher &watcher = The_watcher();
+   std::lock_guard<std::mutex> control_lock(watcher.m_control_mutex);
+   {
+      std::lock_guard<std::mutex> lock(watcher.m_mutex);
+      watcher.m_path = path;
+      watcher.m_poll = poll;
+      watcher.m_stopping = false;
+   }
+
+   Load(path);
+   s_reload_requested.store(false, std::memory_order_relaxed);
+   Install_sighup_handler();
+   watcher.m_thread = std::thread(Watch_loop);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_site_registry::Stop_watching()
+{
+   Watcher &watcher = The_watcher();
+   std::lock_guard<std::mutex> control_lock(watcher.m_control_mutex);
+   if (!watcher.m_thread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> lock(watcher.m_mutex);
+      watcher.m_stopping = true;
+   }
+   watcher.m_wake.notify_one();
+   watcher.m_thread.join();
+   Restore_sighup_handler();
+}
+
+// ------------------------------------------------------------------------------------------------
+std::vector<Log_site_registry::entry> Log_site_registry::Sites()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   std::vector<entry> sites;
+   sites.reserve(registry.m_sites.size());
+   for (const Log_call_site *site : registry.m_sites)
+   {
+      sites.push_back(entry{ site, site->m_state.load(std::memory_order_relaxed) == Log_call_site::e_on });
+   }
+   return sites;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Log_site_registry::Glob_match(std::string_view pattern, std::string_view text)
+{
+   // Backtracks only to the last '*', which is enough for '*' and '?' alone
+   std::size_t p = 0, t = 0;
+   std::size_t star = std::string_view::npos, resume = 0;
+
+   while (t < text.size())
+   {
+      if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+      {
+         ++p;
+         ++t;
+      }
+      else if (p < pattern.size() && pattern[p] == '*')
+      {
+         star = p++;
+         resume = t;
+      }
+      else if (star != std::string_view::npos)
+      {
+         p = star + 1;
+         t = ++resume;
+      }
+      else
+      {
+         return false;
+      }
+   }
+   while (p < pattern.size() && pattern[p] == '*')
+      ++p;
+   return p == pattern.size();
+}
@@ -0,0 +1,101 @@
+/// @file Log_site_registry.h
+
+#ifndef LOG_SITE_REGISTRY_H_
+#define LOG_SITE_REGISTRY_H_
+
+#include "Log_call_site.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Every G_LOG_* call site, with a switch per site that can be flipped while the
+///            process runs. A site joins the registry the first time it is reached (its flag
+///            starts out "unknown"), takes the state the current rules give it, and from then on
+///            the macro tests only its flag: one relaxed load and one branch when it is off.
+///
+///            Rules are "on <selector>" or "off <selector>", applied in order; the last rule
+///            that matches a site decides, and a site no rule matches is on. A selector is one
+///            or more terms, all of which must match:
+///
+///               *                    every site
+///               file=<glob>          the path as __FILE__ gives it, e.g. file=*net/*
+///               line=<number>
+///               function=<glob>      e.g. function=Parse*
+///               module=<glob>        untagged statements are in module "general"
+///               level=<glob>         trace, debug, info, warn or error
+///
+///            A glob has '*' for any run of characters and '?' for one. Enable() adds a rule to
+///            the end of the list; Load() replaces the list with a control file, one rule per
+///            line, '#' starting a comment. Watch() reloads the file whenever it changes and,
+///            where there is one, on SIGHUP.
+///
+///            Disabling a site only skips its statements; the logger's level and on/off switch
+///            still apply to the sites that are on.
+// ================================================================================================
+class Log_site_registry
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Adds a rule that turns the sites @p selector matches on or off, now and when
+   ///            they are first reached. It replaces an earlier rule with the same terms, and a
+   ///            selector of * replaces all earlier rules, since those could no longer decide.
+   /// @return    @e false if @p selector does not parse; nothing is changed then.
+   // ---------------------------------------------------------------------------------------------
+   static bool Enable(std::string_view selector, bool on = true);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Replaces all rules with those in the control file @p path and applies them.
+   /// @return    @e false if the file cannot be read or has a line that does not parse (the
+   ///            first such line goes to @p error); the rules are not changed then.
+   // ---------------------------------------------------------------------------------------------
+   static bool Load(const char *path, std::string *error = nullptr);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Removes all rules: every site is on again.
+   // ---------------------------------------------------------------------------------------------
+   static void Clear();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Loads @p path now, then reloads it from a background thread whenever its
+   ///            modification time changes or the process gets SIGHUP. Both are checked every
+   ///            @p poll; the signal handler only sets a flag. A file that fails to load leaves
+   ///            the rules as they were. Calling it again switches to the new path.
+   // ---------------------------------------------------------------------------------------------
+   static void Watch(const char *path, std::chrono::milliseconds poll = std::chrono::seconds(1));
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Stops the thread started by Watch() and restores the previous SIGHUP handler.
+   ///            The rules stay as they are.
+   // ---------------------------------------------------------------------------------------------
+   static void Stop_watching();
+
+   struct entry
+   {
+      const Log_call_site  *m_site;
+      bool                 m_on;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Every site reached so far, in the order they were first reached.
+   // ---------------------------------------------------------------------------------------------
+   static std::vector<entry> Sites();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    @e true if @p text matches @p pattern ('*' and '?' wildcards).
+   // ---------------------------------------------------------------------------------------------
+   static bool Glob_match(std::string_view pattern, std::string_view text);
+
+private:
+
+   friend struct Log_call_site;
+
+   static bool Add(const Log_call_site &site);
+   static void Apply_rules();    // Registry lock held
+};
+
+#endif // LOG_SITE_REGISTRY_H_
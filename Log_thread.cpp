@@ -0,0 +1,67 @@
+/// @file Log_thread.cpp
+
+#include "Log_thread.h"
+#include "Log_record.h"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace
+{
+   struct Registry
+   {
+      std::mutex                       m_mutex;
+      std::vector<Log_thread::entry>   m_threads;     ///< Index is id - 1
+      std::deque<std::string>          m_names;       ///< Never erased: records point into it
+   };
+
+   // Never destroyed, so that lines written during static destruction can still use the names
+   Registry& The_registry()
+   {
+      static Registry *registry = new Registry;
+      return *registry;
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+std::uint32_t Log_thread::Assign()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   std::uint32_t id = static_cast<std::uint32_t>(registry.m_threads.size() + 1);
+   registry.m_threads.push_back(entry{ id, Thread_id_value(std::this_thread::get_id()), nullptr });
+   t_id = id;
+   return id;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_thread::Set_name(const char *name)
+{
+   std::uint32_t id = Id();
+
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+
+   registry.m_names.emplace_back(name ? name : "");
+   t_name = registry.m_names.back().c_str();
+   registry.m_threads[id - 1].m_name = t_name;
+}
+
+// ------------------------------------------------------------------------------------------------
+std::vector<Log_thread::entry> Log_thread::Threads()
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   return registry.m_threads;
+}
+
+// ------------------------------------------------------------------------------------------------
+const char* Log_thread::Name(std::uint32_t id)
+{
+   Registry &registry = The_registry();
+   std::lock_guard<std::mutex> registry_lock(registry.m_mutex);
+   return (id >= 1 && id <= registry.m_threads.size()) ? registry.m_threads[id - 1].m_name : nullptr;
+}
@@ -0,0 +1,68 @@
+/// @file Log_thread.h
+
+#ifndef LOG_THREAD_H_
+#define LOG_THREAD_H_
+
+#include <cstdint>
+#include <vector>
+
+// ================================================================================================
+/// @brief     Compact thread ids and thread names for the Thread_ID column. A thread gets the next
+///            small number (1, 2, ...) on its first log call; it is cached in a thread_local, so
+///            a record costs one load instead of std::this_thread::get_id(). Numbers are never
+///            reused, so they stay distinct where a native id can be recycled, and they come
+///            out the same from run to run when threads start in the same order.
+///
+///            A thread may also name itself ("io-worker-3"). Names are copied into a registry
+///            that is never freed, so a record can carry a plain pointer to its thread's name.
+// ================================================================================================
+class Log_thread
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Compact id of the calling thread, assigned on first use.
+   // ---------------------------------------------------------------------------------------------
+   static std::uint32_t Id()
+   {
+      std::uint32_t id = t_id;
+      return (id != 0) ? id : Assign();
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Name of the calling thread, or nullptr if it has none.
+   // ---------------------------------------------------------------------------------------------
+   static const char* Name() { return t_name; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Names the calling thread. The string is copied; the copy lives as long as the
+   ///            process, also after the thread has exited or is renamed.
+   // ---------------------------------------------------------------------------------------------
+   static void Set_name(const char *name);
+
+   struct entry
+   {
+      std::uint32_t  m_id;
+      std::uint64_t  m_native_id;      ///< As Thread_id_value() gives it
+      const char     *m_name;          ///< nullptr if unnamed
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Every thread that has an id so far, by id.
+   // ---------------------------------------------------------------------------------------------
+   static std::vector<entry> Threads();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Name of thread @p id, or nullptr if it has none.
+   // ---------------------------------------------------------------------------------------------
+   static const char* Name(std::uint32_t id);
+
+private:
+
+   static std::uint32_t Assign();
+
+   static inline thread_local std::uint32_t  t_id = 0;
+   static inline thread_local const char     *t_name = nullptr;
+};
+
+#endif // LOG_THREAD_H_
@@ -0,0 +1,54 @@
+/// @file Log_timestamp.cpp
+
+#include "Log_timestamp.h"
+
+// ------------------------------------------------------------------------------------------------
+const char* Log_timestamp::Heading(mode m, bool is_milli)
+{
+   switch (m)
+   {
+   case mode::e_thread_delta: return is_milli ? "Tdelta_ms" : "Tdelta_us";
+   case mode::e_absolute:     return is_milli ? "Absolute_ms" : "Absolute_us";
+   default:                   return is_milli ? "Elapsed_ms" : "Elapsed_us";
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Log_timestamp::Start(mode m, std::uint64_t epoch)
+{
+   m_mode = m;
+   m_epoch = epoch;
+   m_last = epoch;
+   m_thread_last.clear();
+}
+
+// ------------------------------------------------------------------------------------------------
+std::int64_t Log_timestamp::Column_ticks(std::uint64_t thread, std::uint64_t ticks)
+{
+   std::uint64_t since = m_epoch;
+
+   switch (m_mode)
+   {
+   case mode::e_global_delta:
+      since = m_last;
+      m_last = ticks;
+      break;
+
+   case mode::e_thread_delta:
+      {
+         auto inserted = m_thread_last.emplace(thread, ticks);
+         if (!inserted.second)
+         {
+            since = inserted.first->second;
+            inserted.first->second = ticks;
+         }
+      }
+      break;
+
+   case mode::e_absolute:
+      break;
+   }
+
+   std::int64_t column = static_cast<std::int64_t>(ticks - since);
+   return (column < 0) ? 0 : column;
+}
@@ -0,0 +1,53 @@
+/// @file Log_timestamp.h
+
+#ifndef LOG_TIMESTAMP_H_
+#define LOG_TIMESTAMP_H_
+
+#include <cstdint>
+#include <unordered_map>
+
+// ================================================================================================
+/// @brief     Turns the absolute Log_clock ticks stored in each record into the value of the time
+///            column, for the timestamp mode chosen at render time. This is renderer state: it is
+///            only touched by whoever writes the lines out (Debugfile under its file lock or on
+///            its writer thread, Binary_log::Decode), never by the threads that log.
+// ================================================================================================
+class Log_timestamp
+{
+public:
+
+   enum class mode : std::uint8_t
+   {
+      e_global_delta,   ///< Since the previous line of any thread ("Elapsed_us")
+      e_thread_delta,   ///< Since the previous line of the same thread ("Tdelta_us")
+      e_absolute        ///< Since the file was opened ("Absolute_us")
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Heading of the time column, which names the mode and the unit.
+   // ---------------------------------------------------------------------------------------------
+   static const char* Heading(mode m, bool is_milli);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Forgets all previous lines and measures from @p epoch ticks.
+   // ---------------------------------------------------------------------------------------------
+   void Start(mode m, std::uint64_t epoch);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Ticks to render for a line written by @p thread at @p ticks. Never negative:
+   ///            records stamped outside the lock can arrive slightly out of order.
+   ///            A thread's first line in e_thread_delta counts from the epoch.
+   // ---------------------------------------------------------------------------------------------
+   std::int64_t Column_ticks(std::uint64_t thread, std::uint64_t ticks);
+
+   mode Mode() const { return m_mode; }
+
+private:
+
+   mode                                         m_mode{mode::e_global_delta};
+   std::uint64_t                                m_epoch{0};
+   std::uint64_t                                m_last{0};
+   std::unordered_map<std::uint64_t, std::uint64_t> m_thread_last;
+};
+
+#endif // LOG_TIMESTAMP_H_
@@ -0,0 +1,350 @@
+/// @file Mmap_sink.cpp
+
+#include "Mmap_sink.h"
+#include "Log_compressor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if !defined _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------
+Mmap_sink::Mmap_sink()
+   : m_segment_bytes(0)
+   , m_keep_segments(1)
+   , m_preamble_length(0)
+   , m_current(nullptr)
+   , m_rotations(0)
+   , m_shifts(0)
+   , m_compressor(nullptr)
+{
+}
+
+// ------------------------------------------------------------------------------------------------
+Mmap_sink::~Mmap_sink()
+{
+   Close();
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Mmap_sink::Open(const std::string &path, std::size_t segment_bytes, int keep_segments)
+{
+   Close();
+
+#if defined _WIN32
+   (void)path;
+   (void)segment_bytes;
+   (void)keep_segments;
+   return false;
+#else
+   std::lock_guard<std::mutex> rotate_lock(m_rotate_mutex);
+
+   m_path = path;
+   m_segment_bytes = std::max<std::size_t>(segment_bytes, 4096);
+   m_keep_segments = std::max(keep_segments, 1);
+   m_preamble_length = (m_preamble.size() < m_segment_bytes / 2) ? m_preamble.size() : 0;
+
+   Shift_files();
+   if (!Map(m_segments[0]))
+      return false;
+
+   m_current.store(&m_segments[0], std::memory_order_release);
+   return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Close()
+{
+   std::lock_guard<std::mutex> rotate_lock(m_rotate_mutex);
+
+   Segment *segment = m_current.exchange(nullptr, std::memory_order_acq_rel);
+   if (segment)
+   {
+      while (segment->m_writers.load(std::memory_order_acquire) != 0)
+      {
+         std::this_thread::yield();
+      }
+      Finish_segment(*segment, std::min(segment->m_offset.load(std::memory_order_relaxed), segment->m_size), m_shifts);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Set_compressor(Log_compressor *compressor)
+{
+   std::lock_guard<std::mutex> rotate_lock(m_rotate_mutex);
+
+   m_compressor = compressor;
+   if (compressor)
+   {
+      m_suffix = Log_compression::Extension(compressor->Format());
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Write(const char *data, std::size_t length)
+{
+   while (length > 0)
+   {
+      Segment *segment = Acquire();
+      if (!segment)
+         return;
+
+      // A chunk always fits in a fresh segment, after the preamble
+      std::size_t chunk = std::min(length, segment->m_size - m_preamble_length);
+      std::size_t position = segment->m_offset.fetch_add(chunk, std::memory_order_relaxed);
+
+      if (position + chunk <= segment->m_size)
+      {
+         std::memcpy(segment->m_base + position, data, chunk);
+         segment->m_writers.fetch_sub(1, std::memory_order_release);
+         data += chunk;
+         length -= chunk;
+         continue;
+      }
+
+      segment->m_writers.fetch_sub(1, std::memory_order_release);
+
+      // Exactly one writer's range straddles the end; it rotates, the others wait and retry.
+      if (position <= segment->m_size)
+         Rotate(segment, position);
+      else
+         std::this_thread::yield();
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Emergency_write(const char *data, std::size_t length)
+{
+   Segment *segment = Acquire();
+   if (!segment)
+      return;
+
+   // Never reserve past the end: Write() relies on the one range that straddles it to rotate
+   std::size_t position = segment->m_offset.load(std::memory_order_relaxed);
+   std::size_t chunk = 0;
+   do
+   {
+      if (position >= segment->m_size)
+         break;
+      chunk = std::min(length, segment->m_size - position);
+   } while (!segment->m_offset.compare_exchange_weak(position, position + chunk, std::memory_order_relaxed));
+
+   if (chunk > 0 && position < segment->m_size)
+   {
+      std::memcpy(segment->m_base + position, data, chunk);
+   }
+   segment->m_writers.fetch_sub(1, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+Mmap_sink::int_type Mmap_sink::overflow(int_type c)
+{
+   if (!traits_type::eq_int_type(c, traits_type::eof()))
+   {
+      char ch = traits_type::to_char_type(c);
+      Write(&ch, 1);
+   }
+   return traits_type::not_eof(c);
+}
+
+// ------------------------------------------------------------------------------------------------
+std::streamsize Mmap_sink::xsputn(const char_type *s, std::streamsize n)
+{
+   Write(s, static_cast<std::size_t>(n));
+   return n;
+}
+
+// ------------------------------------------------------------------------------------------------
+Mmap_sink::Segment* Mmap_sink::Acquire()
+{
+   for (;;)
+   {
+      Segment *segment = m_current.load(std::memory_order_acquire);
+      if (!segment)
+         return nullptr;
+
+      segment->m_writers.fetch_add(1, std::memory_order_acq_rel);
+      if (m_current.load(std::memory_order_acquire) == segment)
+         return segment;
+
+      segment->m_writers.fetch_sub(1, std::memory_order_release);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Mmap_sink::Map(Segment &segment)
+{
+#if defined _WIN32
+   (void)segment;
+   return false;
+#else
+   int fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0)
+      return false;
+
+   off_t size = static_cast<off_t>(m_segment_bytes);
+#if defined __linux__
+   bool allocated = ::fallocate(fd, 0, 0, size) == 0;
+#else
+   bool allocated = ::posix_fallocate(fd, 0, size) == 0;
+#endif
+   // Filesystems without fallocate still work, just without the up-front reservation
+   if (!allocated && ::ftruncate(fd, size) != 0)
+   {
+      ::close(fd);
+      return false;
+   }
+
+   void *base = ::mmap(nullptr, m_segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (base == MAP_FAILED)
+   {
+      ::close(fd);
+      return false;
+   }
+
+   segment.m_fd = fd;
+   segment.m_base = static_cast<char*>(base);
+   segment.m_size = m_segment_bytes;
+   segment.m_offset.store(0, std::memory_order_relaxed);
+   return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Retire(Segment &segment, std::size_t used)
+{
+#if !defined _WIN32
+   if (segment.m_base)
+   {
+      ::munmap(segment.m_base, segment.m_size);
+   }
+   if (segment.m_fd >= 0)
+   {
+      if (::ftruncate(segment.m_fd, static_cast<off_t>(used)) != 0)
+      {
+         // The tail stays zero-filled; nothing better to do
+      }
+      ::close(segment.m_fd);
+   }
+#else
+   (void)used;
+#endif
+   segment.m_base = nullptr;
+   segment.m_fd = -1;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Rotate(Segment *full, std::size_t used)
+{
+   std::lock_guard<std::mutex> rotate_lock(m_rotate_mutex);
+
+   if (m_current.load(std::memory_order_acquire) != full)
+      return;
+
+   Segment &next = (full == &m_segments[0]) ? m_segments[1] : m_segments[0];
+
+   Shift_files();
+   bool mapped = Map(next);
+   if (mapped && m_preamble_length > 0)
+   {
+      std::memcpy(next.m_base, m_preamble.data(), m_preamble_length);
+      next.m_offset.store(m_preamble_length, std::memory_order_relaxed);
+   }
+   m_current.store(mapped ? &next : nullptr, std::memory_order_release);
+
+   while (full->m_writers.load(std::memory_order_acquire) != 0)
+   {
+      std::this_thread::yield();
+   }
+   Finish_segment(*full, used, m_shifts - 1);    // Already shifted to "<name>.1"
+   m_rotations.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Shift_files()
+{
+#if !defined _WIN32
+   ++m_shifts;
+
+   // Each position may hold the plain file, the compressed one, or both while it is compressed
+   const std::string suffixes[2] = { std::string(), m_suffix };
+   int variants = m_suffix.empty() ? 1 : 2;
+
+   for (int v = 0; v < variants; ++v)
+   {
+      const std::string &suffix = suffixes[v];
+      if (m_keep_segments <= 1)
+      {
+         ::unlink((m_path + suffix).c_str());
+         continue;
+      }
+
+      // An open descriptor follows its file through rename(), so the segment being retired can
+      // still be cut to size (and compressed) afterwards.
+      ::unlink((m_path + "." + std::to_string(m_keep_segments - 1) + suffix).c_str());
+      for (int i = m_keep_segments - 2; i >= 1; --i)
+      {
+         ::rename((m_path + "." + std::to_string(i) + suffix).c_str(), 
+                  (m_path + "." + std::to_string(i + 1) + suffix).c_str());
+      }
+      ::rename((m_path + suffix).c_str(), (m_path + ".1" + suffix).c_str());
+   }
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Finish_segment(Segment &segment, std::size_t used, std::uint64_t generation)
+{
+#if !defined _WIN32
+   // The file is m_path while m_shifts == generation, "<m_path>.1" after one more shift, etc.
+   int fd = (m_compressor && used > 0) ? ::dup(segment.m_fd) : -1;
+   Retire(segment, used);
+
+   if (fd >= 0)
+   {
+      std::string target = m_path + ".compressing." + std::to_string(generation);
+      bool queued = m_compressor->Enqueue(fd, used, target, [this, generation, target](bool ok)
+      {
+         Adopt(generation, target, ok);
+      });
+      if (!queued)
+      {
+         ::close(fd);
+      }
+   }
+#else
+   (void)generation;
+   Retire(segment, used);
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+void Mmap_sink::Adopt(std::uint64_t generation, const std::string &compressed, bool ok)
+{
+#if !defined _WIN32
+   std::lock_guard<std::mutex> rotate_lock(m_rotate_mutex);
+
+   // Where the original is now; it may have been rotated out while it was compressed
+   std::uint64_t age = m_shifts - generation;
+   if (ok && age < static_cast<std::uint64_t>(m_keep_segments))
+   {
+      std::string original = (age == 0) ? m_path : m_path + "." + std::to_string(age);
+      if (::rename(compressed.c_str(), (original + m_suffix).c_str()) == 0)
+      {
+         ::unlink(original.c_str());
+         return;
+      }
+   }
+   ::unlink(compressed.c_str());
+#else
+   (void)generation;
+   (void)compressed;
+   (void)ok;
+#endif
+}
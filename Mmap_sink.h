@@ -0,0 +1,126 @@
+/// @file Mmap_sink.h
+
+#ifndef MMAP_SINK_H_
+#define MMAP_SINK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+class Log_compressor;
+
+// ================================================================================================
+/// @brief     Stream buffer that writes into memory-mapped, preallocated segment files, with
+///            size-based rotation. Bytes are copied straight into the mapping, so writing makes no
+///            system call and the data survives a crash of the process (it is in the page cache).
+///
+///            A segment is fallocate()d to its full size up front. A writer reserves its byte
+///            range with one fetch-add on the segment offset and copies into it, so concurrent
+///            writers need no lock. The writer whose range crosses the end of the segment
+///            rotates. The current file keeps its name and older segments are renamed to
+///            "<name>.1" (newest) ... "<name>.<keep - 1>"; the oldest is deleted. Each file is
+///            cut to the bytes actually used when it is retired; after a crash the current file
+///            keeps its full size, zero-filled after the last line. Opening also rotates, so an
+///            existing log is kept rather than truncated.
+///
+///            POSIX only; Open() fails elsewhere, and Debugfile then uses File_sink.
+// ================================================================================================
+class Mmap_sink : public std::streambuf
+{
+public:
+
+   Mmap_sink();
+   ~Mmap_sink() override;
+
+   Mmap_sink(const Mmap_sink&) = delete;
+   Mmap_sink& operator=(const Mmap_sink&) = delete;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Starts writing to @p path in segments of @p segment_bytes, keeping at most
+   ///            @p keep_segments files including the current one.
+   // ---------------------------------------------------------------------------------------------
+   bool Open(const std::string &path, std::size_t segment_bytes, int keep_segments);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Waits for writers to finish, cuts the file to its used size and unmaps it.
+   ///            No other thread may start a write after Close() begins.
+   // ---------------------------------------------------------------------------------------------
+   void Close();
+
+   bool Is_open() const { return m_current.load(std::memory_order_acquire) != nullptr; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Text written at the start of every segment after the first (e.g. the column
+   ///            heading). Set it before Open(); ignored if longer than half a segment.
+   // ---------------------------------------------------------------------------------------------
+   void Set_preamble(const std::string &text) { m_preamble = text; }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Hands every retired segment, and the file left by Close(), to @p compressor. The
+   ///            compressed file ("<name>.N" plus the format's extension) replaces the original in
+   ///            the rotation. nullptr stops handing files over. The compressor must be stopped
+   ///            before this sink is destroyed.
+   // ---------------------------------------------------------------------------------------------
+   void Set_compressor(Log_compressor *compressor);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Appends @p data. Safe to call from several threads at once. Data longer than a
+   ///            segment is split across segments.
+   // ---------------------------------------------------------------------------------------------
+   void Write(const char *data, std::size_t length);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Write() for signal handlers: takes no lock and never rotates, so whatever does
+   ///            not fit in the current segment is dropped.
+   // ---------------------------------------------------------------------------------------------
+   void Emergency_write(const char *data, std::size_t length);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Number of rotations since construction.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Rotations() const { return m_rotations.load(std::memory_order_relaxed); }
+
+protected:
+
+   int_type overflow(int_type c) override;
+   std::streamsize xsputn(const char_type *s, std::streamsize n) override;
+
+private:
+
+   // One mapped file. Two of these alternate and are never freed while open, so a writer that
+   // read a stale pointer only ever touches a valid object (and then sees it is not current).
+   struct Segment
+   {
+      int                        m_fd{-1};
+      char                       *m_base{nullptr};
+      std::size_t                m_size{0};
+      std::atomic<std::size_t>   m_offset{0};
+      std::atomic<int>           m_writers{0};
+   };
+
+   Segment* Acquire();
+   bool Map(Segment &segment);
+   void Retire(Segment &segment, std::size_t used);
+   void Rotate(Segment *full, std::size_t used);
+   void Shift_files();
+   void Finish_segment(Segment &segment, std::size_t used, std::uint64_t generation);
+   void Adopt(std::uint64_t generation, const std::string &compressed, bool ok);
+
+   std::string                m_path;
+   std::size_t                m_segment_bytes;
+   int                        m_keep_segments;
+   std::string                m_preamble;
+   std::size_t                m_preamble_length;
+   Segment                    m_segments[2];
+   std::atomic<Segment*>      m_current;
+   std::mutex                 m_rotate_mutex;
+   std::atomic<std::uint64_t> m_rotations;
+   std::uint64_t              m_shifts;         ///< Shift_files() calls: a file's age in the rotation
+   Log_compressor             *m_compressor;
+   std::string                m_suffix;         ///< Extension of compressed segments, once set
+};
+
+#endif // MMAP_SINK_H_
@@ -2,12 +2,73 @@
 
 #include "Simple_timer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#if defined _WIN32 || defined __APPLE__
+#include <thread>
+#else
+#include <time.h>
+#endif
+
 #pragma warning (disable:4996)
 
+namespace
+{
+   // Spin slice of Wait_until(): starts at 100 us, kept between 20 us and 20 ms (Windows sleeps
+   // in steps of up to 15.6 ms)
+   const std::int64_t         s_min_spin_ns = 20000;
+   const std::int64_t         s_max_spin_ns = 20000000;
+   std::atomic<std::int64_t>  s_spin_ns{100000};
+
+   void Cpu_relax()
+   {
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+      __builtin_ia32_pause();
+#elif defined __GNUC__ && defined __aarch64__
+      asm volatile("yield");
+#endif
+   }
+
+   void Sleep_ns(std::int64_t ns)
+   {
+#if defined _WIN32 || defined __APPLE__
+      std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+#else
+      // An absolute wake-up time, so that a signal interrupting the sleep does not add to it
+      timespec wake;
+      clock_gettime(CLOCK_MONOTONIC, &wake);
+      wake.tv_sec += static_cast<time_t>(ns / 1000000000);
+      wake.tv_nsec += static_cast<long>(ns % 1000000000);
+      if (wake.tv_nsec >= 1000000000)
+      {
+         wake.tv_nsec -= 1000000000;
+         ++wake.tv_sec;
+      }
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR)
+      {
+      }
+#endif
+   }
+
+   // A wake-up within two thirds of the slice lets it shrink by 1/16; a later one makes it half
+   // as large again as that lateness
+   void Adjust_spin(std::int64_t late_ns)
+   {
+      std::int64_t spin = s_spin_ns.load(std::memory_order_relaxed);
+      if (late_ns + late_ns / 2 > spin)
+         spin = std::min(late_ns + late_ns / 2, s_max_spin_ns);
+      else
+         spin = std::max(spin - spin / 16, s_min_spin_ns);
+      s_spin_ns.store(spin, std::memory_order_relaxed);
+   }
+}
+
 // Constructor
 // ------------------------------------------------------------------------------------------------
 Simple_timer::Simple_timer()
-   : m_start(std::chrono::high_resolution_clock::now())
+   : m_start(Log_clock::Now())
 {
 }
 
@@ -20,7 +81,7 @@ Simple_timer::~Simple_timer()
 // Copy constructor
 // ------------------------------------------------------------------------------------------------
 Simple_timer::Simple_timer(const Simple_timer &r)
-   : m_start(std::chrono::high_resolution_clock::now())
+   : m_start(Log_clock::Now())
 {
 }
 
@@ -37,53 +98,118 @@ const Simple_timer& Simple_timer::operator =(const Simple_timer& r)
 // ------------------------------------------------------------------------------------------------
 void Simple_timer::Reset_timer()
 {
-   m_start = std::chrono::high_resolution_clock::now();
+   m_start = Log_clock::Now();
 }
 
 // ------------------------------------------------------------------------------------------------
-double Simple_timer::Elapsed_ms() const
+void Simple_timer::Reset_timer(std::uint64_t at)
 {
-   using namespace std::chrono;
+   m_start = at;
+}
 
-   duration<double, std::milli> elapsed_ms = high_resolution_clock::now() - m_start;
+// ------------------------------------------------------------------------------------------------
+double Simple_timer::Elapsed_ms() const
+{
+   return Log_clock::To_ms(Elapsed_ticks(Log_clock::Now()));
+}
 
-   return elapsed_ms.count();
+// ------------------------------------------------------------------------------------------------
+double Simple_timer::Elapsed_ms(std::uint64_t now) const
+{
+   return Log_clock::To_ms(Elapsed_ticks(now));
 }
 
 // ------------------------------------------------------------------------------------------------
 void Simple_timer::Add_delay_ms(double milliseconds) const
 {
-   using namespace std::chrono;
+   Wait_until(m_start + static_cast<std::uint64_t>(std::max<std::int64_t>(0, Log_clock::From_ns(milliseconds * 1e6))));
+}
+
+// ------------------------------------------------------------------------------------------------
+double Simple_timer::Elapsed_us() const
+{
+   return Log_clock::To_us(Elapsed_ticks(Log_clock::Now()));
+}
+
+// ------------------------------------------------------------------------------------------------
+double Simple_timer::Elapsed_us(std::uint64_t now) const
+{
+   return Log_clock::To_us(Elapsed_ticks(now));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Simple_timer::Add_delay_us(double microseconds) const
+{
+   Wait_until(m_start + static_cast<std::uint64_t>(std::max<std::int64_t>(0, Log_clock::From_ns(microseconds * 1e3))));
+}
+
+// ------------------------------------------------------------------------------------------------
+void Simple_timer::Wait_until(std::uint64_t deadline)
+{
+   std::uint64_t now = Log_clock::Now();
+   if (now >= deadline)
+      return;
 
-   time_point<high_resolution_clock> now = high_resolution_clock::now();
+   std::int64_t spin_ns = s_spin_ns.load(std::memory_order_relaxed);
+   std::int64_t remaining_ns = static_cast<std::int64_t>(Log_clock::To_ns(static_cast<std::int64_t>(deadline - now)));
+   if (remaining_ns > spin_ns)
+   {
+      std::uint64_t wake = now + static_cast<std::uint64_t>(Log_clock::From_ns(static_cast<double>(remaining_ns - spin_ns)));
+      Sleep_ns(remaining_ns - spin_ns);
+
+      now = Log_clock::Now();
+      Adjust_spin((now > wake) ? static_cast<std::int64_t>(Log_clock::To_ns(static_cast<std::int64_t>(now - wake))) : 0);
+   }
 
-   while (duration_cast<std::chrono::milliseconds>(now - m_start).count() < milliseconds)
+   while (Log_clock::Now() < deadline)
    {
-      now = high_resolution_clock::now();
+      Cpu_relax();
    }
 }
 
 // ------------------------------------------------------------------------------------------------
-double Simple_timer::Elapsed_us() const
+double Simple_timer::Spin_us()
 {
-   using namespace std::chrono;
-
-   duration<double, std::micro> elapsed_us = high_resolution_clock::now() - m_start;
+   return static_cast<double>(s_spin_ns.load(std::memory_order_relaxed)) / 1e3;
+}
 
-   return elapsed_us.count();
+// ------------------------------------------------------------------------------------------------
+Simple_pacer::Simple_pacer(std::chrono::nanoseconds period)
+   : m_start(Log_clock::Now())
+   , m_period_ticks(std::max(1.0, static_cast<double>(period.count()) / Log_clock::Ns_per_tick()))
+   , m_periods(0)
+{
 }
 
 // ------------------------------------------------------------------------------------------------
-void Simple_timer::Add_delay_us(double microseconds) const
+std::uint64_t Simple_pacer::Deadline(std::uint64_t periods) const
 {
-   using namespace std::chrono;
+   return m_start + static_cast<std::uint64_t>(std::llround(static_cast<double>(periods) * m_period_ticks));
+}
 
-   time_point<high_resolution_clock> now = high_resolution_clock::now();
+// ------------------------------------------------------------------------------------------------
+std::uint64_t Simple_pacer::Wait()
+{
+   std::uint64_t deadline = Deadline(++m_periods);
+   std::uint64_t now = Log_clock::Now();
 
-   while (duration_cast<std::chrono::microseconds>(now - m_start).count() < microseconds)
+   if (now > deadline)
    {
-      now = high_resolution_clock::now();
+      // Run this period now; the ones whose deadline has passed as well are dropped
+      std::uint64_t skipped = static_cast<std::uint64_t>(static_cast<double>(now - deadline) / m_period_ticks);
+      m_periods += skipped;
+      return skipped;
    }
+
+   Simple_timer::Wait_until(deadline);
+   return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Simple_pacer::Reset()
+{
+   m_start = Log_clock::Now();
+   m_periods = 0;
 }
 
 #pragma warning(default:4996)
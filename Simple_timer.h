@@ -3,7 +3,10 @@
 #ifndef SIMPLE_TIMER_H_
 #define SIMPLE_TIMER_H_
 
+#include "Log_clock.h"
+
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 
 class Simple_timer
@@ -26,6 +29,12 @@ public:
    // ---------------------------------------------------------------------------------------------
    void        Reset_timer();
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Restarts the timer at a Log_clock::Now() reading captured earlier (e.g. by
+   ///            another thread).
+   // ---------------------------------------------------------------------------------------------
+   void        Reset_timer(std::uint64_t at);
+
    // ---------------------------------------------------------------------------------------------
    // Elapsed_ms
    // ---------------------------------------------------------------------------------------------
@@ -33,10 +42,15 @@ public:
    // ---------------------------------------------------------------------------------------------
    double      Elapsed_ms() const;
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Milliseconds from the start of the timer to a given Log_clock::Now() reading.
+   // ---------------------------------------------------------------------------------------------
+   double      Elapsed_ms(std::uint64_t now) const;
+
    // ---------------------------------------------------------------------------------------------
    // Add_delay_ms
    // ---------------------------------------------------------------------------------------------
-   /// @brief     
+   /// @brief     Waits until @p milliseconds after the start of the timer (see Wait_until()).
    // ---------------------------------------------------------------------------------------------
    void        Add_delay_ms(double milliseconds) const;
 
@@ -46,10 +60,34 @@ public:
    double      Elapsed_us() const;
 
    // ---------------------------------------------------------------------------------------------
-   /// @brief     
+   /// @brief     Microseconds from the start of the timer to a given Log_clock::Now() reading.
+   // ---------------------------------------------------------------------------------------------
+   double      Elapsed_us(std::uint64_t now) const;
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Waits until @p microseconds after the start of the timer (see Wait_until()).
    // ---------------------------------------------------------------------------------------------
    void        Add_delay_us(double microseconds) const;
 
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Waits until Log_clock::Now() reaches @p deadline. Sleeps on the monotonic clock
+   ///            (clock_nanosleep with TIMER_ABSTIME where there is one) until Spin_us() before
+   ///            the deadline and spins only for that last slice, so a long delay costs almost no
+   ///            CPU. The slice follows how late the sleeps of all threads have woken up: it
+   ///            grows at once after a late wake-up and shrinks slowly after punctual ones.
+   // ---------------------------------------------------------------------------------------------
+   static void Wait_until(std::uint64_t deadline);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Current spin slice of Wait_until(), in microseconds.
+   // ---------------------------------------------------------------------------------------------
+   static double Spin_us();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Log_clock ticks since the start of the timer. Converting is left to the caller.
+   // ---------------------------------------------------------------------------------------------
+   std::int64_t Elapsed_ticks(std::uint64_t now) const { return static_cast<std::int64_t>(now - m_start); }
+
    // ---------------------------------------------------------------------------------------------
    // printClockData
    // ---------------------------------------------------------------------------------------------
@@ -78,8 +116,45 @@ public:
 
 private:
 
-   std::chrono::time_point<std::chrono::high_resolution_clock> m_start;
+   std::uint64_t     m_start;     ///< Log_clock ticks
+
+};
+
+// ================================================================================================
+/// @brief     Paces a loop at a fixed rate: the n-th Wait() returns at start + n periods. Deadlines
+///            are counted from the start, not from the previous return, so a late wake-up or a
+///            slow iteration does not shift the ones after it and no drift accumulates. A loop
+///            that falls behind by whole periods skips them instead of running them back to back.
+// ================================================================================================
+class Simple_pacer
+{
+public:
+
+   explicit Simple_pacer(std::chrono::nanoseconds period);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Waits for the next deadline (see Simple_timer::Wait_until()).
+   /// @return    Number of periods skipped because the loop was behind; normally 0.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Wait();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Starts counting periods again from now.
+   // ---------------------------------------------------------------------------------------------
+   void        Reset();
+
+   // ---------------------------------------------------------------------------------------------
+   /// @return    Periods since the start, including skipped ones.
+   // ---------------------------------------------------------------------------------------------
+   std::uint64_t Periods() const { return m_periods; }
+
+private:
+
+   std::uint64_t Deadline(std::uint64_t periods) const;
 
+   std::uint64_t     m_start;          ///< Log_clock ticks
+   double            m_period_ticks;
+   std::uint64_t     m_periods;
 };
 
 #endif // SIMPLE_TIMER_H_
@@ -0,0 +1,224 @@
+/// @file Trace_recorder.cpp
+
+#include "Trace_recorder.h"
+#include "Log_clock.h"
+#include "Log_record.h"
+#include "Log_thread.h"
+
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+   // ---------------------------------------------------------------------------------------------
+   // One recorded event. m_seq is the event's index + 1 once the slot is filled, and 0 while the
+   // owner is rewriting it, so an export can tell a torn slot from a good one. The fields are
+   // relaxed atomics, which cost the owner nothing over plain stores.
+   // ---------------------------------------------------------------------------------------------
+   struct Trace_event
+   {
+      std::atomic<std::uint64_t>    m_seq{0};
+      std::atomic<const char*>      m_name{nullptr};
+      std::atomic<std::uint64_t>    m_ticks{0};    ///< Log_clock::Now()
+      std::atomic<char>             m_phase{0};
+   };
+
+   struct Event_copy
+   {
+      const char     *m_name;
+      std::uint64_t  m_ticks;
+      char           m_phase;
+   };
+
+   // ---------------------------------------------------------------------------------------------
+   // One thread's events. Only the owning thread writes; an exporter copies the slots below m_head
+   // and keeps those whose sequence number is unchanged after the copy.
+   // ---------------------------------------------------------------------------------------------
+   struct Thread_ring
+   {
+      Thread_ring(std::size_t capacity, std::uint32_t ordinal, std::uint64_t native_id)
+         : m_events(new Trace_event[capacity])
+         , m_mask(capacity - 1)
+         , m_ordinal(ordinal)
+         , m_native_id(native_id)
+         , m_head(0)
+      {
+      }
+
+      std::unique_ptr<Trace_event[]>   m_events;
+      const std::size_t                m_mask;
+      const std::uint32_t              m_ordinal;     ///< Log_thread::Id(), as in the Thread_ID column
+      const std::uint64_t              m_native_id;
+      std::atomic<std::uint64_t>       m_head;
+   };
+
+   std::mutex                                s_rings_mutex;
+   std::vector<std::unique_ptr<Thread_ring>> s_rings;      // Rings outlive their threads
+   std::atomic<std::size_t>                  s_capacity{65536};
+   const std::uint64_t                       s_epoch = Log_clock::Now();
+
+   Thread_ring& Local_ring()
+   {
+      thread_local Thread_ring *ring = nullptr;
+
+      if (!ring)
+      {
+         std::size_t capacity = 2;
+         while (capacity < s_capacity.load(std::memory_order_relaxed))
+            capacity <<= 1;
+
+         std::lock_guard<std::mutex> rings_lock(s_rings_mutex);
+         s_rings.emplace_back(new Thread_ring(capacity, Log_thread::Id(),
+                                              Thread_id_value(std::this_thread::get_id())));
+         ring = s_rings.back().get();
+      }
+      return *ring;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Copies event @p index of @p ring, if it is still there and was not being rewritten.
+   // ---------------------------------------------------------------------------------------------
+   bool Read_event(const Thread_ring &ring, std::uint64_t index, Event_copy &copy)
+   {
+      const Trace_event &e = ring.m_events[index & ring.m_mask];
+
+      if (e.m_seq.load(std::memory_order_acquire) != index + 1)
+         return false;
+
+      copy.m_name = e.m_name.load(std::memory_order_relaxed);
+      copy.m_ticks = e.m_ticks.load(std::memory_order_relaxed);
+      copy.m_phase = e.m_phase.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return e.m_seq.load(std::memory_order_relaxed) == index + 1;
+   }
+
+   void Write_json_string(std::ostream &os, const char *s)
+   {
+      static const char hex[] = "0123456789abcdef";
+
+      os << '"';
+      for (; s && *s; ++s)
+      {
+         unsigned char c = static_cast<unsigned char>(*s);
+         if (c == '"' || c == '\\')
+            os << '\\' << *s;
+         else if (c < 0x20)
+            os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+         else
+            os << *s;
+      }
+      os << '"';
+   }
+
+   void Write_microseconds(std::ostream &os, double ns)
+   {
+      char digits[32];
+      std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits),
+                                             ns / 1000.0,
+                                             std::chars_format::fixed, 3);
+      os.write(digits, r.ptr - digits);
+   }
+}
+
+// ------------------------------------------------------------------------------------------------
+void Trace_recorder::Set_capacity(std::size_t events_per_thread)
+{
+   s_capacity.store(events_per_thread, std::memory_order_relaxed);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Trace_recorder::Record(const char *name, char phase)
+{
+   Thread_ring &ring = Local_ring();
+   std::uint64_t head = ring.m_head.load(std::memory_order_relaxed);
+
+   Trace_event &e = ring.m_events[head & ring.m_mask];
+
+   e.m_seq.store(0, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   e.m_name.store(name, std::memory_order_relaxed);
+   e.m_ticks.store(Log_clock::Now(), std::memory_order_relaxed);
+   e.m_phase.store(phase, std::memory_order_relaxed);
+
+   e.m_seq.store(head + 1, std::memory_order_release);
+   ring.m_head.store(head + 1, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool Trace_recorder::Write_chrome_trace(const std::string &path)
+{
+   std::ofstream out(path, std::ios::out);
+   if (!out.is_open())
+      return false;
+
+   const long pid = static_cast<long>(getpid());
+   std::vector<Event_copy> events;
+   bool first = true;
+
+   out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+   std::lock_guard<std::mutex> rings_lock(s_rings_mutex);
+
+   for (const std::unique_ptr<Thread_ring> &ring : s_rings)
+   {
+      std::size_t capacity = ring->m_mask + 1;
+      std::uint64_t head = ring->m_head.load(std::memory_order_acquire);
+      std::uint64_t begin = (head > capacity) ? head - capacity : 0;
+
+      // Events the owner overwrites while we copy fail their sequence check and are left out
+      events.clear();
+      Event_copy copy;
+      for (std::uint64_t i = begin; i < head; ++i)
+      {
+         if (Read_event(*ring, i, copy))
+            events.push_back(copy);
+      }
+
+      // Named threads show their Log_thread name, the others their native id
+      out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << ring->m_ordinal << ",\"args\":{\"name\":";
+      if (const char *name = Log_thread::Name(ring->m_ordinal))
+         Write_json_string(out, name);
+      else
+         out << "\"thread " << ring->m_native_id << '"';
+      out << "}}";
+      first = false;
+
+      for (std::size_t i = 0; i < events.size(); ++i)
+      {
+         out << ",\n{\"name\":";
+         Write_json_string(out, events[i].m_name);
+         out << ",\"ph\":\"" << events[i].m_phase << "\",\"ts\":";
+         Write_microseconds(out, Log_clock::To_ns(static_cast<std::int64_t>(events[i].m_ticks - s_epoch)));
+         out << ",\"pid\":" << pid << ",\"tid\":" << ring->m_ordinal << '}';
+      }
+   }
+
+   out << "\n]}\n";
+   return out.good();
+}
+
+// ------------------------------------------------------------------------------------------------
+void Trace_recorder::Clear()
+{
+   std::lock_guard<std::mutex> rings_lock(s_rings_mutex);
+
+   for (const std::unique_ptr<Thread_ring> &ring : s_rings)
+   {
+      ring->m_head.store(0, std::memory_order_release);
+   }
+}
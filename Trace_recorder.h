@@ -0,0 +1,51 @@
+/// @file Trace_recorder.h
+
+#ifndef TRACE_RECORDER_H_
+#define TRACE_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ================================================================================================
+/// @brief     Function-scope tracing into per-thread ring buffers. An entry or exit is a
+///            fixed-size event: the function name pointer (e.g. __FUNCTION__, never copied), a
+///            Log_clock timestamp and the phase. Each thread owns its ring, so recording takes
+///            no lock and does not allocate after the thread's first event. When a ring is full,
+///            the oldest events are overwritten.
+///
+///            Write_chrome_trace() exports every ring as Chrome Trace Event JSON, which
+///            chrome://tracing and ui.perfetto.dev open directly. It may run while threads are
+///            tracing: each event carries a sequence number, and one rewritten during the copy
+///            is left out rather than exported torn.
+// ================================================================================================
+class Trace_recorder
+{
+public:
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Ring size for threads that have not recorded yet (rounded up to a power of two;
+   ///            default 65536 events, 2 MiB per thread).
+   // ---------------------------------------------------------------------------------------------
+   static void Set_capacity(std::size_t events_per_thread);
+
+   static void Begin(const char *name) { Record(name, 'B'); }
+   static void End(const char *name) { Record(name, 'E'); }
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Writes all recorded events as {"traceEvents":[...]} JSON.
+   /// @return    @e false if the file cannot be written.
+   // ---------------------------------------------------------------------------------------------
+   static bool Write_chrome_trace(const std::string &path);
+
+   // ---------------------------------------------------------------------------------------------
+   /// @brief     Discards recorded events. Call when no thread is tracing.
+   // ---------------------------------------------------------------------------------------------
+   static void Clear();
+
+private:
+
+   static void Record(const char *name, char phase);
+};
+
+#endif // TRACE_RECORDER_H_
@@ -0,0 +1,654 @@
+/// @file Debuglog_bench.cpp
+///
+/// Benchmark suite for the logging and timing hot paths, meant to be run before a release and
+/// compared with the previous one. It reports:
+///
+///    - the clocks: period, measured resolution and cost per call of the std::chrono clocks (what
+///      Simple_timer::printClockData() prints) and of Log_clock, plus Simple_timer's calls and
+///      how far Add_delay_us() overshoots and how much CPU it uses;
+///    - Write variants (int, string, G_LOG_FMT, short and long vectors, binary format) with
+///      calls/s and p50/p99/p99.9/max latency per call;
+///    - disabled calls: logging off, level filtered, call site switched off;
+///    - G_LOG_FUNCTION (Logger_helper) writing lines, recording trace events, and filtered;
+///    - each flush policy;
+///    - 1 to 64 threads in synchronous, async and sharded mode.
+///
+/// Latency is taken around every call with Log_clock::Now(), so it includes one clock read
+/// (reported as Log_clock's call_ns). Unless a case says otherwise, the file is flushed every
+/// 64 KiB, so that the numbers measure the logger rather than one write(2) per line.
+///
+/// --json writes the results as JSON, one case per line. --baseline compares ns_per_call and
+/// p99 with such a file and exits with 1 if any case got slower by more than --tolerance percent.
+///
+///    g++ -std=c++17 -O2 -pthread -DENABLE_DEBUG_LOGGING -I.. Debuglog_bench.cpp ../*.cpp
+///    Debuglog_bench [--quick] [--filter <text>] [--threads 1,2,4] [--json <path>]
+///                   [--baseline <path>] [--tolerance <percent>]
+
+#include "Debug_logger_macros.h"
+#include "Log_thread.h"
+#include "Simple_timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+G_LOG_DEFINE(Debuglog_bench.log)
+
+namespace
+{
+   const char *s_log_path = "Debuglog_bench.log";
+
+   struct Options
+   {
+      bool              m_quick{false};
+      std::string       m_filter;
+      std::vector<int>  m_threads{ 1, 2, 4, 8, 16, 32, 64 };
+      std::string       m_json;
+      std::string       m_baseline;
+      double            m_tolerance{10.0};
+   };
+
+   Options s_options;
+
+   struct Case_result
+   {
+      std::string    m_name;
+      int            m_threads{1};
+      std::uint64_t  m_calls{0};
+      double         m_seconds{0.0};
+      double         m_ns_per_call{0.0};   ///< Wall time per call, all threads together
+      bool           m_has_latency{false};
+      double         m_p50_ns{0.0};
+      double         m_p99_ns{0.0};
+      double         m_p999_ns{0.0};
+      double         m_max_ns{0.0};
+   };
+
+   struct Clock_result
+   {
+      std::string    m_name;
+      double         m_period_ns;
+      bool           m_is_steady;
+      double         m_resolution_ns;      ///< Smallest non-zero step seen between two calls
+      double         m_call_ns;
+   };
+
+   struct Delay_result
+   {
+      double         m_requested_us;
+      double         m_mean_us;
+      double         m_max_us;
+      double         m_cpu_percent;    ///< Process CPU time over wall time while waiting
+   };
+
+   std::vector<Case_result>   s_cases;
+   std::vector<Clock_result>  s_clocks;
+   std::vector<Delay_result>  s_delays;
+   double                     s_timer_elapsed_ns = 0.0;
+   double                     s_timer_reset_ns = 0.0;
+
+   std::uint64_t Scaled(std::uint64_t calls)
+   {
+      return s_options.m_quick ? std::max<std::uint64_t>(calls / 10, 100) : calls;
+   }
+
+   bool Selected(const std::string &name)
+   {
+      return s_options.m_filter.empty() || name.find(s_options.m_filter) != std::string::npos;
+   }
+
+   double Percentile(const std::vector<std::uint64_t> &sorted, double fraction)
+   {
+      if (sorted.empty())
+         return 0.0;
+      std::size_t index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+      return Log_clock::To_ns(static_cast<std::int64_t>(sorted[std::min(index, sorted.size() - 1)]));
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Calls fn(i) calls_per_thread times on each of @p threads threads, all released together.
+   // With @p per_call, every call is timed; otherwise only the whole run. The time includes
+   // flushing @p logger at the end.
+   // ---------------------------------------------------------------------------------------------
+   template <typename Fn>
+   void Run(Debugfile &logger, const std::string &name, int threads, std::uint64_t calls_per_thread,
+            bool per_call, Fn&& fn)
+   {
+      if (!Selected(name))
+         return;
+
+      std::vector<std::vector<std::uint64_t>> samples(static_cast<std::size_t>(threads));
+      std::atomic<int> ready{0};
+      std::atomic<bool> go{false};
+      std::vector<std::thread> workers;
+
+      for (int t = 0; t < threads; ++t)
+      {
+         workers.emplace_back([&, t]
+         {
+            std::vector<std::uint64_t> &mine = samples[static_cast<std::size_t>(t)];
+            if (per_call)
+               mine.resize(calls_per_thread);
+
+            for (std::uint64_t i = 0; i < std::min<std::uint64_t>(1000, calls_per_thread); ++i)
+            {
+               fn(i);      // Warm-up: thread ids, staged records and buffers reach their size
+            }
+
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+            {
+               std::this_thread::yield();
+            }
+
+            if (per_call)
+            {
+               for (std::uint64_t i = 0; i < calls_per_thread; ++i)
+               {
+                  std::uint64_t start = Log_clock::Now();
+                  fn(i);
+                  mine[i] = Log_clock::Now() - start;
+               }
+            }
+            else
+            {
+               for (std::uint64_t i = 0; i < calls_per_thread; ++i)
+               {
+                  fn(i);
+               }
+            }
+         });
+      }
+
+      while (ready.load() < threads)
+      {
+         std::this_thread::yield();
+      }
+      auto start = std::chrono::steady_clock::now();
+      go.store(true, std::memory_order_release);
+      for (std::thread &w : workers)
+      {
+         w.join();
+      }
+      logger.Flush();
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      Case_result r;
+      r.m_name = name;
+      r.m_threads = threads;
+      r.m_calls = calls_per_thread * static_cast<std::uint64_t>(threads);
+      r.m_seconds = elapsed.count();
+      r.m_ns_per_call = r.m_seconds * 1e9 / static_cast<double>(r.m_calls);
+
+      if (per_call)
+      {
+         std::vector<std::uint64_t> all;
+         all.reserve(r.m_calls);
+         for (const std::vector<std::uint64_t> &s : samples)
+         {
+            all.insert(all.end(), s.begin(), s.end());
+         }
+         std::sort(all.begin(), all.end());
+         r.m_has_latency = true;
+         r.m_p50_ns = Percentile(all, 0.5);
+         r.m_p99_ns = Percentile(all, 0.99);
+         r.m_p999_ns = Percentile(all, 0.999);
+         r.m_max_ns = Percentile(all, 1.0);
+      }
+
+      std::printf("%-34s %3d thr %10.0f calls/s %9.1f ns/call", name.c_str(), threads,
+                  static_cast<double>(r.m_calls) / r.m_seconds, r.m_ns_per_call);
+      if (r.m_has_latency)
+      {
+         std::printf("   p50 %7.0f  p99 %8.0f  p99.9 %9.0f  max %10.0f ns",
+                     r.m_p50_ns, r.m_p99_ns, r.m_p999_ns, r.m_max_ns);
+      }
+      std::printf("\n");
+      std::fflush(stdout);
+
+      s_cases.push_back(r);
+
+      // Keep the file small between cases
+      logger.Reset();
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Clocks
+   // ---------------------------------------------------------------------------------------------
+   template <typename Clock>
+   void Measure_clock(const char *name)
+   {
+      const int calls = 200000;
+      typedef typename Clock::period P;
+
+      std::int64_t resolution = 0;
+      auto first = Clock::now();
+      auto previous = first;
+      for (int i = 0; i < calls; ++i)
+      {
+         auto now = Clock::now();
+         std::int64_t step = std::chrono::duration_cast<std::chrono::nanoseconds>(now - previous).count();
+         if (step > 0 && (resolution == 0 || step < resolution))
+            resolution = step;
+         previous = now;
+      }
+      double total_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(previous - first).count());
+
+      s_clocks.push_back(Clock_result{ name, 1e9 * static_cast<double>(P::num) / static_cast<double>(P::den),
+                                       Clock::is_steady, static_cast<double>(resolution), total_ns / calls });
+   }
+
+   void Measure_clocks()
+   {
+      Measure_clock<std::chrono::system_clock>("system_clock");
+      Measure_clock<std::chrono::steady_clock>("steady_clock");
+      Measure_clock<std::chrono::high_resolution_clock>("high_resolution_clock");
+
+      const int calls = 200000;
+      std::uint64_t resolution = 0;
+      std::uint64_t first = Log_clock::Now();
+      std::uint64_t previous = first;
+      for (int i = 0; i < calls; ++i)
+      {
+         std::uint64_t now = Log_clock::Now();
+         if (now > previous && (resolution == 0 || now - previous < resolution))
+            resolution = now - previous;
+         previous = now;
+      }
+      s_clocks.push_back(Clock_result{ std::string("Log_clock (") + Log_clock::Source_name() + ")",
+                                       Log_clock::Ns_per_tick(), true,
+                                       Log_clock::To_ns(static_cast<std::int64_t>(resolution)),
+                                       Log_clock::To_ns(static_cast<std::int64_t>(previous - first)) / calls });
+
+      for (const Clock_result &c : s_clocks)
+      {
+         std::printf("%-34s period %8.3f ns  steady %-5s  resolution %8.1f ns  %6.1f ns/call\n",
+                     c.m_name.c_str(), c.m_period_ns, c.m_is_steady ? "yes" : "no", c.m_resolution_ns,
+                     c.m_call_ns);
+      }
+   }
+
+   void Measure_simple_timer()
+   {
+      const int calls = 200000;
+      Simple_timer timer;
+      volatile double sink = 0.0;
+
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < calls; ++i)
+      {
+         sink = sink + timer.Elapsed_us();
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      s_timer_elapsed_ns = elapsed.count() / calls;
+
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < calls; ++i)
+      {
+         timer.Reset_timer();
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+      s_timer_reset_ns = elapsed.count() / calls;
+
+      std::printf("%-34s Elapsed_us %.1f ns/call  Reset_timer %.1f ns/call\n", "Simple_timer",
+                  s_timer_elapsed_ns, s_timer_reset_ns);
+
+      const double requested[] = { 10.0, 100.0, 1000.0, 5000.0, 50000.0 };
+      for (double us : requested)
+      {
+         const int repeats = s_options.m_quick ? 5 : 20;
+         double total = 0.0, max = 0.0;
+         std::clock_t cpu_start = std::clock();
+         for (int i = 0; i < repeats; ++i)
+         {
+            Simple_timer t;
+            t.Add_delay_us(us);
+            double actual = t.Elapsed_us();
+            total += actual;
+            max = std::max(max, actual);
+         }
+         double cpu_us = static_cast<double>(std::clock() - cpu_start) * 1e6 / CLOCKS_PER_SEC;
+         double cpu_percent = 100.0 * cpu_us / total;
+         s_delays.push_back(Delay_result{ us, total / repeats, max, cpu_percent });
+         std::printf("%-34s requested %7.0f us  mean %9.1f us  max %9.1f us  cpu %5.1f%%  (spin %.0f us)\n",
+                     "Simple_timer::Add_delay_us", us, total / repeats, max, cpu_percent, Simple_timer::Spin_us());
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Logging cases
+   // ---------------------------------------------------------------------------------------------
+   void Writes()
+   {
+      const std::uint64_t calls = Scaled(200000);
+      const std::string name = "sensor";
+      const std::vector<double> shorter{ 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5 };
+      std::vector<double> longer(1000);
+      for (std::size_t i = 0; i < longer.size(); ++i)
+      {
+         longer[i] = static_cast<double>(i) * 0.25;
+      }
+
+      Run(g_log, "write/int", 1, calls, true, [](std::uint64_t i) { G_LOG_VAR(i) });
+      Run(g_log, "write/message", 1, calls, true, [](std::uint64_t) { G_LOG_MSG("a constant message") });
+      Run(g_log, "write/string", 1, calls, true, [&](std::uint64_t) { G_LOG_VAR(name) });
+      Run(g_log, "write/double", 1, calls, true, [](std::uint64_t i) { double d = static_cast<double>(i) * 0.5; G_LOG_VAR(d) });
+      Run(g_log, "write/fmt", 1, calls, true, [&](std::uint64_t i)
+      {
+         G_LOG_FMT("i = {}, name = {}, value = {}", i, name, static_cast<double>(i) * 0.5);
+      });
+      Run(g_log, "write/vector_8", 1, calls, true, [&](std::uint64_t) { G_LOG_VAR(shorter) });
+      Run(g_log, "write/vector_1000", 1, Scaled(20000), true, [&](std::uint64_t) { G_LOG_VAR(longer) });
+      Run(g_log, "write/range_summary_1000", 1, Scaled(20000), true, [&](std::uint64_t) { G_LOG_RANGE_SUMMARY(longer) });
+   }
+
+   void Binary_writes()
+   {
+      // Shadows the global logger, so the macros below write to this one
+      Debugfile g_log("Debuglog_bench.bin", true, Debugfile::timing_type::e_micro,
+                      Debugfile::output_format::e_binary);
+      g_log.Set_flush_policy(Debugfile::flush_policy::e_bytes, 1 << 16);
+
+      const std::uint64_t calls = Scaled(200000);
+      const std::vector<double> shorter{ 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5 };
+
+      Run(g_log, "binary/int", 1, calls, true, [&](std::uint64_t i) { G_LOG_VAR(i) });
+      Run(g_log, "binary/fmt", 1, calls, true, [&](std::uint64_t i) { G_LOG_FMT("i = {}, half = {}", i, i / 2); });
+      Run(g_log, "binary/vector_8", 1, calls, true, [&](std::uint64_t) { G_LOG_VAR(shorter) });
+
+      G_LOG_DISABLE
+      std::remove("Debuglog_bench.bin");
+   }
+
+   void Disabled_calls()
+   {
+      const std::uint64_t calls = Scaled(20000000);
+
+      G_LOG_DISABLE
+      Run(g_log, "disabled/logging_off", 1, calls, false, [](std::uint64_t i) { G_LOG_VAR(i) });
+      G_LOG_ENABLE
+
+      G_LOG_SET_LEVEL(INFO)
+      Run(g_log, "disabled/level_filtered", 1, calls, false, [](std::uint64_t i) { G_LOG_VAR_AT(TRACE, bench, i) });
+      G_LOG_SET_LEVEL(TRACE)
+
+      // Lambdas are all called operator(), so the site is picked by its line
+      Log_site_registry::Enable("file=*Debuglog_bench.cpp line=" + std::to_string(__LINE__ + 1), false);
+      Run(g_log, "disabled/site_off", 1, calls, false, [](std::uint64_t i) { G_LOG_VAR(i) });
+      Log_site_registry::Clear();
+   }
+
+   void Bench_function(std::uint64_t i)
+   {
+      G_LOG_FUNCTION
+      (void)i;
+   }
+
+   void Function_scopes()
+   {
+      const std::uint64_t calls = Scaled(100000);
+
+      Run(g_log, "function/lines", 1, calls, true, [](std::uint64_t i) { Bench_function(i); });
+
+      Trace_recorder::Clear();
+      G_LOG_TRACE_ENABLE
+      Run(g_log, "function/traced", 1, calls, true, [](std::uint64_t i) { Bench_function(i); });
+      G_LOG_TRACE_DISABLE
+      Trace_recorder::Clear();
+
+      G_LOG_SET_LEVEL(DEBUG)
+      Run(g_log, "function/filtered", 1, Scaled(20000000), false, [](std::uint64_t i) { Bench_function(i); });
+      G_LOG_SET_LEVEL(TRACE)
+   }
+
+   void Flush_policies()
+   {
+      const std::uint64_t calls = Scaled(100000);
+      struct { const char *m_name; Debugfile::flush_policy m_policy; std::size_t m_threshold; } policies[] =
+      {
+         { "flush/every_line",     Debugfile::flush_policy::e_every_line, 0 },
+         { "flush/bytes_64k",      Debugfile::flush_policy::e_bytes,      1 << 16 },
+         { "flush/interval_100ms", Debugfile::flush_policy::e_interval,   100 },
+         { "flush/explicit",       Debugfile::flush_policy::e_explicit,   0 },
+      };
+
+      for (const auto &p : policies)
+      {
+         g_log.Set_flush_policy(p.m_policy, p.m_threshold);
+         Run(g_log, p.m_name, 1, calls, true, [](std::uint64_t i) { G_LOG_VAR(i) });
+      }
+      g_log.Set_flush_policy(Debugfile::flush_policy::e_bytes, 1 << 16);
+   }
+
+   void Threads()
+   {
+      // About the same total work at every thread count
+      const std::uint64_t total = Scaled(400000);
+
+      for (int threads : s_options.m_threads)
+      {
+         std::uint64_t calls = std::max<std::uint64_t>(total / static_cast<std::uint64_t>(threads), 1000);
+         Run(g_log, "threads/sync", threads, calls, true, [](std::uint64_t i) { G_LOG_VAR(i) });
+
+         g_log.Start_async(8192, Debugfile::overflow_policy::e_block);
+         Run(g_log, "threads/async", threads, calls, true, [](std::uint64_t i) { G_LOG_VAR(i) });
+         g_log.Stop_async();
+
+         g_log.Start_sharded();
+         Run(g_log, "threads/sharded", threads, calls, true, [](std::uint64_t i) { G_LOG_VAR(i) });
+         g_log.Stop_sharded();
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Output
+   // ---------------------------------------------------------------------------------------------
+   std::string Json_case(const Case_result &r)
+   {
+      char text[512];
+      std::snprintf(text, sizeof(text),
+                    "{\"name\": \"%s\", \"threads\": %d, \"calls\": %llu, \"seconds\": %.6f, "
+                    "\"calls_per_second\": %.1f, \"ns_per_call\": %.2f",
+                    r.m_name.c_str(), r.m_threads, static_cast<unsigned long long>(r.m_calls), r.m_seconds,
+                    static_cast<double>(r.m_calls) / r.m_seconds, r.m_ns_per_call);
+      std::string line = text;
+      if (r.m_has_latency)
+      {
+         std::snprintf(text, sizeof(text), ", \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f",
+                       r.m_p50_ns, r.m_p99_ns, r.m_p999_ns, r.m_max_ns);
+         line += text;
+      }
+      return line + "}";
+   }
+
+   bool Write_json(const std::string &path)
+   {
+      std::ofstream out(path);
+      if (!out)
+         return false;
+
+      char text[512];
+      std::time_t now = std::time(nullptr);
+      std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+      out << "{\n\"schema\": 1,\n\"date\": \"" << text << "\",\n\"quick\": " << (s_options.m_quick ? "true" : "false")
+          << ",\n\"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n\"clocks\": [\n";
+      for (std::size_t i = 0; i < s_clocks.size(); ++i)
+      {
+         const Clock_result &c = s_clocks[i];
+         std::snprintf(text, sizeof(text),
+                       "{\"name\": \"%s\", \"period_ns\": %.6f, \"is_steady\": %s, \"resolution_ns\": %.2f, \"call_ns\": %.2f}",
+                       c.m_name.c_str(), c.m_period_ns, c.m_is_steady ? "true" : "false", c.m_resolution_ns, c.m_call_ns);
+         out << text << (i + 1 < s_clocks.size() ? ",\n" : "\n");
+      }
+
+      out << "],\n\"simple_timer\": {\"elapsed_ns\": " << s_timer_elapsed_ns << ", \"reset_ns\": " << s_timer_reset_ns
+          << ", \"delays\": [";
+      for (std::size_t i = 0; i < s_delays.size(); ++i)
+      {
+         std::snprintf(text, sizeof(text),
+                       "{\"requested_us\": %.1f, \"mean_us\": %.2f, \"max_us\": %.2f, \"cpu_percent\": %.1f}",
+                       s_delays[i].m_requested_us, s_delays[i].m_mean_us, s_delays[i].m_max_us,
+                       s_delays[i].m_cpu_percent);
+         out << text << (i + 1 < s_delays.size() ? ", " : "");
+      }
+
+      out << "]},\n\"cases\": [\n";
+      for (std::size_t i = 0; i < s_cases.size(); ++i)
+      {
+         out << Json_case(s_cases[i]) << (i + 1 < s_cases.size() ? ",\n" : "\n");
+      }
+      out << "]\n}\n";
+      return static_cast<bool>(out);
+   }
+
+   // Value of "key": <number> in a line written by Json_case(); false if absent
+   bool Json_number(const std::string &line, const char *key, double &value)
+   {
+      std::string tag = std::string("\"") + key + "\": ";
+      std::size_t at = line.find(tag);
+      if (at == std::string::npos)
+         return false;
+      value = std::strtod(line.c_str() + at + tag.size(), nullptr);
+      return true;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Compares with a file written by an earlier run; returns the number of regressions.
+   // ---------------------------------------------------------------------------------------------
+   int Compare(const std::string &path)
+   {
+      std::ifstream in(path);
+      if (!in)
+      {
+         std::cerr << "cannot read baseline " << path << "\n";
+         return 1;
+      }
+
+      int regressions = 0;
+      std::string line;
+      while (std::getline(in, line))
+      {
+         std::size_t at = line.find("{\"name\": \"");
+         double threads = 0.0;
+         if (at == std::string::npos || !Json_number(line, "threads", threads) || line.find("calls_per_second") == std::string::npos)
+            continue;
+         std::size_t begin = at + 10;
+         std::string name = line.substr(begin, line.find('"', begin) - begin);
+
+         for (const Case_result &r : s_cases)
+         {
+            if (r.m_name != name || r.m_threads != static_cast<int>(threads))
+               continue;
+
+            struct { const char *m_key; double m_now; bool m_valid; } metrics[] =
+            {
+               { "ns_per_call", r.m_ns_per_call, true },
+               { "p99_ns",      r.m_p99_ns,      r.m_has_latency },
+            };
+            for (const auto &m : metrics)
+            {
+               double before = 0.0;
+               if (!m.m_valid || !Json_number(line, m.m_key, before) || before <= 0.0)
+                  continue;
+               double change = (m.m_now - before) / before * 100.0;
+               if (change > s_options.m_tolerance)
+               {
+                  std::printf("REGRESSION %s (%d threads) %s: %.1f -> %.1f (+%.0f%%)\n", name.c_str(),
+                              r.m_threads, m.m_key, before, m.m_now, change);
+                  ++regressions;
+               }
+            }
+         }
+      }
+      return regressions;
+   }
+
+   bool Parse_arguments(int argc, char *argv[])
+   {
+      for (int i = 1; i < argc; ++i)
+      {
+         std::string arg = argv[i];
+         bool has_value = (i + 1 < argc);
+
+         if (arg == "--quick")
+            s_options.m_quick = true;
+         else if (arg == "--filter" && has_value)
+            s_options.m_filter = argv[++i];
+         else if (arg == "--json" && has_value)
+            s_options.m_json = argv[++i];
+         else if (arg == "--baseline" && has_value)
+            s_options.m_baseline = argv[++i];
+         else if (arg == "--tolerance" && has_value)
+            s_options.m_tolerance = std::atof(argv[++i]);
+         else if (arg == "--threads" && has_value)
+         {
+            s_options.m_threads.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ','))
+            {
+               int n = std::atoi(item.c_str());
+               if (n < 1)
+                  return false;
+               s_options.m_threads.push_back(n);
+            }
+         }
+         else
+            return false;
+      }
+      return true;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   if (!Parse_arguments(argc, argv))
+   {
+      std::cerr << "usage: " << argv[0] << " [--quick] [--filter <text>] [--threads 1,2,4] [--json <path>]"
+                   " [--baseline <path>] [--tolerance <percent>]\n";
+      return 2;
+   }
+
+   Measure_clocks();
+   Measure_simple_timer();
+
+   G_LOG_ENABLE
+   g_log.Set_flush_policy(Debugfile::flush_policy::e_bytes, 1 << 16);
+
+   Writes();
+   Binary_writes();
+   Disabled_calls();
+   Function_scopes();
+   Flush_policies();
+   Threads();
+
+   G_LOG_DISABLE
+   std::remove(s_log_path);
+   for (const Log_thread::entry &thread : Log_thread::Threads())
+   {
+      std::remove((std::string(s_log_path) + "." + std::to_string(thread.m_id)).c_str());
+   }
+
+   if (!s_options.m_json.empty() && !Write_json(s_options.m_json))
+   {
+      std::cerr << "cannot write " << s_options.m_json << "\n";
+      return 1;
+   }
+   if (!s_options.m_baseline.empty())
+   {
+      return (Compare(s_options.m_baseline) == 0) ? 0 : 1;
+   }
+   return 0;
+}
@@ -0,0 +1,51 @@
+/// @file Debuglog_cat.cpp
+///
+/// Writes log files to stdout one after the other, decompressing the segments compressed by
+/// Debugfile::Start_compression() (zstd, lz4 or the built-in format) as it streams them. Plain
+/// files are copied as they are, so a whole rotation can be read oldest first:
+///
+///    Debuglog_cat log.txt.3.zst log.txt.2.zst log.txt.1.zst log.txt | grep ...
+///
+/// zstd and lz4 files need the library compiled in, as for the logger (see Log_compression):
+///
+///    g++ -std=c++17 -O2 -pthread -I.. Debuglog_cat.cpp ../*.cpp
+///    g++ -std=c++17 -O2 -pthread -I.. -DDEBUGLOG_WITH_ZSTD -DDEBUGLOG_WITH_LZ4 Debuglog_cat.cpp ../*.cpp -lzstd -llz4
+
+#include "Log_compression.h"
+
+#include <iostream>
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2)
+   {
+      std::cerr << "usage: " << argv[0] << " <log> [<log> ...]" << std::endl;
+      return 2;
+   }
+
+   std::ios::sync_with_stdio(false);
+
+   int status = 0;
+   for (int i = 1; i < argc; ++i)
+   {
+      Log_compression::Reader reader;
+      if (!reader.Open(argv[i]))
+      {
+         std::cerr << argv[i] << (reader.Failed() ? ": compressed in a format this build cannot read" :
+                                                    ": cannot open") << std::endl;
+         status = 1;
+         continue;
+      }
+
+      std::istream in(&reader);
+      std::cout << in.rdbuf();
+      std::cout.clear();    // An empty file sets failbit
+
+      if (reader.Failed())
+      {
+         std::cerr << argv[i] << ": corrupt or truncated" << std::endl;
+         status = 1;
+      }
+   }
+   return status;
+}
@@ -0,0 +1,83 @@
+/// @file Debuglog_collect.cpp
+///
+/// Collector of a shared-memory log channel: merges the records of every process that called
+/// Debugfile::Start_shared() (G_LOG_SHARED) on the channel into one log, in the usual layout
+/// with "<pid>.<thread>" in the thread column. Processes may start and exit in any order, before
+/// or after the collector. It runs until SIGINT or SIGTERM, then writes out what it has read
+/// and exits. --hold is how long a record is kept back so that records of other processes
+/// stamped earlier can go before it (default 50 ms).
+///
+///    g++ -std=c++17 -O2 -pthread -DENABLE_DEBUG_LOGGING -I.. Debuglog_collect.cpp ../*.cpp
+///    Debuglog_collect [--hold <ms>] [--thread-names] [--ms] <channel> <output>
+
+#include "Debugfile.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace
+{
+   std::atomic<bool> s_stop{false};
+
+   extern "C" void On_stop(int)
+   {
+      s_stop.store(true);
+   }
+
+   int Usage(const char *program)
+   {
+      std::cerr << "usage: " << program << " [--hold <ms>] [--thread-names] [--ms] <channel> <output>" << std::endl;
+      return 2;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   long hold_ms = 50;
+   bool thread_names = false;
+   bool is_milli = false;
+
+   int arg = 1;
+   for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg)
+   {
+      if (std::strcmp(argv[arg], "--hold") == 0 && arg + 1 < argc)
+         hold_ms = std::strtol(argv[++arg], nullptr, 10);
+      else if (std::strcmp(argv[arg], "--thread-names") == 0)
+         thread_names = true;
+      else if (std::strcmp(argv[arg], "--ms") == 0)
+         is_milli = true;
+      else
+         return Usage(argv[0]);
+   }
+   if (argc - arg != 2 || hold_ms < 0)
+      return Usage(argv[0]);
+
+   Debugfile log(argv[arg + 1], false, is_milli ? Debugfile::timing_type::e_milli : Debugfile::timing_type::e_micro);
+   log.Show_thread_names(thread_names);
+   log.Set_flush_policy(Debugfile::flush_policy::e_interval, 200);
+   log.Turn_on_debug_file(true);
+
+   std::string error;
+   if (!log.Start_collector(argv[arg], std::chrono::milliseconds(hold_ms), &error))
+   {
+      std::cerr << argv[0] << ": " << error << std::endl;
+      return 1;
+   }
+
+   std::signal(SIGINT, On_stop);
+   std::signal(SIGTERM, On_stop);
+   while (!s_stop.load())
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+   }
+
+   log.Stop_collector();
+   log.Flush();
+   return 0;
+}
@@ -0,0 +1,77 @@
+/// @file Debuglog_decode.cpp
+///
+/// Converts a log written with Debugfile::output_format::e_binary into the text layout that
+/// Debugfile writes in text mode.
+///
+///    Debuglog_decode [--timestamps=global|thread|absolute] <binary_log> [text_output]
+///
+/// Writes to stdout when no output file is given. The time column is the one the log was written
+/// with unless --timestamps picks another: delta since the previous line, delta since the same
+/// thread's previous line, or time since the file was opened.
+
+#include "Binary_log.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char *argv[])
+{
+   const char *program = argv[0];
+   const char *usage = " [--timestamps=global|thread|absolute] <binary_log> [text_output]";
+   const char *option = "--timestamps=";
+
+   Log_timestamp::mode mode = Log_timestamp::mode::e_global_delta;
+   const Log_timestamp::mode *chosen = nullptr;
+
+   if (argc > 1 && std::strncmp(argv[1], option, std::strlen(option)) == 0)
+   {
+      const char *value = argv[1] + std::strlen(option);
+      if (std::strcmp(value, "global") == 0)
+         mode = Log_timestamp::mode::e_global_delta;
+      else if (std::strcmp(value, "thread") == 0)
+         mode = Log_timestamp::mode::e_thread_delta;
+      else if (std::strcmp(value, "absolute") == 0)
+         mode = Log_timestamp::mode::e_absolute;
+      else
+      {
+         std::cerr << "usage: " << program << usage << std::endl;
+         return 2;
+      }
+      chosen = &mode;
+      --argc;
+      ++argv;
+   }
+
+   if (argc < 2 || argc > 3)
+   {
+      std::cerr << "usage: " << program << usage << std::endl;
+      return 2;
+   }
+
+   std::ifstream in(argv[1], std::ios::in | std::ios::binary);
+   if (!in.is_open())
+   {
+      std::cerr << "cannot open " << argv[1] << std::endl;
+      return 1;
+   }
+
+   std::ofstream file_out;
+   if (argc == 3)
+   {
+      file_out.open(argv[2], std::ios::out);
+      if (!file_out.is_open())
+      {
+         std::cerr << "cannot create " << argv[2] << std::endl;
+         return 1;
+      }
+   }
+   std::ostream &out = (argc == 3) ? static_cast<std::ostream&>(file_out) : std::cout;
+
+   if (!Binary_log::Decode(in, out, chosen))
+   {
+      std::cerr << argv[1] << ": not a Debugfile binary log, or truncated" << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,255 @@
+/// @file Debuglog_merge.cpp
+///
+/// Merges the per-thread shard files written by Debugfile::Start_sharded() into one log in the
+/// usual Debugfile layout: the shards are interleaved by their absolute time column (k-way merge,
+/// one pending record per shard, so memory does not grow with the input) and the first column is
+/// turned back into the elapsed time since the previous line. --timestamps=thread makes it the
+/// time since the previous line of the same shard (i.e. thread); --timestamps=absolute keeps the
+/// shards' absolute time.
+///
+///    Debuglog_merge [--timestamps=global|thread|absolute] <output> <shard> [<shard> ...]
+
+#include "Line_formatter.h"
+#include "Log_timestamp.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace
+{
+   const int s_padding = 12;
+
+   // ---------------------------------------------------------------------------------------------
+   // Reads one shard record at a time. A record is a line that starts with a time column; lines
+   // without one (messages containing '\n') belong to the record before them.
+   // ---------------------------------------------------------------------------------------------
+   class Shard_reader
+   {
+   public:
+      explicit Shard_reader(const char *path) : m_in(path) {}
+
+      // Consumes the system time and heading lines; returns the unit and depth column from the
+      // heading.
+      bool Read_preamble(std::string &systime, bool &is_milli, bool &show_depth)
+      {
+         std::string blank, heading;
+         if (!std::getline(m_in, systime) || !std::getline(m_in, blank) || !std::getline(m_in, heading))
+            return false;
+
+         if (heading.find("Absolute_ms") != std::string::npos)
+            is_milli = true;
+         else if (heading.find("Absolute_us") != std::string::npos)
+            is_milli = false;
+         else
+            return false;
+
+         show_depth = heading.find("Depth") != std::string::npos;
+         return Advance();
+      }
+
+      // Moves the next record into m_time/m_rest. Returns false at end of file.
+      bool Advance()
+      {
+         if (!m_has_lookahead && !Read_line())
+            return false;
+
+         if (!Parse_time(m_lookahead, m_time))
+         {
+            // Stray text before the first record: keep it rather than drop it
+            m_time = 0.0;
+         }
+         m_rest.assign(m_lookahead, Time_width(), std::string::npos);
+         m_has_lookahead = false;
+
+         while (Read_line())
+         {
+            double t;
+            if (Parse_time(m_lookahead, t))
+               break;
+            m_rest += '\n';
+            m_rest += m_lookahead;
+            m_has_lookahead = false;
+         }
+         return true;
+      }
+
+      double         m_time{0.0};
+      double         m_previous{0.0}; ///< Time of this shard's previously merged record
+      std::string    m_rest;          ///< Thread_ID column onwards, including continuation lines
+
+   private:
+      bool Read_line()
+      {
+         m_has_lookahead = static_cast<bool>(std::getline(m_in, m_lookahead));
+         return m_has_lookahead;
+      }
+
+      static std::size_t Time_width() { return s_padding; }
+
+      // The time column is right-aligned digits with two decimals, wider only if it overflowed.
+      bool Parse_time(const std::string &line, double &t) const
+      {
+         std::size_t end = line.find('.');
+         if (end == std::string::npos || end + 3 > line.size() || line.size() < Time_width() + s_padding)
+            return false;
+         for (std::size_t i = 0; i < end + 3; ++i)
+         {
+            char c = line[i];
+            if (i == end)
+               continue;
+            if (!((c >= '0' && c <= '9') || (c == ' ' && i < end)))
+               return false;
+         }
+         t = std::strtod(line.c_str(), nullptr);
+         return true;
+      }
+
+      std::ifstream  m_in;
+      std::string    m_lookahead;
+      bool           m_has_lookahead{false};
+   };
+
+   struct Pending
+   {
+      double         m_time;
+      std::size_t    m_shard;
+
+      // Earliest first; ties resolved by shard order so the merge is deterministic
+      bool operator<(const Pending &r) const
+      {
+         return (m_time != r.m_time) ? (m_time > r.m_time) : (m_shard > r.m_shard);
+      }
+   };
+}
+
+int main(int argc, char *argv[])
+{
+   const char *program = argv[0];
+   const char *usage = " [--timestamps=global|thread|absolute] <output> <shard> [<shard> ...]";
+   const char *option = "--timestamps=";
+
+   Log_timestamp::mode mode = Log_timestamp::mode::e_global_delta;
+
+   if (argc > 1 && std::strncmp(argv[1], option, std::strlen(option)) == 0)
+   {
+      const char *value = argv[1] + std::strlen(option);
+      if (std::strcmp(value, "global") == 0)
+         mode = Log_timestamp::mode::e_global_delta;
+      else if (std::strcmp(value, "thread") == 0)
+         mode = Log_timestamp::mode::e_thread_delta;
+      else if (std::strcmp(value, "absolute") == 0)
+         mode = Log_timestamp::mode::e_absolute;
+      else
+      {
+         std::cerr << "usage: " << program << usage << std::endl;
+         return 2;
+      }
+      --argc;
+      ++argv;
+   }
+
+   if (argc < 3)
+   {
+      std::cerr << "usage: " << program << usage << std::endl;
+      return 2;
+   }
+
+   std::vector<std::unique_ptr<Shard_reader>> shards;
+   std::priority_queue<Pending> queue;
+   std::string systime;
+   bool is_milli = false;
+   bool show_depth = false;
+
+   for (int i = 2; i < argc; ++i)
+   {
+      std::unique_ptr<Shard_reader> reader(new Shard_reader(argv[i]));
+      std::string shard_systime;
+      bool shard_milli = false;
+      bool shard_depth = false;
+
+      if (!reader->Read_preamble(shard_systime, shard_milli, shard_depth))
+      {
+         std::cerr << argv[i] << ": not a Debugfile shard, or empty; skipped" << std::endl;
+         continue;
+      }
+      if (systime.empty())
+      {
+         systime = shard_systime;
+         is_milli = shard_milli;
+         show_depth = shard_depth;
+      }
+      else if (shard_milli != is_milli || shard_depth != show_depth)
+      {
+         std::cerr << argv[i] << ": columns differ from the first shard; skipped" << std::endl;
+         continue;
+      }
+
+      queue.push(Pending{reader->m_time, shards.size()});
+      shards.push_back(std::move(reader));
+   }
+
+   if (shards.empty())
+   {
+      std::cerr << "no shards to merge" << std::endl;
+      return 1;
+   }
+
+   std::ofstream out(argv[1], std::ios::out);
+   if (!out.is_open())
+   {
+      std::cerr << "cannot create " << argv[1] << std::endl;
+      return 1;
+   }
+
+   // Debugfile::Open_file preamble
+   Line_formatter line(s_padding);
+   line.Append(systime);
+   line.Append("\n\n");
+   line.Append_column(Log_timestamp::Heading(mode, is_milli));
+   line.Append_column("Thread_ID");
+   if (show_depth)
+   {
+      line.Append_column("Depth", 6);
+   }
+   line.Append(" Log_message\n");
+   out.write(line.Data(), static_cast<std::streamsize>(line.Size()));
+
+   double previous = 0.0;
+   while (!queue.empty())
+   {
+      Pending next = queue.top();
+      queue.pop();
+
+      Shard_reader &reader = *shards[next.m_shard];
+      double elapsed = next.m_time;
+      if (mode == Log_timestamp::mode::e_global_delta)
+      {
+         elapsed = next.m_time - previous;
+         previous = next.m_time;
+      }
+      else if (mode == Log_timestamp::mode::e_thread_delta)
+      {
+         elapsed = next.m_time - reader.m_previous;
+         reader.m_previous = next.m_time;
+      }
+
+      line.Clear();
+      line.Append_timestamp(elapsed < 0.0 ? 0.0 : elapsed);
+      line.Append(reader.m_rest);
+      line.Append('\n');
+      out.write(line.Data(), static_cast<std::streamsize>(line.Size()));
+
+      if (reader.Advance())
+      {
+         queue.push(Pending{reader.m_time, next.m_shard});
+      }
+   }
+
+   return out.good() ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/// @file Debuglog_profile.cpp
+///
+/// Call-tree profile of a text log from its G_LOG_FUNCTION lines ("Entering  --> f" and
+/// "Returning <-- f"): rebuilds each thread's calls (see Log_profile) and prints the top
+/// functions by exclusive time, with inclusive time and call counts, and the hottest call paths.
+/// --folded also writes folded stacks ("main;parse;lex 1234", exclusive microseconds) for
+/// flamegraph.pl or speedscope. The log is read once, line by line, so memory depends on the
+/// number of distinct call paths and not on the size of the log. "-" reads standard input, e.g.
+/// the output of Debuglog_decode or Debuglog_cat.
+///
+/// Any time column works: Elapsed is summed over all lines, Tdelta per thread. Calls still open
+/// at the end of the log are closed at their thread's last line.
+///
+///    g++ -std=c++17 -O2 -pthread -I.. Debuglog_profile.cpp ../*.cpp
+///    Debuglog_profile [--top <n>] [--folded <path>] [--max-nodes <n>] <log|->
+
+#include "Log_profile.h"
+#include "Log_timestamp.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+   const int s_padding = 12;      // Column width used by Debugfile
+
+   const std::string_view s_entering = "Entering  --> ";
+   const std::string_view s_returning = "Returning <-- ";
+
+   int Usage(const char *program)
+   {
+      std::cerr << "usage: " << program << " [--top <n>] [--folded <path>] [--max-nodes <n>] <log|->" << std::endl;
+      return 2;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Reads the time column of Debugfile's heading line; false if @p line is not one.
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_heading(const std::string &line, Log_timestamp::mode &mode, double &ns_per_unit)
+   {
+      if (line.find("Thread_ID") == std::string::npos || line.find("Log_message") == std::string::npos)
+         return false;
+
+      if (line.find("Tdelta_") != std::string::npos)
+         mode = Log_timestamp::mode::e_thread_delta;
+      else if (line.find("Absolute_") != std::string::npos)
+         mode = Log_timestamp::mode::e_absolute;
+      else
+         mode = Log_timestamp::mode::e_global_delta;
+
+      ns_per_unit = (line.find("_ms") != std::string::npos) ? 1e6 : 1e3;
+      return true;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // A record line starts with the time column: right-aligned digits with two decimals, wider
+   // only if it overflowed. Lines without one continue the previous record.
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_time(const std::string &line, double &t)
+   {
+      std::size_t end = line.find('.');
+      if (end == std::string::npos || end + 3 > line.size() || line.size() < static_cast<std::size_t>(2 * s_padding))
+         return false;
+
+      bool digits = false;
+      for (std::size_t i = 0; i < end + 3; ++i)
+      {
+         char c = line[i];
+         if (i == end)
+            continue;
+         if (c >= '0' && c <= '9')
+            digits = true;
+         else if (c != ' ' || digits)
+            return false;
+      }
+      t = std::strtod(line.c_str(), nullptr);
+      return digits;
+   }
+
+   // Next space-delimited token at or after @p at
+   std::string_view Next_token(std::string_view line, std::size_t &at)
+   {
+      while (at < line.size() && line[at] == ' ')
+         ++at;
+      std::size_t begin = at;
+      while (at < line.size() && line[at] != ' ')
+         ++at;
+      return line.substr(begin, at - begin);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   std::size_t top = 20;
+   std::size_t max_nodes = 1 << 20;
+   const char *folded_path = nullptr;
+
+   int arg = 1;
+   for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg)
+   {
+      if (std::strcmp(argv[arg], "--top") == 0 && arg + 1 < argc)
+         top = static_cast<std::size_t>(std::strtoul(argv[++arg], nullptr, 10));
+      else if (std::strcmp(argv[arg], "--folded") == 0 && arg + 1 < argc)
+         folded_path = argv[++arg];
+      else if (std::strcmp(argv[arg], "--max-nodes") == 0 && arg + 1 < argc)
+         max_nodes = static_cast<std::size_t>(std::strtoul(argv[++arg], nullptr, 10));
+      else
+         return Usage(argv[0]);
+   }
+   if (argc - arg != 1)
+      return Usage(argv[0]);
+
+   std::ios::sync_with_stdio(false);
+   std::ifstream file;
+   std::istream *in = &std::cin;
+   if (std::strcmp(argv[arg], "-") != 0)
+   {
+      file.open(argv[arg]);
+      if (!file)
+      {
+         std::cerr << argv[0] << ": cannot open " << argv[arg] << std::endl;
+         return 1;
+      }
+      in = &file;
+   }
+
+   Log_profile profile(max_nodes);
+   Log_timestamp::mode mode = Log_timestamp::mode::e_global_delta;
+   double ns_per_unit = 1e3;
+   bool show_depth = false;
+
+   std::unordered_map<std::string, std::uint64_t> thread_ids;
+   std::unordered_map<std::uint64_t, double> thread_times;      // Tdelta: per thread, in units
+   double now = 0.0;                                              // Elapsed and Absolute, in units
+
+   std::string line;
+   while (std::getline(*in, line))
+   {
+      if (!line.empty() && line.back() == '\r')
+         line.pop_back();
+
+      double column = 0.0;
+      if (!Parse_time(line, column))
+      {
+         // A new file's heading (e.g. segments concatenated by Debuglog_cat) restarts the clock
+         if (Parse_heading(line, mode, ns_per_unit))
+         {
+            show_depth = line.find("Depth") != std::string::npos;
+            now = 0.0;
+            thread_times.clear();
+         }
+         continue;
+      }
+
+      std::string_view view(line);
+      std::size_t at = static_cast<std::size_t>(s_padding);
+      std::string_view label = Next_token(view, at);
+      if (show_depth)
+         Next_token(view, at);
+      while (at < view.size() && view[at] == ' ')
+         ++at;
+      std::string_view message = view.substr(at);
+
+      auto found = thread_ids.find(std::string(label));
+      if (found == thread_ids.end())
+         found = thread_ids.emplace(std::string(label), thread_ids.size()).first;
+      std::uint64_t thread = found->second;
+
+      double t = 0.0;
+      if (mode == Log_timestamp::mode::e_thread_delta)
+         t = (thread_times[thread] += column);
+      else if (mode == Log_timestamp::mode::e_absolute)
+         t = now = column;
+      else
+         t = (now += column);
+      std::int64_t ns = static_cast<std::int64_t>(t * ns_per_unit);
+
+      if (message.compare(0, s_entering.size(), s_entering) == 0)
+         profile.Enter(thread, message.substr(s_entering.size()), ns);
+      else if (message.compare(0, s_returning.size(), s_returning) == 0)
+         profile.Leave(thread, message.substr(s_returning.size()), ns);
+   }
+
+   profile.Finish();
+
+   if (folded_path)
+   {
+      std::ofstream folded(folded_path);
+      profile.Write_folded(folded);
+      if (!folded.flush())
+      {
+         std::cerr << argv[0] << ": cannot write " << folded_path << std::endl;
+         return 1;
+      }
+   }
+
+   profile.Write_top(std::cout, top);
+   return 0;
+}
@@ -0,0 +1,491 @@
+/// @file Debuglog_query.cpp
+///
+/// Prints the records of a text log that fall in a time range and come from given threads or
+/// call sites, using the index that Debugfile::Set_index() writes next to it ("<log>.idx"). The
+/// log is mapped, blocks whose time range or Bloom filters rule them out are skipped, and the
+/// remaining blocks are scanned on all cores; the output keeps the order of the file. The end
+/// of a log that was not closed properly has no index entry and is always scanned.
+///
+/// Times are seconds since the log was opened ("2.5") or a local time of day ("14:03:07.25").
+/// Within a block, a record's time is its block's first time plus the Elapsed column of the
+/// lines after it; with Tdelta (time per thread) the range is applied to whole blocks. A thread
+/// is its number or its name (see Debugfile::Set_thread_name()); a call site is "file:line" (the
+/// file may be given without its directory) or a function name. Several --thread or --site
+/// options match any of them. A call site matches the records it wrote, which the index lists by
+/// their offset in each block; the unindexed end of a log is therefore not searched for them.
+///
+///    g++ -std=c++17 -O2 -pthread -I.. Debuglog_query.cpp ../*.cpp
+///    Debuglog_query [--from <time>] [--to <time>] [--thread <id|name>]... [--site <file:line|function>]...
+///                   [--jobs <n>] [--count] <log>
+
+#include "Log_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   const int s_padding = 12;      // Column width used by Debugfile
+
+   const std::int64_t s_unbounded_from = std::numeric_limits<std::int64_t>::min();
+   const std::int64_t s_unbounded_to = std::numeric_limits<std::int64_t>::max();
+
+   struct Query
+   {
+      std::int64_t               m_from{s_unbounded_from};   ///< Nanoseconds since the log was opened
+      std::int64_t               m_to{s_unbounded_to};
+      bool                       m_by_thread{false};
+      std::vector<std::uint64_t> m_thread_keys;
+      std::vector<std::string>   m_thread_labels;  ///< Thread_ID column texts that match
+      bool                       m_by_site{false};
+      std::vector<std::uint64_t> m_site_ids;
+   };
+
+   // A range of the log to scan. @e block is null for the unindexed end of the file.
+   struct Span
+   {
+      std::uint64_t  m_offset;
+      std::uint64_t  m_end;
+      std::int64_t   m_first_ns;       ///< Time of the first record, or of the record before it
+      const Log_index::block *m_block;
+   };
+
+   struct Result
+   {
+      std::string    m_text;
+      std::uint64_t  m_records{0};
+   };
+
+   int Usage(const char *program)
+   {
+      std::cerr << "usage: " << program << " [--from <time>] [--to <time>] [--thread <id|name>]... "
+                   "[--site <file:line|function>]... [--jobs <n>] [--count] <log>" << std::endl;
+      return 2;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // "2.5" is seconds since the log was opened at @p systime; "14:03:07.25" a local time of day,
+   // taken as the first such time at or after the opening.
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_time(const char *text, std::int64_t systime, std::int64_t &ns)
+   {
+      char *end = nullptr;
+      if (std::strchr(text, ':') == nullptr)
+      {
+         double seconds = std::strtod(text, &end);
+         if (end == text || *end != '\0')
+            return false;
+         ns = static_cast<std::int64_t>(seconds * 1e9);
+         return true;
+      }
+
+      int hours = 0, minutes = 0;
+      double seconds = 0.0;
+      if (std::sscanf(text, "%d:%d:%lf", &hours, &minutes, &seconds) != 3)
+         return false;
+
+#pragma warning(disable:4996)
+      std::time_t opened = static_cast<std::time_t>(systime);
+      std::tm local = *std::localtime(&opened);
+#pragma warning(default:4996)
+
+      double wanted = hours * 3600.0 + minutes * 60.0 + seconds;
+      double at_open = local.tm_hour * 3600.0 + local.tm_min * 60.0 + local.tm_sec;
+      double since = wanted - at_open;
+      if (since < 0.0)
+         since += 24 * 3600.0;
+      ns = static_cast<std::int64_t>(since * 1e9);
+      return true;
+   }
+
+   bool Ends_with(const std::string &text, const std::string &tail)
+   {
+      return text.size() >= tail.size() && text.compare(text.size() - tail.size(), tail.size(), tail) == 0;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Thread keys whose label, number or name is @p wanted ("3", "io-worker", "4711.3"), and the
+   // labels they have in the Thread_ID column.
+   // ---------------------------------------------------------------------------------------------
+   bool Resolve_thread(const Log_index::contents &index, const std::string &wanted, Query &query)
+   {
+      bool found = false;
+      for (const Log_index::thread &t : index.m_threads)
+      {
+         std::uint32_t process = static_cast<std::uint32_t>(t.m_key >> 32);
+         std::string number = std::to_string(static_cast<std::uint32_t>(t.m_key));
+         if (process != 0)
+            number = std::to_string(process) + "." + number;
+
+         if (t.m_label == wanted || number == wanted || t.m_name == wanted)
+         {
+            query.m_thread_keys.push_back(t.m_key);
+            query.m_thread_labels.push_back(t.m_label);
+            found = true;
+         }
+      }
+      return found;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Sites at "file:line" (file matched without its directory) or in function @p wanted.
+   // ---------------------------------------------------------------------------------------------
+   bool Resolve_site(const Log_index::contents &index, const std::string &wanted, Query &query)
+   {
+      std::string file, function;
+      long line = -1;
+      std::size_t colon = wanted.rfind(':');
+      if (colon != std::string::npos && colon + 1 < wanted.size() &&
+          std::strspn(wanted.c_str() + colon + 1, "0123456789") == wanted.size() - colon - 1)
+      {
+         file = wanted.substr(0, colon);
+         line = std::strtol(wanted.c_str() + colon + 1, nullptr, 10);
+      }
+      else
+      {
+         function = wanted;
+      }
+
+      bool found = false;
+      for (const Log_index::site &s : index.m_sites)
+      {
+         bool match = (line >= 0) ? (static_cast<long>(s.m_line) == line &&
+                                     (s.m_file == file || Ends_with(s.m_file, "/" + file) ||
+                                      Ends_with(s.m_file, "\\" + file))) :
+                                    (s.m_function == function);
+         if (match)
+         {
+            query.m_site_ids.push_back(s.m_id);
+            found = true;
+         }
+      }
+      return found;
+   }
+
+   bool Any_in(const std::uint64_t (&bloom)[Log_index::s_bloom_words],
+               const std::vector<std::uint64_t> &keys)
+   {
+      return std::any_of(keys.begin(), keys.end(),
+                         [&bloom](std::uint64_t key) { return Log_index::May_contain(bloom, key); });
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Blocks that may hold a match, and the unindexed end of the file.
+   // ---------------------------------------------------------------------------------------------
+   std::vector<Span> Candidates(const Log_index::contents &index, const Query &query, std::uint64_t file_size)
+   {
+      std::vector<Span> spans;
+      std::uint64_t indexed_end = 0;
+      std::int64_t last_ns = 0;
+
+      for (const Log_index::block &b : index.m_blocks)
+      {
+         indexed_end = std::max(indexed_end, b.m_end);
+         last_ns = b.m_last_ns;
+
+         if (b.m_max_ns < query.m_from || b.m_min_ns > query.m_to || b.m_offset >= file_size)
+            continue;
+         if (query.m_by_thread && !Any_in(b.m_threads, query.m_thread_keys))
+            continue;
+         if (query.m_by_site && !Any_in(b.m_sites, query.m_site_ids))
+            continue;
+         spans.push_back(Span{ b.m_offset, std::min(b.m_end, file_size), b.m_first_ns, &b });
+      }
+
+      // Records there have no known call site
+      if (indexed_end < file_size && !query.m_by_site)
+      {
+         spans.push_back(Span{ indexed_end, file_size, last_ns, nullptr });
+      }
+      return spans;
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // A record line starts with the time column: right-aligned digits with two decimals, possibly
+   // negative, wider only if it overflowed.
+   // ---------------------------------------------------------------------------------------------
+   bool Parse_column_time(const char *line, std::size_t length, double &t)
+   {
+      const char *dot = static_cast<const char*>(std::memchr(line, '.', length));
+      if (dot == nullptr)
+         return false;
+      std::size_t end = static_cast<std::size_t>(dot - line);
+      if (end + 3 > length || length < static_cast<std::size_t>(2 * s_padding))
+         return false;
+
+      bool digits = false;
+      for (std::size_t i = 0; i < end + 3; ++i)
+      {
+         char c = line[i];
+         if (i == end)
+            continue;
+         if (c >= '0' && c <= '9')
+            digits = true;
+         else if (!((c == ' ' && !digits) || (c == '-' && !digits && i < end)))
+            return false;
+      }
+      t = std::strtod(std::string(line, end + 3).c_str(), nullptr);
+      return true;
+   }
+
+   // Next whitespace-delimited token at or after @p at
+   std::string Next_token(const char *line, std::size_t length, std::size_t &at)
+   {
+      while (at < length && line[at] == ' ')
+         ++at;
+      std::size_t begin = at;
+      while (at < length && line[at] != ' ')
+         ++at;
+      return std::string(line + begin, at - begin);
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Whether the index lists the record at @p offset of @p b as written by a wanted site.
+   // ---------------------------------------------------------------------------------------------
+   bool From_site(const Log_index::block &b, std::uint64_t offset, const Query &query)
+   {
+      std::uint32_t in_block = static_cast<std::uint32_t>(offset - b.m_offset);
+      auto found = std::lower_bound(b.m_sited.begin(), b.m_sited.end(), in_block,
+                                    [](const Log_index::sited_record &r, std::uint32_t o) { return r.m_offset < o; });
+      return found != b.m_sited.end() && found->m_offset == in_block &&
+             std::find(query.m_site_ids.begin(), query.m_site_ids.end(), found->m_site) != query.m_site_ids.end();
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Scans one span. Continuation lines (messages containing '\n') go with their record.
+   // ---------------------------------------------------------------------------------------------
+   void Scan(const char *data, const Span &span, const Log_index::header &header, const Query &query,
+             Result &result)
+   {
+      const double ns_per_unit = header.m_is_milli ? 1e6 : 1e3;
+      const Log_timestamp::mode mode = header.m_timestamp_mode;
+
+      // The first record of an indexed block is at its first time; without an index entry, the
+      // first column is counted from the record before the span
+      std::int64_t now = span.m_first_ns;
+      bool first = span.m_block != nullptr;
+      bool keep = false;
+
+      std::uint64_t at = span.m_offset;
+      while (at < span.m_end)
+      {
+         std::uint64_t offset = at;
+         const char *line = data + at;
+         const char *newline = static_cast<const char*>(std::memchr(line, '\n', span.m_end - at));
+         std::size_t length = newline ? static_cast<std::size_t>(newline - line) :
+                                        static_cast<std::size_t>(span.m_end - at);
+         at += length + (newline ? 1 : 0);
+
+         double column = 0.0;
+         if (!Parse_column_time(line, length, column))
+         {
+            if (keep)
+               result.m_text.append(line, length).append("\n");
+            continue;
+         }
+
+         std::int64_t column_ns = static_cast<std::int64_t>(column * ns_per_unit);
+         if (mode == Log_timestamp::mode::e_absolute)
+            now = column_ns;
+         else if (mode == Log_timestamp::mode::e_global_delta && !first)
+            now += column_ns;
+         first = false;
+
+         keep = (mode == Log_timestamp::mode::e_thread_delta) ||
+                (now >= query.m_from && now <= query.m_to);
+
+         std::size_t pos = static_cast<std::size_t>(s_padding);
+         if (keep && query.m_by_thread)
+         {
+            std::string label = Next_token(line, length, pos);
+            keep = std::find(query.m_thread_labels.begin(), query.m_thread_labels.end(), label) !=
+                   query.m_thread_labels.end();
+         }
+         if (keep && query.m_by_site)
+         {
+            keep = span.m_block && From_site(*span.m_block, offset, query);
+         }
+
+         if (keep)
+         {
+            result.m_text.append(line, length).append("\n");
+            ++result.m_records;
+         }
+      }
+   }
+
+   // ---------------------------------------------------------------------------------------------
+   // Splits @p spans into at most @p jobs runs of consecutive spans of about equal size.
+   // ---------------------------------------------------------------------------------------------
+   std::vector<std::size_t> Split(const std::vector<Span> &spans, unsigned jobs)
+   {
+      std::uint64_t total = 0;
+      for (const Span &s : spans)
+         total += s.m_end - s.m_offset;
+
+      std::vector<std::size_t> starts{ 0 };
+      std::uint64_t share = total / std::max(1u, jobs) + 1;
+      std::uint64_t filled = 0;
+      for (std::size_t i = 0; i < spans.size(); ++i)
+      {
+         if (filled >= share && starts.size() < jobs)
+         {
+            starts.push_back(i);
+            filled = 0;
+         }
+         filled += spans[i].m_end - spans[i].m_offset;
+      }
+      starts.push_back(spans.size());
+      return starts;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   const char *from = nullptr;
+   const char *to = nullptr;
+   std::vector<std::string> threads, sites;
+   unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+   bool count_only = false;
+
+   int arg = 1;
+   for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg)
+   {
+      if (std::strcmp(argv[arg], "--from") == 0 && arg + 1 < argc)
+         from = argv[++arg];
+      else if (std::strcmp(argv[arg], "--to") == 0 && arg + 1 < argc)
+         to = argv[++arg];
+      else if (std::strcmp(argv[arg], "--thread") == 0 && arg + 1 < argc)
+         threads.push_back(argv[++arg]);
+      else if (std::strcmp(argv[arg], "--site") == 0 && arg + 1 < argc)
+         sites.push_back(argv[++arg]);
+      else if (std::strcmp(argv[arg], "--jobs") == 0 && arg + 1 < argc)
+         jobs = static_cast<unsigned>(std::max(1L, std::strtol(argv[++arg], nullptr, 10)));
+      else if (std::strcmp(argv[arg], "--count") == 0)
+         count_only = true;
+      else
+         return Usage(argv[0]);
+   }
+   if (argc - arg != 1)
+      return Usage(argv[0]);
+
+   std::string path = argv[arg];
+   Log_index::contents index;
+   std::string error;
+   if (!Log_index::Load(path + ".idx", index, &error))
+   {
+      std::cerr << argv[0] << ": " << error << " (write it with Debugfile::Set_index())" << std::endl;
+      return 1;
+   }
+
+   Query query;
+   if ((from && !Parse_time(from, index.m_header.m_systime, query.m_from)) ||
+       (to && !Parse_time(to, index.m_header.m_systime, query.m_to)))
+      return Usage(argv[0]);
+
+   for (const std::string &t : threads)
+   {
+      if (!Resolve_thread(index, t, query))
+         std::cerr << argv[0] << ": no thread " << t << " in the index" << std::endl;
+      query.m_by_thread = true;
+   }
+   for (const std::string &s : sites)
+   {
+      if (!Resolve_site(index, s, query))
+         std::cerr << argv[0] << ": no call site " << s << " in the index" << std::endl;
+      query.m_by_site = true;
+   }
+
+#if defined _WIN32
+   std::cerr << argv[0] << ": not supported on this platform" << std::endl;
+   return 1;
+#else
+   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   struct stat st;
+   if (fd < 0 || ::fstat(fd, &st) != 0)
+   {
+      std::cerr << argv[0] << ": cannot open " << path << ": " << std::strerror(errno) << std::endl;
+      return 1;
+   }
+
+   std::uint64_t size = static_cast<std::uint64_t>(st.st_size);
+   const char *data = nullptr;
+   if (size > 0)
+   {
+      void *mapped = ::mmap(nullptr, static_cast<std::size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED)
+      {
+         std::cerr << argv[0] << ": cannot map " << path << ": " << std::strerror(errno) << std::endl;
+         ::close(fd);
+         return 1;
+      }
+      data = static_cast<const char*>(mapped);
+   }
+   ::close(fd);
+
+   std::vector<Span> spans = Candidates(index, query, size);
+   std::vector<std::size_t> starts = Split(spans, jobs);
+   std::vector<Result> results(starts.size() - 1);
+
+   if (data)
+   {
+      ::madvise(const_cast<char*>(data), static_cast<std::size_t>(size), MADV_RANDOM);
+
+      std::vector<std::thread> workers;
+      for (std::size_t j = 0; j + 1 < starts.size(); ++j)
+      {
+         workers.emplace_back([&, j]()
+         {
+            for (std::size_t i = starts[j]; i < starts[j + 1]; ++i)
+            {
+               Scan(data, spans[i], index.m_header, query, results[j]);
+            }
+         });
+      }
+      for (std::thread &w : workers)
+      {
+         w.join();
+      }
+      ::munmap(const_cast<char*>(data), static_cast<std::size_t>(size));
+   }
+
+   std::uint64_t records = 0;
+   for (const Result &r : results)
+   {
+      records += r.m_records;
+      if (!count_only)
+         std::cout.write(r.m_text.data(), static_cast<std::streamsize>(r.m_text.size()));
+   }
+   if (count_only)
+      std::cout << records << std::endl;
+
+   std::uint64_t scanned = 0;
+   for (const Span &s : spans)
+      scanned += s.m_end - s.m_offset;
+   std::cerr << records << " records; scanned " << scanned << " of " << size << " bytes in " <<
+                spans.size() << " blocks" << std::endl;
+   std::uint64_t indexed_end = 0;
+   for (const Log_index::block &b : index.m_blocks)
+      indexed_end = std::max(indexed_end, b.m_end);
+   if (query.m_by_site && indexed_end < size)
+      std::cerr << "the last " << (size - indexed_end) << " bytes are not indexed and were not searched "
+                   "for call sites" << std::endl;
+   return 0;
+#endif
+}